@@ -9,9 +9,13 @@
 #include "playlunky_settings.h"
 #include "sigscan.h"
 #include "util/on_scope_exit.h"
+#include "util/profiler.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstdint>
+#include <span>
 
 static VirtualFilesystem* s_FmodVfs{ nullptr };
 
@@ -322,6 +326,8 @@ struct DetourFmodSystemLoadBankMemory
 
     static void ParseSoundbankMemory()
     {
+        const ProfileZone profile_zone{ "ParseSoundbankMemory" };
+
         if (!s_EnableLooseFiles)
             return;
 
@@ -480,11 +486,31 @@ struct DetourFmodSystemLoadBankMemory
 
     static void PreloadModdedSampleData([[maybe_unused]] FMOD::System* fmod_system, FMOD::Bank* bank)
     {
+        const ProfileZone profile_zone{ "PreloadModdedSampleData" };
+
         if (!s_EnableLooseFiles)
             return;
 
         LogInfo("Preloading any modded samples...");
 
+        // Each sample probes these in order, the first one found in the vfs is used
+        static constexpr std::array<std::pair<std::string_view, std::string_view>, 1> c_CachedSampleFormats{ {
+            { "raw_audio/", ".raw" },
+        } };
+        static constexpr std::array<std::pair<std::string_view, std::string_view>, 8> c_SampleFormats{ {
+            { "soundbank/wav/", ".wav" },
+            { "soundbank/ogg/", ".ogg" },
+            { "soundbank/mp3/", ".mp3" },
+            { "soundbank/wv/", ".wv" },
+            { "soundbank/opus/", ".opus" },
+            { "soundbank/flac/", ".flac" },
+            { "soundbank/mpc/", ".mpc" },
+            { "soundbank/mpp/", ".mpp" },
+        } };
+        const std::span<const std::pair<std::string_view, std::string_view>> sample_formats = s_CacheDecodedFiles
+                                                                                                  ? std::span<const std::pair<std::string_view, std::string_view>>{ c_CachedSampleFormats }
+                                                                                                  : std::span<const std::pair<std::string_view, std::string_view>>{ c_SampleFormats };
+
         std::size_t num_samples{ 0 };
         for (FsbFile& fsb_file : s_FsbFiles)
         {
@@ -492,59 +518,32 @@ struct DetourFmodSystemLoadBankMemory
             {
                 fsb_file.Bank = bank;
 
-                for (FsbFile::Sample& sample : fsb_file.Samples)
+                // Resolve all candidates of all samples in one batch instead of one vfs lookup each
+                std::vector<VirtualFilesystem::ResolveRequest> sample_requests;
+                sample_requests.reserve(fsb_file.Samples.size() * sample_formats.size());
+                for (const FsbFile::Sample& sample : fsb_file.Samples)
                 {
-                    if (s_CacheDecodedFiles)
+                    for (const auto& [folder, extension] : sample_formats)
                     {
-                        const auto modded_sample = s_FmodVfs->GetFilePath(fmt::format("raw_audio/{}.raw", sample.Name));
-                        if (modded_sample.has_value() && std::filesystem::exists(modded_sample.value()))
-                        {
-                            Playlunky::Get().RegisterModType(ModType::Sound);
-                            sample.Buffer = LoadCachedAudioFile(modded_sample.value());
-                            num_samples++;
-                        }
+                        sample_requests.push_back({ .Path{ fmt::format("{}{}{}", folder, sample.Name, extension) } });
                     }
-                    else
+                }
+                const auto resolved_samples = s_FmodVfs->ResolveMany(sample_requests);
+
+                for (std::size_t i = 0; i < fsb_file.Samples.size(); i++)
+                {
+                    FsbFile::Sample& sample = fsb_file.Samples[i];
+
+                    const auto sample_candidates = std::span{ resolved_samples }.subspan(i * sample_formats.size(), sample_formats.size());
+                    const auto modded_sample = std::find_if(sample_candidates.begin(), sample_candidates.end(), [](const std::optional<std::filesystem::path>& candidate)
+                                                            { return candidate.has_value(); });
+                    if (modded_sample != sample_candidates.end() && std::filesystem::exists(modded_sample->value()))
                     {
-                        const auto modded_sample = [](const std::string& file_name)
-                        {
-                            auto file_path = s_FmodVfs->GetFilePath(fmt::format("soundbank/wav/{}.wav", file_name));
-                            if (!file_path.has_value())
-                            {
-                                file_path = s_FmodVfs->GetFilePath(fmt::format("soundbank/ogg/{}.ogg", file_name));
-                            }
-                            if (!file_path.has_value())
-                            {
-                                file_path = s_FmodVfs->GetFilePath(fmt::format("soundbank/mp3/{}.mp3", file_name));
-                            }
-                            if (!file_path.has_value())
-                            {
-                                file_path = s_FmodVfs->GetFilePath(fmt::format("soundbank/wv/{}.wv", file_name));
-                            }
-                            if (!file_path.has_value())
-                            {
-                                file_path = s_FmodVfs->GetFilePath(fmt::format("soundbank/opus/{}.opus", file_name));
-                            }
-                            if (!file_path.has_value())
-                            {
-                                file_path = s_FmodVfs->GetFilePath(fmt::format("soundbank/flac/{}.flac", file_name));
-                            }
-                            if (!file_path.has_value())
-                            {
-                                file_path = s_FmodVfs->GetFilePath(fmt::format("soundbank/mpc/{}.mpc", file_name));
-                            }
-                            if (!file_path.has_value())
-                            {
-                                file_path = s_FmodVfs->GetFilePath(fmt::format("soundbank/mpp/{}.mpp", file_name));
-                            }
-                            return file_path;
-                        }(sample.Name);
-                        if (modded_sample.has_value() && std::filesystem::exists(modded_sample.value()))
-                        {
-                            Playlunky::Get().RegisterModType(ModType::Sound);
-                            sample.Buffer = DecodeAudioFile(modded_sample.value());
-                            num_samples++;
-                        }
+                        Playlunky::Get().RegisterModType(ModType::Sound);
+                        sample.Buffer = s_CacheDecodedFiles
+                                            ? LoadCachedAudioFile(modded_sample->value())
+                                            : DecodeAudioFile(modded_sample->value());
+                        num_samples++;
                     }
 
                     // BOOKMARK-POSSIBLE-OPT
@@ -682,6 +681,8 @@ struct DetourFmodSystemLoadBankFile
     };
     static FMOD::FMOD_RESULT Detour(FMOD::System* fmod_system, const char* file_name, int flags, FMOD::Bank** bank)
     {
+        const ProfileZone profile_zone{ "DetourFmodSystemLoadBankFile" };
+
         LogInfo("Loading bank file {} into FMOD...", file_name);
 
         DetourFmodSystemLoadBankMemory::ParseSoundbankMemory();
@@ -740,6 +741,8 @@ struct DetourFmodSystemCreateSound
     };
     static FMOD::FMOD_RESULT Detour(FMOD::System* fmod_system, const char* file_name_or_data, FMOD::FMOD_MODE mode, FMOD::CREATESOUNDEXINFO* exinfo, FMOD::Sound** sound)
     {
+        const ProfileZone profile_zone{ "DetourFmodSystemCreateSound" };
+
         if (exinfo->numsubsounds != 1)
         {
             LogInfo("Loading an audio file with exinfo->numsubsounds != 0, falling back to loading original file...");
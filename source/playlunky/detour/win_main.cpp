@@ -6,6 +6,7 @@
 #include "sigfun.h"
 #include "sigscan.h"
 #include "util/call_once.h"
+#include "util/profiler.h"
 
 #include "../playlunky.h"
 #include "log.h"
@@ -46,7 +47,11 @@ struct DetourInitGameManager
     };
     static void* Detour(void* game_ptr, void* other_ptr, void* more_ptr, void* some_func_ptr)
     {
-        void* res = Trampoline(game_ptr, other_ptr, more_ptr, some_func_ptr);
+        void* res = [&]()
+        {
+            const ProfileZone profile_zone{ "DetourInitGameManager" };
+            return Trampoline(game_ptr, other_ptr, more_ptr, some_func_ptr);
+        }();
         CallOnce([]()
                  {
                      void* api = DetourGetGameApi::Trampoline();
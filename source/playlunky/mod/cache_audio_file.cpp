@@ -2,6 +2,7 @@
 
 #include "decode_audio_file.h"
 #include "util/algorithms.h"
+#include "util/profiler.h"
 
 #include <cassert>
 #include <fstream>
@@ -10,7 +11,7 @@
 #include <libnyquist/Decoders.h>
 #pragma warning(pop)
 
-inline auto GetCachedAudioFilePath(const std::filesystem::path& file_path, const std::filesystem::path& output_path)
+std::filesystem::path GetCachedAudioFilePath(const std::filesystem::path& file_path, const std::filesystem::path& output_path)
 {
     return output_path / "raw_audio" / file_path.filename().replace_extension(".raw");
 }
@@ -37,6 +38,8 @@ void DeleteCachedAudioFile(const std::filesystem::path& file_path, const std::fi
 }
 bool CacheAudioFile(const std::filesystem::path& file_path, const std::filesystem::path& output_path, bool force)
 {
+    const ProfileZone profile_zone{ "CacheAudioFile" };
+
     namespace fs = std::filesystem;
     const fs::path output_file_path = GetCachedAudioFilePath(file_path, output_path);
 
@@ -45,8 +48,11 @@ bool CacheAudioFile(const std::filesystem::path& file_path, const std::filesyste
         DecodedAudioBuffer buffer = DecodeAudioFile(file_path);
 
         {
+            // Other files may be cached into the same folder at the same time
+            std::error_code error_code;
             const auto parent_path = output_file_path.parent_path();
-            if (!fs::exists(parent_path) && !fs::create_directories(parent_path))
+            fs::create_directories(parent_path, error_code);
+            if (!fs::is_directory(parent_path, error_code))
             {
                 return false;
             }
@@ -54,6 +60,10 @@ bool CacheAudioFile(const std::filesystem::path& file_path, const std::filesyste
 
         if (buffer.DataSize > 0)
         {
+            // Output may be a hard link into the content store, replace the file instead of writing through the link
+            std::error_code error_code;
+            fs::remove(output_file_path, error_code);
+
             std::ofstream output_file(output_file_path, std::ios::binary);
             output_file.write(reinterpret_cast<const char*>(&buffer.NumChannels), sizeof(buffer.NumChannels));
             output_file.write(reinterpret_cast<const char*>(&buffer.Frequency), sizeof(buffer.Frequency));
@@ -5,6 +5,7 @@
 #include <filesystem>
 
 bool IsSupportedAudioFile(const std::filesystem::path& file_path);
+std::filesystem::path GetCachedAudioFilePath(const std::filesystem::path& file_path, const std::filesystem::path& output_path);
 bool HasCachedAudioFile(const std::filesystem::path& file_path, const std::filesystem::path& output_path);
 void DeleteCachedAudioFile(const std::filesystem::path& file_path, const std::filesystem::path& output_path);
 bool CacheAudioFile(const std::filesystem::path& file_path, const std::filesystem::path& output_path, bool force);
@@ -0,0 +1,162 @@
+#include "consolidated_mod_database.h"
+
+#include "log.h"
+#include "util/file.h"
+#include "util/mapped_file.h"
+
+#include <cstring>
+#include <span>
+#include <vector>
+
+static constexpr std::uint32_t s_ConsolidatedDatabaseMagicNumber{ 0xC0DBA5E1 };
+
+// Layout of the file: the header, one record per section, a table of all section keys and the 8-byte aligned sections
+struct ConsolidatedDbHeader
+{
+    std::uint32_t MagicNumber;
+    std::uint32_t NumSections;
+    std::uint32_t KeyTableOffset;
+    std::uint32_t KeyTableSize;
+};
+struct ConsolidatedDbSectionRecord
+{
+    std::uint32_t KeyOffset;
+    std::uint32_t KeySize;
+    std::uint64_t DataOffset;
+    std::uint64_t DataSize;
+};
+static_assert(sizeof(ConsolidatedDbHeader) == 16 && sizeof(ConsolidatedDbSectionRecord) == 24);
+
+ConsolidatedModDatabase::ConsolidatedModDatabase(std::filesystem::path file_path)
+    : mFilePath{ std::move(file_path) }
+{
+    auto db_file = MappedFile::Open(mFilePath);
+    if (db_file == nullptr)
+    {
+        return;
+    }
+
+    const std::string_view data{ db_file->GetData() };
+
+    ConsolidatedDbHeader header;
+    if (data.size() < sizeof(header))
+    {
+        return;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    const std::uint64_t records_end{ sizeof(ConsolidatedDbHeader) + std::uint64_t{ header.NumSections } * sizeof(ConsolidatedDbSectionRecord) };
+    if (header.MagicNumber != s_ConsolidatedDatabaseMagicNumber || records_end > header.KeyTableOffset || std::uint64_t{ header.KeyTableOffset } + header.KeyTableSize > data.size())
+    {
+        LogInfo("Ignoring outdated mod database '{}'...", mFilePath.string());
+        return;
+    }
+
+    const std::string_view key_table{ data.substr(header.KeyTableOffset, header.KeyTableSize) };
+    const auto* section_records = reinterpret_cast<const ConsolidatedDbSectionRecord*>(data.data() + sizeof(ConsolidatedDbHeader));
+    for (const ConsolidatedDbSectionRecord& record : std::span{ section_records, header.NumSections })
+    {
+        if (std::uint64_t{ record.KeyOffset } + record.KeySize > key_table.size() || record.DataOffset + record.DataSize > data.size())
+        {
+            LogError("Mod database '{}' is corrupted, mods will be scanned from scratch...", mFilePath.string());
+            mSections.clear();
+            return;
+        }
+
+        // Copied out so the file is not mapped anymore when the .db folder gets removed or the database is committed
+        const std::string_view key{ key_table.substr(record.KeyOffset, record.KeySize) };
+        mSections.insert_or_assign(NormalizedPath::FromNormalized(key), std::string{ data.substr(record.DataOffset, record.DataSize) });
+    }
+}
+ConsolidatedModDatabase::~ConsolidatedModDatabase() = default;
+
+std::optional<std::string_view> ConsolidatedModDatabase::GetSection(const std::filesystem::path& database_folder) const
+{
+    if (auto it = mSections.find(NormalizedPath{ database_folder }); it != mSections.end())
+    {
+        return it->second;
+    }
+    return std::nullopt;
+}
+void ConsolidatedModDatabase::SetSection(const std::filesystem::path& database_folder, std::string data)
+{
+    mSections.insert_or_assign(NormalizedPath{ database_folder }, std::move(data));
+    mChanged = true;
+}
+void ConsolidatedModDatabase::RemoveSections(const std::filesystem::path& database_folder)
+{
+    const NormalizedPath removed_folder{ database_folder };
+    const std::string_view removed_path{ removed_folder.GetString() };
+    const std::size_t num_removed = std::erase_if(mSections, [removed_path](const auto& section)
+                                                  {
+                                                      const std::string_view section_path{ section.first.GetString() };
+                                                      return section_path == removed_path || (section_path.starts_with(removed_path) && section_path[removed_path.size()] == '/');
+                                                  });
+    mChanged = mChanged || num_removed > 0;
+}
+
+bool ConsolidatedModDatabase::Commit()
+{
+    if (!mChanged)
+    {
+        return true;
+    }
+
+    std::vector<ConsolidatedDbSectionRecord> section_records;
+    std::string key_table;
+    for (const auto& [key, section_data] : mSections)
+    {
+        const std::string_view key_string{ key.GetString() };
+        section_records.push_back(ConsolidatedDbSectionRecord{
+            .KeyOffset = static_cast<std::uint32_t>(key_table.size()),
+            .KeySize = static_cast<std::uint32_t>(key_string.size()),
+            .DataOffset = 0,
+            .DataSize = 0,
+        });
+        key_table.append(key_string);
+    }
+
+    const std::size_t key_table_offset{ sizeof(ConsolidatedDbHeader) + section_records.size() * sizeof(ConsolidatedDbSectionRecord) };
+    const ConsolidatedDbHeader header{
+        .MagicNumber = s_ConsolidatedDatabaseMagicNumber,
+        .NumSections = static_cast<std::uint32_t>(section_records.size()),
+        .KeyTableOffset = static_cast<std::uint32_t>(key_table_offset),
+        .KeyTableSize = static_cast<std::uint32_t>(key_table.size()),
+    };
+
+    // Sections are read in place, so each of them has to start 8-byte aligned
+    auto align = [](std::uint64_t offset)
+    { return (offset + 7) & ~std::uint64_t{ 7 }; };
+
+    std::uint64_t data_offset{ align(key_table_offset + key_table.size()) };
+    {
+        std::size_t i{ 0 };
+        for (const auto& [key, section_data] : mSections)
+        {
+            section_records[i].DataOffset = data_offset;
+            section_records[i].DataSize = section_data.size();
+            data_offset = align(data_offset + section_data.size());
+            i++;
+        }
+    }
+
+    std::string data;
+    data.reserve(data_offset);
+    data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    data.append(reinterpret_cast<const char*>(section_records.data()), section_records.size() * sizeof(ConsolidatedDbSectionRecord));
+    data.append(key_table);
+    for (const auto& [key, section_data] : mSections)
+    {
+        data.resize(align(data.size()), '\0');
+        data.append(section_data);
+    }
+
+    if (!WriteFileAtomically(mFilePath, data))
+    {
+        LogError("Failed writing mod database '{}'...", mFilePath.string());
+        return false;
+    }
+
+    mChanged = false;
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "util/normalized_path.h"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Keeps the databases of all mods as sections of a single file, which is loaded once and committed once
+// Sections are keyed by the database folder they replace, that folder still holds everything derived from the mod
+class ConsolidatedModDatabase
+{
+  public:
+    explicit ConsolidatedModDatabase(std::filesystem::path file_path);
+    ~ConsolidatedModDatabase();
+
+    ConsolidatedModDatabase(const ConsolidatedModDatabase&) = delete;
+    ConsolidatedModDatabase(ConsolidatedModDatabase&&) = delete;
+    ConsolidatedModDatabase& operator=(const ConsolidatedModDatabase&) = delete;
+    ConsolidatedModDatabase& operator=(ConsolidatedModDatabase&&) = delete;
+
+    std::optional<std::string_view> GetSection(const std::filesystem::path& database_folder) const;
+    void SetSection(const std::filesystem::path& database_folder, std::string data);
+    // Removes the section of this folder and of all folders inside of it
+    void RemoveSections(const std::filesystem::path& database_folder);
+
+    // Writes all sections to disk if any of them changed
+    bool Commit();
+
+  private:
+    const std::filesystem::path mFilePath;
+    std::unordered_map<NormalizedPath, std::string> mSections;
+    bool mChanged{ false };
+};
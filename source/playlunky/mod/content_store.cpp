@@ -0,0 +1,157 @@
+#include "content_store.h"
+
+#include "log.h"
+#include "util/content_hash.h"
+#include "util/on_scope_exit.h"
+
+#include <fstream>
+
+static bool LinkFile(const std::filesystem::path& source, const std::filesystem::path& destination)
+{
+    namespace fs = std::filesystem;
+
+    std::error_code error_code;
+    fs::create_directories(destination.parent_path(), error_code);
+    fs::create_hard_link(source, destination, error_code);
+    return !error_code;
+}
+
+// Creates a file in the store and tries to link to it, the file system decides this and it does not change while running
+static bool SupportsHardLinks(const std::filesystem::path& store_path)
+{
+    namespace fs = std::filesystem;
+
+    const fs::path probe_path{ store_path / ".link_probe" };
+    const fs::path probe_link_path{ store_path / ".link_probe_link" };
+    OnScopeExit remove_probe{ [&]()
+                              {
+                                  std::error_code error_code;
+                                  fs::remove(probe_link_path, error_code);
+                                  fs::remove(probe_path, error_code);
+                              } };
+
+    std::error_code error_code;
+    fs::create_directories(store_path, error_code);
+    if (!std::ofstream{ probe_path, std::ios::binary })
+    {
+        return false;
+    }
+    return LinkFile(probe_path, probe_link_path);
+}
+
+ContentStore::ContentStore(std::filesystem::path store_path)
+    : mStorePath{ std::move(store_path) }
+    , mEnabled{ SupportsHardLinks(mStorePath) }
+{
+    if (!mEnabled)
+    {
+        LogInfo("Hard links are not supported in '{}', disabling the content store...", mStorePath.string());
+    }
+}
+ContentStore::~ContentStore()
+{
+    if (mNumReused > 0)
+    {
+        LogInfo("Reused {} derived files from the content store, derived {} new ones...", mNumReused.load(), mNumDerived.load());
+    }
+}
+
+bool ContentStore::Derive(std::string_view kind, const std::filesystem::path& source, const std::filesystem::path& destination, const DeriveFun& derive)
+{
+    namespace fs = std::filesystem;
+
+    // Never write through an existing link, that would change the file for every mod sharing it
+    std::error_code error_code;
+    fs::remove(destination, error_code);
+
+    // Copies instead of links would cost the disk space the store is meant to save and are collected again on each launch
+    if (!mEnabled)
+    {
+        return derive(destination);
+    }
+
+    const std::optional<fs::path> stored_path{ GetStoredPath(kind, source) };
+    if (!stored_path.has_value())
+    {
+        return derive(destination);
+    }
+
+    // Only one thread at a time may work on a stored file, the others wait and then find it already stored
+    {
+        std::unique_lock lock{ mInFlightMutex };
+        mInFlightDone.wait(lock, [this, &stored_path]()
+                           { return !mInFlight.contains(stored_path->native()); });
+        mInFlight.insert(stored_path->native());
+    }
+    OnScopeExit release_stored_path{ [this, &stored_path]()
+                                     {
+                                         {
+                                             std::lock_guard lock{ mInFlightMutex };
+                                             mInFlight.erase(stored_path->native());
+                                         }
+                                         mInFlightDone.notify_all();
+                                     } };
+
+    if (fs::exists(stored_path.value(), error_code) && LinkFile(stored_path.value(), destination))
+    {
+        mNumReused++;
+        return true;
+    }
+
+    if (!derive(destination))
+    {
+        return false;
+    }
+    mNumDerived++;
+
+    fs::remove(stored_path.value(), error_code);
+    if (LinkFile(destination, stored_path.value()))
+    {
+        mChanged = true;
+    }
+    return true;
+}
+
+void ContentStore::CollectGarbage()
+{
+    namespace fs = std::filesystem;
+
+    std::error_code error_code;
+    if (!fs::exists(mStorePath, error_code))
+    {
+        return;
+    }
+
+    std::size_t num_removed{ 0 };
+    for (const fs::directory_entry& entry : fs::recursive_directory_iterator{ mStorePath, error_code })
+    {
+        // Only the store itself still refers to this file, a disabled store this way also drops what was stored before
+        if (entry.is_regular_file(error_code) && entry.hard_link_count(error_code) <= 1)
+        {
+            if (fs::remove(entry.path(), error_code))
+            {
+                num_removed++;
+            }
+        }
+    }
+
+    if (num_removed > 0)
+    {
+        LogInfo("Removed {} unused files from the content store...", num_removed);
+        mChanged = true;
+    }
+}
+
+std::optional<std::filesystem::path> ContentStore::GetStoredPath(std::string_view kind, const std::filesystem::path& source) const
+{
+    std::error_code error_code;
+    const std::uintmax_t size{ std::filesystem::file_size(source, error_code) };
+    const std::optional<std::uint64_t> hash{ HashFileContent(source) };
+    if (error_code || !hash.has_value())
+    {
+        return std::nullopt;
+    }
+
+    // Together with the size a 64-bit hash is plenty to tell mod files apart
+    return mStorePath / kind / fmt::format("{:016x}-{:x}", hash.value(), size);
+}
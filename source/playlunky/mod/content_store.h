@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_set>
+
+// Keeps one copy of each derived file, e.g. a converted dds or decoded audio, per unique source content
+// Destinations are hard links into the store, so identical files shipped by many mods are converted and stored once
+// Where the file system does not support hard links the store is disabled and every file is derived in place
+class ContentStore
+{
+  public:
+    ContentStore(std::filesystem::path store_path);
+    ~ContentStore();
+
+    ContentStore(const ContentStore&) = delete;
+    ContentStore(ContentStore&&) = delete;
+    ContentStore& operator=(const ContentStore&) = delete;
+    ContentStore& operator=(ContentStore&&) = delete;
+
+    // Places the file derived from source at destination, only calls derive if no identical source was derived before
+    // Kind separates the different derivations of the same source, derive has to write to the path passed to it
+    // Safe to call from several threads, identical sources derived at the same time wait for the first one and reuse its result
+    using DeriveFun = std::function<bool(const std::filesystem::path&)>;
+    bool Derive(std::string_view kind, const std::filesystem::path& source, const std::filesystem::path& destination, const DeriveFun& derive);
+
+    // Removes stored files that no destination links to anymore
+    void CollectGarbage();
+
+    // True if any file in the store was added or removed
+    bool HasChanged() const
+    {
+        return mChanged;
+    }
+    const std::filesystem::path& GetStorePath() const
+    {
+        return mStorePath;
+    }
+
+  private:
+    std::optional<std::filesystem::path> GetStoredPath(std::string_view kind, const std::filesystem::path& source) const;
+
+    std::filesystem::path mStorePath;
+    const bool mEnabled;
+    std::atomic_bool mChanged{ false };
+    std::atomic_uint64_t mNumDerived{ 0 };
+    std::atomic_uint64_t mNumReused{ 0 };
+
+    std::mutex mInFlightMutex;
+    std::condition_variable mInFlightDone;
+    std::unordered_set<std::filesystem::path::string_type> mInFlight;
+};
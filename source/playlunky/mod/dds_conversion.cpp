@@ -5,11 +5,15 @@
 #include "util/color.h"
 #include "util/image.h"
 #include "util/on_scope_exit.h"
+#include "util/profiler.h"
 #include "util/span_util.h"
 
+#include <array>
 #include <cassert>
+#include <cstring>
 #include <fstream>
 #include <span>
+#include <vector>
 
 bool IsSupportedFileType(const std::filesystem::path& extension)
 {
@@ -35,69 +39,102 @@ bool IsSupportedFileType(const std::filesystem::path& extension)
     return algo::contains(supported_extensions, ext_string);
 }
 
-bool ConvertRBGAToDds(std::span<const std::uint8_t> source, std::uint32_t width, std::uint32_t height, const std::filesystem::path& destination)
+// Everything in front of the pixel data, the same for all uncompressed RGBA textures of one size
+static constexpr std::size_t c_DdsHeaderSize{ 4 + 124 };
+static std::array<std::uint8_t, c_DdsHeaderSize> EncodeDdsHeader(std::uint32_t width, std::uint32_t height)
 {
-    namespace fs = std::filesystem;
+    // https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+    const std::uint32_t header_size = 124;  // hardcoded
+    const std::uint32_t flags = 0x0002100F; // required flags + pitch + mipmapped
 
-    {
-        const auto dest_parent_dir = destination.parent_path();
-        if (!fs::exists(dest_parent_dir))
-        {
-            fs::create_directories(dest_parent_dir);
-        }
-    } // namespace std::filesystem;
+    const std::uint32_t pitch = width * 4; // aka bytes per line
+    const std::uint32_t depth = 1;
+    const std::uint32_t mipmaps = 1;
 
-    if (auto dest_file = std::ofstream{ destination, std::ios::trunc | std::ios::binary })
-    {
-        // https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
-        const std::uint32_t header_size = 124;  // hardcoded
-        const std::uint32_t flags = 0x0002100F; // required flags + pitch + mipmapped
+    const std::uint32_t reserverd1[11]{};
 
-        const std::uint32_t pitch = width * 4; // aka bytes per line
-        const std::uint32_t depth = 1;
-        const std::uint32_t mipmaps = 1;
+    // pixel format sub structure
+    const std::uint32_t pfsize = 32;    // size of pixel format structure, constant
+    const std::uint32_t pfflags = 0x41; // uncompressed RGB with alpha channel
+    const std::uint32_t fourcc = 0;     // compression mode (not used for uncompressed data)
+    const std::uint32_t bitcount = 32;
 
-        const std::uint32_t reserverd1[11]{};
+    // bit masks for each channel, here for RGBA
+    const std::uint32_t rmask = 0x000000FF;
+    const std::uint32_t gmask = 0x0000FF00;
+    const std::uint32_t bmask = 0x00FF0000;
+    const std::uint32_t amask = 0xFF000000;
 
-        // pixel format sub structure
-        const std::uint32_t pfsize = 32;    // size of pixel format structure, constant
-        const std::uint32_t pfflags = 0x41; // uncompressed RGB with alpha channel
-        const std::uint32_t fourcc = 0;     // compression mode (not used for uncompressed data)
-        const std::uint32_t bitcount = 32;
+    const std::uint32_t caps = 0x1000; // simple texture with only one surface and no mipmaps
+    const std::uint32_t caps2 = 0;     // additional surface data, unused
+    const std::uint32_t caps3 = 0;     // unused
+    const std::uint32_t caps4 = 0;     // unused
 
-        // bit masks for each channel, here for RGBA
-        const std::uint32_t rmask = 0x000000FF;
-        const std::uint32_t gmask = 0x0000FF00;
-        const std::uint32_t bmask = 0x00FF0000;
-        const std::uint32_t amask = 0xFF000000;
+    const std::uint32_t reserved2 = 0;
 
-        const std::uint32_t caps = 0x1000; // simple texture with only one surface and no mipmaps
-        const std::uint32_t caps2 = 0;     // additional surface data, unused
-        const std::uint32_t caps3 = 0;     // unused
-        const std::uint32_t caps4 = 0;     // unused
+    std::array<std::uint8_t, c_DdsHeaderSize> dds_header{};
+    std::size_t header_offset{ 0 };
 
-        const std::uint32_t reserved2 = 0;
+    auto write_bytes = [&dds_header, &header_offset](const void* data, std::size_t size)
+    {
+        std::memcpy(dds_header.data() + header_offset, data, size);
+        header_offset += size;
+    };
+    auto write_as_bytes = [&write_bytes](auto... datas)
+    {
+        (
+            write_bytes(&datas, sizeof(datas)),
+            ...);
+    };
 
-        auto write_as_bytes = [](auto& stream, auto... datas)
-        {
-            (
-                stream.write(reinterpret_cast<const char*>(&datas), sizeof(datas)),
-                ...);
-        };
-
-        dest_file << "DDS "; // magic bytes
-        write_as_bytes(dest_file, header_size, flags);
-        write_as_bytes(dest_file, height, width, pitch, depth, mipmaps);
-        dest_file.write(reinterpret_cast<const char*>(reserverd1), sizeof(reserverd1));
-        write_as_bytes(dest_file, pfsize, pfflags, fourcc, bitcount);
-        write_as_bytes(dest_file, rmask, gmask, bmask, amask);
-        write_as_bytes(dest_file, caps, caps2, caps3, caps4);
-        write_as_bytes(dest_file, reserved2);
+    write_bytes("DDS ", 4); // magic bytes
+    write_as_bytes(header_size, flags);
+    write_as_bytes(height, width, pitch, depth, mipmaps);
+    write_bytes(reserverd1, sizeof(reserverd1));
+    write_as_bytes(pfsize, pfflags, fourcc, bitcount);
+    write_as_bytes(rmask, gmask, bmask, amask);
+    write_as_bytes(caps, caps2, caps3, caps4);
+    write_as_bytes(reserved2);
+
+    assert(header_offset == c_DdsHeaderSize);
+    return dds_header;
+}
 
-        dest_file.write(reinterpret_cast<const char*>(source.data()), source.size());
+std::vector<std::uint8_t> EncodeRBGAAsDds(std::span<const std::uint8_t> source, std::uint32_t width, std::uint32_t height)
+{
+    const std::array<std::uint8_t, c_DdsHeaderSize> dds_header{ EncodeDdsHeader(width, height) };
 
+    std::vector<std::uint8_t> dds_data;
+    dds_data.reserve(dds_header.size() + source.size());
+    dds_data.insert(dds_data.end(), dds_header.begin(), dds_header.end());
+    dds_data.insert(dds_data.end(), source.begin(), source.end());
+    return dds_data;
+}
+
+bool ConvertRBGAToDds(std::span<const std::uint8_t> source, std::uint32_t width, std::uint32_t height, const std::filesystem::path& destination)
+{
+    namespace fs = std::filesystem;
+
+    {
+        // Other files may be converted into the same folder at the same time
+        std::error_code error_code;
+        fs::create_directories(destination.parent_path(), error_code);
+    }
+
+    // Destination may be a hard link into the content store, replace the file instead of writing through the link
+    {
+        std::error_code error_code;
+        fs::remove(destination, error_code);
+    }
+
+    // Pixels are written straight from the source, only the header is encoded separately
+    if (auto dest_file = std::ofstream{ destination, std::ios::trunc | std::ios::binary })
+    {
+        const std::array<std::uint8_t, c_DdsHeaderSize> dds_header{ EncodeDdsHeader(width, height) };
+        dest_file.write(reinterpret_cast<const char*>(dds_header.data()), dds_header.size());
+        dest_file.write(reinterpret_cast<const char*>(source.data()), source.size());
         dest_file.flush();
-        return true;
+        return static_cast<bool>(dest_file);
     }
 
     return false;
@@ -105,6 +142,8 @@ bool ConvertRBGAToDds(std::span<const std::uint8_t> source, std::uint32_t width,
 
 bool ConvertImageToDds(const std::filesystem::path& source, const std::filesystem::path& destination)
 {
+    const ProfileZone profile_zone{ "ConvertImageToDds" };
+
     Image source_image;
     if (source_image.Load(source))
     {
@@ -3,9 +3,12 @@
 #include <cstdint>
 #include <filesystem>
 #include <span>
+#include <vector>
 
 bool IsSupportedFileType(const std::filesystem::path& extension);
 
+// Produces the same bytes ConvertRBGAToDds writes to disk, only for files kept in memory, writing to disk streams the pixels instead
+std::vector<std::uint8_t> EncodeRBGAAsDds(std::span<const std::uint8_t> source, std::uint32_t width, std::uint32_t height);
 bool ConvertRBGAToDds(std::span<const std::uint8_t> source, std::uint32_t width, std::uint32_t height, const std::filesystem::path& destination);
 bool ConvertImageToDds(const std::filesystem::path& source, const std::filesystem::path& destination);
 bool ConvertDdsToPng(std::span<const std::uint8_t> source, const std::filesystem::path& destination);
@@ -0,0 +1,299 @@
+#include "derived_asset_graph.h"
+
+#include "log.h"
+#include "util/content_hash.h"
+#include "util/file.h"
+#include "util/mapped_file.h"
+
+#include <cstring>
+
+static constexpr std::uint32_t s_DerivedAssetGraphMagicNumber{ 0xDA6A0001 };
+
+// Layout of the file: the magic number and asset count, followed by the assets one after another
+// Each asset is its name, the hash of its parameters, its inputs and its outputs, strings are stored as size and characters
+// Inputs that did not exist are stored with a write time of zero and a size of all ones
+static constexpr std::uint64_t c_MissingInputSize{ ~std::uint64_t{ 0 } };
+
+DerivedAssetGraph::DerivedAssetGraph(std::filesystem::path graph_path)
+    : mGraphPath{ std::move(graph_path) }
+{
+    auto graph_file = MappedFile::Open(mGraphPath);
+    if (graph_file == nullptr)
+    {
+        return;
+    }
+
+    std::string_view data{ graph_file->GetData() };
+    bool is_valid{ true };
+
+    auto read = [&data, &is_valid]<class T>(T& value)
+    {
+        if (!is_valid || data.size() < sizeof(T))
+        {
+            is_valid = false;
+            value = T{};
+            return;
+        }
+        std::memcpy(&value, data.data(), sizeof(T));
+        data.remove_prefix(sizeof(T));
+    };
+    auto read_string = [&data, &is_valid, &read]()
+    {
+        std::uint32_t size;
+        read(size);
+        if (!is_valid || data.size() < size)
+        {
+            is_valid = false;
+            return std::string{};
+        }
+        std::string string{ data.substr(0, size) };
+        data.remove_prefix(size);
+        return string;
+    };
+
+    std::uint32_t magic_number;
+    std::uint32_t num_assets;
+    read(magic_number);
+    read(num_assets);
+    if (!is_valid || magic_number != s_DerivedAssetGraphMagicNumber)
+    {
+        return;
+    }
+
+    for (std::uint32_t i = 0; i < num_assets && is_valid; i++)
+    {
+        std::string name{ read_string() };
+        AssetRecord asset;
+        read(asset.ParametersHash);
+
+        std::uint32_t num_inputs;
+        read(num_inputs);
+        for (std::uint32_t j = 0; j < num_inputs && is_valid; j++)
+        {
+            InputRecord& input = asset.Inputs.emplace_back();
+            input.Path = read_string();
+            FileStamp stamp;
+            read(stamp.LastWrite);
+            read(stamp.Size);
+            read(input.ContentHash);
+            if (stamp.Size != c_MissingInputSize)
+            {
+                input.Stamp = stamp;
+            }
+        }
+
+        std::uint32_t num_outputs;
+        read(num_outputs);
+        for (std::uint32_t j = 0; j < num_outputs && is_valid; j++)
+        {
+            OutputRecord& output = asset.Outputs.emplace_back();
+            output.Path = read_string();
+            read(output.Stamp.LastWrite);
+            read(output.Stamp.Size);
+        }
+
+        mBuiltAssets.insert_or_assign(std::move(name), std::move(asset));
+    }
+
+    if (!is_valid)
+    {
+        LogError("Derived asset graph '{}' is corrupted, all derived assets will be rebuilt...", mGraphPath.string());
+        mBuiltAssets.clear();
+    }
+}
+DerivedAssetGraph::~DerivedAssetGraph() = default;
+
+bool DerivedAssetGraph::IsOutdated(std::string_view asset, std::span<const std::filesystem::path> outputs, std::span<const std::filesystem::path> inputs, std::string_view parameters)
+{
+    // Inputs are hashed without holding the lock, so the last build is copied and the pending record is only stored at the end
+    std::optional<AssetRecord> built_record;
+    {
+        std::lock_guard lock{ mMutex };
+        if (const auto built_it = mBuiltAssets.find(std::string{ asset }); built_it != mBuiltAssets.end())
+        {
+            built_record = built_it->second;
+        }
+    }
+    const AssetRecord* built_asset = built_record.has_value() ? &built_record.value() : nullptr;
+
+    AssetRecord pending_asset{ .ParametersHash = HashContent(parameters) };
+
+    // Only inputs whose stamp changed since the last build have to be read again
+    pending_asset.Inputs.reserve(inputs.size());
+    for (std::size_t i = 0; i < inputs.size(); i++)
+    {
+        InputRecord& input = pending_asset.Inputs.emplace_back(InputRecord{
+            .Path = inputs[i].string(),
+            .Stamp = GetFileStamp(inputs[i]),
+            .ContentHash = 0,
+        });
+        if (!input.Stamp.has_value())
+        {
+            continue;
+        }
+
+        const InputRecord* built_input = built_asset != nullptr && i < built_asset->Inputs.size() ? &built_asset->Inputs[i] : nullptr;
+        if (built_input != nullptr && built_input->Path == input.Path && built_input->Stamp == input.Stamp)
+        {
+            input.ContentHash = built_input->ContentHash;
+        }
+        else
+        {
+            input.ContentHash = HashFileContent(inputs[i]).value_or(0);
+        }
+    }
+
+    pending_asset.Outputs.reserve(outputs.size());
+    for (const std::filesystem::path& output : outputs)
+    {
+        pending_asset.Outputs.push_back(OutputRecord{ .Path = output.string() });
+    }
+
+    const bool is_outdated = [&]()
+    {
+        if (built_asset == nullptr || built_asset->ParametersHash != pending_asset.ParametersHash || built_asset->Inputs.size() != pending_asset.Inputs.size() || built_asset->Outputs.size() != pending_asset.Outputs.size())
+        {
+            return true;
+        }
+
+        for (std::size_t i = 0; i < pending_asset.Inputs.size(); i++)
+        {
+            const InputRecord& built_input = built_asset->Inputs[i];
+            const InputRecord& pending_input = pending_asset.Inputs[i];
+            if (built_input.Path != pending_input.Path || built_input.Stamp.has_value() != pending_input.Stamp.has_value() || built_input.ContentHash != pending_input.ContentHash)
+            {
+                return true;
+            }
+        }
+
+        // Outputs only have to match their stamp, they are written by us and nobody should touch them
+        for (std::size_t i = 0; i < pending_asset.Outputs.size(); i++)
+        {
+            const OutputRecord& built_output = built_asset->Outputs[i];
+            if (built_output.Path != pending_asset.Outputs[i].Path || GetFileStamp(outputs[i]) != built_output.Stamp)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }();
+
+    std::lock_guard lock{ mMutex };
+    mPendingAssets.insert_or_assign(std::string{ asset }, std::move(pending_asset));
+    return is_outdated;
+}
+void DerivedAssetGraph::MarkBuilt(std::string_view asset)
+{
+    std::lock_guard lock{ mMutex };
+    if (mPendingAssets.contains(std::string{ asset }))
+    {
+        mNewlyBuiltAssets.push_back(std::string{ asset });
+    }
+}
+
+void DerivedAssetGraph::Write()
+{
+    std::lock_guard lock{ mMutex };
+
+    if (mNewlyBuiltAssets.empty())
+    {
+        return;
+    }
+
+    for (const std::string& asset : mNewlyBuiltAssets)
+    {
+        auto pending_it = mPendingAssets.find(asset);
+        if (pending_it == mPendingAssets.end())
+        {
+            continue;
+        }
+        AssetRecord& pending_asset = pending_it->second;
+
+        // Without a stamp for every output it can't be told whether they are still ours next time
+        bool has_all_outputs{ true };
+        for (OutputRecord& output : pending_asset.Outputs)
+        {
+            if (const std::optional<FileStamp> stamp = GetFileStamp(output.Path))
+            {
+                output.Stamp = stamp.value();
+            }
+            else
+            {
+                has_all_outputs = false;
+            }
+        }
+
+        if (has_all_outputs)
+        {
+            mBuiltAssets.insert_or_assign(asset, std::move(pending_asset));
+        }
+        else
+        {
+            mBuiltAssets.erase(asset);
+        }
+        mPendingAssets.erase(pending_it);
+    }
+    mNewlyBuiltAssets.clear();
+
+    std::string data;
+    auto write = [&data]<class T>(const T& value)
+    {
+        data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    };
+    auto write_string = [&data, &write](std::string_view string)
+    {
+        write(static_cast<std::uint32_t>(string.size()));
+        data.append(string);
+    };
+
+    write(s_DerivedAssetGraphMagicNumber);
+    write(static_cast<std::uint32_t>(mBuiltAssets.size()));
+    for (const auto& [name, asset] : mBuiltAssets)
+    {
+        write_string(name);
+        write(asset.ParametersHash);
+
+        write(static_cast<std::uint32_t>(asset.Inputs.size()));
+        for (const InputRecord& input : asset.Inputs)
+        {
+            const FileStamp stamp{ input.Stamp.value_or(FileStamp{ .LastWrite = 0, .Size = c_MissingInputSize }) };
+            write_string(input.Path);
+            write(stamp.LastWrite);
+            write(stamp.Size);
+            write(input.ContentHash);
+        }
+
+        write(static_cast<std::uint32_t>(asset.Outputs.size()));
+        for (const OutputRecord& output : asset.Outputs)
+        {
+            write_string(output.Path);
+            write(output.Stamp.LastWrite);
+            write(output.Stamp.Size);
+        }
+    }
+
+    if (!WriteFileAtomically(mGraphPath, data))
+    {
+        LogError("Failed writing derived asset graph '{}'...", mGraphPath.string());
+    }
+}
+
+std::optional<DerivedAssetGraph::FileStamp> DerivedAssetGraph::GetFileStamp(const std::filesystem::path& file_path)
+{
+    std::error_code error_code;
+    const auto last_write_time = std::filesystem::last_write_time(file_path, error_code);
+    if (error_code)
+    {
+        return std::nullopt;
+    }
+    const std::uintmax_t file_size = std::filesystem::file_size(file_path, error_code);
+    if (error_code)
+    {
+        return std::nullopt;
+    }
+    return FileStamp{
+        .LastWrite = static_cast<std::int64_t>(last_write_time.time_since_epoch().count()),
+        .Size = static_cast<std::uint64_t>(file_size),
+    };
+}
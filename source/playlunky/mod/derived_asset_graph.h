@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Remembers what each derived asset, e.g. a merged sheet or the merged shaders, was last built from
+// An asset is only rebuilt when one of its inputs changed in content, write time and size only decide whether an input has to be hashed again
+// Different assets may be checked and marked from several threads at the same time
+// Only assets merged from several files are tracked, per-file conversions like dds textures or cached audio are tracked by the mod database and content store
+class DerivedAssetGraph
+{
+  public:
+    explicit DerivedAssetGraph(std::filesystem::path graph_path);
+    ~DerivedAssetGraph();
+
+    DerivedAssetGraph(const DerivedAssetGraph&) = delete;
+    DerivedAssetGraph(DerivedAssetGraph&&) = delete;
+    DerivedAssetGraph& operator=(const DerivedAssetGraph&) = delete;
+    DerivedAssetGraph& operator=(DerivedAssetGraph&&) = delete;
+
+    // True if the asset was never built, an output is missing or was changed by someone else, or the inputs differ from the last build
+    // Inputs are ordered and may be missing, parameters hold anything else the asset depends on, e.g. settings
+    bool IsOutdated(std::string_view asset, std::span<const std::filesystem::path> outputs, std::span<const std::filesystem::path> inputs, std::string_view parameters = {});
+    // Records the inputs of the last IsOutdated call for this asset, call once it was built successfully
+    void MarkBuilt(std::string_view asset);
+
+    // Outputs are stamped here, so call this only once everything is on disk
+    void Write();
+
+  private:
+    struct FileStamp
+    {
+        std::int64_t LastWrite;
+        std::uint64_t Size;
+
+        bool operator==(const FileStamp&) const = default;
+    };
+    static std::optional<FileStamp> GetFileStamp(const std::filesystem::path& file_path);
+
+    struct InputRecord
+    {
+        std::string Path;
+        std::optional<FileStamp> Stamp;
+        std::uint64_t ContentHash;
+    };
+    struct OutputRecord
+    {
+        std::string Path;
+        FileStamp Stamp;
+    };
+    struct AssetRecord
+    {
+        std::uint64_t ParametersHash{ 0 };
+        std::vector<InputRecord> Inputs;
+        std::vector<OutputRecord> Outputs;
+    };
+
+    const std::filesystem::path mGraphPath;
+    std::mutex mMutex;
+    std::unordered_map<std::string, AssetRecord> mBuiltAssets;
+    // Outputs are only filled in by Write
+    std::unordered_map<std::string, AssetRecord> mPendingAssets;
+    std::vector<std::string> mNewlyBuiltAssets;
+};
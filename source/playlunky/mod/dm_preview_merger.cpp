@@ -1,37 +1,108 @@
 #include "dm_preview_merger.h"
 
+#include "derived_asset_graph.h"
 #include "level_data.h"
 #include "level_parser.h"
 #include "util/algorithms.h"
 #include "util/format.h"
+#include "util/profiler.h"
 #include "virtual_filesystem.h"
 
 #include <zip_adaptor.h>
 
+using namespace std::string_view_literals;
+
+static constexpr std::string_view s_DmPreviewTokPath{ "Data/Levels/Arena/dmpreview.tok" };
+static constexpr std::array s_ArenaLevels{
+    "Data/Levels/Arena/dm1-1.lvl"sv,
+    "Data/Levels/Arena/dm1-2.lvl"sv,
+    "Data/Levels/Arena/dm1-3.lvl"sv,
+    "Data/Levels/Arena/dm1-4.lvl"sv,
+    "Data/Levels/Arena/dm1-5.lvl"sv,
+    "Data/Levels/Arena/dm2-1.lvl"sv,
+    "Data/Levels/Arena/dm2-2.lvl"sv,
+    "Data/Levels/Arena/dm2-3.lvl"sv,
+    "Data/Levels/Arena/dm2-4.lvl"sv,
+    "Data/Levels/Arena/dm2-5.lvl"sv,
+    "Data/Levels/Arena/dm3-1.lvl"sv,
+    "Data/Levels/Arena/dm3-2.lvl"sv,
+    "Data/Levels/Arena/dm3-3.lvl"sv,
+    "Data/Levels/Arena/dm3-4.lvl"sv,
+    "Data/Levels/Arena/dm3-5.lvl"sv,
+    "Data/Levels/Arena/dm4-1.lvl"sv,
+    "Data/Levels/Arena/dm4-2.lvl"sv,
+    "Data/Levels/Arena/dm4-3.lvl"sv,
+    "Data/Levels/Arena/dm4-4.lvl"sv,
+    "Data/Levels/Arena/dm4-5.lvl"sv,
+    "Data/Levels/Arena/dm5-1.lvl"sv,
+    "Data/Levels/Arena/dm5-2.lvl"sv,
+    "Data/Levels/Arena/dm5-3.lvl"sv,
+    "Data/Levels/Arena/dm5-4.lvl"sv,
+    "Data/Levels/Arena/dm5-5.lvl"sv,
+    "Data/Levels/Arena/dm6-1.lvl"sv,
+    "Data/Levels/Arena/dm6-2.lvl"sv,
+    "Data/Levels/Arena/dm6-3.lvl"sv,
+    "Data/Levels/Arena/dm6-4.lvl"sv,
+    "Data/Levels/Arena/dm6-5.lvl"sv,
+    "Data/Levels/Arena/dm7-1.lvl"sv,
+    "Data/Levels/Arena/dm7-2.lvl"sv,
+    "Data/Levels/Arena/dm7-3.lvl"sv,
+    "Data/Levels/Arena/dm7-4.lvl"sv,
+    "Data/Levels/Arena/dm7-5.lvl"sv,
+    "Data/Levels/Arena/dm8-1.lvl"sv,
+    "Data/Levels/Arena/dm8-2.lvl"sv,
+    "Data/Levels/Arena/dm8-3.lvl"sv,
+    "Data/Levels/Arena/dm8-4.lvl"sv,
+    "Data/Levels/Arena/dm8-5.lvl"sv,
+};
+
 DmPreviewMerger::DmPreviewMerger(const PlaylunkySettings& /*settings*/)
 {
 }
 DmPreviewMerger::~DmPreviewMerger() = default;
 
-void DmPreviewMerger::RegisterDmLevel(std::filesystem::path path, bool outdated, bool deleted)
+void DmPreviewMerger::RegisterDmLevel(const std::filesystem::path& path, bool outdated, bool deleted)
 {
-    if (RegisteredDmLevel* registered_level = algo::find_if(mDmLevels,
-                                                            [&path](const RegisteredDmLevel& sheet)
-                                                            { return algo::is_same_path(sheet.Path, path); }))
+    const NormalizedPath normalized_path{ path };
+    if (RegisteredDmLevel* registered_level = algo::find(mDmLevels, &RegisteredDmLevel::Path, normalized_path))
     {
         registered_level->Outdated = registered_level->Outdated || outdated;
         registered_level->Deleted = registered_level->Deleted || deleted;
         return;
     }
     mDmLevels.push_back(RegisteredDmLevel{
-        .Path = std::move(path),
+        .Path = normalized_path,
         .Outdated = outdated,
         .Deleted = deleted });
 }
 
-bool DmPreviewMerger::NeedsRegeneration(const std::filesystem::path& destination_folder) const
+DmPreviewMerger::Inputs DmPreviewMerger::ResolveInputs(const std::filesystem::path& source_folder, const VirtualFilesystem& vfs)
+{
+    Inputs inputs{ .TokPath = vfs.GetFilePath(s_DmPreviewTokPath).value_or(source_folder / s_DmPreviewTokPath) };
+    inputs.LevelPaths.reserve(s_ArenaLevels.size());
+    for (std::string_view level_path : s_ArenaLevels)
+    {
+        inputs.LevelPaths.push_back(vfs.GetFilePath(level_path));
+    }
+    return inputs;
+}
+
+bool DmPreviewMerger::NeedsRegeneration(const Inputs& inputs, const std::filesystem::path& destination_folder, DerivedAssetGraph* asset_graph) const
 {
     namespace fs = std::filesystem;
+
+    if (asset_graph != nullptr)
+    {
+        // The preview only depends on the tok file and whichever arena levels are loaded, no matter which mod they come from
+        std::vector<fs::path> input_paths{ inputs.TokPath };
+        for (const std::optional<fs::path>& level_path : inputs.LevelPaths)
+        {
+            input_paths.push_back(level_path.value_or(fs::path{}));
+        }
+        const fs::path outputs[]{ destination_folder / s_DmPreviewTokPath };
+        return asset_graph->IsOutdated("dmpreview", outputs, input_paths);
+    }
+
     const bool does_exist = fs::exists(fs::path{ destination_folder / "dmpreview.tok" });
     static auto requires_update = [](const RegisteredDmLevel& registered_level)
     {
@@ -40,61 +111,19 @@ bool DmPreviewMerger::NeedsRegeneration(const std::filesystem::path& destination
     return !does_exist || algo::contains_if(mDmLevels, requires_update);
 }
 
-bool DmPreviewMerger::GenerateDmPreview(const std::filesystem::path& source_folder, const std::filesystem::path& destination_folder, VirtualFilesystem& vfs)
+bool DmPreviewMerger::GenerateDmPreview(const Inputs& inputs, const std::filesystem::path& destination_folder, VirtualFilesystem& vfs)
 {
+    const ProfileZone profile_zone{ "DmPreviewMerger::GenerateDmPreview" };
+
     namespace fs = std::filesystem;
-    using namespace std::string_view_literals;
 
-    static constexpr std::string_view dmpreview_tok_path{ "Data/Levels/Arena/dmpreview.tok" };
-    static constexpr std::array arena_levels{
-        "Data/Levels/Arena/dm1-1.lvl"sv,
-        "Data/Levels/Arena/dm1-2.lvl"sv,
-        "Data/Levels/Arena/dm1-3.lvl"sv,
-        "Data/Levels/Arena/dm1-4.lvl"sv,
-        "Data/Levels/Arena/dm1-5.lvl"sv,
-        "Data/Levels/Arena/dm2-1.lvl"sv,
-        "Data/Levels/Arena/dm2-2.lvl"sv,
-        "Data/Levels/Arena/dm2-3.lvl"sv,
-        "Data/Levels/Arena/dm2-4.lvl"sv,
-        "Data/Levels/Arena/dm2-5.lvl"sv,
-        "Data/Levels/Arena/dm3-1.lvl"sv,
-        "Data/Levels/Arena/dm3-2.lvl"sv,
-        "Data/Levels/Arena/dm3-3.lvl"sv,
-        "Data/Levels/Arena/dm3-4.lvl"sv,
-        "Data/Levels/Arena/dm3-5.lvl"sv,
-        "Data/Levels/Arena/dm4-1.lvl"sv,
-        "Data/Levels/Arena/dm4-2.lvl"sv,
-        "Data/Levels/Arena/dm4-3.lvl"sv,
-        "Data/Levels/Arena/dm4-4.lvl"sv,
-        "Data/Levels/Arena/dm4-5.lvl"sv,
-        "Data/Levels/Arena/dm5-1.lvl"sv,
-        "Data/Levels/Arena/dm5-2.lvl"sv,
-        "Data/Levels/Arena/dm5-3.lvl"sv,
-        "Data/Levels/Arena/dm5-4.lvl"sv,
-        "Data/Levels/Arena/dm5-5.lvl"sv,
-        "Data/Levels/Arena/dm6-1.lvl"sv,
-        "Data/Levels/Arena/dm6-2.lvl"sv,
-        "Data/Levels/Arena/dm6-3.lvl"sv,
-        "Data/Levels/Arena/dm6-4.lvl"sv,
-        "Data/Levels/Arena/dm6-5.lvl"sv,
-        "Data/Levels/Arena/dm7-1.lvl"sv,
-        "Data/Levels/Arena/dm7-2.lvl"sv,
-        "Data/Levels/Arena/dm7-3.lvl"sv,
-        "Data/Levels/Arena/dm7-4.lvl"sv,
-        "Data/Levels/Arena/dm7-5.lvl"sv,
-        "Data/Levels/Arena/dm8-1.lvl"sv,
-        "Data/Levels/Arena/dm8-2.lvl"sv,
-        "Data/Levels/Arena/dm8-3.lvl"sv,
-        "Data/Levels/Arena/dm8-4.lvl"sv,
-        "Data/Levels/Arena/dm8-5.lvl"sv,
-    };
     constexpr std::size_t setroom_width{ 10 };
     constexpr std::size_t setroom_height{ 8 };
     constexpr std::size_t preview_width{ 30 };
     constexpr std::size_t preview_height{ 15 };
     using DmPreviewLevel = std::uint8_t[preview_height][preview_width];
     using DmPreviewLevelArray = std::array<DmPreviewLevel, 40>;
-    static_assert(arena_levels.size() == DmPreviewLevelArray{}.size());
+    static_assert(s_ArenaLevels.size() == DmPreviewLevelArray{}.size());
     static_assert(sizeof(DmPreviewLevelArray) == 18000);
 
     const std::unordered_map<std::string_view, std::uint8_t> known_preview_images{
@@ -179,10 +208,13 @@ bool DmPreviewMerger::GenerateDmPreview(const std::filesystem::path& source_fold
         { "slidingwall_switch"sv, known_preview_images.at("empty"sv) },
     };
 
-    const fs::path input_path{ vfs.GetFilePath(dmpreview_tok_path).value_or(source_folder / dmpreview_tok_path) };
     DmPreviewLevelArray level_previews;
+    if (inputs.LevelPaths.size() != level_previews.size())
+    {
+        return false;
+    }
 
-    if (auto input_file = std::ifstream{ input_path, std::ios::binary })
+    if (auto input_file = std::ifstream{ inputs.TokPath, std::ios::binary })
     {
         input_file.read((char*)level_previews.data(), sizeof(level_previews));
     }
@@ -191,9 +223,9 @@ bool DmPreviewMerger::GenerateDmPreview(const std::filesystem::path& source_fold
         return false;
     }
 
-    for (auto [level_path, level_preview] : zip::zip(arena_levels, level_previews))
+    for (auto [modded_level, level_preview] : zip::zip(inputs.LevelPaths, level_previews))
     {
-        if (auto modded_level = vfs.GetFilePath(level_path))
+        if (modded_level.has_value())
         {
             const LevelData level_data{ LevelParser{}.LoadLevel(modded_level.value()) };
             std::memset(level_preview, 0xff, sizeof(level_preview));
@@ -275,17 +307,9 @@ bool DmPreviewMerger::GenerateDmPreview(const std::filesystem::path& source_fold
         }
     }
 
-    const fs::path output_path{ destination_folder / dmpreview_tok_path };
-    const fs::path output_parent{ output_path.parent_path() };
-    if (!fs::exists(output_parent))
-    {
-        fs::create_directories(output_parent);
-    }
-    if (auto output_file = std::ofstream{ output_path, std::ios::binary })
-    {
-        output_file.write((char*)&level_previews, sizeof(level_previews));
-    }
-    else
+    const fs::path output_path{ destination_folder / s_DmPreviewTokPath };
+    const auto* level_previews_bytes = reinterpret_cast<const std::uint8_t*>(&level_previews);
+    if (!vfs.PublishFile(output_path, std::vector<std::uint8_t>(level_previews_bytes, level_previews_bytes + sizeof(level_previews))))
     {
         return false;
     }
@@ -325,7 +349,7 @@ bool DmPreviewMerger::GenerateDmPreview(const std::filesystem::path& source_fold
     {
         output_file << "Mine" << std::endl;
 
-        for (auto [name, level] : zip::zip(arena_levels, level_previews))
+        for (auto [name, level] : zip::zip(s_ArenaLevels, level_previews))
         {
             output_file << name << std::endl;
             output_file << to_string(level);
@@ -342,7 +366,7 @@ bool DmPreviewMerger::GenerateDmPreview(const std::filesystem::path& source_fold
         {
             output_file << "Known Good" << std::endl;
 
-            for (auto [name, level] : zip::zip(arena_levels, good_level_previews))
+            for (auto [name, level] : zip::zip(s_ArenaLevels, good_level_previews))
             {
                 output_file << name << std::endl;
                 output_file << to_string(level);
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <filesystem>
+#include <optional>
 #include <string>
 #include <vector>
 
+#include "util/normalized_path.h"
+
+class DerivedAssetGraph;
 class PlaylunkySettings;
 class VirtualFilesystem;
 
@@ -17,16 +21,26 @@ class DmPreviewMerger
     DmPreviewMerger& operator=(DmPreviewMerger&&) = delete;
     ~DmPreviewMerger();
 
-    void RegisterDmLevel(std::filesystem::path path, bool outdated, bool deleted);
+    void RegisterDmLevel(const std::filesystem::path& path, bool outdated, bool deleted);
+
+    // The tok file and the arena levels the preview is built from, a level is empty if no mod replaces it
+    // Resolve them before the database folder is mounted, afterwards the preview generated on the last launch would be found as the tok file
+    struct Inputs
+    {
+        std::filesystem::path TokPath;
+        std::vector<std::optional<std::filesystem::path>> LevelPaths;
+    };
+    static Inputs ResolveInputs(const std::filesystem::path& source_folder, const VirtualFilesystem& vfs);
 
-    bool NeedsRegeneration(const std::filesystem::path& destination_folder) const;
+    // With an asset graph the preview is compared against the levels it was last built from, otherwise against the registered levels
+    bool NeedsRegeneration(const Inputs& inputs, const std::filesystem::path& destination_folder, DerivedAssetGraph* asset_graph) const;
 
-    bool GenerateDmPreview(const std::filesystem::path& source_folder, const std::filesystem::path& destination_folder, VirtualFilesystem& vfs);
+    static bool GenerateDmPreview(const Inputs& inputs, const std::filesystem::path& destination_folder, VirtualFilesystem& vfs);
 
   private:
     struct RegisteredDmLevel
     {
-        std::filesystem::path Path;
+        NormalizedPath Path;
         bool Outdated;
         bool Deleted;
     };
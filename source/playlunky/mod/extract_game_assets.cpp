@@ -5,6 +5,7 @@
 #include "detour/sigscan.h"
 #include "log.h"
 #include "util/algorithms.h"
+#include "util/profiler.h"
 
 #include <algorithm>
 #include <cassert>
@@ -30,6 +31,8 @@ std::vector<T> Read(void*& data, std::size_t size)
 
 bool ExtractGameAssets(std::span<const std::filesystem::path> files, const std::filesystem::path& destination)
 {
+    const ProfileZone profile_zone{ "ExtractGameAssets" };
+
     namespace fs = std::filesystem;
 
     if (files.empty())
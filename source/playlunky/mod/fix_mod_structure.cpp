@@ -194,7 +194,7 @@ std::optional<std::filesystem::path> GetCorrectPath(const std::filesystem::path&
     return std::nullopt;
 }
 
-void FixModFolderStructure(const std::filesystem::path& mod_folder)
+bool FixModFolderStructure(const std::filesystem::path& mod_folder)
 {
     namespace fs = std::filesystem;
     struct PathMapping
@@ -217,6 +217,7 @@ void FixModFolderStructure(const std::filesystem::path& mod_folder)
         }
     }
 
+    bool moved_files{ false };
     for (auto& [current_path, target_path] : path_mappings)
     {
         if (current_path != target_path)
@@ -230,6 +231,8 @@ void FixModFolderStructure(const std::filesystem::path& mod_folder)
             }
 
             fs::rename(current_path, target_path);
+            moved_files = true;
         }
     }
+    return moved_files;
 }
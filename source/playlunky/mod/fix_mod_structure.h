@@ -1,5 +1,9 @@
 #pragma once
 
 #include <filesystem>
+#include <optional>
 
-void FixModFolderStructure(const std::filesystem::path& mod_folder);
+// Where a file with the given name is expected to be in a mod, if it is a known file at all
+std::optional<std::filesystem::path> GetCorrectPath(const std::filesystem::path& file_path);
+// Moves known files to where they are expected, returns true if anything was moved
+bool FixModFolderStructure(const std::filesystem::path& mod_folder);
@@ -1,10 +1,23 @@
 #include "mod_database.h"
 
+#include "consolidated_mod_database.h"
 #include "util/algorithms.h"
-#include "util/on_scope_exit.h"
-
-#include <Windows.h>
+#include "util/content_hash.h"
+#include "util/file.h"
+#include "util/mapped_file.h"
+#include "util/parallel_directory_walker.h"
+#include "util/profiler.h"
+#include "util/worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <span>
 
 // Previously used magic numbers:
 //		0xF00DBAAD -- v0.3.0
@@ -24,15 +37,193 @@
 //		0xFACECA2E -- v0.13.0
 //		0x0CA4EDA1 -- v0.14.0
 //		0x0DAD2073 -- v0.14.1
-static constexpr std::uint32_t s_ModDatabaseMagicNumber{ 0x0DAD2073 };
+//		0x57A3B5E7 -- write times and sizes from directory entries
+//		0xF1A7DB01 -- flat layout that is read in place from a mapping
+//		0xF1A7DB02 -- folder fingerprints
+//		0xF1A7DB03 -- content hashes
+//		0xF1A7DB04 -- snapshot generation for the journal
+static constexpr std::uint32_t s_ModDatabaseMagicNumber{ 0xF1A7DB04 };
+static constexpr std::uint32_t s_ModJournalMagicNumber{ 0x10A7DB04 };
+
+// Below this the journal is always appended to, above it the journal may grow to half the records in the snapshot
+static constexpr std::size_t c_MinJournalRecordsBeforeCompaction{ 64 };
+
+// Layout of mod.db: the header, file records, folder records, setting records and a string table at the end
+// All records are 8-byte aligned and reference their strings by offset into the string table
+struct DbStringRef
+{
+    std::uint32_t Offset;
+    std::uint32_t Size;
+};
+struct DbHeader
+{
+    std::uint32_t MagicNumber;
+    std::uint32_t NumFiles;
+    std::uint32_t NumFolders;
+    std::uint32_t NumSettings;
+    std::uint32_t StringTableOffset;
+    std::uint32_t StringTableSize;
+    DbStringRef ModInfo;
+    std::uint64_t Generation;
+    std::uint8_t Enabled;
+    std::uint8_t Padding[7]{};
+};
+struct DbItemRecord
+{
+    DbStringRef Path;
+    std::int64_t LastWrite;
+    std::uint64_t Size;
+    std::uint64_t Fingerprint;
+    // Zero if the content was never hashed
+    std::uint64_t ContentHash;
+};
+struct DbSettingRecord
+{
+    DbStringRef Name;
+    std::uint8_t Value;
+    std::uint8_t Padding[7]{};
+};
+static_assert(sizeof(DbHeader) == 48 && sizeof(DbItemRecord) == 40 && sizeof(DbSettingRecord) == 16);
+
+// Layout of mod.journal: the header followed by records appended in the order the changes were written
+// A journal only applies to the snapshot with the same generation, a partially written record at the end is ignored
+struct DbJournalHeader
+{
+    std::uint32_t MagicNumber;
+    std::uint32_t Padding{};
+    std::uint64_t Generation;
+};
+enum class DbJournalRecordKind : std::uint8_t
+{
+    FileStamp,
+    FileDeleted,
+    FolderStamp,
+    FolderDeleted,
+    Setting,
+    Enabled,
+};
+struct DbJournalRecord
+{
+    DbJournalRecordKind Kind;
+    std::uint8_t Value;
+    std::uint8_t Padding[2]{};
+    // Position of the item or setting in the snapshot
+    std::uint32_t Index;
+    std::int64_t LastWrite;
+    std::uint64_t Size;
+    std::uint64_t Fingerprint;
+    std::uint64_t ContentHash;
+};
+static_assert(sizeof(DbJournalHeader) == 16 && sizeof(DbJournalRecord) == 40);
+
+static void WriteSnapshot(const std::filesystem::path& database_folder, std::string_view data)
+{
+    namespace fs = std::filesystem;
+
+    const fs::path db_path = database_folder / "mod.db";
+    if (!WriteFileAtomically(db_path, data))
+    {
+        LogError("Failed writing mod database '{}'...", db_path.string());
+        return;
+    }
+
+    // Has an older generation than the new snapshot now, so it would be ignored anyways
+    std::error_code error_code;
+    fs::remove(database_folder / "mod.journal", error_code);
+}
+
+ModSnapshotWriter::ModSnapshotWriter()
+    : mWriter(&ModSnapshotWriter::WriterMain, this)
+{
+}
+ModSnapshotWriter::~ModSnapshotWriter()
+{
+    // Everything that was queued is still written, the next launch relies on it
+    {
+        std::lock_guard lock{ mMutex };
+        mStopping = true;
+    }
+    mQueueChanged.notify_all();
+    mWriter.join();
+}
+
+void ModSnapshotWriter::Write(const std::filesystem::path& database_folder, std::string data)
+{
+    {
+        std::lock_guard lock{ mMutex };
+        if (SnapshotJob* queued_job = algo::find(mQueue, &SnapshotJob::DatabaseFolder, database_folder))
+        {
+            queued_job->Data = std::move(data);
+        }
+        else
+        {
+            mQueue.push_back(SnapshotJob{ database_folder, std::move(data) });
+        }
+    }
+    mQueueChanged.notify_all();
+}
+void ModSnapshotWriter::Wait(const std::filesystem::path& database_folder)
+{
+    std::unique_lock lock{ mMutex };
+    mQueueChanged.wait(lock, [this, &database_folder]()
+                       { return !HasPendingWriteLocked(database_folder); });
+}
+void ModSnapshotWriter::Join()
+{
+    std::unique_lock lock{ mMutex };
+    mQueueChanged.wait(lock, [this]()
+                       { return mQueue.empty() && !mWritingFolder.has_value(); });
+}
+
+void ModSnapshotWriter::WriterMain()
+{
+    while (true)
+    {
+        SnapshotJob job;
+        {
+            std::unique_lock lock{ mMutex };
+            mQueueChanged.wait(lock, [this]()
+                               { return mStopping || !mQueue.empty(); });
+            if (mQueue.empty())
+            {
+                return;
+            }
+
+            job = std::move(mQueue.front());
+            mQueue.pop_front();
+            mWritingFolder = job.DatabaseFolder;
+        }
+
+        WriteSnapshot(job.DatabaseFolder, job.Data);
+
+        {
+            std::lock_guard lock{ mMutex };
+            mWritingFolder.reset();
+        }
+        mQueueChanged.notify_all();
+    }
+}
 
-ModDatabase::ModDatabase(std::filesystem::path database_folder, std::filesystem::path mod_folder, ModDatabaseFlags flags)
+bool ModSnapshotWriter::HasPendingWriteLocked(const std::filesystem::path& database_folder) const
+{
+    return mWritingFolder == database_folder || algo::contains(mQueue, &SnapshotJob::DatabaseFolder, database_folder);
+}
+
+ModDatabase::ModDatabase(std::filesystem::path database_folder, std::filesystem::path mod_folder, ModDatabaseFlags flags, ConsolidatedModDatabase* consolidated_db, ModSnapshotWriter* snapshot_writer, WorkerPool* worker_pool)
     : mDatabaseFolder(std::move(database_folder))
     , mModFolder(std::move(mod_folder))
     , mFlags(flags)
+    , mConsolidatedDb(consolidated_db)
+    , mSnapshotWriter(snapshot_writer)
+    , mWorkerPool(worker_pool)
 {
     namespace fs = std::filesystem;
 
+    if (mSnapshotWriter != nullptr)
+    {
+        mSnapshotWriter->Wait(mDatabaseFolder);
+    }
+
     const bool is_global_db = algo::is_sub_path(mDatabaseFolder, mModFolder);
     if (!is_global_db)
     {
@@ -45,217 +236,141 @@ ModDatabase::ModDatabase(std::filesystem::path database_folder, std::filesystem:
 
     if (fs::exists(mDatabaseFolder) && fs::is_directory(mDatabaseFolder))
     {
-        const fs::path db_path = mDatabaseFolder / "mod.db";
-        if (fs::exists(db_path) && fs::is_regular_file(db_path))
-        {
-            std::ifstream db_file(db_path, std::ios::binary);
-
-            {
-                std::uint32_t magic_number;
-                db_file.read(reinterpret_cast<char*>(&magic_number), sizeof(magic_number));
-                if (magic_number != s_ModDatabaseMagicNumber)
-                {
-                    db_file.close();
-                    fs::remove_all(mDatabaseFolder);
-                    mWasOutdated = true;
-                    return;
-                }
-            }
-
-            db_file.read(reinterpret_cast<char*>(&mWasEnabled), sizeof(mWasEnabled));
-            mIsEnabled = mWasEnabled;
+        bool has_db{ false };
+        bool is_valid_db{ false };
 
+        if (mConsolidatedDb != nullptr)
+        {
+            if (const std::optional<std::string_view> section = mConsolidatedDb->GetSection(mDatabaseFolder))
             {
-                std::size_t num_files;
-                db_file.read(reinterpret_cast<char*>(&num_files), sizeof(num_files));
-
-                mFiles.resize(num_files);
-                for (ItemDescriptor& file : mFiles)
-                {
-                    std::size_t path_size;
-                    db_file.read(reinterpret_cast<char*>(&path_size), sizeof(path_size));
-
-                    std::string path(path_size, '\0');
-                    db_file.read(path.data(), path_size);
-
-                    std::time_t last_know_write;
-                    db_file.read(reinterpret_cast<char*>(&last_know_write), sizeof(last_know_write));
-
-                    file.Path = path;
-                    file.LastKnownWrite = last_know_write;
-                }
+                has_db = true;
+                is_valid_db = ReadDatabase(section.value());
             }
+        }
 
+        // Also picks up the previous state of mods when switching to a consolidated database
+        const fs::path db_path = mDatabaseFolder / "mod.db";
+        if (!has_db && fs::exists(db_path) && fs::is_regular_file(db_path))
+        {
+            has_db = true;
+            if (auto db_file = MappedFile::Open(db_path))
             {
-                std::size_t num_folders;
-                db_file.read(reinterpret_cast<char*>(&num_folders), sizeof(num_folders));
-
-                mFolders.resize(num_folders);
-                for (ItemDescriptor& folder : mFolders)
-                {
-                    std::size_t path_size;
-                    db_file.read(reinterpret_cast<char*>(&path_size), sizeof(path_size));
-
-                    std::string path(path_size, '\0');
-                    db_file.read(path.data(), path_size);
-
-                    std::time_t last_know_write;
-                    db_file.read(reinterpret_cast<char*>(&last_know_write), sizeof(last_know_write));
-
-                    folder.Path = path;
-                    folder.LastKnownWrite = last_know_write;
-                }
+                is_valid_db = ReadDatabase(db_file->GetData());
             }
-
+            if (is_valid_db)
             {
-                std::size_t num_settings;
-                db_file.read(reinterpret_cast<char*>(&num_settings), sizeof(num_settings));
-
-                mSettings.resize(num_settings);
-                for (AdditionalSetting& setting : mSettings)
+                if (auto journal_file = MappedFile::Open(mDatabaseFolder / "mod.journal"))
                 {
-                    std::size_t name_size;
-                    db_file.read(reinterpret_cast<char*>(&name_size), sizeof(name_size));
-
-                    std::string name(name_size, '\0');
-                    db_file.read(name.data(), name_size);
-
-                    bool value;
-                    db_file.read(reinterpret_cast<char*>(&value), sizeof(value));
-
-                    setting.Name = std::move(name);
-                    setting.Value = value;
+                    ReplayJournal(journal_file->GetData());
                 }
             }
+        }
 
+        // The mapping is closed again at this point, so the folder can be removed
+        if (has_db && !is_valid_db)
+        {
+            mFiles.clear();
+            mFolders.clear();
+            mFileIndex.clear();
+            mFolderIndex.clear();
+            mStringTable.clear();
+            mAddedPathes.clear();
+            mSettings.clear();
+            mModInfo.clear();
+            mKnownSettings.clear();
+            mKnownModInfo.clear();
+            mNumSnapshotFiles = 0;
+            mNumSnapshotFolders = 0;
+            mNumJournalRecords = 0;
+            mHasSnapshot = false;
+            mHasValidJournal = false;
+            if (mConsolidatedDb != nullptr)
             {
-                std::size_t mod_info_size;
-                db_file.read(reinterpret_cast<char*>(&mod_info_size), sizeof(mod_info_size));
-
-                mModInfo.resize(mod_info_size);
-                db_file.read(mModInfo.data(), mod_info_size);
+                mConsolidatedDb->RemoveSections(mDatabaseFolder);
             }
+            fs::remove_all(mDatabaseFolder);
+            mWasOutdated = true;
+            return;
         }
     }
 }
 ModDatabase::~ModDatabase() = default;
 
+std::vector<ModDatabase::ScannedEntries> ModDatabase::ScanModFolders(std::span<const std::filesystem::path> mod_folders, ModDatabaseFlags flags)
+{
+    const ProfileZone profile_zone{ "ModDatabase::ScanModFolders" };
+
+    const ParallelDirectoryWalker walker{};
+    return walker.Walk(
+        mod_folders,
+        [](const std::filesystem::directory_entry& entry)
+        { return entry.path().filename() != ".db"; },
+        (flags & (ModDatabaseFlags_Recurse | ModDatabaseFlags_Folders)) != 0);
+}
+
+ModDatabase::ScannedEntries ModDatabase::GetScannedSubFolder(const ScannedEntries& parent_entries, const std::filesystem::path& folder)
+{
+    // Entries are sorted by path, so everything below folder directly follows folder itself
+    auto it = std::upper_bound(parent_entries.begin(), parent_entries.end(), folder, [](const std::filesystem::path& path, const std::filesystem::directory_entry& entry)
+                               { return path < entry.path(); });
+    auto end = std::find_if(it, parent_entries.end(), [&folder](const std::filesystem::directory_entry& entry)
+                            { return !algo::is_sub_path(entry.path(), folder); });
+    return ScannedEntries(it, end);
+}
+
 void ModDatabase::UpdateDatabase()
 {
     namespace fs = std::filesystem;
     if (fs::exists(mModFolder) && fs::is_directory(mModFolder))
     {
-        static auto get_last_write_time = [](const fs::path& file_path)
-        {
-            HANDLE file = CreateFile(file_path.string().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
-            if (file != INVALID_HANDLE_VALUE)
-            {
-                OnScopeExit close_handle{ [file]()
-                                          { CloseHandle(file); } };
+        const ParallelDirectoryWalker walker{};
+        const std::vector<ScannedEntries> scanned_entries = walker.Walk(
+            std::span{ &mModFolder, 1 },
+            [this](const fs::directory_entry& entry)
+            { return !algo::is_sub_path(entry.path(), mDatabaseFolder); },
+            (mFlags & (ModDatabaseFlags_Recurse | ModDatabaseFlags_Folders)) != 0);
+        UpdateDatabase(scanned_entries.front());
+    }
+}
+void ModDatabase::UpdateDatabase(const ScannedEntries& scanned_entries)
+{
+    const ProfileZone profile_zone{ "ModDatabase::UpdateDatabase" };
 
-                FILETIME last_write_time;
-                if (GetFileTime(file, NULL, NULL, &last_write_time))
-                {
-                    SYSTEMTIME system_time;
-                    if (FileTimeToSystemTime(&last_write_time, &system_time))
-                    {
-                        std::tm tm;
-                        tm.tm_sec = system_time.wSecond;
-                        tm.tm_min = system_time.wMinute;
-                        tm.tm_hour = system_time.wHour;
-                        tm.tm_mday = system_time.wDay;
-                        tm.tm_mon = system_time.wMonth - 1;
-                        tm.tm_year = system_time.wYear - 1900;
-                        tm.tm_isdst = -1;
-                        return std::mktime(&tm);
-                    }
-                }
-            }
-            return time_t{ 0 };
-        };
+    namespace fs = std::filesystem;
 
-        auto do_iteration = [this](const fs::path& path)
-        {
-            if (algo::is_sub_path(path, mDatabaseFolder))
-            {
-                return false;
-            }
-            else
-            {
-                if (fs::is_regular_file(path) && (mFlags & ModDatabaseFlags_Files))
-                {
-                    const auto rel_file_path = fs::relative(path, mModFolder);
-
-                    const auto last_write_time = get_last_write_time(path);
-
-                    if (ItemDescriptor* existing_file = algo::find(mFiles, &ItemDescriptor::Path, rel_file_path))
-                    {
-                        existing_file->LastWrite = last_write_time;
-                    }
-                    else
-                    {
-                        mFiles.push_back(ItemDescriptor{
-                            .Path = rel_file_path,
-                            .LastWrite = last_write_time });
-                    }
-                }
-                else if (fs::is_directory(path) && (mFlags & ModDatabaseFlags_Folders))
-                {
-                    const auto rel_folder_path = fs::relative(path, mModFolder);
-
-                    auto get_last_folder_write_time = [](const fs::path& folder_path)
-                    {
-                        auto oldest_write_time = get_last_write_time(folder_path);
-                        for (auto& file_path : fs::recursive_directory_iterator(folder_path))
-                        {
-                            const auto file_write_time = get_last_write_time(file_path);
-                            oldest_write_time = std::min(oldest_write_time, file_write_time);
-                        }
-                        return oldest_write_time;
-                    };
-
-                    const auto last_write_time = get_last_folder_write_time(path);
-
-                    if (ItemDescriptor* existing_file = algo::find(mFolders, &ItemDescriptor::Path, rel_folder_path))
-                    {
-                        existing_file->LastWrite = last_write_time;
-                    }
-                    else
-                    {
-                        mFolders.push_back(ItemDescriptor{
-                            .Path = rel_folder_path,
-                            .LastWrite = last_write_time });
-                    }
-                }
-                return true;
-            }
-        };
+    // Folders are scanned recursively to compute their stamps, but without recursion only the top level becomes items
+    const bool recurse = (mFlags & ModDatabaseFlags_Recurse) != 0;
+    const FolderStamps folder_stamps = (mFlags & ModDatabaseFlags_Folders) ? GetFolderStamps(scanned_entries) : FolderStamps{};
 
-        if (mFlags & ModDatabaseFlags_Recurse)
+    for (const fs::directory_entry& entry : scanned_entries)
+    {
+        if (!recurse && entry.path().parent_path() != mModFolder)
         {
-            auto iter_recurse = [&do_iteration](const auto& path, auto& self) -> void
-            {
-                namespace fs = std::filesystem;
-                for (auto& sub_path : fs::directory_iterator(path))
-                {
-                    if (do_iteration(sub_path))
-                    {
-                        if (fs::is_directory(sub_path))
-                        {
-                            self(sub_path, self);
-                        }
-                    }
-                }
-            };
-            iter_recurse(mModFolder, iter_recurse);
+            continue;
         }
-        else
+
+        // Entries are always below the mod folder, so this does not need to touch the filesystem like fs::relative
+        std::error_code error_code;
+        if (entry.is_regular_file(error_code) && (mFlags & ModDatabaseFlags_Files))
         {
-            for (auto& path : fs::directory_iterator(mModFolder))
+            ItemDescriptor& file = FindOrAddItem(mFiles, mFileIndex, entry.path().lexically_relative(mModFolder).string());
+            file.Stamp = GetFileStamp(entry);
+
+            // Same stamp means same content, so the known hash carries over without reading the file
+            if (file.Stamp == file.LastKnownStamp)
             {
-                (void)do_iteration(path);
+                file.ContentHash = file.LastKnownContentHash;
             }
         }
+        else if (entry.is_directory(error_code) && (mFlags & ModDatabaseFlags_Folders))
+        {
+            FindOrAddItem(mFolders, mFolderIndex, entry.path().lexically_relative(mModFolder).string()).Stamp = folder_stamps.at(entry.path().native());
+        }
+    }
+
+    if ((mFlags & ModDatabaseFlags_HashContent) && (mFlags & ModDatabaseFlags_Files))
+    {
+        HashChangedFiles();
     }
 }
 void ModDatabase::WriteDatabase() const
@@ -264,6 +379,10 @@ void ModDatabase::WriteDatabase() const
 
     if (!fs::exists(mModFolder))
     {
+        if (mConsolidatedDb != nullptr)
+        {
+            mConsolidatedDb->RemoveSections(mDatabaseFolder);
+        }
         if (fs::exists(mDatabaseFolder))
         {
             fs::remove_all(mDatabaseFolder);
@@ -282,100 +401,586 @@ void ModDatabase::WriteDatabase() const
     if (fs::exists(mDatabaseFolder) && fs::is_directory(mDatabaseFolder))
     {
         const fs::path db_path = mDatabaseFolder / "mod.db";
-        if (fs::exists(db_path))
+        const fs::path journal_path = mDatabaseFolder / "mod.journal";
+        if (mConsolidatedDb != nullptr)
         {
-            fs::remove_all(db_path);
+            mConsolidatedDb->SetSection(mDatabaseFolder, SerializeDatabase(mGeneration));
+
+            // A leftover file would be read again if the consolidated database is turned off
+            std::error_code error_code;
+            fs::remove(db_path, error_code);
+            fs::remove(journal_path, error_code);
+            return;
         }
 
-        std::ofstream db_file(db_path, std::ios::binary);
-        db_file.write(reinterpret_cast<const char*>(&s_ModDatabaseMagicNumber), sizeof(s_ModDatabaseMagicNumber));
-        db_file.write(reinterpret_cast<const char*>(&mIsEnabled), sizeof(mIsEnabled));
+        // Usually only a few items changed, appending those is a lot cheaper than writing the whole database
+        const std::optional<std::string> journal_records{ SerializeJournalRecords() };
+        if (journal_records.has_value())
+        {
+            const std::size_t num_records{ mNumJournalRecords + journal_records->size() / sizeof(DbJournalRecord) };
+            const std::size_t max_records{ std::max(c_MinJournalRecordsBeforeCompaction, (mNumSnapshotFiles + mNumSnapshotFolders + mKnownSettings.size()) / 2) };
+            if (num_records <= max_records && AppendJournal(journal_path, journal_records.value()))
+            {
+                return;
+            }
+        }
 
-        if (mFlags & ModDatabaseFlags_Files)
+        // A newer generation than any journal that may still be lying around, which invalidates it even if it can't be removed
+        const std::uint64_t now{ static_cast<std::uint64_t>(std::chrono::system_clock::now().time_since_epoch().count()) };
+        const std::uint64_t generation{ std::max(mGeneration + 1, now) };
+        if (mSnapshotWriter != nullptr)
+        {
+            mSnapshotWriter->Write(mDatabaseFolder, SerializeDatabase(generation));
+        }
+        else
         {
-            const std::size_t num_files = algo::count_if(mFiles, [](const auto& file)
-                                                         { return file.Exists(); });
-            db_file.write(reinterpret_cast<const char*>(&num_files), sizeof(num_files));
+            WriteSnapshot(mDatabaseFolder, SerializeDatabase(generation));
+        }
+    }
+}
 
-            for (const ItemDescriptor& file : mFiles)
-            {
-                if (file.Exists())
-                {
-                    const std::string path_string = file.Path.string();
-                    const std::size_t path_size = path_string.size();
-                    db_file.write(reinterpret_cast<const char*>(&path_size), sizeof(path_size));
-                    db_file.write(path_string.data(), path_string.size());
+bool ModDatabase::GetAdditionalSetting(std::string_view name, bool default_value) const
+{
+    if (auto it = mSettings.find(name); it != mSettings.end())
+    {
+        return it->second;
+    }
+    return default_value;
+}
+void ModDatabase::SetAdditionalSetting(std::string_view name, bool value)
+{
+    if (auto it = mSettings.find(name); it != mSettings.end())
+    {
+        it->second = value;
+        return;
+    }
+    mSettings.emplace(std::string{ name }, value);
+}
 
-                    const std::time_t last_write_time = file.LastWrite.value();
-                    db_file.write(reinterpret_cast<const char*>(&last_write_time), sizeof(last_write_time));
-                }
+bool ModDatabase::ReadDatabase(std::string_view data)
+{
+    DbHeader header;
+    if (data.size() < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.MagicNumber != s_ModDatabaseMagicNumber)
+    {
+        return false;
+    }
+
+    const std::uint64_t num_items{ std::uint64_t{ header.NumFiles } + header.NumFolders };
+    const std::uint64_t records_end{ sizeof(DbHeader) + num_items * sizeof(DbItemRecord) + std::uint64_t{ header.NumSettings } * sizeof(DbSettingRecord) };
+    if (records_end > header.StringTableOffset || std::uint64_t{ header.StringTableOffset } + header.StringTableSize > data.size())
+    {
+        return false;
+    }
+
+    // Records are read in place, the layout guarantees they are aligned
+    const auto* file_records = reinterpret_cast<const DbItemRecord*>(data.data() + sizeof(DbHeader));
+    const auto* folder_records = file_records + header.NumFiles;
+    const auto* setting_records = reinterpret_cast<const DbSettingRecord*>(folder_records + header.NumFolders);
+
+    // Items point into the string table, it is copied once as a whole since the data is unmapped or replaced again soon
+    mStringTable.assign(data.substr(header.StringTableOffset, header.StringTableSize));
+    const std::string_view string_table{ mStringTable };
+
+    auto get_string = [&string_table](DbStringRef string) -> std::optional<std::string_view>
+    {
+        if (std::uint64_t{ string.Offset } + string.Size > string_table.size())
+        {
+            return std::nullopt;
+        }
+        return string_table.substr(string.Offset, string.Size);
+    };
+    auto read_items = [&get_string](std::span<const DbItemRecord> records, std::vector<ItemDescriptor>& items, ItemIndex& index)
+    {
+        items.reserve(records.size());
+        for (const DbItemRecord& record : records)
+        {
+            const std::optional<std::string_view> path{ get_string(record.Path) };
+            if (!path.has_value())
+            {
+                return false;
             }
+
+            ItemDescriptor& item = items.emplace_back(ItemDescriptor{
+                .Path = path.value(),
+                .LastKnownStamp = ItemStamp{ .LastWrite = record.LastWrite, .Size = record.Size, .Fingerprint = record.Fingerprint },
+                .LastKnownContentHash = record.ContentHash != 0 ? std::optional{ record.ContentHash } : std::nullopt,
+            });
+            index.emplace(item.Path, items.size() - 1);
+        }
+        return true;
+    };
+
+    if (!read_items({ file_records, header.NumFiles }, mFiles, mFileIndex) ||
+        !read_items({ folder_records, header.NumFolders }, mFolders, mFolderIndex))
+    {
+        return false;
+    }
+
+    for (const DbSettingRecord& record : std::span{ setting_records, header.NumSettings })
+    {
+        const std::optional<std::string_view> name{ get_string(record.Name) };
+        if (!name.has_value())
+        {
+            return false;
+        }
+        mSettings.insert_or_assign(std::string{ name.value() }, record.Value != 0);
+    }
+
+    const std::optional<std::string_view> mod_info{ get_string(header.ModInfo) };
+    if (!mod_info.has_value())
+    {
+        return false;
+    }
+    mModInfo = mod_info.value();
+
+    mWasEnabled = header.Enabled != 0;
+    mIsEnabled = mWasEnabled;
+
+    mGeneration = header.Generation;
+    mNumSnapshotFiles = header.NumFiles;
+    mNumSnapshotFolders = header.NumFolders;
+    mKnownSettings.assign(mSettings.begin(), mSettings.end());
+    mKnownModInfo = mModInfo;
+    mHasSnapshot = true;
+    return true;
+}
+void ModDatabase::ReplayJournal(std::string_view data)
+{
+    DbJournalHeader header;
+    if (data.size() < sizeof(header))
+    {
+        return;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.MagicNumber != s_ModJournalMagicNumber || header.Generation != mGeneration)
+    {
+        return;
+    }
+
+    const std::string_view records_data{ data.substr(sizeof(header)) };
+    const std::size_t num_records{ records_data.size() / sizeof(DbJournalRecord) };
+    mHasValidJournal = true;
+
+    // Appending after a torn record would misalign everything that follows, so the journal has to be folded into a new snapshot
+    mNeedsCompaction = records_data.size() % sizeof(DbJournalRecord) != 0;
+
+    auto replay_item = [](const DbJournalRecord& record, std::vector<ItemDescriptor>& items, std::size_t num_snapshot_items, bool deleted)
+    {
+        if (record.Index >= num_snapshot_items)
+        {
+            return false;
+        }
+
+        ItemDescriptor& item = items[record.Index];
+        if (deleted)
+        {
+            item.LastKnownStamp = std::nullopt;
+            item.LastKnownContentHash = std::nullopt;
         }
         else
         {
-            const std::size_t num_files = 0;
-            db_file.write(reinterpret_cast<const char*>(&num_files), sizeof(num_files));
+            item.LastKnownStamp = ItemStamp{ .LastWrite = record.LastWrite, .Size = record.Size, .Fingerprint = record.Fingerprint };
+            item.LastKnownContentHash = record.ContentHash != 0 ? std::optional{ record.ContentHash } : std::nullopt;
+        }
+        return true;
+    };
+
+    for (std::size_t i = 0; i < num_records; i++)
+    {
+        DbJournalRecord record;
+        std::memcpy(&record, records_data.data() + i * sizeof(record), sizeof(record));
+
+        bool is_valid_record{ false };
+        switch (record.Kind)
+        {
+        case DbJournalRecordKind::FileStamp:
+        case DbJournalRecordKind::FileDeleted:
+            is_valid_record = replay_item(record, mFiles, mNumSnapshotFiles, record.Kind == DbJournalRecordKind::FileDeleted);
+            break;
+        case DbJournalRecordKind::FolderStamp:
+        case DbJournalRecordKind::FolderDeleted:
+            is_valid_record = replay_item(record, mFolders, mNumSnapshotFolders, record.Kind == DbJournalRecordKind::FolderDeleted);
+            break;
+        case DbJournalRecordKind::Setting:
+            if (record.Index < mKnownSettings.size())
+            {
+                auto& [name, value] = mKnownSettings[record.Index];
+                value = record.Value != 0;
+                mSettings.insert_or_assign(name, value);
+                is_valid_record = true;
+            }
+            break;
+        case DbJournalRecordKind::Enabled:
+            mWasEnabled = record.Value != 0;
+            mIsEnabled = mWasEnabled;
+            is_valid_record = true;
+            break;
+        }
+
+        // Everything up to here was written by a consistent state, the rest is dropped with the next snapshot
+        if (!is_valid_record)
+        {
+            mNeedsCompaction = true;
+            break;
         }
+        mNumJournalRecords++;
+    }
+}
+std::string ModDatabase::SerializeDatabase(std::uint64_t generation) const
+{
+    std::vector<DbItemRecord> file_records;
+    std::vector<DbItemRecord> folder_records;
+    std::vector<DbSettingRecord> setting_records;
+    std::string string_table;
 
-        if (mFlags & ModDatabaseFlags_Folders)
+    auto add_string = [&string_table](std::string_view string)
+    {
+        const DbStringRef string_ref{ .Offset = static_cast<std::uint32_t>(string_table.size()), .Size = static_cast<std::uint32_t>(string.size()) };
+        string_table.append(string);
+        return string_ref;
+    };
+    auto write_items = [&add_string](const std::vector<ItemDescriptor>& items, std::vector<DbItemRecord>& records)
+    {
+        for (const ItemDescriptor& item : items)
         {
-            const std::size_t num_folders = algo::count_if(mFolders, [](const auto& folder)
-                                                           { return folder.Exists(); });
-            db_file.write(reinterpret_cast<const char*>(&num_folders), sizeof(num_folders));
+            if (item.Exists())
+            {
+                const ItemStamp& stamp = item.Stamp.value();
+                records.push_back(DbItemRecord{
+                    .Path = add_string(item.Path),
+                    .LastWrite = stamp.LastWrite,
+                    .Size = stamp.Size,
+                    .Fingerprint = stamp.Fingerprint,
+                    .ContentHash = item.ContentHash.value_or(0),
+                });
+            }
+        }
+    };
+
+    if (mFlags & ModDatabaseFlags_Files)
+    {
+        write_items(mFiles, file_records);
+    }
+    if (mFlags & ModDatabaseFlags_Folders)
+    {
+        write_items(mFolders, folder_records);
+    }
+    for (const auto& [name, value] : mSettings)
+    {
+        setting_records.push_back(DbSettingRecord{
+            .Name = add_string(name),
+            .Value = static_cast<std::uint8_t>(value ? 1 : 0),
+        });
+    }
+
+    const DbStringRef mod_info{ add_string(mModInfo) };
+
+    const std::size_t file_records_size{ file_records.size() * sizeof(DbItemRecord) };
+    const std::size_t folder_records_size{ folder_records.size() * sizeof(DbItemRecord) };
+    const std::size_t setting_records_size{ setting_records.size() * sizeof(DbSettingRecord) };
+
+    const DbHeader header{
+        .MagicNumber = s_ModDatabaseMagicNumber,
+        .NumFiles = static_cast<std::uint32_t>(file_records.size()),
+        .NumFolders = static_cast<std::uint32_t>(folder_records.size()),
+        .NumSettings = static_cast<std::uint32_t>(setting_records.size()),
+        .StringTableOffset = static_cast<std::uint32_t>(sizeof(DbHeader) + file_records_size + folder_records_size + setting_records_size),
+        .StringTableSize = static_cast<std::uint32_t>(string_table.size()),
+        .ModInfo = mod_info,
+        .Generation = generation,
+        .Enabled = static_cast<std::uint8_t>(mIsEnabled ? 1 : 0),
+    };
+
+    // Assembled in one buffer so the file is written with a single write
+    std::string data;
+    data.reserve(header.StringTableOffset + string_table.size());
+    data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    data.append(reinterpret_cast<const char*>(file_records.data()), file_records_size);
+    data.append(reinterpret_cast<const char*>(folder_records.data()), folder_records_size);
+    data.append(reinterpret_cast<const char*>(setting_records.data()), setting_records_size);
+    data.append(string_table);
+    return data;
+}
+std::optional<std::string> ModDatabase::SerializeJournalRecords() const
+{
+    if (!mHasSnapshot || mNeedsCompaction || mModInfo != mKnownModInfo)
+    {
+        return std::nullopt;
+    }
 
-            for (const ItemDescriptor& folder : mFolders)
+    std::vector<DbJournalRecord> records;
+    auto add_item_records = [&records](const std::vector<ItemDescriptor>& items, std::size_t num_snapshot_items, DbJournalRecordKind stamp_kind, DbJournalRecordKind deleted_kind)
+    {
+        for (std::size_t i = 0; i < items.size(); i++)
+        {
+            const ItemDescriptor& item = items[i];
+            if (i >= num_snapshot_items)
             {
-                if (folder.Exists())
+                // New items have a path, which doesn't fit into a record
+                if (item.Exists())
                 {
-                    const std::string path_string = folder.Path.string();
-                    const std::size_t path_size = path_string.size();
-                    db_file.write(reinterpret_cast<const char*>(&path_size), sizeof(path_size));
-                    db_file.write(path_string.data(), path_string.size());
+                    return false;
+                }
+                continue;
+            }
 
-                    const std::time_t last_write_time = folder.LastWrite.value();
-                    db_file.write(reinterpret_cast<const char*>(&last_write_time), sizeof(last_write_time));
+            if (item.Exists())
+            {
+                const ItemStamp& stamp = item.Stamp.value();
+                if (item.LastKnownStamp != stamp || item.LastKnownContentHash != item.ContentHash)
+                {
+                    records.push_back(DbJournalRecord{
+                        .Kind = stamp_kind,
+                        .Value = 0,
+                        .Index = static_cast<std::uint32_t>(i),
+                        .LastWrite = stamp.LastWrite,
+                        .Size = stamp.Size,
+                        .Fingerprint = stamp.Fingerprint,
+                        .ContentHash = item.ContentHash.value_or(0),
+                    });
                 }
             }
+            else if (item.Existed())
+            {
+                records.push_back(DbJournalRecord{
+                    .Kind = deleted_kind,
+                    .Value = 0,
+                    .Index = static_cast<std::uint32_t>(i),
+                    .LastWrite = 0,
+                    .Size = 0,
+                    .Fingerprint = 0,
+                    .ContentHash = 0,
+                });
+            }
         }
-        else
+        return true;
+    };
+
+    if ((mFlags & ModDatabaseFlags_Files) && !add_item_records(mFiles, mNumSnapshotFiles, DbJournalRecordKind::FileStamp, DbJournalRecordKind::FileDeleted))
+    {
+        return std::nullopt;
+    }
+    if ((mFlags & ModDatabaseFlags_Folders) && !add_item_records(mFolders, mNumSnapshotFolders, DbJournalRecordKind::FolderStamp, DbJournalRecordKind::FolderDeleted))
+    {
+        return std::nullopt;
+    }
+
+    if (mSettings.size() != mKnownSettings.size())
+    {
+        return std::nullopt;
+    }
+    for (std::size_t i = 0; i < mKnownSettings.size(); i++)
+    {
+        const auto& [name, known_value] = mKnownSettings[i];
+        const bool value{ GetAdditionalSetting(name, known_value) };
+        if (value != known_value)
         {
-            const std::size_t num_folders = 0;
-            db_file.write(reinterpret_cast<const char*>(&num_folders), sizeof(num_folders));
+            records.push_back(DbJournalRecord{
+                .Kind = DbJournalRecordKind::Setting,
+                .Value = static_cast<std::uint8_t>(value ? 1 : 0),
+                .Index = static_cast<std::uint32_t>(i),
+                .LastWrite = 0,
+                .Size = 0,
+                .Fingerprint = 0,
+                .ContentHash = 0,
+            });
         }
+    }
 
-        const std::size_t num_settings = mSettings.size();
-        db_file.write(reinterpret_cast<const char*>(&num_settings), sizeof(num_settings));
-        for (const AdditionalSetting& setting : mSettings)
-        {
-            const std::size_t name_size = setting.Name.size();
-            db_file.write(reinterpret_cast<const char*>(&name_size), sizeof(name_size));
-            db_file.write(setting.Name.data(), setting.Name.size());
+    if (mIsEnabled != mWasEnabled)
+    {
+        records.push_back(DbJournalRecord{
+            .Kind = DbJournalRecordKind::Enabled,
+            .Value = static_cast<std::uint8_t>(mIsEnabled ? 1 : 0),
+            .Index = 0,
+            .LastWrite = 0,
+            .Size = 0,
+            .Fingerprint = 0,
+            .ContentHash = 0,
+        });
+    }
+
+    return std::string{ reinterpret_cast<const char*>(records.data()), records.size() * sizeof(DbJournalRecord) };
+}
+bool ModDatabase::AppendJournal(const std::filesystem::path& journal_path, std::string_view records) const
+{
+    if (records.empty())
+    {
+        return true;
+    }
+
+    // A missing or stale journal is started over, everything in it is already part of the snapshot or doesn't belong to it
+    const auto open_mode = mHasValidJournal ? std::ios::app | std::ios::binary : std::ios::trunc | std::ios::binary;
+    auto journal_file = std::ofstream{ journal_path, open_mode };
+    if (!journal_file)
+    {
+        return false;
+    }
+
+    if (!mHasValidJournal)
+    {
+        const DbJournalHeader header{
+            .MagicNumber = s_ModJournalMagicNumber,
+            .Generation = mGeneration,
+        };
+        journal_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    journal_file.write(records.data(), records.size());
+    journal_file.flush();
+    return static_cast<bool>(journal_file);
+}
+
+ModDatabase::ItemStamp ModDatabase::GetFileStamp(const std::filesystem::directory_entry& file)
+{
+    // The directory iterator already fetched these, on Windows neither call touches the file itself
+    std::error_code error_code;
+    const auto last_write_time = file.last_write_time(error_code);
+    const std::int64_t last_write = error_code ? 0 : static_cast<std::int64_t>(last_write_time.time_since_epoch().count());
+    const std::uintmax_t file_size = file.is_regular_file(error_code) ? file.file_size(error_code) : 0;
+    return ItemStamp{
+        .LastWrite = last_write,
+        .Size = error_code ? 0 : static_cast<std::uint64_t>(file_size),
+    };
+}
+ModDatabase::FolderStamps ModDatabase::GetFolderStamps(const ScannedEntries& scanned_entries)
+{
+    namespace fs = std::filesystem;
 
-            db_file.write(reinterpret_cast<const char*>(&setting.Value), sizeof(setting.Value));
+    auto hash_bytes = [](std::uint64_t hash, const void* data, std::size_t size)
+    {
+        // 64-bit FNV-1a
+        const auto* bytes = static_cast<const std::uint8_t*>(data);
+        for (std::size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ bytes[i]) * 0x100000001b3;
         }
+        return hash;
+    };
+
+    struct FolderContents
+    {
+        std::uint64_t Fingerprint{ 0xcbf29ce484222325 };
+        std::int64_t LastWrite{ std::numeric_limits<std::int64_t>::min() };
+        std::uint64_t Size{ 0 };
+    };
+    std::unordered_map<fs::path::string_type, FolderContents> folder_contents;
+
+    FolderStamps folder_stamps;
+
+    // Entries are sorted by path, so walking them backwards visits everything inside a folder before the folder itself
+    for (auto it = scanned_entries.rbegin(); it != scanned_entries.rend(); ++it)
+    {
+        const fs::directory_entry& entry = *it;
+        const fs::path& path = entry.path();
+
+        ItemStamp stamp = GetFileStamp(entry);
 
+        std::error_code error_code;
+        if (entry.is_directory(error_code))
         {
-            std::size_t mod_info_size = mModInfo.size();
-            db_file.write(reinterpret_cast<char*>(&mod_info_size), sizeof(mod_info_size));
-            db_file.write(mModInfo.data(), mod_info_size);
+            FolderContents contents{};
+            if (auto contents_it = folder_contents.find(path.native()); contents_it != folder_contents.end())
+            {
+                contents = contents_it->second;
+                folder_contents.erase(contents_it);
+            }
+
+            stamp = ItemStamp{
+                .LastWrite = std::max(stamp.LastWrite, contents.LastWrite),
+                .Size = contents.Size,
+                .Fingerprint = contents.Fingerprint,
+            };
+            folder_stamps.emplace(path.native(), stamp);
         }
+
+        FolderContents& parent_contents = folder_contents[path.parent_path().native()];
+        const fs::path file_name = path.filename();
+        parent_contents.Fingerprint = hash_bytes(parent_contents.Fingerprint, file_name.c_str(), file_name.native().size() * sizeof(fs::path::value_type));
+        parent_contents.Fingerprint = hash_bytes(parent_contents.Fingerprint, &stamp, sizeof(stamp));
+        parent_contents.LastWrite = std::max(parent_contents.LastWrite, stamp.LastWrite);
+        parent_contents.Size += stamp.Size;
     }
+
+    return folder_stamps;
 }
 
-bool ModDatabase::GetAdditionalSetting(std::string_view name, bool default_value) const
+void ModDatabase::HashChangedFiles()
 {
-    if (const AdditionalSetting* setting = algo::find(mSettings, &AdditionalSetting::Name, name))
+    std::vector<ItemDescriptor*> files_to_hash;
+    for (ItemDescriptor& file : mFiles)
     {
-        return setting->Value;
+        if (file.Exists() && !file.ContentHash.has_value())
+        {
+            files_to_hash.push_back(&file);
+        }
+    }
+    if (files_to_hash.empty())
+    {
+        return;
+    }
+
+    // Each file is hashed by exactly one thread, so the items can be written to without locking
+    // Jobs on the pool may start only after all files were hashed, so they share the state and never touch a file then
+    struct HashState
+    {
+        std::vector<ItemDescriptor*> Files;
+        std::atomic_size_t NextFile{ 0 };
+        std::atomic_size_t NumHashed{ 0 };
+    };
+    const auto state = std::make_shared<HashState>();
+    state->Files = files_to_hash;
+
+    auto hash_files = [mod_folder = &mModFolder, state]()
+    {
+        const std::size_t num_files{ state->Files.size() };
+        for (std::size_t i = state->NextFile++; i < num_files; i = state->NextFile++)
+        {
+            ItemDescriptor& file = *state->Files[i];
+            file.ContentHash = HashFileContent(*mod_folder / std::filesystem::path{ file.Path });
+            if (++state->NumHashed == num_files)
+            {
+                state->NumHashed.notify_all();
+            }
+        }
+    };
+
+    if (mWorkerPool != nullptr)
+    {
+        const std::size_t num_helpers{ std::min(mWorkerPool->GetNumThreads(), state->Files.size() - 1) };
+        for (std::size_t i = 0; i < num_helpers; i++)
+        {
+            mWorkerPool->Submit(hash_files);
+        }
+    }
+    hash_files();
+
+    // Only waits for files that were picked up by the pool and are still being hashed
+    for (std::size_t num_hashed = state->NumHashed.load(); num_hashed < state->Files.size(); num_hashed = state->NumHashed.load())
+    {
+        state->NumHashed.wait(num_hashed);
+    }
+
+    const std::size_t num_unchanged = std::count_if(files_to_hash.begin(), files_to_hash.end(), [](const ItemDescriptor* file)
+                                                    { return file->Existed() && file->IsContentUnchanged(); });
+    if (num_unchanged > 0)
+    {
+        LogInfo("{} files in '{}' were touched but their content did not change...", num_unchanged, mModFolder.filename().string());
     }
-    return default_value;
 }
-void ModDatabase::SetAdditionalSetting(std::string_view name, bool value)
+
+ModDatabase::ItemDescriptor& ModDatabase::FindOrAddItem(std::vector<ItemDescriptor>& items, ItemIndex& index, std::string rel_path)
 {
-    if (AdditionalSetting* setting = algo::find(mSettings, &AdditionalSetting::Name, name))
+    if (auto it = index.find(NormalizedPathView{ rel_path }); it != index.end())
     {
-        setting->Value = value;
-        return;
+        return items[it->second];
     }
-    mSettings.push_back(AdditionalSetting{ .Name{ std::string{ name } }, .Value{ value } });
+
+    const std::string_view path{ mAddedPathes.emplace_back(std::move(rel_path)) };
+    index.emplace(path, items.size());
+    return items.emplace_back(ItemDescriptor{ .Path = path });
 }
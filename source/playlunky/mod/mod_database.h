@@ -1,24 +1,88 @@
 #pragma once
 
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <map>
+#include <mutex>
 #include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "log.h"
+#include "util/normalized_path.h"
+
+class ConsolidatedModDatabase;
+class WorkerPool;
+
+// Writes new mod.db snapshots on a background thread in the order they were requested
+// A snapshot that is still queued is replaced by a newer one for the same folder, so each folder is written at most once per batch
+// Has to outlive every database writing through it, its owner joins it before anything it depends on is torn down
+class ModSnapshotWriter
+{
+  public:
+    ModSnapshotWriter();
+    ~ModSnapshotWriter();
+
+    ModSnapshotWriter(const ModSnapshotWriter&) = delete;
+    ModSnapshotWriter(ModSnapshotWriter&&) = delete;
+    ModSnapshotWriter& operator=(const ModSnapshotWriter&) = delete;
+    ModSnapshotWriter& operator=(ModSnapshotWriter&&) = delete;
+
+    void Write(const std::filesystem::path& database_folder, std::string data);
+    // Waits until the last snapshot requested for this folder is on disk
+    void Wait(const std::filesystem::path& database_folder);
+    // Waits for all pending writes
+    void Join();
+
+  private:
+    struct SnapshotJob
+    {
+        std::filesystem::path DatabaseFolder;
+        std::string Data;
+    };
+
+    void WriterMain();
+    bool HasPendingWriteLocked(const std::filesystem::path& database_folder) const;
+
+    std::mutex mMutex;
+    std::condition_variable mQueueChanged;
+    std::deque<SnapshotJob> mQueue;
+    std::optional<std::filesystem::path> mWritingFolder;
+    bool mStopping{ false };
+
+    std::thread mWriter;
+};
 
 using ModDatabaseFlagsInt = std::int8_t;
 enum ModDatabaseFlags : ModDatabaseFlagsInt
 {
     ModDatabaseFlags_Files = 1 << 0,
     ModDatabaseFlags_Folders = 1 << 1,
-    ModDatabaseFlags_Recurse = 1 << 2
+    ModDatabaseFlags_Recurse = 1 << 2,
+    // Files with a new stamp are hashed, those whose content did not change are not reported as outdated
+    ModDatabaseFlags_HashContent = 1 << 3
 };
 
 class ModDatabase
 {
   public:
-    ModDatabase(std::filesystem::path database_folder, std::filesystem::path mod_folder, ModDatabaseFlags flags);
+    // With a consolidated database the state is kept in its section for database_folder instead of a mod.db inside that folder
+    // Without a snapshot writer new snapshots are written before WriteDatabase returns
+    // With a worker pool its idle threads help hashing changed files, the calling thread hashes either way
+    ModDatabase(std::filesystem::path database_folder, std::filesystem::path mod_folder, ModDatabaseFlags flags, ConsolidatedModDatabase* consolidated_db = nullptr, ModSnapshotWriter* snapshot_writer = nullptr, WorkerPool* worker_pool = nullptr);
     ~ModDatabase();
 
+    // Items refer to pathes stored in the database itself
+    ModDatabase(const ModDatabase&) = delete;
+    ModDatabase(ModDatabase&&) = delete;
+    ModDatabase& operator=(const ModDatabase&) = delete;
+    ModDatabase& operator=(ModDatabase&&) = delete;
+
     void SetEnabled(bool enabled)
     {
         mIsEnabled = enabled;
@@ -46,7 +110,15 @@ class ModDatabase
         return mModInfo;
     }
 
+    // Entries found below a mod folder, sorted by path
+    using ScannedEntries = std::vector<std::filesystem::directory_entry>;
+    // Walks all mod folders concurrently, pass each result to UpdateDatabase of the database for that folder
+    static std::vector<ScannedEntries> ScanModFolders(std::span<const std::filesystem::path> mod_folders, ModDatabaseFlags flags);
+    // Entries below folder taken from a recursive scan of one of its parents, same as scanning folder itself
+    static ScannedEntries GetScannedSubFolder(const ScannedEntries& parent_entries, const std::filesystem::path& folder);
+
     void UpdateDatabase();
+    void UpdateDatabase(const ScannedEntries& scanned_entries);
     void WriteDatabase() const;
 
     bool GetAdditionalSetting(std::string_view name, bool default_value) const;
@@ -63,7 +135,7 @@ class ModDatabase
         {
             const bool outdated = file.IsNew() || file.IsChanged();
             const bool deleted = file.IsDeleted();
-            fun(file.Path, outdated, deleted, new_enabled_state);
+            fun(std::filesystem::path{ file.Path }, outdated, deleted, new_enabled_state);
         }
     }
 
@@ -78,28 +150,64 @@ class ModDatabase
         {
             const bool outdated = folder.IsNew() || folder.IsChanged();
             const bool deleted = folder.IsDeleted();
-            fun(folder.Path, outdated, deleted, new_enabled_state);
+            fun(std::filesystem::path{ folder.Path }, outdated, deleted, new_enabled_state);
         }
     }
 
   private:
+    // Returns false if data is not a valid database of the current version
+    bool ReadDatabase(std::string_view data);
+    std::string SerializeDatabase(std::uint64_t generation) const;
+
+    // The journal next to mod.db holds fixed-size records of everything that changed since that snapshot was written
+    // Records refer to items and settings by their position in the snapshot, anything else requires writing a new snapshot
+    void ReplayJournal(std::string_view data);
+    // Returns nullopt if the changes since the last write can't be expressed as journal records
+    std::optional<std::string> SerializeJournalRecords() const;
+    bool AppendJournal(const std::filesystem::path& journal_path, std::string_view records) const;
+
     const std::filesystem::path mDatabaseFolder;
     const std::filesystem::path mModFolder;
     const ModDatabaseFlags mFlags;
+    ConsolidatedModDatabase* const mConsolidatedDb;
+    ModSnapshotWriter* const mSnapshotWriter;
+    WorkerPool* const mWorkerPool;
+
+    // Taken from the directory entry, so scanning never has to open a file
+    // Write time is in ticks of std::filesystem::file_time_type, for folders it is the newest one and size the sum of everything inside
+    // Folders also get a fingerprint rolled up from the name and stamp of everything inside, so any change below them changes it
+    struct ItemStamp
+    {
+        std::int64_t LastWrite;
+        std::uint64_t Size;
+        std::uint64_t Fingerprint{ 0 };
+
+        bool operator==(const ItemStamp&) const = default;
+    };
+    static ItemStamp GetFileStamp(const std::filesystem::directory_entry& file);
+    // Stamps of all folders in the scanned entries, computed bottom-up in one pass over them
+    using FolderStamps = std::unordered_map<std::filesystem::path::string_type, ItemStamp>;
+    static FolderStamps GetFolderStamps(const ScannedEntries& scanned_entries);
+
+    // Hashes all existing files that don't have a hash for their current stamp yet
+    void HashChangedFiles();
 
     struct ItemDescriptor
     {
-        std::filesystem::path Path{};
-        std::optional<std::time_t> LastKnownWrite{ std::nullopt };
-        std::optional<std::time_t> LastWrite{ std::nullopt };
+        // Relative path as it was scanned or read, points into mStringTable or mAddedPathes
+        std::string_view Path{};
+        std::optional<ItemStamp> LastKnownStamp{ std::nullopt };
+        std::optional<ItemStamp> Stamp{ std::nullopt };
+        std::optional<std::uint64_t> LastKnownContentHash{ std::nullopt };
+        std::optional<std::uint64_t> ContentHash{ std::nullopt };
 
         bool Exists() const
         {
-            return LastWrite.has_value();
+            return Stamp.has_value();
         }
         bool Existed() const
         {
-            return LastKnownWrite.has_value();
+            return LastKnownStamp.has_value();
         }
         bool IsNew() const
         {
@@ -107,22 +215,43 @@ class ModDatabase
         }
         bool IsChanged() const
         {
-            return Exists() && Existed() && LastKnownWrite.value() < LastWrite.value();
+            return Exists() && Existed() && LastKnownStamp.value() != Stamp.value() && !IsContentUnchanged();
+        }
+        bool IsContentUnchanged() const
+        {
+            return LastKnownContentHash.has_value() && LastKnownContentHash == ContentHash;
         }
         bool IsDeleted() const
         {
             return Existed() && !Exists();
         }
     };
+    // Items keep the order they were first seen in, the index maps their path to their position
+    // Pathes are hashed and compared normalized, so they are found no matter their separators or case
+    using ItemIndex = std::unordered_map<std::string_view, std::size_t, NormalizedPathHash, NormalizedPathEqual>;
+    ItemDescriptor& FindOrAddItem(std::vector<ItemDescriptor>& items, ItemIndex& index, std::string rel_path);
+
     std::vector<ItemDescriptor> mFiles;
     std::vector<ItemDescriptor> mFolders;
+    ItemIndex mFileIndex;
+    ItemIndex mFolderIndex;
 
-    struct AdditionalSetting
-    {
-        std::string Name;
-        bool Value;
-    };
-    std::vector<AdditionalSetting> mSettings;
+    // The string table of the snapshot is copied as a whole, pathes of items added since are stored one by one
+    std::string mStringTable;
+    std::deque<std::string> mAddedPathes;
+
+    std::map<std::string, bool, std::less<>> mSettings;
+
+    // State of the snapshot with the journal applied, which is what the next write has to be compared against
+    std::uint64_t mGeneration{ 0 };
+    std::size_t mNumSnapshotFiles{ 0 };
+    std::size_t mNumSnapshotFolders{ 0 };
+    std::vector<std::pair<std::string, bool>> mKnownSettings;
+    std::string mKnownModInfo;
+    std::size_t mNumJournalRecords{ 0 };
+    bool mHasSnapshot{ false };
+    bool mHasValidJournal{ false };
+    bool mNeedsCompaction{ false };
 
     bool mWasEnabled{ false };
     bool mIsEnabled{ true };
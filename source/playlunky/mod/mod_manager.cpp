@@ -2,8 +2,11 @@
 
 #include "bug_fixes.h"
 #include "cache_audio_file.h"
+#include "consolidated_mod_database.h"
+#include "content_store.h"
 #include "dds_conversion.h"
 #include "decode_audio_file.h"
+#include "derived_asset_graph.h"
 #include "dm_preview_merger.h"
 #include "extract_game_assets.h"
 #include "fix_mod_structure.h"
@@ -26,8 +29,12 @@
 
 #include "log.h"
 #include "util/algorithms.h"
+#include "util/deferred_work.h"
 #include "util/function_pointer.h"
+#include "util/normalized_path.h"
+#include "util/profiler.h"
 #include "util/regex.h"
+#include "util/worker_pool.h"
 
 #include "detour/imgui.h"
 
@@ -36,7 +43,9 @@
 #include <Windows.h>
 #include <filesystem>
 #include <fstream>
+#include <limits>
 #include <map>
+#include <span>
 #include <unordered_map>
 #include <zip.h>
 
@@ -46,16 +55,35 @@ static constexpr ctll::fixed_string s_LuminosityTextureRule{ ".*_lumin\\.(dds|bm
 static constexpr ctll::fixed_string s_StringFileRule{ "strings([0-9]{2})\\.str" };
 static constexpr ctll::fixed_string s_StringModFileRule{ "strings([0-9]{2})_mod\\.str" };
 
+// Deferred work the game is likely to ask for first runs first, soundbanks are loaded before the title screen
+static constexpr std::int32_t s_CachedAudioPriority{ 2 };
+static constexpr std::int32_t s_JournalSheetsPriority{ 1 };
+static constexpr std::int32_t s_DmPreviewPriority{ 0 };
+static constexpr std::int32_t s_FinishDeferredWorkPriority{ std::numeric_limits<std::int32_t>::min() };
+
+static void CollectContentStoreGarbage(ContentStore& content_store, VirtualFilesystem& vfs)
+{
+    content_store.CollectGarbage();
+    if (content_store.HasChanged())
+    {
+        vfs.DiscardSnapshot(content_store.GetStorePath());
+    }
+}
+
 ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings, VirtualFilesystem& vfs)
     : mSpriteSheetMerger{ new SpriteSheetMerger{ settings } }
+    , mSnapshotWriter{ new ModSnapshotWriter{} }
     , mVfs{ vfs }
     , mModsRoot{ mods_root }
     , mDeveloperMode{ settings.GetBool("settings", "enable_developer_mode", false) || settings.GetBool("script_settings", "enable_developer_mode", false) }
     , mConsoleMode{ settings.GetBool("script_settings", "enable_developer_console", false) }
+    , mVfsTracing{ settings.GetBool("general_settings", "enable_vfs_tracing", false) }
     , mConsoleKey{ static_cast<std::uint64_t>(settings.GetInt("key_bindings", "console", VK_OEM_3)) }
     , mConsoleAltKey{ static_cast<std::uint64_t>(settings.GetInt("key_bindings", "console_alt", VK_OEM_5)) }
     , mConsoleCloseKey{ static_cast<std::uint64_t>(settings.GetInt("key_bindings", "console_close", VK_ESCAPE)) }
 {
+    const ProfileZone profile_zone{ "ModManager::ModManager" };
+
     namespace fs = std::filesystem;
 
     LogInfo("Initializing Mod Manager...");
@@ -74,6 +102,11 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
 
     const bool disable_asset_caching = settings.GetBool("general_settings", "disable_asset_caching", false);
 
+    if (mVfsTracing)
+    {
+        vfs.EnableTracing();
+    }
+
     const bool enable_raw_string_loading = !speedrun_mode && settings.GetBool("script_settings", "enable_raw_string_loading", false);
     const bool enable_customizable_sheets = !speedrun_mode && settings.GetBool("sprite_settings", "enable_customizable_sheets", true);
 
@@ -92,18 +125,43 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
         const auto db_folder{ mods_root_path / ".db" };
         const auto mod_db_folder{ db_folder / "Mods" };
 
+        std::unique_ptr<ConsolidatedModDatabase> consolidated_db;
+        if (settings.GetBool("general_settings", "use_consolidated_mod_database", false))
+        {
+            consolidated_db = std::make_unique<ConsolidatedModDatabase>(db_folder / "mods.db");
+        }
+        else if (std::error_code error_code; fs::remove(db_folder / "mods.db", error_code))
+        {
+            // Per-mod databases are written again from now on, the consolidated one would be outdated when turned back on
+            LogInfo("Removed consolidated mod database...");
+        }
+
         bool speedrun_mode_changed{ false };
         bool journal_gen_settings_change{ false };
         bool sticker_gen_settings_change{ false };
+        bool mods_root_changed{ false };
+
+        struct ModArchive
+        {
+            fs::path ArchivePath;
+            fs::path ModFolder;
+            ModType Types;
+        };
+        std::vector<ModArchive> mod_archives;
+
+        // The whole mods folder is walked once, the root database and all loose mods that did not change on disk since are updated from that
+        const ModDatabase::ScannedEntries mods_root_entries = std::move(ModDatabase::ScanModFolders(std::span{ &mods_root_path, 1 }, static_cast<ModDatabaseFlags>(ModDatabaseFlags_Files | ModDatabaseFlags_Folders)).front());
+        std::vector<fs::path> rewritten_mod_folders;
 
         {
             bool has_loose_files{ false };
 
-            ModDatabase mod_db{ db_folder, mods_root, static_cast<ModDatabaseFlags>(ModDatabaseFlags_Files | ModDatabaseFlags_Folders) };
+            ModDatabase mod_db{ db_folder, mods_root, static_cast<ModDatabaseFlags>(ModDatabaseFlags_Files | ModDatabaseFlags_Folders), consolidated_db.get(), mSnapshotWriter.get() };
 
             if (mod_db.WasOutdated())
             {
                 settings.SetBool("bug_fixes", "missing_pipes", false);
+                mods_root_changed = true;
             }
 
             const bool journal_gen = settings.GetBool("sprite_settings", "generate_character_journal_entries", true);
@@ -122,21 +180,35 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
             mod_db.SetAdditionalSetting("generate_character_journal_stickers", sticker_gen);
             mod_db.SetAdditionalSetting("generate_sticker_pixel_art", sticker_pixel_gen);
 
-            mod_db.UpdateDatabase();
-            mod_db.ForEachFile([&mods_root_path, &has_loose_files, &load_order_updated](const fs::path& rel_file_path, bool outdated, bool deleted, [[maybe_unused]] std::optional<bool> new_enabled_state)
+            mod_db.UpdateDatabase(mods_root_entries);
+            mod_db.ForEachFile([&mods_root_path, &has_loose_files, &load_order_updated, &mod_archives, &mods_root_changed, &rewritten_mod_folders](const fs::path& rel_file_path, bool outdated, bool deleted, [[maybe_unused]] std::optional<bool> new_enabled_state)
                                {
-                                   if (outdated)
+                                   mods_root_changed = mods_root_changed || outdated || deleted;
+                                   if (algo::is_same_path(rel_file_path.extension(), ".zip"))
                                    {
-                                       if (algo::is_same_path(rel_file_path.extension(), ".zip"))
+                                       const fs::path zip_path = mods_root_path / rel_file_path;
+                                       const fs::path unzipped_mod_folder = fs::path{ zip_path }.replace_extension();
+                                       if (!deleted && !fs::exists(unzipped_mod_folder))
                                        {
-                                           const fs::path zip_path = mods_root_path / rel_file_path;
-                                           const auto message = fmt::format("Found archive '{}' in mods packs folder. Do you want to unzip it in order for it to be loadable as a mod?", zip_path.filename().string());
-                                           if (MessageBox(NULL, message.c_str(), "Zipped Mod Found", MB_YESNO) == IDYES)
+                                           if (std::optional<ModType> mod_types = GetMountableModArchiveTypes(zip_path))
                                            {
-                                               UnzipMod(zip_path);
+                                               mod_archives.push_back({ zip_path, unzipped_mod_folder, mod_types.value() });
+                                           }
+                                           else if (outdated)
+                                           {
+                                               const auto message = fmt::format("Found archive '{}' in mods packs folder. Do you want to unzip it in order for it to be loadable as a mod?", zip_path.filename().string());
+                                               if (MessageBox(NULL, message.c_str(), "Zipped Mod Found", MB_YESNO) == IDYES)
+                                               {
+                                                   UnzipMod(zip_path);
+                                                   FixModFolderStructure(unzipped_mod_folder);
+                                                   rewritten_mod_folders.push_back(unzipped_mod_folder);
+                                               }
                                            }
                                        }
-                                       else if (algo::is_same_path(rel_file_path.filename(), "load_order.txt") && (outdated || deleted))
+                                   }
+                                   else if (outdated)
+                                   {
+                                       if (algo::is_same_path(rel_file_path.filename(), "load_order.txt") && (outdated || deleted))
                                        {
                                            load_order_updated = true;
                                        }
@@ -146,13 +218,14 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
                                        }
                                    } });
 
-            mod_db.UpdateDatabase();
-            mod_db.ForEachFolder([&mods_root_path](const fs::path& rel_folder_path, [[maybe_unused]] bool outdated, [[maybe_unused]] bool deleted, [[maybe_unused]] std::optional<bool> new_enabled_state)
+            // Folders unzipped above are not in the scan, they were fixed right away
+            mod_db.ForEachFolder([&mods_root_path, &mods_root_changed, &rewritten_mod_folders](const fs::path& rel_folder_path, bool outdated, bool deleted, [[maybe_unused]] std::optional<bool> new_enabled_state)
                                  {
+                                     mods_root_changed = mods_root_changed || outdated || deleted;
                                      const fs::path folder_path = mods_root_path / rel_folder_path;
-                                     if (fs::exists(folder_path))
+                                     if (fs::exists(folder_path) && FixModFolderStructure(folder_path))
                                      {
-                                         FixModFolderStructure(folder_path);
+                                         rewritten_mod_folders.push_back(folder_path);
                                      } });
 
             mod_db.WriteDatabase();
@@ -164,6 +237,12 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
             }
         }
 
+        // Unless mods or settings changed the indices of all mounted folders are restored from the last launch, changed mods are discarded again before mounting them
+        if (!mods_root_changed && !disable_asset_caching && !speedrun_mode && !speedrun_mode_changed && !journal_gen_settings_change && !sticker_gen_settings_change)
+        {
+            vfs.LoadSnapshot(db_folder / "vfs.snapshot");
+        }
+
         const auto db_original_folder = db_folder / "Original";
         {
             const auto files = std::array{
@@ -256,7 +335,7 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
             }
         }
 
-        const std::vector<fs::path> mod_folders = [this, mods_root_path, mod_db_folder](const fs::path& root_folder)
+        const std::vector<fs::path> mod_folders = [this, mods_root_path, mod_db_folder, &mod_archives](const fs::path& root_folder)
         {
             std::vector<fs::path> mod_folders;
 
@@ -268,6 +347,12 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
                 }
             }
 
+            // Archives that can be mounted directly take the place of their unzipped folder
+            for (const ModArchive& mod_archive : mod_archives)
+            {
+                mod_folders.push_back(mod_archive.ModFolder);
+            }
+
             // Add all mods that were deleted since last load
             {
                 if (fs::exists(mod_db_folder))
@@ -319,6 +404,38 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
             return mod_name_to_prio;
         }();
 
+        // Loose mods that will be loaded are all scanned at once up front, instead of one after another below
+        // Only folders written to since the mods folder was walked are scanned again
+        std::unordered_map<std::string, ModDatabase::ScannedEntries> scanned_mod_folders = [&mod_folders, &mod_archives, &mod_name_to_prio, &mods_root_entries, &rewritten_mod_folders]()
+        {
+            std::unordered_map<std::string, ModDatabase::ScannedEntries> scanned_mod_folders;
+
+            std::vector<fs::path> folders_to_scan;
+            for (const fs::path& mod_folder : mod_folders)
+            {
+                const auto it = mod_name_to_prio.find(mod_folder.filename().string());
+                const bool enabled = it == mod_name_to_prio.end() || it->second.Enabled;
+                if (enabled && !algo::contains(mod_archives, &ModArchive::ModFolder, mod_folder) && fs::is_directory(mod_folder))
+                {
+                    if (algo::contains(rewritten_mod_folders, mod_folder))
+                    {
+                        folders_to_scan.push_back(mod_folder);
+                    }
+                    else
+                    {
+                        scanned_mod_folders.emplace(mod_folder.filename().string(), ModDatabase::GetScannedSubFolder(mods_root_entries, mod_folder));
+                    }
+                }
+            }
+
+            std::vector<ModDatabase::ScannedEntries> scanned_entries = ModDatabase::ScanModFolders(folders_to_scan, ModDatabaseFlags_Recurse);
+            for (std::size_t i = 0; i < folders_to_scan.size(); i++)
+            {
+                scanned_mod_folders.emplace(folders_to_scan[i].filename().string(), std::move(scanned_entries[i]));
+            }
+            return scanned_mod_folders;
+        }();
+
         const bool enable_sprite_hot_loading = settings.GetBool("sprite_settings", "enable_sprite_hot_loading", false);
         if (enable_sprite_hot_loading)
         {
@@ -327,15 +444,90 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
 
         mSpriteSheetMerger->GatherSheetData(journal_gen_settings_change, sticker_gen_settings_change);
         StringMerger string_merger;
-        DmPreviewMerger dmpreview_merger{ settings };
+        const auto dmpreview_merger = std::make_shared<DmPreviewMerger>(settings);
+
+        std::shared_ptr<ContentStore> content_store;
+        if (!disable_asset_caching && settings.GetBool("general_settings", "enable_content_deduplication", false))
+        {
+            content_store = std::make_shared<ContentStore>(db_folder / "Content");
+        }
+        const auto derive_file = [content_store](std::string_view kind, const fs::path& source, const fs::path& destination, const ContentStore::DeriveFun& derive)
+        {
+            return content_store ? content_store->Derive(kind, source, destination, derive) : derive(destination);
+        };
+
+        // Files nothing needs to reach the title screen are generated in the background, jobs only start once all mounts exist
+        // Each job lists the files it generates relative to the mounted folder, loading one of them before it is done waits for it
+        if (!speedrun_mode && settings.GetBool("general_settings", "enable_deferred_asset_generation", false))
+        {
+            mDeferredWork = std::make_shared<DeferredWorkScheduler>();
+        }
+        const auto defer_job = [this, &vfs](std::int32_t priority, std::span<const fs::path> generated_files, std::function<bool()> job, std::string success_message, std::string error_message)
+        {
+            DeferredWorkScheduler::JobHandle handle = mDeferredWork->Submit(priority, std::move(job));
+            for (const fs::path& generated_file : generated_files)
+            {
+                vfs.DeferFile(algo::path_string(generated_file), [deferred_work = mDeferredWork, handle]()
+                              {
+                                  deferred_work->Wait(handle);
+                                  return deferred_work->IsDone(handle); });
+            }
+            mDeferredJobs.push_back(DeferredJob{
+                .Job = handle,
+                .SuccessMessage = std::move(success_message),
+                .ErrorMessage = std::move(error_message),
+            });
+            return handle;
+        };
+        // Same as for jobs on the pool, deferred jobs writing the same destination run in the order they were submitted
+        std::unordered_map<NormalizedPath, DeferredWorkScheduler::JobHandle> last_deferred_job_per_destination;
+
+        // Converting and caching files runs on the pool while mods are registered in order on this thread, idle threads also help hashing changed mod files
+        // Jobs writing the same destination run in the order they were submitted, a job returns nullopt if it had nothing to do
+        struct DeriveJob
+        {
+            std::shared_future<std::optional<bool>> Result;
+            std::string SuccessMessage;
+            std::string ErrorMessage;
+        };
+        std::vector<DeriveJob> derive_jobs;
+        std::unordered_map<NormalizedPath, std::shared_future<std::optional<bool>>> last_job_per_destination;
+        WorkerPool worker_pool{};
+        const auto submit_derive_job = [&](const fs::path& destination, std::function<std::optional<bool>()> job, std::string success_message, std::string error_message)
+        {
+            std::shared_future<std::optional<bool>>& last_job = last_job_per_destination[NormalizedPath{ destination }];
+            last_job = worker_pool.Submit([previous_job = last_job, job = std::move(job)]()
+                                          {
+                                              if (previous_job.valid())
+                                              {
+                                                  previous_job.wait();
+                                              }
+                                              return job(); })
+                           .share();
+            derive_jobs.push_back(DeriveJob{
+                .Result = last_job,
+                .SuccessMessage = std::move(success_message),
+                .ErrorMessage = std::move(error_message),
+            });
+        };
+        // Databases are written once everything derived from their files is on disk
+        std::vector<std::unique_ptr<ModDatabase>> mod_dbs_to_write;
         bool has_outdated_shaders{ false };
 
+        const ModDatabaseFlags loose_mod_db_flags = settings.GetBool("general_settings", "enable_content_hashing", false)
+                                                        ? static_cast<ModDatabaseFlags>(ModDatabaseFlags_Files | ModDatabaseFlags_Recurse | ModDatabaseFlags_HashContent)
+                                                        : static_cast<ModDatabaseFlags>(ModDatabaseFlags_Files | ModDatabaseFlags_Recurse);
+
         for (const fs::path& mod_folder : mod_folders)
         {
+            const ProfileZone mod_profile_zone{ "ModManager::RegisterMod" };
+
             const std::string mod_name = mod_folder.filename().string();
             const auto this_db_folder = db_folder / "Mods" / mod_name;
 
-            const auto [prio, enabled] = [&mod_name_to_prio, &mod_name, &mod_folder]() mutable
+            const ModArchive* mod_archive = algo::find(mod_archives, &ModArchive::ModFolder, mod_folder);
+
+            const auto [prio, enabled] = [&mod_name_to_prio, &mod_name, &mod_folder, mod_archive]() mutable
             {
                 std::int64_t prio{ static_cast<std::int64_t>(mod_name_to_prio.size()) };
                 bool enabled{ true };
@@ -347,20 +539,40 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
                 }
                 else
                 {
-                    mod_name_to_prio[mod_name] = { prio, fs::exists(mod_folder) };
+                    mod_name_to_prio[mod_name] = { prio, mod_archive != nullptr || fs::exists(mod_folder) };
                 }
                 return std::pair{ prio, enabled };
             }();
 
             ModInfo mod_info{ mod_name };
 
+            if (mod_archive != nullptr)
             {
-                ModDatabase mod_db{ this_db_folder, mod_folder, static_cast<ModDatabaseFlags>(ModDatabaseFlags_Files | ModDatabaseFlags_Recurse) };
+                if (enabled)
+                {
+                    Playlunky::Get().RegisterModType(mod_archive->Types);
+                    vfs.MountArchive(mod_archive->ArchivePath.string(), this_db_folder.string(), prio, VfsType::User);
+                }
+
+                mMods.push_back(std::move(mod_info));
+                continue;
+            }
+
+            {
+                ModDatabase& mod_db = *mod_dbs_to_write.emplace_back(std::make_unique<ModDatabase>(this_db_folder, mod_folder, loose_mod_db_flags, consolidated_db.get(), mSnapshotWriter.get(), &worker_pool));
                 mod_db.SetEnabled(enabled);
 
                 if (mod_db.IsEnabled() || mod_db.WasEnabled())
                 {
-                    mod_db.UpdateDatabase();
+                    if (auto scanned = scanned_mod_folders.find(mod_name); scanned != scanned_mod_folders.end())
+                    {
+                        mod_db.UpdateDatabase(scanned->second);
+                        scanned_mod_folders.erase(scanned);
+                    }
+                    else
+                    {
+                        mod_db.UpdateDatabase();
+                    }
                     const std::vector<fs::path> mod_load_paths{ this_db_folder, mod_folder };
                     if (mod_db.IsEnabled())
                     {
@@ -387,8 +599,11 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
                         mod_db.SetInfo("");
                         mSpriteSheetMerger->RegisterCustomImages(mod_name, mod_load_paths, db_original_folder, prio, mod_info.GetCustomImages());
                     }
+                    bool mod_changed{ false };
                     mod_db.ForEachFile([&](const fs::path& rel_asset_path, bool outdated, bool deleted, std::optional<bool> new_enabled_state)
                                        {
+                                           mod_changed = mod_changed || outdated || deleted || new_enabled_state.has_value();
+
                                            const auto rel_asset_path_string = algo::path_string(rel_asset_path);
 
                                            const auto full_asset_path = mod_folder / rel_asset_path;
@@ -413,7 +628,7 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
                                                    const auto rel_asset_file_name = rel_asset_path.filename().string();
                                                    if (ctre::match<s_DmLevel>(rel_asset_file_name) || algo::is_same_path(rel_asset_path, "Data/Levels/Arena/dmpreview.tok"))
                                                    {
-                                                       dmpreview_merger.RegisterDmLevel(full_asset_path, outdated, deleted);
+                                                       dmpreview_merger->RegisterDmLevel(full_asset_path, outdated, deleted);
                                                    }
                                                }
                                            }
@@ -473,18 +688,27 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
 
                                                    if (deleted)
                                                    {
-                                                       if (fs::remove(db_destination))
-                                                       {
-                                                           LogInfo("Successfully deleted file '{}' that was removed from a mod...", full_asset_path.string());
-                                                       }
-                                                   }
-                                                   else if (ConvertImageToDds(full_asset_path, db_destination))
-                                                   {
-                                                       LogInfo("Successfully converted file '{}' to be readable by the game...", full_asset_path.string());
+                                                       submit_derive_job(
+                                                           db_destination,
+                                                           [db_destination]() -> std::optional<bool>
+                                                           {
+                                                               std::error_code error_code;
+                                                               return fs::remove(db_destination, error_code) ? std::optional{ true } : std::nullopt;
+                                                           },
+                                                           fmt::format("Successfully deleted file '{}' that was removed from a mod...", full_asset_path.string()),
+                                                           "");
                                                    }
                                                    else
                                                    {
-                                                       LogError("Failed converting file '{}' to be readable by the game...", full_asset_path.string());
+                                                       submit_derive_job(
+                                                           db_destination,
+                                                           [&derive_file, full_asset_path, db_destination]() -> std::optional<bool>
+                                                           {
+                                                               return derive_file("dds", full_asset_path, db_destination, [&full_asset_path](const fs::path& destination)
+                                                                                  { return ConvertImageToDds(full_asset_path, destination); });
+                                                           },
+                                                           fmt::format("Successfully converted file '{}' to be readable by the game...", full_asset_path.string()),
+                                                           fmt::format("Failed converting file '{}' to be readable by the game...", full_asset_path.string()));
                                                    }
                                                }
                                            }
@@ -516,21 +740,68 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
                                            }
                                            else if (cache_decoded_audio_files && IsSupportedAudioFile(rel_asset_path))
                                            {
+                                               const auto cached_audio_path = GetCachedAudioFilePath(full_asset_path, this_db_folder);
                                                if (deleted)
                                                {
-                                                   DeleteCachedAudioFile(full_asset_path, this_db_folder);
+                                                   submit_derive_job(
+                                                       cached_audio_path,
+                                                       [full_asset_path, this_db_folder]() -> std::optional<bool>
+                                                       {
+                                                           DeleteCachedAudioFile(full_asset_path, this_db_folder);
+                                                           return std::nullopt;
+                                                       },
+                                                       "",
+                                                       "");
                                                }
-                                               else if (!HasCachedAudioFile(full_asset_path, this_db_folder))
+                                               else if (mDeferredWork)
                                                {
-                                                   if (CacheAudioFile(full_asset_path, this_db_folder, outdated))
+                                                   // The mod database is written before this job runs, a stale cache must not survive until the next launch
+                                                   if (outdated)
                                                    {
-                                                       LogInfo("Successfully cached audio file '{}'...", full_asset_path.string());
+                                                       DeleteCachedAudioFile(full_asset_path, this_db_folder);
                                                    }
-                                                   else
+                                                   if (!HasCachedAudioFile(full_asset_path, this_db_folder))
                                                    {
-                                                       LogError("Failed caching audio file '{}'...", full_asset_path.string());
+                                                       const fs::path generated_files[]{ cached_audio_path.lexically_relative(this_db_folder) };
+                                                       DeferredWorkScheduler::JobHandle& last_job = last_deferred_job_per_destination[NormalizedPath{ cached_audio_path }];
+                                                       last_job = defer_job(
+                                                           s_CachedAudioPriority,
+                                                           generated_files,
+                                                           [this, derive_file, full_asset_path, this_db_folder, cached_audio_path, previous_job = last_job]()
+                                                           {
+                                                               if (previous_job)
+                                                               {
+                                                                   mDeferredWork->Wait(previous_job);
+                                                               }
+                                                               if (!derive_file("raw_audio", full_asset_path, cached_audio_path, [&](const fs::path&)
+                                                                                { return CacheAudioFile(full_asset_path, this_db_folder, false); }))
+                                                               {
+                                                                   return false;
+                                                               }
+                                                               // The folder of this mod was indexed before its cached file existed
+                                                               mVfs.InvalidateIndex(cached_audio_path);
+                                                               return true;
+                                                           },
+                                                           fmt::format("Successfully cached audio file '{}'...", full_asset_path.string()),
+                                                           fmt::format("Failed caching audio file '{}'...", full_asset_path.string()));
                                                    }
                                                }
+                                               else
+                                               {
+                                                   submit_derive_job(
+                                                       cached_audio_path,
+                                                       [&derive_file, full_asset_path, this_db_folder, cached_audio_path, outdated]() -> std::optional<bool>
+                                                       {
+                                                           if (HasCachedAudioFile(full_asset_path, this_db_folder))
+                                                           {
+                                                               return std::nullopt;
+                                                           }
+                                                           return derive_file("raw_audio", full_asset_path, cached_audio_path, [&](const fs::path&)
+                                                                              { return CacheAudioFile(full_asset_path, this_db_folder, outdated); });
+                                                       },
+                                                       fmt::format("Successfully cached audio file '{}'...", full_asset_path.string()),
+                                                       fmt::format("Failed caching audio file '{}'...", full_asset_path.string()));
+                                               }
                                            }
                                            else if (!speedrun_mode && enabled && !deleted && algo::is_same_path(rel_asset_path.filename(), "main.lua"))
                                            {
@@ -543,7 +814,12 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
                                                    LogError("Mod {} appears to contain multiple main.lua files... {} will be ignored...", mod_name, full_asset_path_string);
                                                }
                                            } });
-                    mod_db.WriteDatabase();
+
+                    if (mod_changed)
+                    {
+                        vfs.DiscardSnapshot(this_db_folder);
+                        vfs.DiscardSnapshot(mod_folder);
+                    }
                 }
             }
 
@@ -560,6 +836,41 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
             }
         }
 
+        // Results are reported in submission order, so the log reads the same as if everything ran on this thread
+        {
+            const ProfileZone wait_profile_zone{ "ModManager::WaitForDerivedFiles" };
+            worker_pool.WaitIdle();
+        }
+        for (DeriveJob& derive_job : derive_jobs)
+        {
+            if (const std::optional<bool> result = derive_job.Result.get())
+            {
+                if (result.value() && !derive_job.SuccessMessage.empty())
+                {
+                    LogInfo("{}", derive_job.SuccessMessage);
+                }
+                else if (!result.value() && !derive_job.ErrorMessage.empty())
+                {
+                    LogError("{}", derive_job.ErrorMessage);
+                }
+            }
+        }
+        derive_jobs.clear();
+        last_job_per_destination.clear();
+
+        for (const std::unique_ptr<ModDatabase>& mod_db : mod_dbs_to_write)
+        {
+            mod_db->WriteDatabase();
+        }
+        mod_dbs_to_write.clear();
+
+        // Deferred audio is not linked into the store yet, its files would be collected
+        if (content_store && !mDeferredWork)
+        {
+            CollectContentStoreGarbage(*content_store, vfs);
+            content_store.reset();
+        }
+
         SetupSpecialPathes(vfs, settings);
 
         if (speedrun_mode)
@@ -598,10 +909,28 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
                 });
         }
 
+        {
+            // Generated sheets, shaders, strings and previews are loaded from memory while they are written to disk
+            static constexpr std::size_t c_GeneratedFilesMemoryBudget{ 256 * 1024 * 1024 };
+            vfs.MountMemory(db_folder.string(), -1, VfsType::Backend, c_GeneratedFilesMemoryBudget);
+        }
+
+        // Decides about rebuilding generated files by what they were built from instead of which mod files changed
+        std::shared_ptr<DerivedAssetGraph> asset_graph;
+        if (!disable_asset_caching)
+        {
+            asset_graph = std::make_shared<DerivedAssetGraph>(db_folder / "derived_assets.db");
+        }
+
+        // Painting and hot-loading regenerate sheets on the game thread, which must not happen while a job does the same
+        using SheetGroup = SpriteSheetMerger::SheetGroup;
+        const bool defer_journal_sheets = mDeferredWork && !mSpritePainter && !mSpriteHotLoader;
+        const SheetGroup sheet_group = defer_journal_sheets ? SheetGroup::Immediate : SheetGroup::All;
+
         LogInfo("Merging entity sheets... This includes the automatic generating of stickers...");
-        if (mSpriteSheetMerger->NeedsRegeneration(db_folder))
+        if (mSpriteSheetMerger->NeedsRegeneration(db_folder, asset_graph.get(), sheet_group))
         {
-            if (mSpriteSheetMerger->GenerateRequiredSheets(db_original_folder, db_folder, vfs))
+            if (mSpriteSheetMerger->GenerateRequiredSheets(db_original_folder, db_folder, vfs, false, asset_graph.get(), sheet_group))
             {
                 LogInfo("Successfully generated merged sheets from mods...");
             }
@@ -611,12 +940,29 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
             }
         }
 
+        if (defer_journal_sheets)
+        {
+            const std::vector<fs::path> journal_sheets = mSpriteSheetMerger->GetSheetsNeedingRegeneration(db_folder, asset_graph.get(), SheetGroup::Deferrable);
+            if (!journal_sheets.empty())
+            {
+                defer_job(
+                    s_JournalSheetsPriority,
+                    journal_sheets,
+                    [this, db_original_folder, db_folder, asset_graph]()
+                    {
+                        return mSpriteSheetMerger->GenerateRequiredSheets(db_original_folder, db_folder, mVfs, false, asset_graph.get(), SheetGroup::Deferrable);
+                    },
+                    "Successfully generated merged journal sheets from mods...",
+                    "Failed generating merged journal sheets from mods...");
+            }
+        }
+
         if (enable_sprite_hot_loading && mSpriteHotLoader)
         {
             LogInfo("Setting up sprite hot-loading...");
             mSpriteHotLoader->FinalizeSetup();
         }
-        else if (!mSpritePainter)
+        else if (!mSpritePainter && !defer_journal_sheets)
         {
             mSpriteSheetMerger.reset();
         }
@@ -627,11 +973,24 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
         }
 
         LogInfo("Merging shader mods...");
-        if (has_outdated_shaders || !fs::exists(db_folder / "shaders.hlsl"))
+        const bool shaders_outdated = [&]()
+        {
+            if (asset_graph)
+            {
+                const fs::path outputs[]{ db_folder / "shaders.hlsl" };
+                return asset_graph->IsOutdated("shaders", outputs, GetMergeShadersInputs(db_original_folder, "shaders.hlsl", vfs));
+            }
+            return has_outdated_shaders || !fs::exists(db_folder / "shaders.hlsl");
+        }();
+        if (shaders_outdated)
         {
             if (MergeShaders(db_original_folder, db_folder, "shaders.hlsl", vfs))
             {
                 LogInfo("Successfully generated a full shader file from installed shader mods...");
+                if (asset_graph)
+                {
+                    asset_graph->MarkBuilt("shaders");
+                }
             }
             else
             {
@@ -645,11 +1004,19 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
         }
 
         LogInfo("Merging string mods...");
-        if (string_merger.NeedsRegen() || !fs::exists(db_folder / "strings00.str"))
+        if (asset_graph)
+        {
+            string_merger.UpdateOutdatedStringTables(db_original_folder, db_folder, "strings_hashes.hash", speedrun_mode, vfs, *asset_graph);
+        }
+        if (string_merger.NeedsRegen() || (!asset_graph && !fs::exists(db_folder / "strings00.str")))
         {
             if (string_merger.MergeStrings(db_original_folder, db_folder, "strings_hashes.hash", speedrun_mode, vfs))
             {
                 LogInfo("Successfully generated a full string file from installed string mods...");
+                if (asset_graph)
+                {
+                    string_merger.MarkStringTablesBuilt(*asset_graph);
+                }
             }
             else
             {
@@ -658,9 +1025,29 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
         }
 
         LogInfo("Generating arena previews...");
-        if (dmpreview_merger.NeedsRegeneration(db_folder))
+        // Resolved now, the database folder holding the last generated preview is only mounted further down
+        DmPreviewMerger::Inputs dmpreview_inputs{ DmPreviewMerger::ResolveInputs(db_original_folder, vfs) };
+        if (dmpreview_merger->NeedsRegeneration(dmpreview_inputs, db_folder, asset_graph.get()))
         {
-            if (dmpreview_merger.GenerateDmPreview(db_original_folder, db_folder, vfs))
+            const auto generate_dmpreview = [this, dmpreview_inputs = std::move(dmpreview_inputs), db_folder, asset_graph]()
+            {
+                if (!DmPreviewMerger::GenerateDmPreview(dmpreview_inputs, db_folder, mVfs))
+                {
+                    return false;
+                }
+                if (asset_graph)
+                {
+                    asset_graph->MarkBuilt("dmpreview");
+                }
+                return true;
+            };
+
+            if (mDeferredWork)
+            {
+                const fs::path generated_files[]{ "Data/Levels/Arena/dmpreview.tok" };
+                defer_job(s_DmPreviewPriority, generated_files, generate_dmpreview, "Successfully generated arena previews...", "Failed generating arena previews...");
+            }
+            else if (generate_dmpreview())
             {
                 LogInfo("Successfully generated arena previews...");
             }
@@ -679,6 +1066,13 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
         vfs.MountFolder(db_folder.string(), -1, VfsType::Backend);
         vfs.MountFolder("", -2, VfsType::Backend);
 
+        if (!speedrun_mode && settings.GetBool("general_settings", "enable_load_prefetching", false))
+        {
+            static constexpr std::size_t c_PrefetchThreads{ 2 };
+            static constexpr std::size_t c_PrefetchCacheBudget{ 64 * 1024 * 1024 };
+            vfs.EnablePrefetching(c_PrefetchThreads, c_PrefetchCacheBudget, true);
+        }
+
         {
             struct ModNameAndState
             {
@@ -707,13 +1101,56 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
             }
         }
 
+        // Everything generated has to be on disk before the database records the state of the mods folder
+        vfs.FlushPublishedFiles();
+        if (asset_graph)
+        {
+            asset_graph->Write();
+        }
+
         {
             // Rewrite mod database so we don't trigger changes on files written during mod load (e.g. load_order.txt)
-            ModDatabase mod_db{ db_folder, mods_root, static_cast<ModDatabaseFlags>(ModDatabaseFlags_Files | ModDatabaseFlags_Folders) };
+            // This has to walk the mods folder again, files may have been written anywhere in it while loading
+            ModDatabase mod_db{ db_folder, mods_root, static_cast<ModDatabaseFlags>(ModDatabaseFlags_Files | ModDatabaseFlags_Folders), consolidated_db.get(), mSnapshotWriter.get() };
             mod_db.UpdateDatabase();
             mod_db.WriteDatabase();
         }
 
+        if (consolidated_db)
+        {
+            consolidated_db->Commit();
+        }
+
+        if (mDeferredWork)
+        {
+            // Taken last and waits for the jobs still running, only then is everything generated on disk
+            std::vector<DeferredWorkScheduler::JobHandle> deferred_jobs;
+            for (const DeferredJob& deferred_job : mDeferredJobs)
+            {
+                deferred_jobs.push_back(deferred_job.Job);
+            }
+            mDeferredWork->Submit(s_FinishDeferredWorkPriority, [this, deferred_jobs = std::move(deferred_jobs), asset_graph, content_store]()
+                                  {
+                                      for (const DeferredWorkScheduler::JobHandle& deferred_job : deferred_jobs)
+                                      {
+                                          mDeferredWork->Wait(deferred_job);
+                                      }
+
+                                      mVfs.FlushPublishedFiles();
+                                      if (asset_graph)
+                                      {
+                                          asset_graph->Write();
+                                      }
+                                      if (content_store)
+                                      {
+                                          CollectContentStoreGarbage(*content_store, mVfs);
+                                      }
+                                      return true; });
+
+            LogInfo("Generating {} assets in the background...", mDeferredJobs.size());
+            mDeferredWork->Start();
+        }
+
         if (Playlunky::Get().IsModTypeLoaded(ModType::Script | ModType::Level))
         {
             Spelunky_SetWriteLoadOptimization(true);
@@ -882,6 +1319,30 @@ ModManager::ModManager(std::string_view mods_root, PlaylunkySettings& settings,
 }
 ModManager::~ModManager()
 {
+    // Snapshots still being written in the background must not outlive the mod manager
+    mSnapshotWriter->Join();
+
+    if (mDeferredWork)
+    {
+        // Jobs use the sprite merger and the vfs, both have to outlive them
+        mDeferredWork->WaitIdle();
+        mVfs.ClearDeferredFiles();
+    }
+
+    if (mDeveloperMode)
+    {
+        mVfs.LogStatistics();
+    }
+
+    if (mVfsTracing)
+    {
+        const auto db_folder = mModsRoot / ".db";
+        if (mVfs.WriteTrace(db_folder / "vfs_trace.json", db_folder / "vfs_trace.txt"))
+        {
+            LogInfo("Wrote vfs trace to '{}'...", db_folder.string());
+        }
+    }
+
     BugFixesCleanup();
 
     Spelunky_DestroySoundManager();
@@ -900,6 +1361,8 @@ ModManager::~ModManager()
 
 void ModManager::PostGameInit(const class PlaylunkySettings& settings)
 {
+    const ProfileZone profile_zone{ "ModManager::PostGameInit" };
+
     const bool speedrun_mode = settings.GetBool("general_settings", "speedrun_mode", false);
 
     PatchCharacterDefinitions(mVfs, settings);
@@ -932,6 +1395,14 @@ void ModManager::PostGameInit(const class PlaylunkySettings& settings)
 
     // Bugfixes may use scripts for some functionality
     BugFixesInit(settings, db_folder, db_original_folder);
+    mVfs.InvalidateIndex(db_folder / "Mods/BugFixes");
+
+    // All mounts are final now, the next launch can skip indexing them unless something changes in the meantime
+    // While deferred work still writes into them this waits until it is done
+    if (!mDeferredWork && std::filesystem::exists(db_folder))
+    {
+        mVfs.SaveSnapshot(db_folder / "vfs.snapshot");
+    }
 
     mScriptManager.CommitScripts(settings);
 
@@ -948,6 +1419,45 @@ void ModManager::PostGameInit(const class PlaylunkySettings& settings)
 
     Spelunky_PostInitState();
 }
+void ModManager::WriteStartupProfile() const
+{
+    const auto db_folder = mModsRoot / ".db";
+    if (std::filesystem::exists(db_folder) && WriteProfile(db_folder / "startup_profile.json", db_folder / "startup_profile.txt"))
+    {
+        LogInfo("Wrote startup profile to '{}'...", db_folder.string());
+    }
+}
+
+void ModManager::FinishDeferredWork()
+{
+    // Results are reported in submission order, the same as for files derived during startup
+    for (const DeferredJob& deferred_job : mDeferredJobs)
+    {
+        if (mDeferredWork->Wait(deferred_job.Job))
+        {
+            LogInfo("{}", deferred_job.SuccessMessage);
+        }
+        else
+        {
+            LogError("{}", deferred_job.ErrorMessage);
+        }
+    }
+    mDeferredJobs.clear();
+
+    mVfs.ClearDeferredFiles();
+    mDeferredWork.reset();
+
+    if (!mSpritePainter && !mSpriteHotLoader)
+    {
+        mSpriteSheetMerger.reset();
+    }
+
+    const auto db_folder = mModsRoot / ".db";
+    if (std::filesystem::exists(db_folder))
+    {
+        mVfs.SaveSnapshot(db_folder / "vfs.snapshot");
+    }
+}
 
 bool ModManager::OnInput(std::uint32_t msg, std::uint64_t w_param, std::int64_t /*l_param*/)
 {
@@ -983,6 +1493,11 @@ bool ModManager::OnInput(std::uint32_t msg, std::uint64_t w_param, std::int64_t
 }
 void ModManager::Update()
 {
+    if (mDeferredWork && mDeferredWork->IsIdle())
+    {
+        FinishDeferredWork();
+    }
+
     if (mSpritePainter || mSpriteHotLoader || mDeveloperMode)
     {
         const auto db_folder = mModsRoot / ".db";
@@ -2,12 +2,15 @@
 
 #include "script_manager.h"
 
+#include "util/deferred_work.h"
+
 #include <filesystem>
 #include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
 
+class ModSnapshotWriter;
 class PlaylunkySettings;
 class SpriteHotLoader;
 class SpritePainter;
@@ -26,19 +29,35 @@ class ModManager
     ModManager& operator=(ModManager&&) = delete;
 
     void PostGameInit(const PlaylunkySettings& settings);
+    // Zones recorded until now as a trace and a summary in the database folder
+    void WriteStartupProfile() const;
 
     bool OnInput(std::uint32_t msg, std::uint64_t w_param, std::int64_t l_param);
     void Update();
     void Draw();
 
   private:
+    // Reports deferred work once all of it is done and drops everything that was only kept alive for it
+    void FinishDeferredWork();
+
     std::vector<class ModInfo> mMods;
     std::unique_ptr<SpriteHotLoader> mSpriteHotLoader;
     std::unique_ptr<SpritePainter> mSpritePainter;
     std::unique_ptr<SpriteSheetMerger> mSpriteSheetMerger;
+    std::unique_ptr<ModSnapshotWriter> mSnapshotWriter;
     ScriptManager mScriptManager;
     VirtualFilesystem& mVfs;
 
+    // Shared with the vfs, which waits for files that are still being generated when they are requested
+    std::shared_ptr<DeferredWorkScheduler> mDeferredWork;
+    struct DeferredJob
+    {
+        DeferredWorkScheduler::JobHandle Job;
+        std::string SuccessMessage;
+        std::string ErrorMessage;
+    };
+    std::vector<DeferredJob> mDeferredJobs;
+
     std::filesystem::path mModsRoot;
 
     bool mForceShowOptions{ false };
@@ -46,6 +65,7 @@ class ModManager
 
     bool mDeveloperMode;
     bool mConsoleMode;
+    bool mVfsTracing;
     std::string mModSaveGameOverride;
     std::uint64_t mConsoleKey;
     std::uint64_t mConsoleAltKey;
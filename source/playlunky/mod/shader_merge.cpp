@@ -8,6 +8,7 @@
 #include "util/file_watch.h"
 #include "util/image.h"
 #include "util/on_scope_exit.h"
+#include "util/profiler.h"
 #include "util/regex.h"
 #include "util/tokenize.h"
 #include "virtual_filesystem.h"
@@ -30,6 +31,7 @@ template<class... Ts>
 overloaded(Ts...) -> overloaded<Ts...>;
 
 bool MergeShadersImpl(
+    VirtualFilesystem& vfs,
     const std::filesystem::path& destination_folder,
     const std::filesystem::path& shader_file,
     std::variant<std::filesystem::path, std::string> source_shader,
@@ -409,21 +411,8 @@ bool MergeShadersImpl(
         }
     }
 
-    namespace fs = std::filesystem;
-
-    if (!fs::exists(destination_folder))
-    {
-        fs::create_directories(destination_folder);
-    }
-
     const auto destination_file = destination_folder / shader_file;
-    if (auto merged_shader_file = std::ofstream{ destination_file, std::ios::trunc })
-    {
-        merged_shader_file.write(source_shader_code.data(), source_shader_code.size());
-        return true;
-    }
-
-    return false;
+    return vfs.PublishFile(destination_file, std::vector<std::uint8_t>(source_shader_code.begin(), source_shader_code.end()));
 }
 
 bool MergeShaders(
@@ -432,6 +421,8 @@ bool MergeShaders(
     const std::filesystem::path& shader_file,
     VirtualFilesystem& vfs)
 {
+    const ProfileZone profile_zone{ "MergeShaders" };
+
     const auto source_shader = vfs.GetFilePath(shader_file).value_or(source_folder / shader_file);
     std::string source_shader_code = [&source_shader]()
     {
@@ -449,7 +440,18 @@ bool MergeShaders(
 
     const auto shader_mods = vfs.GetAllFilePaths("shaders_mod.hlsl");
 
-    return MergeShadersImpl(destination_folder, shader_file, std::move(source_shader_code), shader_mods);
+    return MergeShadersImpl(vfs, destination_folder, shader_file, std::move(source_shader_code), shader_mods);
+}
+
+std::vector<std::filesystem::path> GetMergeShadersInputs(
+    const std::filesystem::path& source_folder,
+    const std::filesystem::path& shader_file,
+    VirtualFilesystem& vfs)
+{
+    std::vector<std::filesystem::path> inputs{ vfs.GetFilePath(shader_file).value_or(source_folder / shader_file) };
+    const auto shader_mods = vfs.GetAllFilePaths("shaders_mod.hlsl");
+    inputs.insert(inputs.end(), shader_mods.begin(), shader_mods.end());
+    return inputs;
 }
 
 std::uint32_t g_ReloadTimer;
@@ -477,7 +479,7 @@ void SetupShaderHotReload(
 
     g_ReloadTimer = 0;
     g_ReloadTimerSignal.store(0, std::memory_order_relaxed);
-    g_ReloadCallback = std::bind_front(MergeShadersImpl, destination_folder, shader_file);
+    g_ReloadCallback = std::bind_front(MergeShadersImpl, std::ref(vfs), destination_folder, shader_file);
     g_CallbackFiles.clear();
 
     if (modded_source_shader.has_value())
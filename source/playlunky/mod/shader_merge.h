@@ -11,6 +11,11 @@ bool MergeShaders(
     const std::filesystem::path& destination_folder,
     const std::filesystem::path& shader_file,
     VirtualFilesystem& vfs);
+// The files MergeShaders would read, in the order it reads them
+std::vector<std::filesystem::path> GetMergeShadersInputs(
+    const std::filesystem::path& source_folder,
+    const std::filesystem::path& shader_file,
+    VirtualFilesystem& vfs);
 
 void SetupShaderHotReload(
     const std::filesystem::path& source_folder,
@@ -5,6 +5,7 @@
 #include "log.h"
 #include "playlunky_settings.h"
 #include "sprite_sheet_merger.h"
+#include "virtual_filesystem.h"
 #include "util/algorithms.h"
 #include "util/on_scope_exit.h"
 
@@ -61,9 +62,9 @@ void SpriteHotLoader::Update(const std::filesystem::path& source_folder, const s
         const std::size_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
         if (now - m_ReloadTimestamp > m_ReloadDelay)
         {
-            algo::erase_if(m_PendingReloads, [this](auto& pending_reload)
+            algo::erase_if(m_PendingReloads, [this, &vfs](auto& pending_reload)
                            {
-                               pending_reload.has_warned = !PrepareHotLoad(pending_reload.sheet->full_path, pending_reload.sheet->db_destination, !pending_reload.has_warned);
+                               pending_reload.has_warned = !PrepareHotLoad(pending_reload.sheet->full_path, pending_reload.sheet->db_destination, vfs, !pending_reload.has_warned);
                                return !pending_reload.has_warned; });
             if (m_HasPendingReloads && m_PendingReloads.empty())
             {
@@ -74,7 +75,7 @@ void SpriteHotLoader::Update(const std::filesystem::path& source_folder, const s
     }
 }
 
-bool SpriteHotLoader::PrepareHotLoad(const std::filesystem::path& full_path, const std::filesystem::path& db_destination, bool emit_info)
+bool SpriteHotLoader::PrepareHotLoad(const std::filesystem::path& full_path, const std::filesystem::path& db_destination, VirtualFilesystem& vfs, bool emit_info)
 {
     if (emit_info)
     {
@@ -102,6 +103,7 @@ bool SpriteHotLoader::PrepareHotLoad(const std::filesystem::path& full_path, con
     {
         return false;
     }
+    vfs.InvalidateIndex(db_destination);
 
     const std::filesystem::path path = [&]()
     {
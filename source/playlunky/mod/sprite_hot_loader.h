@@ -32,7 +32,7 @@ class SpriteHotLoader
     void Update(const std::filesystem::path& source_folder, const std::filesystem::path& destination_folder, VirtualFilesystem& vfs);
 
   private:
-    bool PrepareHotLoad(const std::filesystem::path& full_path, const std::filesystem::path& db_destination, bool emit_info);
+    bool PrepareHotLoad(const std::filesystem::path& full_path, const std::filesystem::path& db_destination, VirtualFilesystem& vfs, bool emit_info);
 
     struct RegisteredSheet
     {
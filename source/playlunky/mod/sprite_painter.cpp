@@ -842,6 +842,8 @@ bool SpritePainter::RepaintImage(const std::filesystem::path& full_path, const s
             // Save to .png (or possibly other source format, should work too)
             repainted_image.Write(real_db_destination);
         }
+
+        m_Vfs.InvalidateIndex(real_db_destination);
     }
 
     return true;
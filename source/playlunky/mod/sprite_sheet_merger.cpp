@@ -1,6 +1,7 @@
 #include "sprite_sheet_merger.h"
 
 #include "dds_conversion.h"
+#include "derived_asset_graph.h"
 #include "entity_data_extraction.h"
 #include "extract_game_assets.h"
 #include "log.h"
@@ -8,6 +9,7 @@
 #include "util/algorithms.h"
 #include "util/format.h"
 #include "util/on_scope_exit.h"
+#include "util/profiler.h"
 #include "virtual_filesystem.h"
 
 #include <spel2.h>
@@ -77,17 +79,15 @@ void SpriteSheetMerger::GatherSheetData(bool force_regen_char_journal, bool forc
 
 void SpriteSheetMerger::RegisterSheet(const std::filesystem::path& full_sheet, bool outdated, bool deleted)
 {
-    auto full_sheet_no_ext = std::filesystem::path{ full_sheet }.replace_extension();
-    if (RegisteredSourceSheet* registered_sheet = algo::find_if(m_RegisteredSourceSheets,
-                                                                [&full_sheet_no_ext](const RegisteredSourceSheet& sheet)
-                                                                { return algo::is_same_path(sheet.Path, full_sheet_no_ext); }))
+    const NormalizedPath full_sheet_no_ext{ std::filesystem::path{ full_sheet }.replace_extension() };
+    if (RegisteredSourceSheet* registered_sheet = algo::find(m_RegisteredSourceSheets, &RegisteredSourceSheet::Path, full_sheet_no_ext))
     {
         registered_sheet->Outdated = registered_sheet->Outdated || outdated;
         registered_sheet->Deleted = registered_sheet->Deleted || deleted;
         return;
     }
     m_RegisteredSourceSheets.push_back(RegisteredSourceSheet{
-        .Path = std::move(full_sheet_no_ext),
+        .Path = full_sheet_no_ext,
         .Outdated = outdated,
         .Deleted = deleted });
 }
@@ -97,13 +97,12 @@ void SpriteSheetMerger::RegisterCustomImages(std::string_view mod_name, std::spa
 
     auto get_image = [this](const fs::path& image_path) -> Image&
     {
-        if (auto* image = algo::find_if(m_CachedImages,
-                                        [&image_path](const LoadedImage& image)
-                                        { return algo::is_same_path(image.ImagePath, image_path); }))
+        const NormalizedPath normalized_image_path{ image_path };
+        if (auto* image = algo::find(m_CachedImages, &LoadedImage::ImagePath, normalized_image_path))
         {
             return *image->ImageFile;
         }
-        m_CachedImages.push_back({ image_path, std::make_unique<Image>() });
+        m_CachedImages.push_back({ normalized_image_path, std::make_unique<Image>() });
         m_CachedImages.back().ImageFile->Load(image_path);
         return *m_CachedImages.back().ImageFile;
     };
@@ -178,19 +177,45 @@ void SpriteSheetMerger::RegisterCustomImages(std::string_view mod_name, std::spa
     }
 }
 
-bool SpriteSheetMerger::NeedsRegeneration(const std::filesystem::path& destination_folder) const
+bool SpriteSheetMerger::NeedsRegeneration(const std::filesystem::path& destination_folder, const DerivedAssetGraph* asset_graph, SheetGroup group) const
 {
     for (const TargetSheet& target_sheet : m_TargetSheets)
     {
-        if (NeedsRegen(target_sheet, destination_folder))
+        if (IsInGroup(target_sheet, group) && NeedsRegen(target_sheet, destination_folder, asset_graph))
         {
             return true;
         }
     }
     return false;
 }
+std::vector<std::filesystem::path> SpriteSheetMerger::GetSheetsNeedingRegeneration(const std::filesystem::path& destination_folder, const DerivedAssetGraph* asset_graph, SheetGroup group) const
+{
+    std::vector<std::filesystem::path> sheets;
+    for (const TargetSheet& target_sheet : m_TargetSheets)
+    {
+        if (IsInGroup(target_sheet, group) && NeedsRegen(target_sheet, destination_folder, asset_graph))
+        {
+            sheets.push_back(target_sheet.Path);
+        }
+    }
+    return sheets;
+}
 
-bool SpriteSheetMerger::NeedsRegen(const TargetSheet& target_sheet, const std::filesystem::path& destination_folder) const
+bool SpriteSheetMerger::IsInGroup(const TargetSheet& target_sheet, SheetGroup group)
+{
+    switch (group)
+    {
+    case SheetGroup::Immediate:
+        return !target_sheet.Deferrable;
+    case SheetGroup::Deferrable:
+        return target_sheet.Deferrable;
+    case SheetGroup::All:
+    default:
+        return true;
+    }
+}
+
+bool SpriteSheetMerger::NeedsRegen(const TargetSheet& target_sheet, const std::filesystem::path& destination_folder, const DerivedAssetGraph* asset_graph) const
 {
     namespace fs = std::filesystem;
 
@@ -199,18 +224,18 @@ bool SpriteSheetMerger::NeedsRegen(const TargetSheet& target_sheet, const std::f
         return true;
     }
 
+    // The graph knows about missing outputs and changed sources, so with it any modded source is enough
+    const bool has_asset_graph = asset_graph != nullptr;
     const bool does_exist = fs::exists(fs::path{ destination_folder / target_sheet.Path }.replace_extension(".DDS"));
     const bool random_select = target_sheet.RandomSelect;
     for (const SourceSheet& source_sheet : target_sheet.SourceSheets)
     {
-        const auto source_path_no_ext = source_sheet.Path.has_extension()
-                                            ? fs::path{ source_sheet.Path }.replace_extension()
-                                            : source_sheet.Path;
-        if (const RegisteredSourceSheet* registered_sheet = algo::find_if(m_RegisteredSourceSheets,
-                                                                          [&source_path_no_ext](const RegisteredSourceSheet& sheet)
-                                                                          { return algo::is_same_path(sheet.Path, source_path_no_ext); }))
+        const NormalizedPath source_path_no_ext{ source_sheet.Path.has_extension()
+                                                     ? fs::path{ source_sheet.Path }.replace_extension()
+                                                     : source_sheet.Path };
+        if (const RegisteredSourceSheet* registered_sheet = algo::find(m_RegisteredSourceSheets, &RegisteredSourceSheet::Path, source_path_no_ext))
         {
-            if (!does_exist || random_select || registered_sheet->Outdated || registered_sheet->Deleted)
+            if (has_asset_graph || !does_exist || random_select || registered_sheet->Outdated || registered_sheet->Deleted)
             {
                 return true;
             }
@@ -220,11 +245,9 @@ bool SpriteSheetMerger::NeedsRegen(const TargetSheet& target_sheet, const std::f
     {
         for (const auto& path : multi_source_sheets.Paths)
         {
-            if (const RegisteredSourceSheet* registered_sheet = algo::find_if(m_RegisteredSourceSheets,
-                                                                              [&path](const RegisteredSourceSheet& sheet)
-                                                                              { return algo::is_same_path(sheet.Path, path); }))
+            if (const RegisteredSourceSheet* registered_sheet = algo::find(m_RegisteredSourceSheets, &RegisteredSourceSheet::Path, NormalizedPath{ path }))
             {
-                if (!does_exist || random_select || registered_sheet->Outdated || registered_sheet->Deleted)
+                if (has_asset_graph || !does_exist || random_select || registered_sheet->Outdated || registered_sheet->Deleted)
                 {
                     return true;
                 }
@@ -235,11 +258,19 @@ bool SpriteSheetMerger::NeedsRegen(const TargetSheet& target_sheet, const std::f
     return false;
 }
 
-bool SpriteSheetMerger::GenerateRequiredSheets(const std::filesystem::path& source_folder, const std::filesystem::path& destination_folder, VirtualFilesystem& vfs, bool force_reload)
+bool SpriteSheetMerger::GenerateRequiredSheets(const std::filesystem::path& source_folder, const std::filesystem::path& destination_folder, VirtualFilesystem& vfs, bool force_reload, DerivedAssetGraph* asset_graph, SheetGroup group)
 {
+    const ProfileZone profile_zone{ "SpriteSheetMerger::GenerateRequiredSheets" };
+
     OnScopeExit clear_sheet_data{
-        [this]()
+        [this, group]()
         {
+            // Deferrable sheets still have to see which sources changed, their loaded sources are likely shared with them too
+            if (group == SheetGroup::Immediate)
+            {
+                return;
+            }
+
             for (RegisteredSourceSheet& sheet : m_RegisteredSourceSheets)
             {
                 sheet.Outdated = false;
@@ -253,21 +284,35 @@ bool SpriteSheetMerger::GenerateRequiredSheets(const std::filesystem::path& sour
 
     auto get_image = [this](const fs::path& image_path) -> Image&
     {
-        if (auto* image = algo::find(m_CachedImages, &LoadedImage::ImagePath, image_path))
+        const NormalizedPath normalized_image_path{ image_path };
+        if (auto* image = algo::find(m_CachedImages, &LoadedImage::ImagePath, normalized_image_path))
         {
             return *image->ImageFile;
         }
-        m_CachedImages.push_back({ image_path, std::make_unique<Image>() });
+        m_CachedImages.push_back({ normalized_image_path, std::make_unique<Image>() });
         m_CachedImages.back().ImageFile->Load(image_path);
         return *m_CachedImages.back().ImageFile;
     };
 
+    auto find_in_load_paths = [](const SourceSheet& source_sheet) -> std::optional<fs::path>
+    {
+        for (const fs::path& load_path : source_sheet.LoadPaths)
+        {
+            const fs::path absolute_path = load_path / source_sheet.Path;
+            if (fs::exists(absolute_path))
+            {
+                return absolute_path;
+            }
+        }
+        return std::nullopt;
+    };
+
     for (const TargetSheet& target_sheet : m_TargetSheets)
     {
-        if (NeedsRegen(target_sheet, destination_folder))
+        if (IsInGroup(target_sheet, group) && NeedsRegen(target_sheet, destination_folder, asset_graph))
         {
             const auto target_file_path = vfs.GetFilePathFilterExt(target_sheet.Path, Image::AllowedExtensions).value_or(fs::path{ source_folder / target_sheet.Path }.replace_extension(".png"));
-            Image target_image = get_image(target_file_path).Clone();
+            const auto destination_file_path = fs::path{ destination_folder / target_sheet.Path }.replace_extension(".DDS");
 
             static auto validate_source_aspect_ratio = [](const SourceSheet& source_sheet, const Image& source_image)
             {
@@ -282,23 +327,68 @@ bool SpriteSheetMerger::GenerateRequiredSheets(const std::filesystem::path& sour
 
             float upscaling = 1.0f;
 
+            // Resolve all sources of this sheet in one go, random selection has to pick for each source separately though
+            std::vector<std::optional<fs::path>> resolved_source_paths;
+            if (!target_sheet.RandomSelect)
+            {
+                std::vector<VirtualFilesystem::ResolveRequest> source_requests;
+                for (const SourceSheet& source_sheet : target_sheet.SourceSheets)
+                {
+                    source_requests.push_back({ source_sheet.Path, Image::AllowedExtensions });
+                }
+                for (const MultiSourceTile& multi_source_sheet : target_sheet.MultiSourceTiles)
+                {
+                    for (const fs::path& path : multi_source_sheet.Paths)
+                    {
+                        source_requests.push_back({ path, Image::AllowedExtensions });
+                    }
+                }
+                resolved_source_paths = vfs.ResolveMany(source_requests);
+            }
+            std::size_t next_source_index{ 0 };
+
+            // Random selection picks new sources each time, so only sheets with fixed sources can be looked up in the graph
+            const std::string asset_name{ fmt::format("sheet:{}", target_sheet.Path.string()) };
+            const bool use_asset_graph{ asset_graph != nullptr && !target_sheet.RandomSelect };
+            if (use_asset_graph)
+            {
+                std::vector<fs::path> inputs{ target_file_path };
+                for (std::size_t i = 0; i < resolved_source_paths.size(); i++)
+                {
+                    std::optional<fs::path> source_file_path{ resolved_source_paths[i] };
+                    if (i < target_sheet.SourceSheets.size())
+                    {
+                        if (std::optional<fs::path> load_path = find_in_load_paths(target_sheet.SourceSheets[i]))
+                        {
+                            source_file_path = std::move(load_path);
+                        }
+                    }
+                    inputs.push_back(source_file_path.value_or(fs::path{}));
+                }
+
+                const fs::path outputs[]{ destination_file_path };
+                if (!asset_graph->IsOutdated(asset_name, outputs, inputs) && !target_sheet.ForceRegen)
+                {
+                    continue;
+                }
+            }
+
+            Image target_image = get_image(target_file_path).Clone();
+
             std::vector<std::optional<fs::path>> target_sheet_paths;
             for (const SourceSheet& source_sheet : target_sheet.SourceSheets)
             {
+                const std::size_t source_index{ next_source_index++ };
                 auto source_file_path = [&, random_select = target_sheet.RandomSelect]() -> std::optional<fs::path>
                 {
-                    for (const fs::path& load_path : source_sheet.LoadPaths)
+                    if (std::optional<fs::path> load_path = find_in_load_paths(source_sheet))
                     {
-                        const fs::path absolute_path = load_path / source_sheet.Path;
-                        if (fs::exists(absolute_path))
-                        {
-                            return absolute_path;
-                        }
+                        return load_path;
                     }
 
                     if (!random_select)
                     {
-                        return vfs.GetFilePathFilterExt(source_sheet.Path, Image::AllowedExtensions);
+                        return resolved_source_paths[source_index];
                     }
                     else
                     {
@@ -408,13 +498,16 @@ bool SpriteSheetMerger::GenerateRequiredSheets(const std::filesystem::path& sour
                 };
                 const auto target_size = ::ImageSize{ .x{ static_cast<std::uint32_t>(target_region.width) }, .y{ static_cast<std::uint32_t>(target_region.height) } };
 
+                std::size_t next_tile_source_index{ next_source_index };
+                next_source_index += multi_source_sheet.Paths.size();
                 for (auto [path, size, tile_mapping] : zip::zip(multi_source_sheet.Paths, multi_source_sheet.Sizes, multi_source_sheet.TileMap))
                 {
+                    const std::size_t source_index{ next_tile_source_index++ };
                     auto source_file_path = [&, random_select = target_sheet.RandomSelect]() -> std::optional<fs::path>
                     {
                         if (!random_select)
                         {
-                            return vfs.GetFilePathFilterExt(path, Image::AllowedExtensions);
+                            return resolved_source_paths[source_index];
                         }
                         else
                         {
@@ -469,12 +562,17 @@ bool SpriteSheetMerger::GenerateRequiredSheets(const std::filesystem::path& sour
                 }
             }
 
-            const auto destination_file_path = fs::path{ destination_folder / target_sheet.Path }.replace_extension(".DDS");
-            if (!ConvertRBGAToDds(target_image.GetData(), target_image.GetWidth(), target_image.GetHeight(), destination_file_path))
+            if (!vfs.PublishFile(destination_file_path, EncodeRBGAAsDds(target_image.GetData(), target_image.GetWidth(), target_image.GetHeight())))
             {
                 return false;
             }
-            else if (force_reload)
+
+            if (use_asset_graph)
+            {
+                asset_graph->MarkBuilt(asset_name);
+            }
+
+            if (force_reload)
             {
                 Spelunky_ReloadTexture(fs::path{ target_sheet.Path }.replace_extension(".DDS").string().c_str());
             }
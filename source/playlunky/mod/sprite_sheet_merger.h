@@ -9,7 +9,9 @@
 
 #include "sprite_sheet_merger_types.h"
 #include "util/image.h"
+#include "util/normalized_path.h"
 
+class DerivedAssetGraph;
 class VirtualFilesystem;
 class EntityDataExtractor;
 
@@ -28,15 +30,28 @@ class SpriteSheetMerger
     void RegisterSheet(const std::filesystem::path& full_sheet, bool outdated, bool deleted);
     void RegisterCustomImages(std::string_view mod_name, std::span<const std::filesystem::path> load_paths, const std::filesystem::path& original_data_folder, std::int64_t priority, const CustomImages& custom_images);
 
-    bool NeedsRegeneration(const std::filesystem::path& destination_folder) const;
+    // Deferrable sheets, e.g. the journal, are not needed to reach the title screen and can be generated separately in the background
+    enum class SheetGroup
+    {
+        All,
+        Immediate,
+        Deferrable,
+    };
 
-    bool GenerateRequiredSheets(const std::filesystem::path& source_folder, const std::filesystem::path& destination_folder, VirtualFilesystem& vfs, bool force_reload = false);
+    // With an asset graph every sheet with a registered source is a candidate, the graph then decides which of them are rebuilt
+    bool NeedsRegeneration(const std::filesystem::path& destination_folder, const DerivedAssetGraph* asset_graph = nullptr, SheetGroup group = SheetGroup::All) const;
+    // Pathes of the sheets NeedsRegeneration would consider, relative to the destination folder and without extension
+    std::vector<std::filesystem::path> GetSheetsNeedingRegeneration(const std::filesystem::path& destination_folder, const DerivedAssetGraph* asset_graph, SheetGroup group) const;
+
+    // Generating only the immediate group keeps the state of registered sheets for generating the deferrable group afterwards
+    bool GenerateRequiredSheets(const std::filesystem::path& source_folder, const std::filesystem::path& destination_folder, VirtualFilesystem& vfs, bool force_reload = false, DerivedAssetGraph* asset_graph = nullptr, SheetGroup group = SheetGroup::All);
 
   private:
     friend class EntityDataExtractor;
 
     struct TargetSheet;
-    bool NeedsRegen(const TargetSheet& target_sheet, const std::filesystem::path& destination_folder) const;
+    static bool IsInGroup(const TargetSheet& target_sheet, SheetGroup group);
+    bool NeedsRegen(const TargetSheet& target_sheet, const std::filesystem::path& destination_folder, const DerivedAssetGraph* asset_graph) const;
 
     void MakeItemsSheet();
     void MakeJournalItemsSheet();
@@ -66,12 +81,13 @@ class SpriteSheetMerger
         std::vector<MultiSourceTile> MultiSourceTiles;
         bool RandomSelect;
         bool ForceRegen;
+        bool Deferrable;
     };
     std::vector<TargetSheet> m_TargetSheets;
 
     struct RegisteredSourceSheet
     {
-        std::filesystem::path Path;
+        NormalizedPath Path;
         bool Outdated;
         bool Deleted;
     };
@@ -81,7 +97,7 @@ class SpriteSheetMerger
 
     struct LoadedImage
     {
-        std::filesystem::path ImagePath;
+        NormalizedPath ImagePath;
         std::unique_ptr<Image> ImageFile;
     };
     std::vector<LoadedImage> m_CachedImages;
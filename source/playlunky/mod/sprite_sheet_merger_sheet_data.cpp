@@ -56,7 +56,8 @@ void SpriteSheetMerger::MakeJournalItemsSheet()
     m_TargetSheets.push_back(TargetSheet{
         .Path{ "Data/Textures/journal_entry_items" },
         .Size{ .Width{ 1600 }, .Height{ 1600 } },
-        .SourceSheets{ std::move(source_sheets) } });
+        .SourceSheets{ std::move(source_sheets) },
+        .Deferrable{ true } });
 }
 void SpriteSheetMerger::MakeJournalMonstersSheet()
 {
@@ -199,7 +200,8 @@ void SpriteSheetMerger::MakeJournalMonstersSheet()
     m_TargetSheets.push_back(TargetSheet{
         .Path{ "Data/Textures/journal_entry_mons" },
         .Size{ .Width{ 1600 }, .Height{ 960 } },
-        .SourceSheets{ std::move(source_sheets) } });
+        .SourceSheets{ std::move(source_sheets) },
+        .Deferrable{ true } });
 }
 void SpriteSheetMerger::MakeJournalMonstersBigSheet()
 {
@@ -254,7 +256,8 @@ void SpriteSheetMerger::MakeJournalMonstersBigSheet()
         .Path{ "Data/Textures/journal_entry_mons_big" },
         .Size{ .Width{ 1600 }, .Height{ 1920 } },
         .SourceSheets{ std::move(source_sheets) },
-        .RandomSelect{ false } });
+        .RandomSelect{ false },
+        .Deferrable{ true } });
 }
 void SpriteSheetMerger::MakeJournalPeopleSheet(bool force_regen)
 {
@@ -395,7 +398,8 @@ void SpriteSheetMerger::MakeJournalPeopleSheet(bool force_regen)
         .Size{ .Width{ 1600 }, .Height{ 800 } },
         .SourceSheets{ std::move(source_sheets) },
         .RandomSelect{ mRandomCharacterSelectEnabled },
-        .ForceRegen{ force_regen } });
+        .ForceRegen{ force_regen },
+        .Deferrable{ true } });
 }
 void SpriteSheetMerger::MakeJournalStickerSheet(bool force_regen)
 {
@@ -500,7 +504,8 @@ void SpriteSheetMerger::MakeJournalStickerSheet(bool force_regen)
         .Size{ .Width{ 800 }, .Height{ 800 } },
         .SourceSheets{ std::move(source_sheets) },
         .RandomSelect{ mRandomCharacterSelectEnabled },
-        .ForceRegen{ force_regen } });
+        .ForceRegen{ force_regen },
+        .Deferrable{ true } });
 }
 void SpriteSheetMerger::MakeMountsTargetSheet()
 {
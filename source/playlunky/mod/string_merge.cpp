@@ -1,14 +1,17 @@
 #include "string_merge.h"
 
+#include "derived_asset_graph.h"
 #include "known_files.h"
 #include "log.h"
 #include "playlunky.h"
 #include "util/algorithms.h"
 #include "util/format.h"
+#include "util/profiler.h"
 #include "virtual_filesystem.h"
 
 #include <charconv>
 #include <fstream>
+#include <sstream>
 #include <unordered_map>
 
 bool StringMerger::RegisterOutdatedStringTable(std::string_view table)
@@ -58,9 +61,49 @@ bool StringMerger::RegisterModdedStringTable(std::string_view table)
     return true;
 }
 
+void StringMerger::UpdateOutdatedStringTables(
+    const std::filesystem::path& source_folder, const std::filesystem::path& destination_folder, const std::filesystem::path& hash_file_path, bool speedrun_mode, VirtualFilesystem& vfs, DerivedAssetGraph& asset_graph)
+{
+    namespace fs = std::filesystem;
+
+    mOutdatedStringTables.clear();
+    for (std::uint8_t string_table = 0; string_table <= 12; string_table++)
+    {
+        const auto string_table_name = fmt::format("strings{:02}.str", string_table);
+        const auto string_table_mod_name = fmt::format("strings{:02}_mod.str", string_table);
+
+        // Same files MergeStrings reads, a full table from a mod replaces the original, string mods are applied on top of the original
+        const auto string_table_mod_files = vfs.GetAllFilePaths(string_table_mod_name);
+        std::vector<fs::path> inputs{
+            source_folder / hash_file_path,
+            source_folder / string_table_name,
+            vfs.GetFilePath(string_table_name).value_or(source_folder / string_table_name),
+        };
+        inputs.insert(inputs.end(), string_table_mod_files.begin(), string_table_mod_files.end());
+
+        const fs::path output{ destination_folder / string_table_name };
+        if (asset_graph.IsOutdated(fmt::format("strings{:02}", string_table), std::span{ &output, 1 }, inputs, speedrun_mode ? "speedrun" : ""))
+        {
+            mOutdatedStringTables.push_back(OutdatedStringTable{
+                .Index{ string_table },
+                .Modded{ !string_table_mod_files.empty() } });
+        }
+    }
+    mNeedsRegen = !mOutdatedStringTables.empty();
+}
+void StringMerger::MarkStringTablesBuilt(DerivedAssetGraph& asset_graph) const
+{
+    for (const OutdatedStringTable& outdated_string_table : mOutdatedStringTables)
+    {
+        asset_graph.MarkBuilt(fmt::format("strings{:02}", outdated_string_table.Index));
+    }
+}
+
 bool StringMerger::MergeStrings(
     const std::filesystem::path& source_folder, const std::filesystem::path& destination_folder, const std::filesystem::path& hash_file_path, bool speedrun_mode, VirtualFilesystem& vfs)
 {
+    const ProfileZone profile_zone{ "StringMerger::MergeStrings" };
+
 
     namespace fs = std::filesystem;
 
@@ -177,9 +220,10 @@ bool StringMerger::MergeStrings(
                 const auto string_table_destination_file = destination_folder / string_table_name;
 
                 auto strings_source_file = std::ifstream{ string_table_source_file };
-                auto strings_destination_file = std::ofstream{ string_table_destination_file, std::ios::trunc };
+                // Built in memory, so line endings are written the way a text-mode file would have them
+                auto strings_destination_file = std::ostringstream{};
 
-                if (strings_source_file && strings_destination_file)
+                if (strings_source_file)
                 {
                     hash_file.seekg(0, std::ios::beg);
 
@@ -195,12 +239,19 @@ bool StringMerger::MergeStrings(
                         {
                             if (auto* modded_string = algo::find(modded_strings, &ModdedString::Hash, hash_string))
                             {
-                                strings_destination_file << modded_string->String << '\n';
+                                strings_destination_file << modded_string->String << "\r\n";
                                 continue;
                             }
                         }
 
-                        strings_destination_file << source_string << '\n';
+                        strings_destination_file << source_string << "\r\n";
+                    }
+
+                    const std::string merged_strings{ std::move(strings_destination_file).str() };
+                    if (!vfs.PublishFile(string_table_destination_file, std::vector<std::uint8_t>(merged_strings.begin(), merged_strings.end())))
+                    {
+                        LogError("Failed writing string table '{}'...", string_table_destination_file.string());
+                        return false;
                     }
                 }
             }
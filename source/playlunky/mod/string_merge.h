@@ -5,6 +5,7 @@
 #include <string_view>
 #include <vector>
 
+class DerivedAssetGraph;
 class VirtualFilesystem;
 
 class StringMerger
@@ -20,6 +21,12 @@ class StringMerger
     bool RegisterOutdatedStringTable(std::string_view table);
     bool RegisterModdedStringTable(std::string_view table);
 
+    // Replaces the registered tables with those whose inputs changed since they were last merged
+    void UpdateOutdatedStringTables(
+        const std::filesystem::path& source_folder, const std::filesystem::path& destination_folder, const std::filesystem::path& hash_file_path, bool speedrun_mode, VirtualFilesystem& vfs, DerivedAssetGraph& asset_graph);
+    // Call after merging succeeded
+    void MarkStringTablesBuilt(DerivedAssetGraph& asset_graph) const;
+
     bool NeedsRegen() const
     {
         return mNeedsRegen;
@@ -1,9 +1,16 @@
 #include "unzip_mod.h"
 
+#include "fix_mod_structure.h"
+#include "known_files.h"
 #include "log.h"
+#include "playlunky.h"
+#include "util/algorithms.h"
 #include "util/format.h"
+#include "util/on_scope_exit.h"
 #include "util/unzip_file.h"
 
+#include <zip.h>
+
 void UnzipMod(const std::filesystem::path& zip_file)
 {
     namespace fs = std::filesystem;
@@ -13,4 +20,67 @@ void UnzipMod(const std::filesystem::path& zip_file)
     {
         LogError("Can't open zip archive '{}': {}/n", zip_file.string(), err.value());
     }
-}
\ No newline at end of file
+}
+
+std::optional<ModType> GetMountableModArchiveTypes(const std::filesystem::path& zip_file)
+{
+    namespace fs = std::filesystem;
+
+    const std::string zip_file_string = zip_file.string();
+
+    std::int32_t error;
+    zip* archive = zip_open(zip_file_string.c_str(), ZIP_RDONLY, &error);
+    if (archive == nullptr)
+    {
+        return std::nullopt;
+    }
+    OnScopeExit close_archive([archive]()
+                              { zip_discard(archive); });
+
+    ModType mod_types{ ModType::None };
+    for (zip_int64_t i = 0; i < zip_get_num_entries(archive, 0); i++)
+    {
+        struct zip_stat entry_stat
+        {
+        };
+        if (zip_stat_index(archive, i, 0, &entry_stat) != 0)
+        {
+            return std::nullopt;
+        }
+
+        const std::string_view entry_name{ entry_stat.name };
+        if (entry_name.ends_with('/'))
+        {
+            continue;
+        }
+
+        const fs::path entry_path{ entry_name };
+        const fs::path extension{ entry_path.extension() };
+        if (algo::is_same_path(extension, ".txt") || algo::is_same_path(extension, ".md"))
+        {
+            continue;
+        }
+
+        // Anything that has to be converted, merged or moved needs the regular mod pipeline
+        if (auto correct_path = GetCorrectPath(entry_path); correct_path && !algo::is_same_path(correct_path.value(), entry_path))
+        {
+            return std::nullopt;
+        }
+
+        const std::string stem{ entry_path.stem().string() };
+        if (algo::is_same_path(extension, ".dds") && !stem.ends_with("_col") && !stem.ends_with("_lumin"))
+        {
+            mod_types = mod_types | (algo::contains(s_KnownCharFiles, stem) ? ModType::CharacterSprite : ModType::Sprite);
+        }
+        else if (algo::is_same_path(extension, ".lvl") && !algo::contains(s_ArenaLevelFiles, stem))
+        {
+            mod_types = mod_types | ModType::Level;
+        }
+        else if (!algo::is_same_path(extension, ".fnb"))
+        {
+            return std::nullopt;
+        }
+    }
+
+    return mod_types;
+}
@@ -1,5 +1,12 @@
 #pragma once
 
 #include <filesystem>
+#include <optional>
+
+enum class ModType;
 
 void UnzipMod(const std::filesystem::path& zip_file);
+
+// Zipped mods that only contain assets the game can load as they are can be mounted without unzipping them
+// Returns the types of mod the archive contains, or nothing if it has to be unzipped first
+std::optional<ModType> GetMountableModArchiveTypes(const std::filesystem::path& zip_file);
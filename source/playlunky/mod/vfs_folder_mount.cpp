@@ -0,0 +1,227 @@
+#include "vfs_folder_mount.h"
+
+#include "log.h"
+#include "util/normalized_path.h"
+#include "util/on_scope_exit.h"
+
+#include <spel2.h>
+
+#include <Windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+
+// Large files are copied straight out of a mapping of the file, everything else is read with a single ReadFile
+static constexpr std::size_t c_MappedReadThreshold{ 1024 * 1024 };
+static bool ReadWholeFile(HANDLE file, void* destination, std::size_t file_size)
+{
+    if (file_size == 0)
+    {
+        return true;
+    }
+
+    if (file_size >= c_MappedReadThreshold)
+    {
+        if (HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL))
+        {
+            auto close_mapping = OnScopeExit{ [mapping]()
+                                              { CloseHandle(mapping); } };
+            if (const void* mapped_data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, file_size))
+            {
+                std::memcpy(destination, mapped_data, file_size);
+                UnmapViewOfFile(mapped_data);
+                return true;
+            }
+        }
+    }
+
+    // ReadFile takes a 32-bit size and may return less than requested
+    char* write_pointer = static_cast<char*>(destination);
+    std::size_t remaining_size = file_size;
+    while (remaining_size > 0)
+    {
+        const DWORD chunk_size = static_cast<DWORD>(std::min<std::size_t>(remaining_size, std::numeric_limits<DWORD>::max()));
+        DWORD size_read{ 0 };
+        if (!ReadFile(file, write_pointer, chunk_size, &size_read, NULL) || size_read == 0)
+        {
+            return false;
+        }
+        write_pointer += size_read;
+        remaining_size -= size_read;
+    }
+    return true;
+}
+
+VfsFolderMount::VfsFolderMount(std::filesystem::path mounted_path, VfsType type, std::optional<std::string_view> index_snapshot)
+    : mMountedPath(std::move(mounted_path))
+    , mMountedPathString(mMountedPath.string())
+    , mType(type)
+    , mIndex(mMountedPath, !mMountedPath.empty(), index_snapshot) // The game folder is huge, only index what is actually requested from it
+{
+    std::replace(mMountedPathString.begin(), mMountedPathString.end(), '\\', '/');
+}
+
+VfsFolderMount::FileInfo* VfsFolderMount::LoadFile(const NormalizedPathView& file_path, void* (*allocator)(std::size_t)) const
+{
+    if (mIndex.HasFilter())
+    {
+        // Most mounts don't contain most files, skip them before trying to open anything
+        if (VfsPathIndex::CanIndex(file_path.GetPath()))
+        {
+            if (!mIndex.MayContain(file_path))
+            {
+                mFilterRejects.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            if (!mIndex.FindFile(file_path))
+            {
+                mFilterFalsePositives.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            mFilterHits.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    const auto load_start = std::chrono::steady_clock::now();
+
+    const std::filesystem::path full_path{ mMountedPath.empty() ? std::filesystem::path{ file_path.GetPath() } : mMountedPath / file_path.GetPath() };
+    HANDLE file = CreateFileW(full_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+    auto close_file = OnScopeExit{ [file]()
+                                   { CloseHandle(file); } };
+
+    LARGE_INTEGER file_size_info{};
+    if (!GetFileSizeEx(file, &file_size_info))
+    {
+        return nullptr;
+    }
+    const std::size_t file_size = static_cast<std::size_t>(file_size_info.QuadPart);
+
+    if (FileInfo* file_info = VirtualFilesystem::AllocateFileInfo(allocator, file_size))
+    {
+        if (!ReadWholeFile(file, file_info->Data, file_size))
+        {
+            LogError("Could not read file {}, this will either crash or cause glitches...", full_path.string());
+        }
+
+        const auto load_time = std::chrono::steady_clock::now() - load_start;
+        mLoadedFiles.fetch_add(1, std::memory_order_relaxed);
+        mLoadedBytes.fetch_add(file_size, std::memory_order_relaxed);
+        mLoadNanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(load_time).count(), std::memory_order_relaxed);
+
+        return file_info;
+    }
+
+    return nullptr;
+}
+
+std::optional<std::filesystem::path> VfsFolderMount::GetFilePath(const std::filesystem::path& path) const
+{
+    if (VfsPathIndex::CanIndex(path))
+    {
+        if (auto file_name = mIndex.FindFile(path))
+        {
+            if (path.has_extension())
+            {
+                return mMountedPath / path;
+            }
+            else
+            {
+                return mMountedPath / path.parent_path() / file_name.value();
+            }
+        }
+        return std::nullopt;
+    }
+
+    namespace fs = std::filesystem;
+    if (path.has_extension())
+    {
+        const auto full_path = mMountedPath / path;
+        if (fs::exists(full_path))
+        {
+            return full_path;
+        }
+    }
+    else
+    {
+        // Painfully check each file if it matches the name, return first match
+        auto parent_path = path.has_parent_path() ? mMountedPath / path.parent_path() : mMountedPath;
+        if (fs::exists(parent_path))
+        {
+            const std::string file_name{ path.filename().string() };
+            for (auto& dir_path : fs::directory_iterator{ parent_path })
+            {
+                if (fs::is_regular_file(dir_path) && NormalizedPath::IsSame(dir_path.path().stem().string(), file_name))
+                {
+                    return dir_path.path();
+                }
+            }
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<std::filesystem::path> VfsFolderMount::GetDiskPath(std::filesystem::path file_path) const
+{
+    return file_path;
+}
+
+bool VfsFolderMount::IsType(VfsType type) const
+{
+    return type == VfsType::Any || type == mType;
+}
+
+void VfsFolderMount::InvalidateIndex(const std::filesystem::path& changed_path)
+{
+    mIndex.Invalidate(changed_path);
+}
+
+std::optional<VfsSnapshot::Mount> VfsFolderMount::TakeSnapshot(std::int64_t priority) const
+{
+    if (!mIndex.HasFilter())
+    {
+        return std::nullopt;
+    }
+
+    VfsSnapshotWriter writer;
+    mIndex.WriteSnapshot(writer);
+    return VfsSnapshot::Mount{
+        .MountedPath = mMountedPath.string(),
+        .Priority = priority,
+        .Type = static_cast<std::uint8_t>(mType),
+        .Index = writer.GetData(),
+    };
+}
+
+VfsFolderMount::LoadStatistics VfsFolderMount::GetLoadStatistics() const
+{
+    return LoadStatistics{
+        .LoadedFiles = mLoadedFiles.load(std::memory_order_relaxed),
+        .LoadedBytes = mLoadedBytes.load(std::memory_order_relaxed),
+        .LoadNanoseconds = mLoadNanoseconds.load(std::memory_order_relaxed),
+    };
+}
+
+void VfsFolderMount::LogStatistics() const
+{
+    const std::uint64_t rejects{ mFilterRejects.load(std::memory_order_relaxed) };
+    const std::uint64_t hits{ mFilterHits.load(std::memory_order_relaxed) };
+    const std::uint64_t false_positives{ mFilterFalsePositives.load(std::memory_order_relaxed) };
+    if (rejects + hits + false_positives > 0)
+    {
+        LogInfo("Mount '{}': {} loads skipped by filter, {} hits, {} false positives", mMountedPathString, rejects, hits, false_positives);
+    }
+
+    const std::uint64_t loaded_files{ mLoadedFiles.load(std::memory_order_relaxed) };
+    if (loaded_files > 0)
+    {
+        const std::uint64_t loaded_bytes{ mLoadedBytes.load(std::memory_order_relaxed) };
+        const double load_milliseconds{ static_cast<double>(mLoadNanoseconds.load(std::memory_order_relaxed)) / 1e6 };
+        LogInfo("Mount '{}': {} files loaded ({} bytes) in {:.3f} ms", mMountedPathString, loaded_files, loaded_bytes, load_milliseconds);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "util/normalized_path.h"
+#include "vfs_mount_impl.h"
+#include "vfs_path_index.h"
+#include "vfs_snapshot.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Mounts a folder on disk, mounts of non-empty pathes index all their files up front so misses never touch the disk
+class VfsFolderMount : public IVfsMountImpl
+{
+  public:
+    VfsFolderMount(std::filesystem::path mounted_path, VfsType type, std::optional<std::string_view> index_snapshot);
+    virtual ~VfsFolderMount() override = default;
+
+    VfsFolderMount(const VfsFolderMount&) = delete;
+    VfsFolderMount(VfsFolderMount&&) = delete;
+    VfsFolderMount& operator=(const VfsFolderMount&) = delete;
+    VfsFolderMount& operator=(VfsFolderMount&&) = delete;
+
+    virtual FileInfo* LoadFile(const NormalizedPathView& file_path, void* (*allocator)(std::size_t)) const override;
+    virtual std::optional<std::filesystem::path> GetFilePath(const std::filesystem::path& path) const override;
+    virtual std::optional<std::filesystem::path> GetDiskPath(std::filesystem::path file_path) const override;
+    virtual bool IsType(VfsType type) const override;
+    virtual void InvalidateIndex(const std::filesystem::path& changed_path) override;
+    virtual void LogStatistics() const override;
+
+    // Only eagerly indexed mounts are worth restoring on the next launch
+    std::optional<VfsSnapshot::Mount> TakeSnapshot(std::int64_t priority) const;
+
+    // Only counts files that were actually read from disk, loads skipped by the index are not included
+    struct LoadStatistics
+    {
+        std::uint64_t LoadedFiles;
+        std::uint64_t LoadedBytes;
+        std::uint64_t LoadNanoseconds;
+    };
+    LoadStatistics GetLoadStatistics() const;
+
+  private:
+    std::filesystem::path mMountedPath;
+    std::string mMountedPathString;
+    VfsType mType;
+    VfsPathIndex mIndex;
+
+    mutable std::atomic_uint64_t mFilterRejects{ 0 };
+    mutable std::atomic_uint64_t mFilterHits{ 0 };
+    mutable std::atomic_uint64_t mFilterFalsePositives{ 0 };
+
+    mutable std::atomic_uint64_t mLoadedFiles{ 0 };
+    mutable std::atomic_uint64_t mLoadedBytes{ 0 };
+    mutable std::atomic_uint64_t mLoadNanoseconds{ 0 };
+};
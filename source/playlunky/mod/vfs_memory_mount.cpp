@@ -0,0 +1,303 @@
+#include "vfs_memory_mount.h"
+
+#include "log.h"
+#include "util/algorithms.h"
+
+#include <spel2.h>
+
+#include <cstring>
+#include <fstream>
+
+VfsMemoryMount::VfsMemoryMount(std::filesystem::path backing_path, VfsType type, std::size_t memory_budget)
+    : mBackingPath(std::move(backing_path))
+    , mType(type)
+    , mMemoryBudget(memory_budget)
+    , mWriter(&VfsMemoryMount::WriterMain, this)
+{
+}
+VfsMemoryMount::~VfsMemoryMount()
+{
+    // Everything that was published has to end up on disk, the next launch relies on it
+    {
+        std::lock_guard lock{ mMutex };
+        mStopping = true;
+    }
+    mWriteQueueChanged.notify_all();
+    mWriter.join();
+}
+
+VfsMemoryMount::FileInfo* VfsMemoryMount::LoadFile(const NormalizedPathView& file_path, void* (*allocator)(std::size_t)) const
+{
+    if (mNumFiles.load(std::memory_order_acquire) == 0)
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<const std::vector<std::uint8_t>> file_data;
+    {
+        std::lock_guard lock{ mMutex };
+        auto it = mFiles.find(file_path);
+        if (it == mFiles.end())
+        {
+            return nullptr;
+        }
+        file_data = it->second.Data;
+    }
+
+    const std::size_t file_size = file_data->size();
+    if (FileInfo* file_info = VirtualFilesystem::AllocateFileInfo(allocator, file_size))
+    {
+        std::memcpy(file_info->Data, file_data->data(), file_size);
+
+        mLoadedFiles.fetch_add(1, std::memory_order_relaxed);
+        mLoadedBytes.fetch_add(file_size, std::memory_order_relaxed);
+
+        return file_info;
+    }
+
+    return nullptr;
+}
+
+std::optional<std::filesystem::path> VfsMemoryMount::GetFilePath([[maybe_unused]] const std::filesystem::path& path) const
+{
+    // Generated files must not be picked up as inputs while other files are still being generated
+    return std::nullopt;
+}
+
+std::optional<std::filesystem::path> VfsMemoryMount::GetDiskPath(std::filesystem::path file_path) const
+{
+    return file_path;
+}
+
+bool VfsMemoryMount::IsType(VfsType type) const
+{
+    return type == VfsType::Any || type == mType;
+}
+
+void VfsMemoryMount::InvalidateIndex(const std::filesystem::path& changed_path)
+{
+    // Somebody else wrote to the backing folder, files still waiting to be written are newer than that
+    std::lock_guard lock{ mMutex };
+    std::erase_if(mPublishOrder, [&](const NormalizedPath& normalized_path)
+                  {
+                      auto it = mFiles.find(normalized_path);
+                      const PublishedFile& file = it->second;
+                      if (!file.WritePending && algo::is_sub_path(mBackingPath / file.RelativePath, changed_path))
+                      {
+                          mResidentSize -= file.Data->size();
+                          mFiles.erase(it);
+                          return true;
+                      }
+                      return false;
+                  });
+    mNumFiles.store(mFiles.size(), std::memory_order_release);
+}
+
+void VfsMemoryMount::LogStatistics() const
+{
+    const std::uint64_t loaded_files{ mLoadedFiles.load(std::memory_order_relaxed) };
+    const std::uint64_t written_bytes{ mWrittenBytes.load(std::memory_order_relaxed) };
+    if (loaded_files + written_bytes > 0)
+    {
+        const std::uint64_t loaded_bytes{ mLoadedBytes.load(std::memory_order_relaxed) };
+        LogInfo("Generated files in '{}': {} files loaded from memory ({} bytes), {} bytes written behind", mBackingPath.string(), loaded_files, loaded_bytes, written_bytes);
+    }
+}
+
+void VfsMemoryMount::Publish(const std::filesystem::path& relative_path, std::vector<std::uint8_t> data, bool write_behind)
+{
+    const NormalizedPath normalized_path{ relative_path };
+    auto shared_data = std::make_shared<const std::vector<std::uint8_t>>(std::move(data));
+
+    {
+        std::lock_guard lock{ mMutex };
+
+        if (auto it = mFiles.find(normalized_path); it != mFiles.end())
+        {
+            mResidentSize -= it->second.Data->size();
+            algo::erase(mPublishOrder, normalized_path);
+            if (it->second.WritePending)
+            {
+                mPendingWrites.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        mResidentSize += shared_data->size();
+        mPublishOrder.push_back(normalized_path);
+
+        PublishedFile& file = mFiles[normalized_path];
+        file = PublishedFile{
+            .RelativePath = relative_path,
+            .Data = shared_data,
+            .WritePending = write_behind,
+            .OnDisk = false,
+            .WriteFailed = false,
+        };
+        mNumFiles.store(mFiles.size(), std::memory_order_release);
+
+        if (!write_behind)
+        {
+            std::erase_if(mWriteQueue, [&](const WriteJob& queued_job)
+                          { return queued_job.Key == normalized_path; });
+        }
+        else
+        {
+            mPendingWrites.fetch_add(1, std::memory_order_relaxed);
+
+            // A queued write of an older version is simply replaced
+            if (WriteJob* queued_job = algo::find(mWriteQueue, &WriteJob::Key, normalized_path))
+            {
+                queued_job->Data = std::move(shared_data);
+            }
+            else
+            {
+                mWriteQueue.push_back(WriteJob{ normalized_path, relative_path, std::move(shared_data) });
+            }
+        }
+    }
+    mWriteQueueChanged.notify_all();
+}
+
+void VfsMemoryMount::WaitForWrite(const std::filesystem::path& relative_path) const
+{
+    if (mPendingWrites.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+
+    const NormalizedPath normalized_path{ relative_path };
+    const bool match_stem{ !relative_path.has_extension() };
+
+    std::unique_lock lock{ mMutex };
+    mWriteQueueChanged.wait(lock, [&]()
+                            { return !HasPendingWriteLocked(normalized_path, match_stem); });
+}
+void VfsMemoryMount::WaitForAllWrites() const
+{
+    std::unique_lock lock{ mMutex };
+    mWriteQueueChanged.wait(lock, [this]()
+                            { return mWriteQueue.empty() && mWritesInFlight == 0; });
+}
+
+std::vector<std::filesystem::path> VfsMemoryMount::TakeWrittenFiles()
+{
+    std::lock_guard lock{ mMutex };
+
+    std::vector<std::filesystem::path> written_files;
+    for (auto& [normalized_path, disk_path] : mWrittenFiles)
+    {
+        if (auto it = mFiles.find(normalized_path); it != mFiles.end() && !it->second.WritePending && !it->second.WriteFailed)
+        {
+            it->second.OnDisk = true;
+        }
+        written_files.push_back(std::move(disk_path));
+    }
+    mWrittenFiles.clear();
+    mHasWrittenFiles.store(false, std::memory_order_release);
+
+    return written_files;
+}
+void VfsMemoryMount::EvictWrittenFiles()
+{
+    // Oldest files were most likely already loaded by the game
+    std::lock_guard lock{ mMutex };
+    std::erase_if(mPublishOrder, [&](const NormalizedPath& normalized_path)
+                  {
+                      if (mResidentSize <= mMemoryBudget)
+                      {
+                          return false;
+                      }
+
+                      auto it = mFiles.find(normalized_path);
+                      const PublishedFile& file = it->second;
+                      if (file.OnDisk && !file.WritePending)
+                      {
+                          mResidentSize -= file.Data->size();
+                          mFiles.erase(it);
+                          return true;
+                      }
+                      return false;
+                  });
+    mNumFiles.store(mFiles.size(), std::memory_order_release);
+}
+
+void VfsMemoryMount::WriterMain()
+{
+    namespace fs = std::filesystem;
+
+    while (true)
+    {
+        WriteJob job;
+        {
+            std::unique_lock lock{ mMutex };
+            mWriteQueueChanged.wait(lock, [this]()
+                                    { return mStopping || !mWriteQueue.empty(); });
+            if (mWriteQueue.empty())
+            {
+                return;
+            }
+
+            job = std::move(mWriteQueue.front());
+            mWriteQueue.pop_front();
+            mWritesInFlight++;
+        }
+
+        const fs::path disk_path{ mBackingPath / job.RelativePath };
+
+        std::error_code error_code;
+        fs::create_directories(disk_path.parent_path(), error_code);
+        bool written{ false };
+        if (auto disk_file = std::ofstream{ disk_path, std::ios::trunc | std::ios::binary })
+        {
+            disk_file.write(reinterpret_cast<const char*>(job.Data->data()), job.Data->size());
+            disk_file.close();
+            written = static_cast<bool>(disk_file);
+        }
+
+        if (written)
+        {
+            mWrittenBytes.fetch_add(job.Data->size(), std::memory_order_relaxed);
+        }
+        else
+        {
+            LogError("Could not write generated file {}, it is kept in memory and will have to be generated again on the next launch...", disk_path.string());
+        }
+
+        {
+            std::lock_guard lock{ mMutex };
+            mWritesInFlight--;
+            if (auto it = mFiles.find(job.Key); it != mFiles.end() && it->second.Data == job.Data)
+            {
+                // Waiters are released either way, a failed file is simply never reported as written and thus never evicted
+                it->second.WritePending = false;
+                it->second.WriteFailed = !written;
+                mPendingWrites.fetch_sub(1, std::memory_order_relaxed);
+            }
+            if (written)
+            {
+                mWrittenFiles.emplace_back(job.Key, disk_path);
+                mHasWrittenFiles.store(true, std::memory_order_release);
+            }
+        }
+        mWriteQueueChanged.notify_all();
+    }
+}
+
+bool VfsMemoryMount::HasPendingWriteLocked(const NormalizedPath& normalized_path, bool match_stem) const
+{
+    if (!match_stem)
+    {
+        auto it = mFiles.find(normalized_path);
+        return it != mFiles.end() && it->second.WritePending;
+    }
+
+    const std::string_view stem{ normalized_path.GetString() };
+    for (const auto& [file_path, file] : mFiles)
+    {
+        const std::string_view file_path_view{ file_path.GetString() };
+        if (file.WritePending && file_path_view.starts_with(stem) && file_path_view.find('.', stem.size()) == stem.size())
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "util/normalized_path.h"
+#include "vfs_mount_impl.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Serves files generated by the loader straight from memory and writes them to the backing folder in the background
+// Files are only visible to LoadFile, preprocessing finds them through the mount of the backing folder once they are on disk
+class VfsMemoryMount : public IVfsMountImpl
+{
+  public:
+    VfsMemoryMount(std::filesystem::path backing_path, VfsType type, std::size_t memory_budget);
+    virtual ~VfsMemoryMount() override;
+
+    VfsMemoryMount(const VfsMemoryMount&) = delete;
+    VfsMemoryMount(VfsMemoryMount&&) = delete;
+    VfsMemoryMount& operator=(const VfsMemoryMount&) = delete;
+    VfsMemoryMount& operator=(VfsMemoryMount&&) = delete;
+
+    virtual FileInfo* LoadFile(const NormalizedPathView& file_path, void* (*allocator)(std::size_t)) const override;
+    virtual std::optional<std::filesystem::path> GetFilePath(const std::filesystem::path& path) const override;
+    virtual std::optional<std::filesystem::path> GetDiskPath(std::filesystem::path file_path) const override;
+    virtual bool IsType(VfsType type) const override;
+    virtual void InvalidateIndex(const std::filesystem::path& changed_path) override;
+    virtual void LogStatistics() const override;
+
+    const std::filesystem::path& GetBackingPath() const
+    {
+        return mBackingPath;
+    }
+
+    // Replaces the file at the given path relative to the backing folder, with write_behind set it is also written to disk
+    void Publish(const std::filesystem::path& relative_path, std::vector<std::uint8_t> data, bool write_behind);
+
+    // Blocks until the file is written to disk, for pathes without extension this waits for all files with a matching stem
+    void WaitForWrite(const std::filesystem::path& relative_path) const;
+    void WaitForAllWrites() const;
+
+    // Returns all files that were written to disk since the last call, after this they may be dropped from memory
+    bool HasWrittenFiles() const
+    {
+        return mHasWrittenFiles.load(std::memory_order_acquire);
+    }
+    std::vector<std::filesystem::path> TakeWrittenFiles();
+    void EvictWrittenFiles();
+
+  private:
+    struct PublishedFile
+    {
+        std::filesystem::path RelativePath;
+        std::shared_ptr<const std::vector<std::uint8_t>> Data;
+        bool WritePending;
+        bool OnDisk;
+        // Kept in memory for the rest of the session, the disk may hold an older version or nothing at all
+        bool WriteFailed;
+    };
+    struct WriteJob
+    {
+        NormalizedPath Key;
+        std::filesystem::path RelativePath;
+        std::shared_ptr<const std::vector<std::uint8_t>> Data;
+    };
+
+    void WriterMain();
+    bool HasPendingWriteLocked(const NormalizedPath& normalized_path, bool match_stem) const;
+
+    std::filesystem::path mBackingPath;
+    VfsType mType;
+    const std::size_t mMemoryBudget;
+
+    mutable std::mutex mMutex;
+    mutable std::condition_variable mWriteQueueChanged;
+    bool mStopping{ false };
+
+    // Keyed by normalized path relative to the backing folder
+    std::unordered_map<NormalizedPath, PublishedFile, NormalizedPathHash, NormalizedPathEqual> mFiles;
+    // Lets LoadFile skip the lock while nothing is resident, which is most of the time once the pipeline is done
+    std::atomic_size_t mNumFiles{ 0 };
+    std::deque<NormalizedPath> mPublishOrder;
+    std::size_t mResidentSize{ 0 };
+
+    std::deque<WriteJob> mWriteQueue;
+    std::size_t mWritesInFlight{ 0 };
+    std::atomic_size_t mPendingWrites{ 0 };
+    std::vector<std::pair<NormalizedPath, std::filesystem::path>> mWrittenFiles;
+    std::atomic_bool mHasWrittenFiles{ false };
+
+    mutable std::atomic_uint64_t mLoadedFiles{ 0 };
+    mutable std::atomic_uint64_t mLoadedBytes{ 0 };
+    std::atomic_uint64_t mWrittenBytes{ 0 };
+
+    // Started last so that everything it touches is already constructed
+    std::thread mWriter;
+};
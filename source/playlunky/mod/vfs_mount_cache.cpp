@@ -0,0 +1,103 @@
+#include "vfs_mount_cache.h"
+
+#include "util/normalized_path.h"
+
+#include <functional>
+
+static constexpr std::size_t c_InitialNumSlots{ 64 };
+
+VfsMountCache::VfsMountCache()
+{
+    mTables.push_back(MakeTable(c_InitialNumSlots));
+    mTable.store(mTables.back().get(), std::memory_order_release);
+}
+VfsMountCache::~VfsMountCache() = default;
+
+std::optional<const VfsMountCache::VfsMount*> VfsMountCache::Find(Key key) const
+{
+    return Find(key, Hash(key));
+}
+std::optional<const VfsMountCache::VfsMount*> VfsMountCache::Find(Key key, std::size_t hash) const
+{
+    const Table* table = mTable.load(std::memory_order_acquire);
+    if (const Entry* entry = FindInTable(*table, key, hash))
+    {
+        return entry->Mount;
+    }
+    return std::nullopt;
+}
+
+void VfsMountCache::InsertIfMissing(Key key, const VfsMount* mount)
+{
+    InsertIfMissing(key, Hash(key), mount);
+}
+void VfsMountCache::InsertIfMissing(Key key, std::size_t hash, const VfsMount* mount)
+{
+    Table* table = mTables.back().get();
+    if (FindInTable(*table, key, hash) != nullptr)
+    {
+        return;
+    }
+
+    const Entry* entry = &mEntries.emplace_back(Entry{ hash, key.Group, NormalizedPath::Normalize(key.Path), mount });
+
+    // Keep the load factor below one half so probe sequences stay short
+    if ((mEntries.size() * 2) > (table->Mask + 1))
+    {
+        // Readers may still be probing the old table, it stays alive until the cache is destroyed
+        std::unique_ptr<Table> new_table{ MakeTable((table->Mask + 1) * 2) };
+        for (const Entry& existing_entry : mEntries)
+        {
+            InsertIntoTable(*new_table, &existing_entry);
+        }
+        mTables.push_back(std::move(new_table));
+        mTable.store(mTables.back().get(), std::memory_order_release);
+    }
+    else
+    {
+        InsertIntoTable(*table, entry);
+    }
+}
+
+std::size_t VfsMountCache::Hash(Key key)
+{
+    const std::size_t path_hash{ NormalizedPath::Hash(key.Path) };
+    const std::size_t group_hash{ std::hash<const void*>{}(key.Group) };
+    return path_hash ^ (group_hash + 0x9e3779b97f4a7c15ull + (path_hash << 6) + (path_hash >> 2));
+}
+
+const VfsMountCache::Entry* VfsMountCache::FindInTable(const Table& table, Key key, std::size_t hash)
+{
+    for (std::size_t i = hash & table.Mask;; i = (i + 1) & table.Mask)
+    {
+        const Entry* entry = table.Slots[i].load(std::memory_order_acquire);
+        if (entry == nullptr)
+        {
+            return nullptr;
+        }
+        else if (entry->Hash == hash && entry->Group == key.Group && NormalizedPath::IsSame(entry->Path, key.Path))
+        {
+            return entry;
+        }
+    }
+}
+
+void VfsMountCache::InsertIntoTable(Table& table, const Entry* entry)
+{
+    for (std::size_t i = entry->Hash & table.Mask;; i = (i + 1) & table.Mask)
+    {
+        if (table.Slots[i].load(std::memory_order_relaxed) == nullptr)
+        {
+            table.Slots[i].store(entry, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+std::unique_ptr<VfsMountCache::Table> VfsMountCache::MakeTable(std::size_t num_slots)
+{
+    auto table = std::make_unique<Table>();
+    table->Mask = num_slots - 1;
+    table->Slots = std::make_unique<std::atomic<const Entry*>[]>(num_slots);
+    return table;
+}
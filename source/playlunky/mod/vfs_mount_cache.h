@@ -0,0 +1,94 @@
+#pragma once
+
+#include "virtual_filesystem.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Insert-only cache of which mount was chosen for a path or a group of pathes
+// Lookups are wait-free, inserts are serialized and publish a new table when the current one gets too full
+// Pathes are hashed and compared in normalized form on the fly, lookups neither allocate nor intern anything
+class VfsMountCache
+{
+  public:
+    using VfsMount = VirtualFilesystem::VfsMount;
+
+    VfsMountCache();
+    ~VfsMountCache();
+
+    VfsMountCache(const VfsMountCache&) = delete;
+    VfsMountCache(VfsMountCache&&) = delete;
+    VfsMountCache& operator=(const VfsMountCache&) = delete;
+    VfsMountCache& operator=(VfsMountCache&&) = delete;
+
+    // Either a group of pathes or a single path, the path only has to live as long as the call
+    struct Key
+    {
+        const void* Group{ nullptr };
+        std::string_view Path{};
+    };
+
+    // Cached mounts may be nullptr, so an empty optional signals a cache miss
+    std::optional<const VfsMount*> Find(Key key) const;
+
+    // Returns the cached mount or computes and caches it, concurrent callers will all receive the same mount
+    // Additional keys that should map to the same result can be passed to InsertIfMissing from within compute
+    template<class FunT>
+    const VfsMount* FindOrInsert(Key key, FunT&& compute)
+    {
+        const std::size_t hash{ Hash(key) };
+        if (std::optional<const VfsMount*> cached_mount = Find(key, hash))
+        {
+            return cached_mount.value();
+        }
+
+        std::lock_guard lock{ mWriteMutex };
+        if (std::optional<const VfsMount*> cached_mount = Find(key, hash))
+        {
+            return cached_mount.value();
+        }
+
+        const VfsMount* mount = compute();
+        InsertIfMissing(key, hash, mount);
+        return mount;
+    }
+
+    // Must only be called from within the compute callback of FindOrInsert
+    void InsertIfMissing(Key key, const VfsMount* mount);
+
+  private:
+    // Only entries own a copy of their path, made once when they are inserted
+    struct Entry
+    {
+        std::size_t Hash;
+        const void* Group;
+        std::string Path;
+        const VfsMount* Mount;
+    };
+    struct Table
+    {
+        std::size_t Mask;
+        std::unique_ptr<std::atomic<const Entry*>[]> Slots;
+    };
+
+    std::optional<const VfsMount*> Find(Key key, std::size_t hash) const;
+    void InsertIfMissing(Key key, std::size_t hash, const VfsMount* mount);
+
+    static std::size_t Hash(Key key);
+    static const Entry* FindInTable(const Table& table, Key key, std::size_t hash);
+    static void InsertIntoTable(Table& table, const Entry* entry);
+    static std::unique_ptr<Table> MakeTable(std::size_t num_slots);
+
+    std::atomic<const Table*> mTable;
+
+    // Everything below is only touched while holding mWriteMutex
+    std::mutex mWriteMutex;
+    std::deque<Entry> mEntries;
+    std::vector<std::unique_ptr<Table>> mTables;
+};
@@ -0,0 +1,30 @@
+#include "vfs_mount_impl.h"
+
+#include <spel2.h>
+
+#include <cstdlib>
+#include <new>
+
+// Lives with the mounts rather than the vfs, so mounts can be built without the rest of it
+VirtualFilesystem::FileInfo* VirtualFilesystem::AllocateFileInfo(void* (*allocator)(std::size_t), std::size_t file_size)
+{
+    if (allocator == nullptr)
+    {
+        allocator = malloc;
+    }
+
+    const std::size_t allocation_size = file_size + sizeof(FileInfo);
+    if (void* buf = allocator(allocation_size))
+    {
+        void* data = static_cast<void*>(reinterpret_cast<char*>(buf) + 24);
+        FileInfo* file_info = new (buf) FileInfo();
+        *file_info = {
+            .Data = data,
+            .DataSize = static_cast<int>(file_size),
+            .AllocationSize = static_cast<int>(allocation_size)
+        };
+        return file_info;
+    }
+
+    return nullptr;
+}
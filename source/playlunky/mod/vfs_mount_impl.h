@@ -0,0 +1,35 @@
+#pragma once
+
+#include "util/normalized_path.h"
+#include "virtual_filesystem.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+class IVfsMountImpl
+{
+  public:
+    virtual ~IVfsMountImpl() = default;
+
+    using FileInfo = VirtualFilesystem::FileInfo;
+    // The path is hashed once for all mounts, lookups must not intern it, it comes straight from the game
+    virtual FileInfo* LoadFile(const NormalizedPathView& file_path, void* (*allocator)(std::size_t)) const = 0;
+    virtual std::optional<std::filesystem::path> GetFilePath(const std::filesystem::path& path) const = 0;
+    // Turns a path returned from GetFilePath into one that can be opened from disk, nullopt if that failed
+    virtual std::optional<std::filesystem::path> GetDiskPath(std::filesystem::path file_path) const = 0;
+    virtual bool IsType(VfsType type) const = 0;
+    virtual void InvalidateIndex(const std::filesystem::path& changed_path) = 0;
+    virtual void LogStatistics() const = 0;
+};
+
+struct VirtualFilesystem::VfsMount
+{
+    std::int64_t Priority;
+    std::string Name;
+    std::vector<VfsMount*> LinkedMounts;
+    std::unique_ptr<IVfsMountImpl> MountImpl;
+};
@@ -0,0 +1,482 @@
+#include "vfs_path_index.h"
+
+#include "vfs_snapshot.h"
+
+#include <algorithm>
+#include <mutex>
+
+static std::string NormalizeAbsoluteVfsPath(const std::filesystem::path& path)
+{
+    namespace fs = std::filesystem;
+    const fs::path absolute_path{ path.empty() ? fs::current_path() : fs::absolute(path) };
+    return NormalizedPath::Normalize(absolute_path.lexically_normal().string());
+}
+static std::string JoinVfsPath(const NormalizedPath& directory, const NormalizedPath& name)
+{
+    std::string joined{ directory.GetString() };
+    if (!joined.empty())
+    {
+        joined += '/';
+    }
+    joined += name.GetString();
+    return joined;
+}
+// Same as std::filesystem::path::has_extension for a single file name
+static bool HasExtension(std::string_view file_name)
+{
+    const std::size_t extension_pos{ file_name.rfind('.') };
+    return extension_pos != std::string_view::npos && extension_pos != 0 && file_name != "..";
+}
+static std::string_view GetFileName(std::string_view path)
+{
+    const std::size_t last_separator{ path.find_last_of("/\\") };
+    return last_separator == std::string_view::npos ? path : path.substr(last_separator + 1);
+}
+
+VfsPathIndex::VfsPathIndex(std::filesystem::path root_path, bool build_eagerly, std::optional<std::string_view> snapshot)
+    : mRootPath{ std::move(root_path) }
+    , mAbsoluteRootPath{ NormalizeAbsoluteVfsPath(mRootPath) }
+    , mIsEager{ build_eagerly }
+{
+    if (mIsEager)
+    {
+        if (!snapshot.has_value() || !RestoreSnapshot(snapshot.value()))
+        {
+            mListings.clear();
+            ListRecursive(NormalizedPath{}, mRootPath);
+        }
+        RebuildFilter();
+    }
+}
+VfsPathIndex::~VfsPathIndex() = default;
+
+bool VfsPathIndex::CanIndex(const std::filesystem::path& path)
+{
+    if (path.empty() || path.has_root_path())
+    {
+        return false;
+    }
+
+    for (const std::filesystem::path& element : path)
+    {
+        if (element == "." || element == "..")
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+bool VfsPathIndex::CanIndex(std::string_view path)
+{
+    if (path.empty() || path.starts_with('/') || path.starts_with('\\') || path.find(':') != std::string_view::npos)
+    {
+        return false;
+    }
+
+    while (true)
+    {
+        const std::size_t separator{ path.find_first_of("/\\") };
+        const std::string_view element{ path.substr(0, separator) };
+        if (element == "." || element == "..")
+        {
+            return false;
+        }
+        if (separator == std::string_view::npos)
+        {
+            return true;
+        }
+        path.remove_prefix(separator + 1);
+    }
+}
+
+std::optional<std::filesystem::path> VfsPathIndex::FindFile(const std::filesystem::path& path) const
+{
+    const std::string path_string{ path.string() };
+    return FindFile(NormalizedPathView{ path_string });
+}
+std::optional<std::filesystem::path> VfsPathIndex::FindFile(const NormalizedPathView& path) const
+{
+    const std::string_view path_view{ path.GetPath() };
+    const std::size_t last_separator{ path_view.find_last_of("/\\") };
+    const std::string_view file_name_view{ last_separator == std::string_view::npos ? path_view : path_view.substr(last_separator + 1) };
+    const NormalizedPathView directory{ last_separator == std::string_view::npos ? std::string_view{} : path_view.substr(0, last_separator) };
+    const NormalizedPathView file_name{ file_name_view };
+
+    auto find_in_listing = [&](const DirectoryListing& listing) -> std::optional<std::filesystem::path>
+    {
+        const NameMap& lookup = HasExtension(file_name_view) ? listing.Files : listing.Stems;
+        if (auto it = lookup.find(file_name); it != lookup.end())
+        {
+            return it->second;
+        }
+        return std::nullopt;
+    };
+
+    if (mIsEager)
+    {
+        std::shared_lock lock{ mListingsMutex };
+        if (auto it = mListings.find(directory); it != mListings.end() && it->second.has_value())
+        {
+            return find_in_listing(it->second.value());
+        }
+        return std::nullopt;
+    }
+
+    // Lazy indices list directories on first access, those are only looked up during preprocessing
+    std::lock_guard lock{ mListingsMutex };
+    if (const DirectoryListing* listing = GetListing(NormalizedPath{ directory.GetPath() }))
+    {
+        return find_in_listing(*listing);
+    }
+    return std::nullopt;
+}
+
+bool VfsPathIndex::MayContain(const NormalizedPathView& path) const
+{
+    const BloomFilter* filter{ mFilter.load(std::memory_order_acquire) };
+    if (filter == nullptr || !HasExtension(GetFileName(path.GetPath())))
+    {
+        return true;
+    }
+    return filter->MayContain(path.GetHash());
+}
+
+void VfsPathIndex::Invalidate(const std::filesystem::path& changed_path)
+{
+    const std::string absolute_changed_path{ NormalizeAbsoluteVfsPath(changed_path) };
+    if (!absolute_changed_path.starts_with(mAbsoluteRootPath))
+    {
+        // A change to a parent of the root may affect anything inside the root
+        if (mAbsoluteRootPath.starts_with(absolute_changed_path) && mAbsoluteRootPath[absolute_changed_path.size()] == '/')
+        {
+            std::lock_guard lock{ mListingsMutex };
+            for (const auto& [directory, listing] : mListings)
+            {
+                DropListing(directory, listing);
+            }
+            mListings.clear();
+            UpdateFilter();
+        }
+        return;
+    }
+
+    std::string_view relative_path{ absolute_changed_path };
+    relative_path.remove_prefix(mAbsoluteRootPath.size());
+    if (!relative_path.empty())
+    {
+        if (!relative_path.starts_with('/'))
+        {
+            // Only shares a prefix with the root, e.g. 'Mods/Foo' and 'Mods/FooBar'
+            return;
+        }
+        relative_path.remove_prefix(1);
+    }
+
+    auto is_parent_or_same = [](std::string_view parent, std::string_view child)
+    {
+        return parent.empty() || child == parent || (child.starts_with(parent) && child[parent.size()] == '/');
+    };
+
+    std::lock_guard lock{ mListingsMutex };
+    std::erase_if(mListings, [&](const auto& listing)
+                  {
+                      const std::string_view directory{ listing.first.GetString() };
+                      if (is_parent_or_same(relative_path, directory) || is_parent_or_same(directory, relative_path))
+                      {
+                          DropListing(listing.first, listing.second);
+                          return true;
+                      }
+                      return false; });
+    UpdateFilter();
+}
+
+void VfsPathIndex::WriteSnapshot(VfsSnapshotWriter& writer) const
+{
+    // Eager indices never hold dropped listings outside of Invalidate, so this already describes the whole folder
+    std::shared_lock lock{ mListingsMutex };
+
+    std::uint32_t num_listings{ 0 };
+    for (const auto& [directory, listing] : mListings)
+    {
+        num_listings += listing.has_value() ? 1 : 0;
+    }
+    writer.Write(num_listings);
+
+    for (const auto& [directory, listing] : mListings)
+    {
+        if (!listing.has_value())
+        {
+            continue;
+        }
+
+        writer.WriteString(directory.GetString());
+        writer.WriteString(directory.IsEmpty() ? std::string{} : listing->DiskPath.lexically_relative(mRootPath).string());
+
+        writer.Write(static_cast<std::uint32_t>(listing->Files.size()));
+        for (const auto& [file, file_name] : listing->Files)
+        {
+            writer.WriteString(file_name.string());
+        }
+
+        // Which file a stem maps to depends on the order files were listed in, so it is stored explicitly
+        writer.Write(static_cast<std::uint32_t>(listing->Stems.size()));
+        for (const auto& [stem, file_name] : listing->Stems)
+        {
+            writer.WriteString(stem.GetString());
+            writer.WriteString(file_name.string());
+        }
+
+        writer.Write(static_cast<std::uint32_t>(listing->SubDirectories.size()));
+        for (const auto& [sub_directory, sub_directory_name] : listing->SubDirectories)
+        {
+            writer.WriteString(sub_directory_name.string());
+        }
+    }
+}
+
+bool VfsPathIndex::RestoreSnapshot(std::string_view snapshot)
+{
+    VfsSnapshotReader reader{ snapshot };
+
+    std::uint32_t num_listings{ 0 };
+    if (!reader.Read(num_listings))
+    {
+        return false;
+    }
+
+    for (std::uint32_t i = 0; i < num_listings; i++)
+    {
+        std::string_view directory;
+        std::string_view relative_disk_path;
+        if (!reader.ReadString(directory) || !reader.ReadString(relative_disk_path))
+        {
+            return false;
+        }
+
+        DirectoryListing listing{};
+        listing.DiskPath = relative_disk_path.empty() ? mRootPath : mRootPath / relative_disk_path;
+
+        std::uint32_t num_files{ 0 };
+        if (!reader.Read(num_files))
+        {
+            return false;
+        }
+        listing.Files.reserve(num_files);
+        for (std::uint32_t j = 0; j < num_files; j++)
+        {
+            std::string_view file_name;
+            if (!reader.ReadString(file_name))
+            {
+                return false;
+            }
+            listing.Files.try_emplace(NormalizedPath{ file_name }, file_name);
+        }
+
+        std::uint32_t num_stems{ 0 };
+        if (!reader.Read(num_stems))
+        {
+            return false;
+        }
+        listing.Stems.reserve(num_stems);
+        for (std::uint32_t j = 0; j < num_stems; j++)
+        {
+            std::string_view stem;
+            std::string_view file_name;
+            if (!reader.ReadString(stem) || !reader.ReadString(file_name))
+            {
+                return false;
+            }
+            listing.Stems.try_emplace(NormalizedPath::FromNormalized(stem), file_name);
+        }
+
+        std::uint32_t num_sub_directories{ 0 };
+        if (!reader.Read(num_sub_directories))
+        {
+            return false;
+        }
+        listing.SubDirectories.reserve(num_sub_directories);
+        for (std::uint32_t j = 0; j < num_sub_directories; j++)
+        {
+            std::string_view sub_directory_name;
+            if (!reader.ReadString(sub_directory_name))
+            {
+                return false;
+            }
+            listing.SubDirectories.try_emplace(NormalizedPath{ sub_directory_name }, sub_directory_name);
+        }
+
+        mListings.insert_or_assign(NormalizedPath::FromNormalized(directory), std::move(listing));
+    }
+
+    return reader.IsAtEnd();
+}
+
+const VfsPathIndex::DirectoryListing* VfsPathIndex::GetListing(const NormalizedPath& directory) const
+{
+    if (auto it = mListings.find(directory); it != mListings.end())
+    {
+        return it->second.has_value() ? &it->second.value() : nullptr;
+    }
+
+    if (directory.IsEmpty())
+    {
+        return ListDirectory(directory, mRootPath);
+    }
+
+    const std::string_view directory_view{ directory.GetString() };
+    const std::size_t last_separator{ directory_view.rfind('/') };
+    const NormalizedPath parent_directory{ NormalizedPath::FromNormalized(last_separator == std::string_view::npos ? std::string_view{} : directory_view.substr(0, last_separator)) };
+    const NormalizedPath directory_name{ NormalizedPath::FromNormalized(last_separator == std::string_view::npos ? directory_view : directory_view.substr(last_separator + 1)) };
+
+    // Only list directories that are known to exist, pointers into mListings are stable across insertions
+    if (const DirectoryListing* parent_listing = GetListing(parent_directory))
+    {
+        if (auto it = parent_listing->SubDirectories.find(directory_name); it != parent_listing->SubDirectories.end())
+        {
+            return ListDirectory(directory, parent_listing->DiskPath / it->second);
+        }
+    }
+
+    mListings[directory] = std::nullopt;
+    return nullptr;
+}
+
+const VfsPathIndex::DirectoryListing* VfsPathIndex::ListDirectory(NormalizedPath directory, std::filesystem::path disk_path) const
+{
+    namespace fs = std::filesystem;
+
+    std::error_code error_code;
+    fs::directory_iterator dir_it{ disk_path.empty() ? fs::path{ "." } : disk_path, error_code };
+    if (error_code)
+    {
+        mListings[directory] = std::nullopt;
+        return nullptr;
+    }
+
+    // Only keep the filter up to date once it was built, the initial listing builds it in one go
+    BloomFilter* filter{ mIsEager && !mFilters.empty() ? mFilters.back().get() : nullptr };
+
+    DirectoryListing listing{};
+    listing.DiskPath = std::move(disk_path);
+    for (; dir_it != fs::directory_iterator{}; dir_it.increment(error_code))
+    {
+        if (error_code)
+        {
+            break;
+        }
+
+        const fs::directory_entry& entry = *dir_it;
+        fs::path file_name = entry.path().filename();
+        if (entry.is_regular_file(error_code))
+        {
+            if (filter != nullptr)
+            {
+                std::string file_path{ JoinVfsPath(directory, NormalizedPath{ file_name }) };
+                if (mDroppedFiles.erase(file_path) == 0)
+                {
+                    filter->Insert(NormalizedPath::Hash(file_path));
+                    mFilterSize++;
+                }
+            }
+            listing.Stems.try_emplace(NormalizedPath{ file_name.stem() }, file_name);
+            listing.Files.try_emplace(NormalizedPath{ file_name }, std::move(file_name));
+        }
+        else if (entry.is_directory(error_code))
+        {
+            listing.SubDirectories.try_emplace(NormalizedPath{ file_name }, std::move(file_name));
+        }
+    }
+
+    auto [it, inserted] = mListings.insert_or_assign(directory, std::move(listing));
+    return &it->second.value();
+}
+
+void VfsPathIndex::ListRecursive(const NormalizedPath& directory, std::filesystem::path disk_path) const
+{
+    if (const DirectoryListing* listing = ListDirectory(directory, std::move(disk_path)))
+    {
+        for (const auto& [sub_directory, sub_directory_name] : listing->SubDirectories)
+        {
+            ListRecursive(NormalizedPath::FromNormalized(JoinVfsPath(directory, sub_directory)), listing->DiskPath / sub_directory_name);
+        }
+    }
+}
+void VfsPathIndex::ListMissingRecursive(const NormalizedPath& directory) const
+{
+    // Unlike ListRecursive this reuses all listings that are still cached
+    if (const DirectoryListing* listing = GetListing(directory))
+    {
+        for (const auto& [sub_directory, sub_directory_name] : listing->SubDirectories)
+        {
+            ListMissingRecursive(NormalizedPath::FromNormalized(JoinVfsPath(directory, sub_directory)));
+        }
+    }
+}
+void VfsPathIndex::ListInvalidated() const
+{
+    if (!mHasDroppedListings)
+    {
+        return;
+    }
+
+    ListMissingRecursive(NormalizedPath{});
+    mHasDroppedListings = false;
+
+    // Whatever did not show up again was deleted, those files stay in the filter until it is rebuilt
+    mDroppedFiles.clear();
+}
+void VfsPathIndex::DropListing(const NormalizedPath& directory, const OptionalListing& listing) const
+{
+    mHasDroppedListings = true;
+    if (mIsEager && !mFilters.empty() && listing.has_value())
+    {
+        for (const auto& [file, file_name] : listing->Files)
+        {
+            mDroppedFiles.insert(JoinVfsPath(directory, file));
+        }
+    }
+}
+void VfsPathIndex::UpdateFilter() const
+{
+    if (!mIsEager)
+    {
+        return;
+    }
+
+    ListInvalidated();
+    if (mFilterSize > mFilterCapacity)
+    {
+        RebuildFilter();
+    }
+}
+void VfsPathIndex::RebuildFilter() const
+{
+    std::size_t num_files{ 0 };
+    for (const auto& [directory, listing] : mListings)
+    {
+        if (listing.has_value())
+        {
+            num_files += listing->Files.size();
+        }
+    }
+
+    // Leaves room for files added later on, e.g. generated by the mod pipeline
+    mFilterCapacity = std::max<std::size_t>(num_files * 2, 64);
+    mFilterSize = num_files;
+    auto filter = std::make_unique<BloomFilter>(mFilterCapacity);
+    mDroppedFiles.clear();
+    for (const auto& [directory, listing] : mListings)
+    {
+        if (listing.has_value())
+        {
+            for (const auto& [file, file_name] : listing->Files)
+            {
+                filter->Insert(NormalizedPath::Hash(JoinVfsPath(directory, file)));
+            }
+        }
+    }
+
+    mFilters.push_back(std::move(filter));
+    mFilter.store(mFilters.back().get(), std::memory_order_release);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "util/bloom_filter.h"
+#include "util/normalized_path.h"
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class VfsSnapshotWriter;
+
+// Case-insensitive index of all files inside a mounted folder
+// Each directory is listed at most once, afterwards lookups are resolved purely in memory
+class VfsPathIndex
+{
+  public:
+    // If build_eagerly is set the whole folder is indexed right away, otherwise directories are indexed on first access
+    // An eager index can be restored from a snapshot instead, which does not touch the disk at all
+    VfsPathIndex(std::filesystem::path root_path, bool build_eagerly, std::optional<std::string_view> snapshot = std::nullopt);
+    ~VfsPathIndex();
+
+    VfsPathIndex(const VfsPathIndex&) = delete;
+    VfsPathIndex(VfsPathIndex&&) = delete;
+    VfsPathIndex& operator=(const VfsPathIndex&) = delete;
+    VfsPathIndex& operator=(VfsPathIndex&&) = delete;
+
+    // Only relative pathes that stay inside the root can be answered by the index
+    static bool CanIndex(const std::filesystem::path& path);
+    static bool CanIndex(std::string_view path);
+
+    // Returns the name of the file on disk, if path has no extension this is the first file with a matching stem
+    // Eager indices are complete at all times, looking up in them only takes a shared lock and interns nothing
+    std::optional<std::filesystem::path> FindFile(const std::filesystem::path& path) const;
+    std::optional<std::filesystem::path> FindFile(const NormalizedPathView& path) const;
+
+    // Cheap pre-check before FindFile, false means the file is definitely not in the index
+    // Never blocks, it probes the filter as it was published by the last change to the index
+    // Always true for lazily built indices and for pathes without extension
+    bool MayContain(const NormalizedPathView& path) const;
+    bool HasFilter() const
+    {
+        return mIsEager;
+    }
+
+    // Drops all cached listings that may be affected by a change to the given file or folder
+    // Eager indices list the dropped directories again right away and update their filter, so reads never have to
+    void Invalidate(const std::filesystem::path& changed_path);
+
+    // Writes the complete index in a form that can be passed to the constructor on the next launch
+    void WriteSnapshot(VfsSnapshotWriter& writer) const;
+
+  private:
+    using NameMap = std::unordered_map<NormalizedPath, std::filesystem::path, NormalizedPathHash, NormalizedPathEqual>;
+    struct DirectoryListing
+    {
+        std::filesystem::path DiskPath;
+        NameMap Files;
+        NameMap Stems;
+        NameMap SubDirectories;
+    };
+    using OptionalListing = std::optional<DirectoryListing>;
+    using ListingMap = std::unordered_map<NormalizedPath, OptionalListing, NormalizedPathHash, NormalizedPathEqual>;
+
+    const DirectoryListing* GetListing(const NormalizedPath& directory) const;
+    const DirectoryListing* ListDirectory(NormalizedPath directory, std::filesystem::path disk_path) const;
+    void ListRecursive(const NormalizedPath& directory, std::filesystem::path disk_path) const;
+    void ListMissingRecursive(const NormalizedPath& directory) const;
+    void ListInvalidated() const;
+    void DropListing(const NormalizedPath& directory, const OptionalListing& listing) const;
+    void UpdateFilter() const;
+    void RebuildFilter() const;
+    bool RestoreSnapshot(std::string_view snapshot);
+
+    const std::filesystem::path mRootPath;
+    const std::string mAbsoluteRootPath;
+    const bool mIsEager;
+
+    mutable std::shared_mutex mListingsMutex;
+    mutable ListingMap mListings;
+    mutable bool mHasDroppedListings{ false };
+
+    // Files that show up when listing again are inserted into the published filter in place, readers never wait for it
+    // Deleted files stay in the filter and only cause false positives, it is rebuilt once more files went in than it was sized for
+    // Replaced filters are kept alive until the index is destroyed, a reader may still be probing them
+    mutable std::atomic<const BloomFilter*> mFilter{ nullptr };
+    mutable std::vector<std::unique_ptr<BloomFilter>> mFilters;
+    mutable std::unordered_set<std::string> mDroppedFiles;
+    mutable std::size_t mFilterSize{ 0 };
+    mutable std::size_t mFilterCapacity{ 0 };
+};
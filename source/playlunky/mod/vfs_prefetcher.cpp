@@ -0,0 +1,271 @@
+#include "vfs_prefetcher.h"
+
+#include "log.h"
+#include "util/algorithms.h"
+
+#include <spel2.h>
+
+#include <cstdlib>
+#include <cstring>
+
+// Successors are followed this many files ahead, each file remembers this many distinct successors
+static constexpr std::size_t c_PredictionDepth{ 16 };
+static constexpr std::size_t c_MaxSuccessors{ 4 };
+
+VfsPrefetcher::VfsPrefetcher(LoaderFun loader, std::size_t num_threads, std::size_t cache_budget, bool predict_loads)
+    : mLoader{ std::move(loader) }
+    , mCacheBudget{ cache_budget }
+    , mPredictLoads{ predict_loads }
+{
+    for (std::size_t i = 0; i < num_threads; i++)
+    {
+        mWorkers.emplace_back(&VfsPrefetcher::WorkerMain, this);
+    }
+}
+VfsPrefetcher::~VfsPrefetcher()
+{
+    {
+        std::lock_guard lock{ mMutex };
+        mStopping = true;
+    }
+    mWorkAvailable.notify_all();
+
+    for (std::thread& worker : mWorkers)
+    {
+        worker.join();
+    }
+
+    Clear();
+}
+
+void VfsPrefetcher::Prefetch(std::span<const char* const> paths)
+{
+    {
+        std::lock_guard lock{ mMutex };
+        for (const char* path : paths)
+        {
+            EnqueueLocked(path);
+        }
+        UpdateNumTrackedLocked();
+    }
+    mWorkAvailable.notify_all();
+}
+
+VfsPrefetcher::FileInfo* VfsPrefetcher::Take(const NormalizedPathView& path, void* (*allocator)(std::size_t), bool may_be_stale)
+{
+    if (!mPredictLoads && mNumTracked.load(std::memory_order_acquire) == 0)
+    {
+        mMisses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    CachedFile cached_file{};
+    {
+        std::lock_guard lock{ mMutex };
+
+        const std::size_t num_queued{ mQueue.size() };
+        if (mPredictLoads)
+        {
+            PredictLocked(path);
+        }
+        if (mQueue.size() != num_queued)
+        {
+            mWorkAvailable.notify_all();
+        }
+
+        auto it = mCache.find(path);
+        if (it == mCache.end() || may_be_stale)
+        {
+            if (it != mCache.end())
+            {
+                std::free(it->second.Info);
+                mCacheSize -= it->second.Size;
+                algo::erase(mCacheOrder, it->first);
+                mCache.erase(it);
+            }
+
+            // The caller loads the file itself now, so a result still in flight is useless
+            if (auto pending_it = mPending.find(path); pending_it != mPending.end())
+            {
+                std::erase_if(mQueue, [&](const Job& queued_job)
+                              { return NormalizedPathEqual{}(queued_job.Path, path); });
+                mPending.erase(pending_it);
+            }
+            UpdateNumTrackedLocked();
+
+            mMisses.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        cached_file = it->second;
+        algo::erase(mCacheOrder, it->first);
+        mCache.erase(it);
+        mCacheSize -= cached_file.Size;
+        UpdateNumTrackedLocked();
+    }
+
+    mHits.fetch_add(1, std::memory_order_relaxed);
+
+    if (allocator == nullptr)
+    {
+        // Prefetched files were allocated with malloc, so they can be handed off as they are
+        return cached_file.Info;
+    }
+
+    const std::size_t file_size = static_cast<std::size_t>(cached_file.Info->DataSize);
+    FileInfo* file_info = VirtualFilesystem::AllocateFileInfo(allocator, file_size);
+    if (file_info != nullptr)
+    {
+        std::memcpy(file_info->Data, cached_file.Info->Data, file_size);
+    }
+    std::free(cached_file.Info);
+    return file_info;
+}
+
+void VfsPrefetcher::Clear()
+{
+    std::lock_guard lock{ mMutex };
+    for (auto& [path, cached_file] : mCache)
+    {
+        std::free(cached_file.Info);
+    }
+    mCache.clear();
+    mCacheOrder.clear();
+    mCacheSize = 0;
+
+    // Loads in flight were started before this, they are dropped by the worker once done
+    mQueue.clear();
+    mPending.clear();
+    mGeneration++;
+    UpdateNumTrackedLocked();
+}
+
+void VfsPrefetcher::LogStatistics() const
+{
+    const std::uint64_t hits{ mHits.load(std::memory_order_relaxed) };
+    const std::uint64_t misses{ mMisses.load(std::memory_order_relaxed) };
+    const std::uint64_t prefetched_bytes{ mPrefetchedBytes.load(std::memory_order_relaxed) };
+    LogInfo("Prefetcher: {} loads served from prefetched files, {} misses, {} bytes prefetched", hits, misses, prefetched_bytes);
+}
+
+void VfsPrefetcher::WorkerMain()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock lock{ mMutex };
+            mWorkAvailable.wait(lock, [this]()
+                                { return mStopping || !mQueue.empty(); });
+            if (mStopping)
+            {
+                return;
+            }
+
+            job = std::move(mQueue.front());
+            mQueue.pop_front();
+        }
+
+        FileInfo* file_info = mLoader(job.Path.c_str());
+
+        std::lock_guard lock{ mMutex };
+
+        // Either everything was cleared since the job was queued or the file was already loaded by the game
+        auto pending_it = job.Generation == mGeneration ? mPending.find(job.Path) : mPending.end();
+        if (pending_it == mPending.end() || file_info == nullptr)
+        {
+            std::free(file_info);
+            if (pending_it != mPending.end())
+            {
+                mPending.erase(pending_it);
+                UpdateNumTrackedLocked();
+            }
+            continue;
+        }
+
+        mPending.erase(pending_it);
+        InsertLocked(std::move(job.Path), file_info);
+        UpdateNumTrackedLocked();
+    }
+}
+
+void VfsPrefetcher::PredictLocked(const NormalizedPathView& path)
+{
+    if (!mLastLoad.empty() && !NormalizedPathEqual{}(mLastLoad, path))
+    {
+        auto it = mSuccessors.find(mLastLoad);
+        if (it == mSuccessors.end())
+        {
+            it = mSuccessors.emplace(mLastLoad, std::vector<std::string>{}).first;
+        }
+
+        std::vector<std::string>& successors = it->second;
+        if (successors.size() < c_MaxSuccessors && !algo::contains_if(successors, [&](const std::string& successor)
+                                                                      { return NormalizedPathEqual{}(successor, path); }))
+        {
+            successors.emplace_back(path.GetPath());
+        }
+    }
+
+    // Follow the first successor of each file, that is the order in which the game loaded them the first time
+    std::string_view current_path{ path.GetPath() };
+    for (std::size_t i = 0; i < c_PredictionDepth; i++)
+    {
+        auto it = mSuccessors.find(NormalizedPathView{ current_path });
+        if (it == mSuccessors.end() || it->second.empty())
+        {
+            break;
+        }
+        current_path = it->second.front();
+        EnqueueLocked(current_path);
+    }
+
+    // Reuses the capacity of the previous path
+    mLastLoad.assign(path.GetPath());
+}
+
+void VfsPrefetcher::EnqueueLocked(std::string_view path)
+{
+    const NormalizedPathView normalized_path{ path };
+    if (mCache.contains(normalized_path) || mPending.contains(normalized_path))
+    {
+        return;
+    }
+
+    mPending.emplace(path);
+    mQueue.push_back(Job{ std::string{ path }, mGeneration });
+}
+
+void VfsPrefetcher::InsertLocked(std::string path, FileInfo* file_info)
+{
+    const std::size_t file_size{ static_cast<std::size_t>(file_info->AllocationSize) };
+    if (file_size > mCacheBudget)
+    {
+        std::free(file_info);
+        return;
+    }
+
+    EvictLocked(file_size);
+    mCacheOrder.push_back(path);
+    mCache.insert_or_assign(std::move(path), CachedFile{ file_info, file_size });
+    mCacheSize += file_size;
+    mPrefetchedBytes.fetch_add(file_size, std::memory_order_relaxed);
+}
+
+void VfsPrefetcher::EvictLocked(std::size_t required_size)
+{
+    // Oldest prefetches are the least likely to still be needed
+    while (!mCacheOrder.empty() && mCacheSize + required_size > mCacheBudget)
+    {
+        auto it = mCache.find(mCacheOrder.front());
+        mCacheSize -= it->second.Size;
+        std::free(it->second.Info);
+        mCache.erase(it);
+        mCacheOrder.pop_front();
+    }
+}
+
+void VfsPrefetcher::UpdateNumTrackedLocked()
+{
+    mNumTracked.store(mCache.size() + mPending.size(), std::memory_order_release);
+}
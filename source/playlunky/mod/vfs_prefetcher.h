@@ -0,0 +1,102 @@
+#pragma once
+
+#include "util/normalized_path.h"
+#include "virtual_filesystem.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Loads files on a few worker threads ahead of time and keeps them until the game asks for them
+class VfsPrefetcher
+{
+  public:
+    using FileInfo = VirtualFilesystem::FileInfo;
+    // Has to load files with malloc as allocator
+    using LoaderFun = std::function<FileInfo*(const char*)>;
+
+    // With predict_loads set the order in which files are loaded is remembered and used to prefetch the files following each load
+    VfsPrefetcher(LoaderFun loader, std::size_t num_threads, std::size_t cache_budget, bool predict_loads);
+    ~VfsPrefetcher();
+
+    VfsPrefetcher(const VfsPrefetcher&) = delete;
+    VfsPrefetcher(VfsPrefetcher&&) = delete;
+    VfsPrefetcher& operator=(const VfsPrefetcher&) = delete;
+    VfsPrefetcher& operator=(VfsPrefetcher&&) = delete;
+
+    void Prefetch(std::span<const char* const> paths);
+
+    // Called for every load, hands out a prefetched file copied into memory from allocator and drops it from the cache
+    // Returns nullptr if it was not prefetched, or if it may be stale, in that case the prefetched file is dropped
+    // Predictions are updated under the same lock and nothing is allocated unless a new successor is learned
+    FileInfo* Take(const NormalizedPathView& path, void* (*allocator)(std::size_t), bool may_be_stale);
+
+    // Drops everything that was prefetched, e.g. because mounted files changed, loads still in flight are dropped once they finish
+    void Clear();
+
+    void LogStatistics() const;
+
+  private:
+    struct CachedFile
+    {
+        FileInfo* Info;
+        std::size_t Size;
+    };
+    struct Job
+    {
+        std::string Path;
+        std::uint64_t Generation;
+    };
+
+    void WorkerMain();
+    void PredictLocked(const NormalizedPathView& path);
+    void EnqueueLocked(std::string_view path);
+    void InsertLocked(std::string path, FileInfo* file_info);
+    void EvictLocked(std::size_t required_size);
+    void UpdateNumTrackedLocked();
+
+    LoaderFun mLoader;
+    const std::size_t mCacheBudget;
+    const bool mPredictLoads;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mWorkAvailable;
+    bool mStopping{ false };
+
+    // Bumped by Clear, results of jobs queued before that are dropped when they finish
+    std::uint64_t mGeneration{ 0 };
+
+    // All pathes are kept as requested, hashing and comparing them normalizes on the fly
+    template<class T>
+    using PathMap = std::unordered_map<std::string, T, NormalizedPathHash, NormalizedPathEqual>;
+    using PathSet = std::unordered_set<std::string, NormalizedPathHash, NormalizedPathEqual>;
+
+    std::deque<Job> mQueue;
+    PathSet mPending;
+
+    PathMap<CachedFile> mCache;
+    std::deque<std::string> mCacheOrder;
+    std::size_t mCacheSize{ 0 };
+
+    // Lets Take skip the lock while there is nothing to take and nothing to predict
+    std::atomic_size_t mNumTracked{ 0 };
+
+    std::string mLastLoad;
+    PathMap<std::vector<std::string>> mSuccessors;
+
+    std::vector<std::thread> mWorkers;
+
+    mutable std::atomic_uint64_t mHits{ 0 };
+    mutable std::atomic_uint64_t mMisses{ 0 };
+    mutable std::atomic_uint64_t mPrefetchedBytes{ 0 };
+};
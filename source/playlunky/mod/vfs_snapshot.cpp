@@ -0,0 +1,85 @@
+#include "vfs_snapshot.h"
+
+#include "log.h"
+#include "util/file.h"
+
+static constexpr std::uint32_t c_SnapshotMagic{ 0x53564c50 }; // 'PLVS'
+static constexpr std::uint32_t c_SnapshotVersion{ 1 };
+
+std::unique_ptr<VfsSnapshot> VfsSnapshot::Load(const std::filesystem::path& snapshot_path)
+{
+    std::unique_ptr<VfsSnapshot> snapshot{ new VfsSnapshot{} };
+    snapshot->mFile = MappedFile::Open(snapshot_path);
+    if (snapshot->mFile == nullptr)
+    {
+        return nullptr;
+    }
+
+    VfsSnapshotReader reader{ snapshot->mFile->GetData() };
+
+    std::uint32_t magic{ 0 };
+    std::uint32_t version{ 0 };
+    std::uint32_t num_mounts{ 0 };
+    if (!reader.Read(magic) || magic != c_SnapshotMagic || !reader.Read(version) || version != c_SnapshotVersion || !reader.Read(num_mounts))
+    {
+        LogInfo("Ignoring outdated vfs snapshot '{}'...", snapshot_path.string());
+        return nullptr;
+    }
+
+    for (std::uint32_t i = 0; i < num_mounts; i++)
+    {
+        std::string_view mounted_path;
+        MappedMount mount{};
+        if (!reader.ReadString(mounted_path) || !reader.Read(mount.Priority) || !reader.Read(mount.Type) || !reader.ReadString(mount.Index))
+        {
+            LogError("Vfs snapshot '{}' is corrupted, mods will be indexed from scratch...", snapshot_path.string());
+            return nullptr;
+        }
+        snapshot->mMounts.insert_or_assign(NormalizedPath{ mounted_path }, mount);
+    }
+
+    LogInfo("Loaded vfs snapshot with {} mounts...", snapshot->mMounts.size());
+    return snapshot;
+}
+bool VfsSnapshot::Write(const std::filesystem::path& snapshot_path, std::span<const Mount> mounts)
+{
+    VfsSnapshotWriter writer;
+    writer.Write(c_SnapshotMagic);
+    writer.Write(c_SnapshotVersion);
+    writer.Write(static_cast<std::uint32_t>(mounts.size()));
+    for (const Mount& mount : mounts)
+    {
+        writer.WriteString(mount.MountedPath);
+        writer.Write(mount.Priority);
+        writer.Write(mount.Type);
+        writer.WriteString(mount.Index);
+    }
+
+    // Never replace the snapshot with a half written one
+    return WriteFileAtomically(snapshot_path, writer.GetData());
+}
+
+VfsSnapshot::~VfsSnapshot() = default;
+
+std::optional<std::string_view> VfsSnapshot::FindIndex(std::string_view mounted_path, std::int64_t priority, std::uint8_t type) const
+{
+    if (auto it = mMounts.find(NormalizedPath{ mounted_path }); it != mMounts.end())
+    {
+        const MappedMount& mount = it->second;
+        if (mount.Priority == priority && mount.Type == type)
+        {
+            return mount.Index;
+        }
+    }
+    return std::nullopt;
+}
+
+void VfsSnapshot::Discard(std::string_view changed_path)
+{
+    const std::string normalized_path{ NormalizedPath::Normalize(changed_path) };
+    std::erase_if(mMounts, [&](const auto& mount)
+                  {
+                      const std::string_view mounted_path{ mount.first.GetString() };
+                      return mounted_path.empty() || normalized_path == mounted_path || (normalized_path.starts_with(mounted_path) && normalized_path[mounted_path.size()] == '/');
+                  });
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "util/mapped_file.h"
+#include "util/normalized_path.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Little helpers to write and read the flat binary format of snapshots
+class VfsSnapshotWriter
+{
+  public:
+    template<class T>
+    requires std::is_trivially_copyable_v<T>
+    void Write(const T& value)
+    {
+        mData.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void WriteString(std::string_view value)
+    {
+        Write(static_cast<std::uint32_t>(value.size()));
+        mData.append(value);
+    }
+
+    const std::string& GetData() const
+    {
+        return mData;
+    }
+
+  private:
+    std::string mData;
+};
+class VfsSnapshotReader
+{
+  public:
+    explicit VfsSnapshotReader(std::string_view data)
+        : mData{ data }
+    {
+    }
+
+    template<class T>
+    requires std::is_trivially_copyable_v<T>
+    bool Read(T& value)
+    {
+        if (mData.size() < sizeof(value))
+        {
+            return false;
+        }
+        std::memcpy(&value, mData.data(), sizeof(value));
+        mData.remove_prefix(sizeof(value));
+        return true;
+    }
+    bool ReadString(std::string_view& value)
+    {
+        std::uint32_t size{ 0 };
+        if (!Read(size) || mData.size() < size)
+        {
+            return false;
+        }
+        value = mData.substr(0, size);
+        mData.remove_prefix(size);
+        return true;
+    }
+
+    bool IsAtEnd() const
+    {
+        return mData.empty();
+    }
+
+  private:
+    std::string_view mData;
+};
+
+// Resolved state of all folder mounts from a previous launch, mapped into memory straight from the .db folder
+class VfsSnapshot
+{
+  public:
+    struct Mount
+    {
+        std::string MountedPath;
+        std::int64_t Priority;
+        std::uint8_t Type;
+        std::string Index;
+    };
+
+    // Returns nullptr if there is no snapshot or it can't be read
+    static std::unique_ptr<VfsSnapshot> Load(const std::filesystem::path& snapshot_path);
+    static bool Write(const std::filesystem::path& snapshot_path, std::span<const Mount> mounts);
+
+    ~VfsSnapshot();
+
+    VfsSnapshot(const VfsSnapshot&) = delete;
+    VfsSnapshot(VfsSnapshot&&) = delete;
+    VfsSnapshot& operator=(const VfsSnapshot&) = delete;
+    VfsSnapshot& operator=(VfsSnapshot&&) = delete;
+
+    // Returns the serialized path index of a mount if it was mounted the same way last time
+    std::optional<std::string_view> FindIndex(std::string_view mounted_path, std::int64_t priority, std::uint8_t type) const;
+    // Forgets about all mounts containing the given path, e.g. because it changed since the snapshot was taken
+    void Discard(std::string_view changed_path);
+
+  private:
+    VfsSnapshot() = default;
+
+    struct MappedMount
+    {
+        std::int64_t Priority;
+        std::uint8_t Type;
+        std::string_view Index;
+    };
+
+    std::unique_ptr<MappedFile> mFile;
+
+    // Keyed by normalized mounted path, views point into the mapping
+    std::unordered_map<NormalizedPath, MappedMount> mMounts;
+};
@@ -0,0 +1,159 @@
+#include "vfs_tracer.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+static constexpr std::array<std::string_view, 2> c_CallNames{ "load_file", "get_file_path" };
+
+VfsTracer::VfsTracer()
+    : mStartTime{ std::chrono::steady_clock::now() }
+{
+}
+VfsTracer::~VfsTracer() = default;
+
+void VfsTracer::RecordCall(Call call, std::string_view path, bool found, std::chrono::nanoseconds latency)
+{
+    const std::uint64_t latency_nanoseconds{ static_cast<std::uint64_t>(latency.count()) };
+    const std::uint64_t start_nanoseconds{ static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStartTime - latency).count()) };
+    const std::size_t call_index{ static_cast<std::size_t>(call) };
+    const std::size_t bucket{ std::min<std::size_t>(std::bit_width(latency_nanoseconds / 1000), c_NumLatencyBuckets - 1) };
+    const NormalizedPath normalized_path{ path };
+
+    std::lock_guard lock{ mMutex };
+
+    PathStats& path_stats = mPaths[normalized_path];
+    path_stats.Calls[call_index]++;
+    path_stats.Found[call_index] += found ? 1 : 0;
+
+    LatencyHistogram& histogram = mLatencies[call_index];
+    histogram.Buckets[bucket]++;
+    histogram.Count++;
+    histogram.TotalNanoseconds += latency_nanoseconds;
+    histogram.MaxNanoseconds = std::max(histogram.MaxNanoseconds, latency_nanoseconds);
+
+    if (mEvents.size() < c_MaxTraceEvents)
+    {
+        mEvents.push_back(TraceEvent{
+            .TracedCall = call,
+            .Found = found,
+            .StartNanoseconds = start_nanoseconds,
+            .LatencyNanoseconds = latency_nanoseconds,
+            .Path = std::string{ path },
+        });
+    }
+    else
+    {
+        mDroppedEvents++;
+    }
+}
+void VfsTracer::RecordMount(std::string_view mount_name, bool hit)
+{
+    std::lock_guard lock{ mMutex };
+
+    auto it = mMounts.find(std::string{ mount_name });
+    if (it == mMounts.end())
+    {
+        it = mMounts.emplace(std::string{ mount_name }, MountStats{}).first;
+    }
+    (hit ? it->second.Hits : it->second.Misses)++;
+}
+
+bool VfsTracer::WriteJson(const std::filesystem::path& json_path) const
+{
+    using nlohmann::json;
+
+    json root = json::object();
+    {
+        std::lock_guard lock{ mMutex };
+
+        json& calls = root["calls"];
+        for (std::size_t i = 0; i < c_NumCalls; i++)
+        {
+            const LatencyHistogram& histogram = mLatencies[i];
+
+            json buckets = json::array();
+            for (std::size_t j = 0; j < c_NumLatencyBuckets; j++)
+            {
+                if (histogram.Buckets[j] != 0)
+                {
+                    const bool is_last_bucket{ j == c_NumLatencyBuckets - 1 };
+                    buckets.push_back({
+                        { "below_us", is_last_bucket ? json{} : json(std::uint64_t{ 1 } << j) },
+                        { "count", histogram.Buckets[j] },
+                    });
+                }
+            }
+
+            calls[c_CallNames[i]] = {
+                { "count", histogram.Count },
+                { "total_ns", histogram.TotalNanoseconds },
+                { "max_ns", histogram.MaxNanoseconds },
+                { "latency_histogram", std::move(buckets) },
+            };
+        }
+
+        json& mounts = root["mounts"];
+        mounts = json::array();
+        for (const auto& [mount_name, mount_stats] : mMounts)
+        {
+            mounts.push_back({
+                { "mount", mount_name },
+                { "hits", mount_stats.Hits },
+                { "misses", mount_stats.Misses },
+            });
+        }
+
+        // Most requested pathes first, those are the ones worth looking at
+        std::vector<std::pair<NormalizedPath, PathStats>> sorted_paths{ mPaths.begin(), mPaths.end() };
+        std::sort(sorted_paths.begin(), sorted_paths.end(), [](const auto& lhs, const auto& rhs)
+                  { return lhs.second.Calls[0] + lhs.second.Calls[1] > rhs.second.Calls[0] + rhs.second.Calls[1]; });
+
+        json& paths = root["paths"];
+        paths = json::array();
+        for (const auto& [path, path_stats] : sorted_paths)
+        {
+            json path_json{ { "path", path.GetString() } };
+            for (std::size_t i = 0; i < c_NumCalls; i++)
+            {
+                path_json[fmt::format("{}_calls", c_CallNames[i])] = path_stats.Calls[i];
+                path_json[fmt::format("{}_found", c_CallNames[i])] = path_stats.Found[i];
+            }
+            paths.push_back(std::move(path_json));
+        }
+
+        root["dropped_trace_events"] = mDroppedEvents;
+    }
+
+    if (auto json_file = std::ofstream{ json_path, std::ios::trunc })
+    {
+        json_file << root.dump(4);
+        return static_cast<bool>(json_file);
+    }
+
+    LogError("Could not write vfs statistics to {}...", json_path.string());
+    return false;
+}
+
+bool VfsTracer::WriteTrace(const std::filesystem::path& trace_path) const
+{
+    if (auto trace_file = std::ofstream{ trace_path, std::ios::trunc | std::ios::binary })
+    {
+        std::lock_guard lock{ mMutex };
+        for (const TraceEvent& event : mEvents)
+        {
+            trace_file << c_CallNames[static_cast<std::size_t>(event.TracedCall)] << ' '
+                       << event.StartNanoseconds << ' '
+                       << event.LatencyNanoseconds << ' '
+                       << (event.Found ? 1 : 0) << ' '
+                       << event.Path << '\n';
+        }
+        return static_cast<bool>(trace_file);
+    }
+
+    LogError("Could not write vfs trace to {}...", trace_path.string());
+    return false;
+}
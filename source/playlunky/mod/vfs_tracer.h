@@ -0,0 +1,84 @@
+#pragma once
+
+#include "util/normalized_path.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Records every call into the virtual filesystem, which mount answered it and how long it took
+// Only created when tracing is enabled, every recorded call takes a lock
+class VfsTracer
+{
+  public:
+    enum class Call : std::uint8_t
+    {
+        LoadFile,
+        GetFilePath,
+    };
+
+    VfsTracer();
+    ~VfsTracer();
+
+    VfsTracer(const VfsTracer&) = delete;
+    VfsTracer(VfsTracer&&) = delete;
+    VfsTracer& operator=(const VfsTracer&) = delete;
+    VfsTracer& operator=(VfsTracer&&) = delete;
+
+    void RecordCall(Call call, std::string_view path, bool found, std::chrono::nanoseconds latency);
+    // A hit means the mount served the call, a miss that it was asked but did not have the file
+    void RecordMount(std::string_view mount_name, bool hit);
+
+    // Per-path and per-mount counters plus latency histograms
+    bool WriteJson(const std::filesystem::path& json_path) const;
+    // One line per call in the order they happened: call, offset from the first call and latency in ns, found, path
+    bool WriteTrace(const std::filesystem::path& trace_path) const;
+
+  private:
+    // Bucket 0 holds calls below 1us, bucket i calls in [2^(i-1), 2^i) us, the last one everything slower
+    static constexpr std::size_t c_NumLatencyBuckets{ 24 };
+    static constexpr std::size_t c_NumCalls{ 2 };
+    // Keeps the trace of a long session from eating all memory, counters keep counting after this
+    static constexpr std::size_t c_MaxTraceEvents{ 1024 * 1024 };
+
+    struct PathStats
+    {
+        std::array<std::uint64_t, c_NumCalls> Calls{};
+        std::array<std::uint64_t, c_NumCalls> Found{};
+    };
+    struct MountStats
+    {
+        std::uint64_t Hits{ 0 };
+        std::uint64_t Misses{ 0 };
+    };
+    struct LatencyHistogram
+    {
+        std::array<std::uint64_t, c_NumLatencyBuckets> Buckets{};
+        std::uint64_t Count{ 0 };
+        std::uint64_t TotalNanoseconds{ 0 };
+        std::uint64_t MaxNanoseconds{ 0 };
+    };
+    struct TraceEvent
+    {
+        Call TracedCall;
+        bool Found;
+        std::uint64_t StartNanoseconds;
+        std::uint64_t LatencyNanoseconds;
+        std::string Path;
+    };
+
+    const std::chrono::steady_clock::time_point mStartTime;
+
+    mutable std::mutex mMutex;
+    std::unordered_map<NormalizedPath, PathStats> mPaths;
+    std::unordered_map<std::string, MountStats> mMounts;
+    std::array<LatencyHistogram, c_NumCalls> mLatencies;
+    std::vector<TraceEvent> mEvents;
+    std::uint64_t mDroppedEvents{ 0 };
+};
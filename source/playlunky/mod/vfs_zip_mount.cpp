@@ -0,0 +1,383 @@
+#include "vfs_zip_mount.h"
+
+#include "log.h"
+#include "util/file.h"
+#include "util/on_scope_exit.h"
+#include "vfs_path_index.h"
+
+#include <spel2.h>
+
+#include <Windows.h>
+#include <cstring>
+#include <vector>
+#include <zip.h>
+
+template<class T>
+static T ReadLittleEndian(const std::uint8_t* data)
+{
+    // Only ever built for x86, which is little endian as well
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+// Offsets of the data of each entry in the order of the central directory, which is the order libzip indexes entries in
+// An offset is empty when the local header can't be found, zip64 archives are left to libzip entirely
+static std::vector<std::optional<std::uint64_t>> GetEntryDataOffsets(const std::uint8_t* data, std::uint64_t size)
+{
+    static constexpr std::uint32_t c_EndOfCentralDirectorySignature{ 0x06054b50 };
+    static constexpr std::uint32_t c_CentralDirectoryHeaderSignature{ 0x02014b50 };
+    static constexpr std::uint32_t c_LocalHeaderSignature{ 0x04034b50 };
+    static constexpr std::uint64_t c_EndOfCentralDirectorySize{ 22 };
+    static constexpr std::uint64_t c_CentralDirectoryHeaderSize{ 46 };
+    static constexpr std::uint64_t c_LocalHeaderSize{ 30 };
+
+    std::vector<std::optional<std::uint64_t>> data_offsets;
+    if (size < c_EndOfCentralDirectorySize)
+    {
+        return data_offsets;
+    }
+
+    // The end of central directory record is only followed by a comment of up to 64k
+    const std::uint64_t search_end{ size - c_EndOfCentralDirectorySize };
+    const std::uint64_t search_begin{ search_end > 0xffff ? search_end - 0xffff : 0 };
+    for (std::uint64_t end_of_directory = search_end + 1; end_of_directory-- > search_begin;)
+    {
+        if (ReadLittleEndian<std::uint32_t>(data + end_of_directory) != c_EndOfCentralDirectorySignature)
+        {
+            continue;
+        }
+
+        const auto num_entries{ ReadLittleEndian<std::uint16_t>(data + end_of_directory + 10) };
+        const auto directory_offset{ ReadLittleEndian<std::uint32_t>(data + end_of_directory + 16) };
+        if (num_entries == 0xffff || directory_offset == 0xffffffff)
+        {
+            return data_offsets;
+        }
+
+        data_offsets.reserve(num_entries);
+        std::uint64_t header_offset{ directory_offset };
+        for (std::uint16_t i = 0; i < num_entries; i++)
+        {
+            if (header_offset + c_CentralDirectoryHeaderSize > size || ReadLittleEndian<std::uint32_t>(data + header_offset) != c_CentralDirectoryHeaderSignature)
+            {
+                data_offsets.clear();
+                return data_offsets;
+            }
+
+            const std::uint8_t* header{ data + header_offset };
+            const auto name_length{ ReadLittleEndian<std::uint16_t>(header + 28) };
+            const auto extra_length{ ReadLittleEndian<std::uint16_t>(header + 30) };
+            const auto comment_length{ ReadLittleEndian<std::uint16_t>(header + 32) };
+            const std::uint64_t local_header_offset{ ReadLittleEndian<std::uint32_t>(header + 42) };
+
+            std::optional<std::uint64_t>& data_offset = data_offsets.emplace_back();
+            if (local_header_offset + c_LocalHeaderSize <= size && ReadLittleEndian<std::uint32_t>(data + local_header_offset) == c_LocalHeaderSignature)
+            {
+                const std::uint8_t* local_header{ data + local_header_offset };
+                data_offset = local_header_offset + c_LocalHeaderSize + ReadLittleEndian<std::uint16_t>(local_header + 26) + ReadLittleEndian<std::uint16_t>(local_header + 28);
+            }
+
+            header_offset += c_CentralDirectoryHeaderSize + name_length + extra_length + comment_length;
+        }
+        return data_offsets;
+    }
+
+    return data_offsets;
+}
+
+VfsZipMount::VfsZipMount(std::filesystem::path archive_path, std::filesystem::path extract_path, VfsType type)
+    : mArchivePath(std::move(archive_path))
+    , mExtractPath(std::move(extract_path))
+    , mType(type)
+{
+    HANDLE file_handle = CreateFileW(mArchivePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        LogError("Can't open zip archive '{}'...", mArchivePath.string());
+        return;
+    }
+    mFileHandle = file_handle;
+
+    LARGE_INTEGER file_size{};
+    if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+    {
+        LogError("Can't read size of zip archive '{}'...", mArchivePath.string());
+        return;
+    }
+
+    mMappingHandle = CreateFileMappingW(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mMappingHandle == NULL)
+    {
+        LogError("Can't map zip archive '{}' into memory...", mArchivePath.string());
+        return;
+    }
+
+    mMappedData = MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (mMappedData == nullptr)
+    {
+        LogError("Can't map zip archive '{}' into memory...", mArchivePath.string());
+        return;
+    }
+
+    mMappedSize = static_cast<std::uint64_t>(file_size.QuadPart);
+
+    zip* archive = OpenArchive();
+    if (archive == nullptr)
+    {
+        return;
+    }
+
+    const std::vector<std::optional<std::uint64_t>> data_offsets{ GetEntryDataOffsets(static_cast<const std::uint8_t*>(mMappedData), mMappedSize) };
+
+    const zip_int64_t num_entries = zip_get_num_entries(archive, 0);
+    mEntries.reserve(static_cast<std::size_t>(num_entries));
+    for (zip_int64_t i = 0; i < num_entries; i++)
+    {
+        struct zip_stat entry_stat
+        {
+        };
+        if (zip_stat_index(archive, i, 0, &entry_stat) == 0 && (entry_stat.valid & ZIP_STAT_NAME) && (entry_stat.valid & ZIP_STAT_SIZE))
+        {
+            const std::string_view entry_name{ entry_stat.name };
+            if (entry_name.ends_with('/'))
+            {
+                continue;
+            }
+
+            std::optional<std::uint64_t> stored_data_offset;
+            const bool is_stored{ (entry_stat.valid & ZIP_STAT_COMP_METHOD) && entry_stat.comp_method == ZIP_CM_STORE };
+            const bool is_encrypted{ !(entry_stat.valid & ZIP_STAT_ENCRYPTION_METHOD) || entry_stat.encryption_method != ZIP_EM_NONE };
+            if (is_stored && !is_encrypted && static_cast<std::size_t>(i) < data_offsets.size())
+            {
+                const std::optional<std::uint64_t>& data_offset = data_offsets[static_cast<std::size_t>(i)];
+                if (data_offset.has_value() && data_offset.value() <= mMappedSize && entry_stat.size <= mMappedSize - data_offset.value())
+                {
+                    stored_data_offset = data_offset;
+                }
+            }
+
+            const NormalizedPath normalized_name{ entry_name };
+            const NormalizedPath normalized_stem{ std::filesystem::path{ entry_name }.replace_extension() };
+            mStems.try_emplace(normalized_stem, normalized_name);
+            mEntries.try_emplace(normalized_name, ZipEntry{ static_cast<std::uint64_t>(i), entry_stat.size, std::string{ entry_name }, stored_data_offset });
+        }
+    }
+
+    ReleaseArchive(archive);
+
+    LogInfo("Indexed {} files in zip archive '{}'...", mEntries.size(), mArchivePath.string());
+}
+VfsZipMount::~VfsZipMount()
+{
+    for (zip* archive : mArchivePool)
+    {
+        zip_discard(archive);
+    }
+    if (mMappedData != nullptr)
+    {
+        UnmapViewOfFile(mMappedData);
+    }
+    if (mMappingHandle != nullptr)
+    {
+        CloseHandle(mMappingHandle);
+    }
+    if (mFileHandle != nullptr)
+    {
+        CloseHandle(mFileHandle);
+    }
+}
+
+VfsZipMount::FileInfo* VfsZipMount::LoadFile(const NormalizedPathView& file_path, void* (*allocator)(std::size_t)) const
+{
+    const ZipEntry* entry = FindEntry(file_path);
+    if (entry == nullptr)
+    {
+        return nullptr;
+    }
+
+    const std::size_t file_size = static_cast<std::size_t>(entry->Size);
+    if (FileInfo* file_info = VirtualFilesystem::AllocateFileInfo(allocator, file_size))
+    {
+        if (!ReadEntry(*entry, file_info->Data))
+        {
+            LogError("Could not read file {} from archive {}, this will either crash or cause glitches...", entry->Name, mArchivePath.string());
+        }
+
+        mLoadedFiles.fetch_add(1, std::memory_order_relaxed);
+        mLoadedBytes.fetch_add(file_size, std::memory_order_relaxed);
+
+        return file_info;
+    }
+
+    return nullptr;
+}
+
+std::optional<std::filesystem::path> VfsZipMount::GetFilePath(const std::filesystem::path& path) const
+{
+    if (!VfsPathIndex::CanIndex(path))
+    {
+        return std::nullopt;
+    }
+
+    const std::string path_string{ path.string() };
+    const NormalizedPathView normalized_path{ path_string };
+    if (path.has_extension())
+    {
+        if (FindEntry(normalized_path) != nullptr)
+        {
+            return mArchivePath / path;
+        }
+    }
+    else if (auto it = mStems.find(normalized_path); it != mStems.end())
+    {
+        const ZipEntry& entry = mEntries.at(it->second);
+        return mArchivePath / path.parent_path() / std::filesystem::path{ entry.Name }.filename();
+    }
+
+    return std::nullopt;
+}
+
+std::optional<std::filesystem::path> VfsZipMount::GetDiskPath(std::filesystem::path file_path) const
+{
+    namespace fs = std::filesystem;
+
+    const fs::path relative_path{ file_path.lexically_relative(mArchivePath) };
+    const std::string relative_path_string{ relative_path.string() };
+    const ZipEntry* entry = FindEntry(NormalizedPathView{ relative_path_string });
+    if (entry == nullptr)
+    {
+        return file_path;
+    }
+
+    const fs::path disk_path{ mExtractPath / relative_path };
+
+    std::lock_guard lock{ mExtractMutex };
+
+    std::error_code error_code;
+    if (fs::exists(disk_path, error_code) && fs::last_write_time(disk_path, error_code) >= fs::last_write_time(mArchivePath, error_code))
+    {
+        return disk_path;
+    }
+
+    std::vector<char> contents(static_cast<std::size_t>(entry->Size));
+    if (!ReadEntry(*entry, contents.data()))
+    {
+        LogError("Could not extract file {} from archive {}...", entry->Name, mArchivePath.string());
+        return std::nullopt;
+    }
+
+    fs::create_directories(disk_path.parent_path(), error_code);
+    if (!WriteFileAtomically(disk_path, std::string_view{ contents.data(), contents.size() }))
+    {
+        LogError("Could not extract file {} from archive {}...", entry->Name, mArchivePath.string());
+        return std::nullopt;
+    }
+    mExtractedFiles.fetch_add(1, std::memory_order_relaxed);
+
+    return disk_path;
+}
+
+bool VfsZipMount::IsType(VfsType type) const
+{
+    return type == VfsType::Any || type == mType;
+}
+
+void VfsZipMount::InvalidateIndex([[maybe_unused]] const std::filesystem::path& changed_path)
+{
+    // Archives are never written to while mounted
+}
+
+void VfsZipMount::LogStatistics() const
+{
+    const std::uint64_t loaded_files{ mLoadedFiles.load(std::memory_order_relaxed) };
+    const std::uint64_t loaded_bytes{ mLoadedBytes.load(std::memory_order_relaxed) };
+    const std::uint64_t extracted_files{ mExtractedFiles.load(std::memory_order_relaxed) };
+    if (loaded_files + extracted_files > 0)
+    {
+        LogInfo("Archive '{}': {} files loaded ({} bytes), {} files extracted", mArchivePath.string(), loaded_files, loaded_bytes, extracted_files);
+    }
+}
+
+const VfsZipMount::ZipEntry* VfsZipMount::FindEntry(const NormalizedPathView& path) const
+{
+    if (auto it = mEntries.find(path); it != mEntries.end())
+    {
+        return &it->second;
+    }
+    return nullptr;
+}
+
+bool VfsZipMount::ReadEntry(const ZipEntry& entry, void* destination) const
+{
+    if (entry.StoredDataOffset.has_value())
+    {
+        std::memcpy(destination, static_cast<const std::uint8_t*>(mMappedData) + entry.StoredDataOffset.value(), static_cast<std::size_t>(entry.Size));
+        return true;
+    }
+
+    zip* archive = AcquireArchive();
+    if (archive == nullptr)
+    {
+        return false;
+    }
+    OnScopeExit release_archive{ [this, archive]()
+                                 { ReleaseArchive(archive); } };
+
+    if (zip_file_t* zipped_file = zip_fopen_index(archive, entry.Index, 0))
+    {
+        OnScopeExit close_zipped_file{ [zipped_file]()
+                                       { zip_fclose(zipped_file); } };
+        const zip_int64_t read_size = zip_fread(zipped_file, destination, entry.Size);
+        return read_size >= 0 && static_cast<std::uint64_t>(read_size) == entry.Size;
+    }
+    return false;
+}
+
+zip* VfsZipMount::OpenArchive() const
+{
+    if (mMappedData == nullptr)
+    {
+        return nullptr;
+    }
+
+    zip_error_t error;
+    zip_error_init(&error);
+    OnScopeExit fini_error{ [&error]()
+                            { zip_error_fini(&error); } };
+
+    zip_source_t* source = zip_source_buffer_create(mMappedData, mMappedSize, 0, &error);
+    if (source == nullptr)
+    {
+        LogError("Can't open zip archive '{}': {}", mArchivePath.string(), zip_error_strerror(&error));
+        return nullptr;
+    }
+
+    zip* archive = zip_open_from_source(source, ZIP_RDONLY, &error);
+    if (archive == nullptr)
+    {
+        zip_source_free(source);
+        LogError("Can't open zip archive '{}': {}", mArchivePath.string(), zip_error_strerror(&error));
+        return nullptr;
+    }
+
+    return archive;
+}
+zip* VfsZipMount::AcquireArchive() const
+{
+    {
+        std::lock_guard lock{ mArchivePoolMutex };
+        if (!mArchivePool.empty())
+        {
+            zip* archive = mArchivePool.back();
+            mArchivePool.pop_back();
+            return archive;
+        }
+    }
+    return OpenArchive();
+}
+void VfsZipMount::ReleaseArchive(zip* archive) const
+{
+    std::lock_guard lock{ mArchivePoolMutex };
+    mArchivePool.push_back(archive);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "util/normalized_path.h"
+#include "vfs_mount_impl.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct zip;
+
+// Mounts a zip archive in place, the central directory is indexed once and entries are read straight from a mapping of the archive
+// Stored entries are copied from the mapping, compressed ones are decompressed by libzip
+class VfsZipMount : public IVfsMountImpl
+{
+  public:
+    VfsZipMount(std::filesystem::path archive_path, std::filesystem::path extract_path, VfsType type);
+    virtual ~VfsZipMount() override;
+
+    VfsZipMount(const VfsZipMount&) = delete;
+    VfsZipMount(VfsZipMount&&) = delete;
+    VfsZipMount& operator=(const VfsZipMount&) = delete;
+    VfsZipMount& operator=(VfsZipMount&&) = delete;
+
+    virtual FileInfo* LoadFile(const NormalizedPathView& file_path, void* (*allocator)(std::size_t)) const override;
+    virtual std::optional<std::filesystem::path> GetFilePath(const std::filesystem::path& path) const override;
+    virtual std::optional<std::filesystem::path> GetDiskPath(std::filesystem::path file_path) const override;
+    virtual bool IsType(VfsType type) const override;
+    virtual void InvalidateIndex(const std::filesystem::path& changed_path) override;
+    virtual void LogStatistics() const override;
+
+  private:
+    struct ZipEntry
+    {
+        std::uint64_t Index;
+        std::uint64_t Size;
+        std::string Name;
+        // Offset of the data in the mapping, only for entries that are neither compressed nor encrypted
+        std::optional<std::uint64_t> StoredDataOffset;
+    };
+
+    const ZipEntry* FindEntry(const NormalizedPathView& path) const;
+    bool ReadEntry(const ZipEntry& entry, void* destination) const;
+
+    zip* OpenArchive() const;
+    zip* AcquireArchive() const;
+    void ReleaseArchive(zip* archive) const;
+
+    std::filesystem::path mArchivePath;
+    std::filesystem::path mExtractPath;
+    VfsType mType;
+
+    void* mFileHandle{ nullptr };
+    void* mMappingHandle{ nullptr };
+    const void* mMappedData{ nullptr };
+    std::uint64_t mMappedSize{ 0 };
+
+    // libzip archives are not thread-safe, each read of a compressed entry borrows an archive of its own
+    // Archives are opened on the mapping as needed and kept for later reads, so at most one per concurrent reader exists
+    mutable std::mutex mArchivePoolMutex;
+    mutable std::vector<zip*> mArchivePool;
+
+    // Keys are normalized pathes, stems map pathes without extension to the first matching entry
+    std::unordered_map<NormalizedPath, ZipEntry, NormalizedPathHash, NormalizedPathEqual> mEntries;
+    std::unordered_map<NormalizedPath, NormalizedPath, NormalizedPathHash, NormalizedPathEqual> mStems;
+
+    mutable std::mutex mExtractMutex;
+
+    mutable std::atomic_uint64_t mLoadedFiles{ 0 };
+    mutable std::atomic_uint64_t mLoadedBytes{ 0 };
+    mutable std::atomic_uint64_t mExtractedFiles{ 0 };
+};
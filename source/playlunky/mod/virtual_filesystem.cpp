@@ -2,178 +2,312 @@
 
 #include "log.h"
 #include "util/algorithms.h"
-#include "util/on_scope_exit.h"
+#include "util/normalized_path.h"
+#include "util/profiler.h"
+#include "vfs_folder_mount.h"
+#include "vfs_memory_mount.h"
+#include "vfs_mount_cache.h"
+#include "vfs_mount_impl.h"
+#include "vfs_prefetcher.h"
+#include "vfs_snapshot.h"
+#include "vfs_tracer.h"
+#include "vfs_zip_mount.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
 
-#include <spel2.h>
+VirtualFilesystem::VirtualFilesystem()
+    : m_MountCache{ std::make_unique<VfsMountCache>() }
+{
+    srand(static_cast<unsigned int>(time(nullptr))); // use something better for randomness?
+}
+VirtualFilesystem::~VirtualFilesystem() = default;
 
-#include <Windows.h>
-#include <filesystem>
+VirtualFilesystem::VfsMount* VirtualFilesystem::MountFolder(std::string_view path, std::int64_t priority, VfsType type)
+{
+    namespace fs = std::filesystem;
+
+    LogInfo("Mounting folder '{}' as a virtual filesystem...", path);
+
+    auto it = std::upper_bound(mMounts.begin(), mMounts.end(), priority, [](std::int64_t prio, const auto& mount)
+                               { return mount->Priority > prio; });
+    const std::optional<std::string_view> index_snapshot{ m_Snapshot ? m_Snapshot->FindIndex(path, priority, static_cast<std::uint8_t>(type)) : std::nullopt };
+    VfsMount* new_mount = new VfsMount{ .Priority = priority, .Name = std::string{ path }, .MountImpl = std::make_unique<VfsFolderMount>(path, type, index_snapshot) };
+    mMounts.emplace(it, new_mount);
 
-class IVfsMountImpl
+    return new_mount;
+}
+VirtualFilesystem::VfsMount* VirtualFilesystem::MountArchive(std::string_view path, std::string_view extract_path, std::int64_t priority, VfsType type)
 {
-  public:
-    virtual ~IVfsMountImpl() = default;
+    LogInfo("Mounting archive '{}' as a virtual filesystem...", path);
 
-    using FileInfo = VirtualFilesystem::FileInfo;
-    virtual FileInfo* LoadFile(const char* file_path, void* (*allocator)(std::size_t)) const = 0;
-    virtual std::optional<std::filesystem::path> GetFilePath(const std::filesystem::path& path) const = 0;
-    virtual bool IsType(VfsType type) const = 0;
-};
+    auto it = std::upper_bound(mMounts.begin(), mMounts.end(), priority, [](std::int64_t prio, const auto& mount)
+                               { return mount->Priority > prio; });
+    VfsMount* new_mount = new VfsMount{ .Priority = priority, .Name = std::string{ path }, .MountImpl = std::make_unique<VfsZipMount>(path, extract_path, type) };
+    mMounts.emplace(it, new_mount);
 
-class VfsFolderMount : public IVfsMountImpl
+    return new_mount;
+}
+VirtualFilesystem::VfsMount* VirtualFilesystem::MountMemory(std::string_view backing_path, std::int64_t priority, VfsType type, std::size_t memory_budget)
+{
+    LogInfo("Mounting memory for generated files in '{}' as a virtual filesystem...", backing_path);
+
+    auto memory_mount = std::make_unique<VfsMemoryMount>(backing_path, type, memory_budget);
+    m_MemoryMount = memory_mount.get();
+
+    auto it = std::upper_bound(mMounts.begin(), mMounts.end(), priority, [](std::int64_t prio, const auto& mount)
+                               { return mount->Priority > prio; });
+    VfsMount* new_mount = new VfsMount{ .Priority = priority, .Name = std::string{ backing_path }, .MountImpl = std::move(memory_mount) };
+    mMounts.emplace(it, new_mount);
+
+    return new_mount;
+}
+void VirtualFilesystem::LinkMounts(struct VfsMount* lhs_mount, struct VfsMount* rhs_mount)
 {
-  public:
-    VfsFolderMount(std::filesystem::path mounted_path, VfsType type)
-        : mMountedPath(std::move(mounted_path))
-        , mMountedPathString(mMountedPath.string())
-        , mType(type)
+    if (!algo::contains(lhs_mount->LinkedMounts, lhs_mount))
     {
-        std::replace(mMountedPathString.begin(), mMountedPathString.end(), '\\', '/');
+        lhs_mount->LinkedMounts.push_back(lhs_mount);
     }
-    virtual ~VfsFolderMount() override = default;
-
-    virtual FileInfo* LoadFile(const char* file_path, void* (*allocator)(std::size_t)) const override
+    if (!algo::contains(rhs_mount->LinkedMounts, rhs_mount))
     {
-        char full_path[MAX_PATH];
-        if (mMountedPathString.empty())
-        {
-            strcpy_s(full_path, file_path);
-        }
-        else
-        {
-            sprintf_s(full_path, "%s/%s", mMountedPathString.c_str(), file_path);
-        }
-
-        FILE* file{ nullptr };
-        auto error = fopen_s(&file, full_path, "rb");
-        if (error == 0 && file != nullptr)
+        rhs_mount->LinkedMounts.push_back(rhs_mount);
+    }
+    if (!algo::contains(lhs_mount->LinkedMounts, rhs_mount))
+    {
+        lhs_mount->LinkedMounts.push_back(rhs_mount);
+        rhs_mount->LinkedMounts.push_back(lhs_mount);
+        auto index_sort_pred = [this](const VfsMount* lhs, const VfsMount* rhs)
         {
-            auto close_file = OnScopeExit{ [file]()
-                                           { fclose(file); } };
+            size_t lhs_index = algo::find(mMounts, &std::unique_ptr<VfsMount>::get, lhs) - &mMounts.front();
+            size_t rhs_index = algo::find(mMounts, &std::unique_ptr<VfsMount>::get, rhs) - &mMounts.front();
+            return lhs_index < rhs_index;
+        };
+        algo::sort(lhs_mount->LinkedMounts, index_sort_pred);
+        algo::sort(rhs_mount->LinkedMounts, index_sort_pred);
+    }
+}
 
-            fseek(file, 0, SEEK_END);
-            const std::size_t file_size = ftell(file);
-            fseek(file, 0, SEEK_SET);
+void VirtualFilesystem::LoadSnapshot(const std::filesystem::path& snapshot_path)
+{
+    std::lock_guard lock{ m_SnapshotMutex };
+    m_Snapshot = VfsSnapshot::Load(snapshot_path);
+}
+void VirtualFilesystem::DiscardSnapshot(const std::filesystem::path& changed_path)
+{
+    std::lock_guard lock{ m_SnapshotMutex };
+    if (m_Snapshot)
+    {
+        m_Snapshot->Discard(changed_path.string());
+    }
+}
+void VirtualFilesystem::SaveSnapshot(const std::filesystem::path& snapshot_path)
+{
+    // Restored indices point into the mapped file, it has to be closed before it can be replaced
+    {
+        std::lock_guard lock{ m_SnapshotMutex };
+        m_Snapshot.reset();
+    }
 
-            if (allocator == nullptr)
+    std::vector<VfsSnapshot::Mount> snapshot_mounts;
+    for (const auto& mount : mMounts)
+    {
+        if (const VfsFolderMount* folder_mount = dynamic_cast<const VfsFolderMount*>(mount->MountImpl.get()))
+        {
+            if (auto snapshot_mount = folder_mount->TakeSnapshot(mount->Priority))
             {
-                allocator = malloc;
+                snapshot_mounts.push_back(std::move(snapshot_mount).value());
             }
+        }
+    }
 
-            const std::size_t allocation_size = file_size + sizeof(FileInfo);
-            if (void* buf = allocator(allocation_size))
-            {
-                void* data = static_cast<void*>(reinterpret_cast<char*>(buf) + 24);
-                const auto size_read = fread(data, 1, file_size, file);
-                if (size_read != file_size)
-                {
-                    LogError("Could not read file {}, this will either crash or cause glitches...", full_path);
-                }
-
-                FileInfo* file_info = new (buf) FileInfo();
-                *file_info = {
-                    .Data = data,
-                    .DataSize = static_cast<int>(file_size),
-                    .AllocationSize = static_cast<int>(allocation_size)
-                };
+    if (VfsSnapshot::Write(snapshot_path, snapshot_mounts))
+    {
+        m_SnapshotPath = snapshot_path;
+        m_SnapshotSaved.store(true, std::memory_order_release);
+    }
+    else
+    {
+        LogError("Could not write vfs snapshot '{}', next launch will index all mods from scratch...", snapshot_path.string());
+    }
+}
+void VirtualFilesystem::DeleteSavedSnapshot() const
+{
+    if (m_SnapshotSaved.exchange(false, std::memory_order_acq_rel))
+    {
+        std::error_code error_code;
+        std::filesystem::remove(m_SnapshotPath, error_code);
+    }
+}
 
-                return file_info;
-            }
-        }
+// Deferred files are keyed by their normalized path without extension, the game and preprocessing disagree about extensions
+static std::string_view GetDeferredFileKey(std::string_view path)
+{
+    // Keys are the path without extension, they are normalized by the hash and equality of the map
+    const std::size_t extension_pos{ path.rfind('.') };
+    if (extension_pos != std::string_view::npos && path.find_first_of("/\\", extension_pos) == std::string_view::npos)
+    {
+        path.remove_suffix(path.size() - extension_pos);
+    }
+    return path;
+}
 
-        return nullptr;
+void VirtualFilesystem::DeferFile(std::string_view relative_path, DeferredFileWaitFun wait)
+{
+    std::lock_guard lock{ m_DeferredFilesMutex };
+    const std::string_view key{ GetDeferredFileKey(relative_path) };
+    auto it = m_DeferredFiles.find(NormalizedPathView{ key });
+    if (it == m_DeferredFiles.end())
+    {
+        it = m_DeferredFiles.emplace(std::string{ key }, std::vector<DeferredFileWaitFun>{}).first;
+    }
+    it->second.push_back(std::move(wait));
+    m_NumDeferredFiles.store(m_DeferredFiles.size(), std::memory_order_release);
+}
+void VirtualFilesystem::ClearDeferredFiles()
+{
+    std::lock_guard lock{ m_DeferredFilesMutex };
+    m_DeferredFiles.clear();
+    m_NumDeferredFiles.store(0, std::memory_order_release);
+}
+bool VirtualFilesystem::WaitForDeferredFile(std::string_view path) const
+{
+    if (m_NumDeferredFiles.load(std::memory_order_acquire) == 0)
+    {
+        return false;
     }
 
-    virtual std::optional<std::filesystem::path> GetFilePath(const std::filesystem::path& path) const override
+    const NormalizedPathView key{ GetDeferredFileKey(path) };
+
+    // Waits are called without holding the lock, they may load other deferred files themselves
+    std::vector<DeferredFileWaitFun> waits;
     {
-        namespace fs = std::filesystem;
-        if (path.has_extension())
-        {
-            const auto full_path = mMountedPath / path;
-            if (fs::exists(full_path))
-            {
-                return std::move(full_path);
-            }
-        }
-        else
+        std::lock_guard lock{ m_DeferredFilesMutex };
+        const auto it = m_DeferredFiles.find(key);
+        if (it == m_DeferredFiles.end())
         {
-            // Painfully check each file if it matches the name, return first match
-            auto parent_path = path.has_parent_path() ? mMountedPath / path.parent_path() : mMountedPath;
-            if (fs::exists(parent_path))
-            {
-                auto file_name = path.filename();
-                for (auto& dir_path : fs::directory_iterator{ parent_path })
-                {
-                    if (fs::is_regular_file(dir_path) && algo::is_same_path(dir_path.path().stem(), file_name))
-                    {
-                        return dir_path.path();
-                    }
-                }
-            }
+            return false;
         }
-
-        return std::nullopt;
+        waits = it->second;
     }
 
-    virtual bool IsType(VfsType type) const override
+    bool is_ready{ true };
+    for (const DeferredFileWaitFun& wait : waits)
     {
-        return type == VfsType::Any || type == mType;
+        is_ready = wait() && is_ready;
     }
 
-  private:
-    std::filesystem::path mMountedPath;
-    std::string mMountedPathString;
-    VfsType mType;
-};
+    // Not ready if the file is looked up while generating it, later lookups have to wait again
+    if (is_ready)
+    {
+        std::lock_guard lock{ m_DeferredFilesMutex };
+        if (const auto it = m_DeferredFiles.find(key); it != m_DeferredFiles.end())
+        {
+            m_DeferredFiles.erase(it);
+        }
+        m_NumDeferredFiles.store(m_DeferredFiles.size(), std::memory_order_release);
+    }
+    return true;
+}
 
-struct VirtualFilesystem::VfsMount
+void VirtualFilesystem::InvalidateIndex(const std::filesystem::path& changed_path)
 {
-    std::int64_t Priority;
-    std::vector<VfsMount*> LinkedMounts;
-    std::unique_ptr<IVfsMountImpl> MountImpl;
-};
+    DeleteSavedSnapshot();
+    DiscardSnapshot(changed_path);
 
-VirtualFilesystem::VirtualFilesystem()
-{
-    srand(static_cast<unsigned int>(time(nullptr))); // use something better for randomness?
+    for (const auto& mount : mMounts)
+    {
+        mount->MountImpl->InvalidateIndex(changed_path);
+    }
+
+    if (m_Prefetcher)
+    {
+        m_Prefetcher->Clear();
+    }
 }
-VirtualFilesystem::~VirtualFilesystem() = default;
 
-VirtualFilesystem::VfsMount* VirtualFilesystem::MountFolder(std::string_view path, std::int64_t priority, VfsType type)
+bool VirtualFilesystem::PublishFile(const std::filesystem::path& file_path, std::vector<std::uint8_t> data, bool write_behind)
 {
     namespace fs = std::filesystem;
 
-    LogInfo("Mounting folder '{}' as a virtual filesystem...", path);
+    if (m_MemoryMount != nullptr && algo::is_sub_path(file_path, m_MemoryMount->GetBackingPath()))
+    {
+        m_MemoryMount->Publish(file_path.lexically_relative(m_MemoryMount->GetBackingPath()), std::move(data), write_behind);
+        DiscardSnapshot(file_path);
 
-    auto it = std::upper_bound(mMounts.begin(), mMounts.end(), priority, [](std::int64_t prio, const auto& mount)
-                               { return mount->Priority > prio; });
-    VfsMount* new_mount = new VfsMount{ .Priority = priority, .MountImpl = std::make_unique<VfsFolderMount>(path, type) };
-    mMounts.emplace(it, new_mount);
+        if (m_Prefetcher)
+        {
+            m_Prefetcher->Clear();
+        }
+        return true;
+    }
 
-    return new_mount;
+    std::error_code error_code;
+    fs::create_directories(file_path.parent_path(), error_code);
+    if (auto disk_file = std::ofstream{ file_path, std::ios::trunc | std::ios::binary })
+    {
+        disk_file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        disk_file.close();
+        InvalidateIndex(file_path);
+        return static_cast<bool>(disk_file);
+    }
+    return false;
 }
-void VirtualFilesystem::LinkMounts(struct VfsMount* lhs_mount, struct VfsMount* rhs_mount)
+void VirtualFilesystem::FlushPublishedFiles()
 {
-    if (!algo::contains(lhs_mount->LinkedMounts, lhs_mount))
+    const ProfileZone profile_zone{ "VirtualFilesystem::FlushPublishedFiles" };
+
+    if (m_MemoryMount != nullptr)
     {
-        lhs_mount->LinkedMounts.push_back(lhs_mount);
+        m_MemoryMount->WaitForAllWrites();
+        SyncPublishedFiles();
     }
-    if (!algo::contains(rhs_mount->LinkedMounts, rhs_mount))
+}
+
+void VirtualFilesystem::LogStatistics() const
+{
+    for (const auto& mount : mMounts)
     {
-        rhs_mount->LinkedMounts.push_back(rhs_mount);
+        mount->MountImpl->LogStatistics();
     }
-    if (!algo::contains(lhs_mount->LinkedMounts, rhs_mount))
+
+    if (m_Prefetcher)
     {
-        lhs_mount->LinkedMounts.push_back(rhs_mount);
-        rhs_mount->LinkedMounts.push_back(lhs_mount);
-        auto index_sort_pred = [this](const VfsMount* lhs, const VfsMount* rhs)
-        {
-            size_t lhs_index = algo::find(mMounts, &std::unique_ptr<VfsMount>::get, lhs) - &mMounts.front();
-            size_t rhs_index = algo::find(mMounts, &std::unique_ptr<VfsMount>::get, rhs) - &mMounts.front();
-            return lhs_index < rhs_index;
-        };
-        algo::sort(lhs_mount->LinkedMounts, index_sort_pred);
-        algo::sort(rhs_mount->LinkedMounts, index_sort_pred);
+        m_Prefetcher->LogStatistics();
+    }
+}
+
+void VirtualFilesystem::EnableTracing()
+{
+    m_Tracer = std::make_unique<VfsTracer>();
+}
+bool VirtualFilesystem::WriteTrace(const std::filesystem::path& json_path, const std::filesystem::path& trace_path) const
+{
+    if (!m_Tracer)
+    {
+        return false;
+    }
+
+    const bool wrote_json = m_Tracer->WriteJson(json_path);
+    const bool wrote_trace = m_Tracer->WriteTrace(trace_path);
+    return wrote_json && wrote_trace;
+}
+
+void VirtualFilesystem::EnablePrefetching(std::size_t num_threads, std::size_t cache_budget, bool predict_loads)
+{
+    m_Prefetcher = std::make_unique<VfsPrefetcher>(
+        [this](const char* path)
+        { return LoadFileFromMounts(path, nullptr); },
+        num_threads,
+        cache_budget,
+        predict_loads);
+}
+void VirtualFilesystem::Prefetch(std::span<const char* const> paths)
+{
+    if (m_Prefetcher)
+    {
+        m_Prefetcher->Prefetch(paths);
     }
 }
 
@@ -189,7 +323,8 @@ void VirtualFilesystem::RegisterCustomFilter(CustomFilterFun filter)
 
 void VirtualFilesystem::BindPathes(std::vector<std::string_view> pathes)
 {
-    if (std::vector<std::string_view>* bound_pathes = GetBoundPathes(pathes))
+    BoundPathes* bound_pathes = GetBoundPathes(pathes);
+    if (bound_pathes != nullptr)
     {
         for (std::string_view path : pathes)
         {
@@ -201,13 +336,20 @@ void VirtualFilesystem::BindPathes(std::vector<std::string_view> pathes)
     }
     else
     {
-        m_BoundPathes.push_back(std::move(pathes));
+        bound_pathes = &m_BoundPathes.emplace_back(std::move(pathes));
+    }
+
+    const std::size_t group_id{ static_cast<std::size_t>(bound_pathes - m_BoundPathes.data()) };
+    for (std::string_view path : *bound_pathes)
+    {
+        AddToPathGroupIndex(m_BoundPathesIndex, path, group_id);
     }
 }
 
 void VirtualFilesystem::LinkPathes(std::vector<LinkedPathesElement> pathes)
 {
-    if (LinkedPathes* linked_pathes = GetLinkedPathes(pathes))
+    LinkedPathes* linked_pathes = GetLinkedPathes(pathes);
+    if (linked_pathes != nullptr)
     {
         for (LinkedPathesElement& path : pathes)
         {
@@ -219,11 +361,52 @@ void VirtualFilesystem::LinkPathes(std::vector<LinkedPathesElement> pathes)
     }
     else
     {
-        m_LinkedPathes.push_back(std::move(pathes));
+        linked_pathes = &m_LinkedPathes.emplace_back(std::move(pathes));
+    }
+
+    const std::size_t group_id{ static_cast<std::size_t>(linked_pathes - m_LinkedPathes.data()) };
+    for (const LinkedPathesElement& path : *linked_pathes)
+    {
+        AddToPathGroupIndex(m_LinkedPathesIndex, path.Path.string(), group_id);
     }
 }
 
 VirtualFilesystem::FileInfo* VirtualFilesystem::LoadFile(const char* path, void* (*allocator)(std::size_t)) const
+{
+    if (m_Tracer)
+    {
+        const auto start_time = std::chrono::steady_clock::now();
+        FileInfo* loaded_data = LoadFileUntraced(path, allocator);
+        m_Tracer->RecordCall(VfsTracer::Call::LoadFile, path, loaded_data != nullptr, std::chrono::steady_clock::now() - start_time);
+        return loaded_data;
+    }
+    return LoadFileUntraced(path, allocator);
+}
+VirtualFilesystem::FileInfo* VirtualFilesystem::LoadFileUntraced(const char* path, void* (*allocator)(std::size_t)) const
+{
+    const bool was_deferred{ WaitForDeferredFile(path) };
+
+    SyncPublishedFiles();
+
+    // Hashed once here instead of by the prefetcher and each mount, most of them only probe their filter with it
+    const NormalizedPathView normalized_path{ path };
+
+    if (m_Prefetcher)
+    {
+        // A deferred file was just generated, so whatever was prefetched for it is outdated
+        if (FileInfo* prefetched_data = m_Prefetcher->Take(normalized_path, allocator, was_deferred))
+        {
+            return prefetched_data;
+        }
+    }
+
+    return LoadFileFromMounts(path, normalized_path, allocator);
+}
+VirtualFilesystem::FileInfo* VirtualFilesystem::LoadFileFromMounts(const char* path, void* (*allocator)(std::size_t)) const
+{
+    return LoadFileFromMounts(path, NormalizedPathView{ path }, allocator);
+}
+VirtualFilesystem::FileInfo* VirtualFilesystem::LoadFileFromMounts(const char* path, const NormalizedPathView& normalized_path, void* (*allocator)(std::size_t)) const
 {
     if (mMounts.empty())
     {
@@ -253,7 +436,12 @@ VirtualFilesystem::FileInfo* VirtualFilesystem::LoadFile(const char* path, void*
             }
         }
 
-        if (FileInfo* loaded_data = mount->MountImpl->LoadFile(path, allocator))
+        FileInfo* loaded_data = mount->MountImpl->LoadFile(normalized_path, allocator);
+        if (m_Tracer)
+        {
+            m_Tracer->RecordMount(mount->Name, loaded_data != nullptr);
+        }
+        if (loaded_data != nullptr)
         {
             return loaded_data;
         }
@@ -262,6 +450,41 @@ VirtualFilesystem::FileInfo* VirtualFilesystem::LoadFile(const char* path, void*
     return nullptr;
 }
 
+void VirtualFilesystem::SyncPublishedFiles() const
+{
+    if (m_MemoryMount == nullptr || !m_MemoryMount->HasWrittenFiles())
+    {
+        return;
+    }
+
+    DeleteSavedSnapshot();
+
+    for (const std::filesystem::path& written_file : m_MemoryMount->TakeWrittenFiles())
+    {
+        for (const auto& mount : mMounts)
+        {
+            if (mount->MountImpl.get() != m_MemoryMount)
+            {
+                mount->MountImpl->InvalidateIndex(written_file);
+            }
+        }
+    }
+
+    // Only now that the backing folder mount can find them may files be dropped from memory
+    m_MemoryMount->EvictWrittenFiles();
+}
+void VirtualFilesystem::WaitForPublishedFile(const std::filesystem::path& path) const
+{
+    WaitForDeferredFile(path.string());
+
+    if (m_MemoryMount != nullptr)
+    {
+        // Preprocessing reads files from disk, so a pending write of the requested file has to finish first
+        m_MemoryMount->WaitForWrite(path);
+        SyncPublishedFiles();
+    }
+}
+
 std::optional<std::filesystem::path> VirtualFilesystem::GetFilePath(const std::filesystem::path& path, VfsType type) const
 {
     return GetFilePathFilterExt(path, {}, type);
@@ -281,17 +504,30 @@ std::optional<std::filesystem::path> VirtualFilesystem::GetFilePathFilterExt(con
         return std::nullopt;
     }
 
-    if (const VfsMount* linked_mount = GetLinkedMount(path, path_view, allowed_extensions, type))
+    WaitForPublishedFile(path);
+
+    const auto start_time = m_Tracer ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+
+    const VfsMount* resolving_mount = GetLinkedMount(path, path_view, allowed_extensions, type);
+    if (resolving_mount == nullptr)
     {
-        return GetFilePath(linked_mount, path, path_view, allowed_extensions, type);
+        resolving_mount = GetLoadingMount(path, path_view, allowed_extensions, type);
     }
 
-    if (const VfsMount* loading_mount = GetLoadingMount(path, path_view, allowed_extensions, type))
+    std::optional<std::filesystem::path> file_path{ resolving_mount != nullptr
+                                                        ? GetFilePath(resolving_mount, path, path_view, allowed_extensions, type)
+                                                        : std::nullopt };
+
+    if (m_Tracer)
     {
-        return GetFilePath(loading_mount, path, path_view, allowed_extensions, type);
+        m_Tracer->RecordCall(VfsTracer::Call::GetFilePath, path_view, file_path.has_value(), std::chrono::steady_clock::now() - start_time);
+        if (file_path.has_value())
+        {
+            m_Tracer->RecordMount(resolving_mount->Name, true);
+        }
     }
 
-    return std::nullopt;
+    return file_path;
 }
 std::optional<std::filesystem::path> VirtualFilesystem::GetDifferentFilePath(const std::filesystem::path& path, VfsType type) const
 {
@@ -316,6 +552,8 @@ std::optional<std::filesystem::path> VirtualFilesystem::GetRandomFilePathFilterE
         return std::nullopt;
     }
 
+    WaitForPublishedFile(path);
+
     const std::string path_string = path.string();
     std::string_view path_view{ path_string };
 
@@ -340,13 +578,18 @@ std::vector<std::filesystem::path> VirtualFilesystem::GetAllFilePaths(const std:
         return file_paths;
     }
 
+    WaitForPublishedFile(path);
+
     for (const auto& mount : mMounts)
     {
         if (mount->MountImpl->IsType(type))
         {
             if (auto file_path = mount->MountImpl->GetFilePath(path))
             {
-                file_paths.push_back(std::move(file_path).value());
+                if (auto disk_path = mount->MountImpl->GetDiskPath(std::move(file_path).value()))
+                {
+                    file_paths.push_back(std::move(disk_path).value());
+                }
             }
         }
     }
@@ -354,6 +597,101 @@ std::vector<std::filesystem::path> VirtualFilesystem::GetAllFilePaths(const std:
     return file_paths;
 }
 
+std::vector<std::optional<std::filesystem::path>> VirtualFilesystem::ResolveMany(std::span<const ResolveRequest> requests, VfsType type) const
+{
+    std::vector<std::optional<std::filesystem::path>> resolved_paths(requests.size());
+    if (mMounts.empty())
+    {
+        return resolved_paths;
+    }
+
+    struct PendingRequest
+    {
+        std::size_t Index;
+        std::string PathString;
+    };
+    std::vector<PendingRequest> pending_requests;
+    pending_requests.reserve(requests.size());
+
+    // Identical requests are only resolved once and then copied
+    std::unordered_map<std::string, std::size_t> unique_requests;
+    std::vector<std::pair<std::size_t, std::size_t>> duplicate_requests;
+
+    for (std::size_t i = 0; i < requests.size(); i++)
+    {
+        const ResolveRequest& request = requests[i];
+        if (!IsAllowedFile(request.Path))
+        {
+            continue;
+        }
+
+        std::string path_string{ request.Path.string() };
+
+        std::string request_key{ path_string };
+        for (const std::filesystem::path& allowed_extension : request.AllowedExtensions)
+        {
+            request_key += '|';
+            request_key += allowed_extension.string();
+        }
+        if (auto [it, inserted] = unique_requests.try_emplace(std::move(request_key), i); !inserted)
+        {
+            duplicate_requests.emplace_back(i, it->second);
+            continue;
+        }
+
+        WaitForPublishedFile(request.Path);
+
+        // Bound and linked pathes depend on other pathes, those take the usual route
+        if (GetLinkedPathes(path_string) != nullptr || GetBoundPathes(path_string) != nullptr)
+        {
+            resolved_paths[i] = GetFilePathFilterExt(request.Path, request.AllowedExtensions, type);
+            continue;
+        }
+
+        pending_requests.push_back(PendingRequest{ i, std::move(path_string) });
+    }
+
+    // Same as GetLoadingMount, the first mount that has a file passing the filters wins
+    for (const auto& mount : mMounts)
+    {
+        if (pending_requests.empty())
+        {
+            break;
+        }
+
+        if (!mount->MountImpl->IsType(type))
+        {
+            continue;
+        }
+
+        std::erase_if(pending_requests, [&](const PendingRequest& pending_request)
+                      {
+                          const ResolveRequest& request = requests[pending_request.Index];
+                          auto file_path = mount->MountImpl->GetFilePath(request.Path);
+                          if (!file_path.has_value() || !FilterPath(file_path.value(), pending_request.PathString, request.AllowedExtensions))
+                          {
+                              return false;
+                          }
+
+                          // Same as GetFilePath with this mount, but the file found above is not looked up a second time
+                          std::optional<std::filesystem::path>& resolved_path = resolved_paths[pending_request.Index];
+                          resolved_path = GetLinkedMountsFilePath(mount.get(), request.Path, pending_request.PathString, request.AllowedExtensions, type);
+                          if (!resolved_path.has_value())
+                          {
+                              resolved_path = mount->MountImpl->GetDiskPath(std::move(file_path).value());
+                          }
+                          return true;
+                      });
+    }
+
+    for (const auto& [duplicate_index, original_index] : duplicate_requests)
+    {
+        resolved_paths[duplicate_index] = resolved_paths[original_index];
+    }
+
+    return resolved_paths;
+}
+
 bool VirtualFilesystem::IsAllowedFile(const std::filesystem::path& path) const
 {
     if (!m_RestrictedFiles.empty())
@@ -370,6 +708,23 @@ std::optional<std::filesystem::path> VirtualFilesystem::GetFilePath(const VfsMou
                                                                     std::string_view path_view,
                                                                     std::span<const std::filesystem::path> allowed_extensions,
                                                                     VfsType type) const
+{
+    if (auto file_path = GetLinkedMountsFilePath(mount, path, path_view, allowed_extensions, type))
+    {
+        return file_path;
+    }
+
+    if (auto file_path = mount->MountImpl->GetFilePath(path))
+    {
+        return mount->MountImpl->GetDiskPath(std::move(file_path).value());
+    }
+    return std::nullopt;
+}
+std::optional<std::filesystem::path> VirtualFilesystem::GetLinkedMountsFilePath(const VfsMount* mount,
+                                                                                const std::filesystem::path& path,
+                                                                                std::string_view path_view,
+                                                                                std::span<const std::filesystem::path> allowed_extensions,
+                                                                                VfsType type) const
 {
     for (const VfsMount* linked_mount : mount->LinkedMounts)
     {
@@ -380,13 +735,12 @@ std::optional<std::filesystem::path> VirtualFilesystem::GetFilePath(const VfsMou
                 std::filesystem::path file_path = std::move(return_path).value();
                 if (FilterPath(file_path, path_view, allowed_extensions))
                 {
-                    return return_path;
+                    return linked_mount->MountImpl->GetDiskPath(std::move(file_path));
                 }
             }
         }
     }
-
-    return mount->MountImpl->GetFilePath(path);
+    return std::nullopt;
 }
 
 const VirtualFilesystem::VfsMount* VirtualFilesystem::GetLinkedMount(
@@ -409,30 +763,25 @@ const VirtualFilesystem::VfsMount* VirtualFilesystem::GetLinkedMount(
         }
 #endif
 
-        const CachedMountKey cache_key{ linked_pathes };
-
-        std::lock_guard lock{ m_MountCacheMutex };
-        if (const CachedMount* cached_mount = algo::find(m_MountCache, &CachedMount::Key, cache_key))
-        {
-            return cached_mount->Mount;
-        }
-
-        const VfsMount* linked_mount{ nullptr };
-        for (const LinkedPathesElement& linked_path : *linked_pathes)
-        {
-            const std::string linked_path_string{ linked_path.Path.string() };
-            const std::string_view linked_path_view{ linked_path_string };
-            if (const VfsMount* loading_mount = GetLoadingMount(linked_path.Path, linked_path_view, linked_path.AllowedExtensions, type))
+        return m_MountCache->FindOrInsert(
+            VfsMountCache::Key{ .Group{ linked_pathes } },
+            [&]()
             {
-                if (linked_mount == nullptr || loading_mount->Priority < linked_mount->Priority)
+                const VfsMount* linked_mount{ nullptr };
+                for (const LinkedPathesElement& linked_path : *linked_pathes)
                 {
-                    linked_mount = loading_mount;
+                    const std::string linked_path_string{ linked_path.Path.string() };
+                    const std::string_view linked_path_view{ linked_path_string };
+                    if (const VfsMount* loading_mount = GetLoadingMount(linked_path.Path, linked_path_view, linked_path.AllowedExtensions, type))
+                    {
+                        if (linked_mount == nullptr || loading_mount->Priority < linked_mount->Priority)
+                        {
+                            linked_mount = loading_mount;
+                        }
+                    }
                 }
-            }
-        }
-
-        m_MountCache.push_back(CachedMount{ cache_key, linked_mount });
-        return linked_mount;
+                return linked_mount;
+            });
     }
 
     return nullptr;
@@ -541,57 +890,45 @@ const VirtualFilesystem::VfsMount* VirtualFilesystem::GetRandomLinkedMount(
             }
         }
 #endif
-        const CachedMountKey cache_key{ linked_pathes };
-
-        std::lock_guard lock{ m_MountCacheMutex };
-        if (const CachedMount* cached_mount = algo::find(m_MountCache, &CachedMount::Key, cache_key))
-        {
-            return cached_mount->Mount;
-        }
-
-        const VfsMount* linked_mount{ [&]() -> const VfsMount*
-                                      {
-                                          std::vector<const VfsMount*> all_mounts;
-                                          for (const LinkedPathesElement& linked_path : *linked_pathes)
-                                          {
-                                              const std::string linked_path_string{ linked_path.Path.string() };
-                                              const std::string_view linked_path_view{ linked_path_string };
-                                              std::vector<const VfsMount*> mounts = GetAllLoadingMounts(linked_path.Path, linked_path_view, linked_path.AllowedExtensions, type);
-                                              all_mounts.insert(all_mounts.end(), mounts.begin(), mounts.end());
-                                          }
-                                          std::sort(all_mounts.begin(), all_mounts.end());
-                                          all_mounts.erase(std::unique(all_mounts.begin(), all_mounts.end()), all_mounts.end());
-                                          if (!all_mounts.empty())
-                                          {
-                                              return all_mounts[rand() % all_mounts.size()]; // use something better for randomness??? nah...
-                                          }
-                                          else
-                                          {
-                                              return nullptr;
-                                          }
-                                      }() };
-
-        // Also cache for all bound-pathes of all linked files in case a path is bound to a path but not linked to it
-        std::vector<const BoundPathes*> all_bound_pathes;
-        for (const LinkedPathesElement& linked_path : *linked_pathes)
-        {
-            const std::string linked_path_string{ linked_path.Path.string() };
-            const std::string_view linked_path_view{ linked_path_string };
-            if (const BoundPathes* bound_pathes = GetBoundPathes(linked_path_view))
+        return m_MountCache->FindOrInsert(
+            VfsMountCache::Key{ .Group{ linked_pathes } },
+            [&]()
             {
-                all_bound_pathes.push_back(bound_pathes);
-            }
-        }
-        std::sort(all_bound_pathes.begin(), all_bound_pathes.end());
-        all_bound_pathes.erase(std::unique(all_bound_pathes.begin(), all_bound_pathes.end()), all_bound_pathes.end());
-
-        m_MountCache.push_back(CachedMount{ cache_key, linked_mount });
-        for (const BoundPathes* bound_pathes : all_bound_pathes)
-        {
-            m_MountCache.push_back(CachedMount{ CachedMountKey{ bound_pathes }, linked_mount });
-        }
+                const VfsMount* linked_mount{ [&]() -> const VfsMount*
+                                              {
+                                                  std::vector<const VfsMount*> all_mounts;
+                                                  for (const LinkedPathesElement& linked_path : *linked_pathes)
+                                                  {
+                                                      const std::string linked_path_string{ linked_path.Path.string() };
+                                                      const std::string_view linked_path_view{ linked_path_string };
+                                                      std::vector<const VfsMount*> mounts = GetAllLoadingMounts(linked_path.Path, linked_path_view, linked_path.AllowedExtensions, type);
+                                                      all_mounts.insert(all_mounts.end(), mounts.begin(), mounts.end());
+                                                  }
+                                                  std::sort(all_mounts.begin(), all_mounts.end());
+                                                  all_mounts.erase(std::unique(all_mounts.begin(), all_mounts.end()), all_mounts.end());
+                                                  if (!all_mounts.empty())
+                                                  {
+                                                      return all_mounts[rand() % all_mounts.size()]; // use something better for randomness??? nah...
+                                                  }
+                                                  else
+                                                  {
+                                                      return nullptr;
+                                                  }
+                                              }() };
+
+                // Also cache for all bound-pathes of all linked files in case a path is bound to a path but not linked to it
+                for (const LinkedPathesElement& linked_path : *linked_pathes)
+                {
+                    const std::string linked_path_string{ linked_path.Path.string() };
+                    const std::string_view linked_path_view{ linked_path_string };
+                    if (const BoundPathes* bound_pathes = GetBoundPathes(linked_path_view))
+                    {
+                        m_MountCache->InsertIfMissing(VfsMountCache::Key{ .Group{ bound_pathes } }, linked_mount);
+                    }
+                }
 
-        return linked_mount;
+                return linked_mount;
+            });
     }
 
     return nullptr;
@@ -602,39 +939,27 @@ const VirtualFilesystem::VfsMount* VirtualFilesystem::GetRandomLoadingMount(
     std::span<const std::filesystem::path> allowed_extensions,
     VfsType type) const
 {
-    CachedMountKey cache_key = [&]()
+    auto select_mount = [&]() -> const VfsMount*
     {
-        if (const BoundPathes* bound_pathes = GetBoundPathes(path_view))
+        std::vector<const VfsMount*> mounts = GetAllLoadingMounts(path, path_view, allowed_extensions, type);
+        if (!mounts.empty())
         {
-            return CachedMountKey{ bound_pathes };
+            return mounts[rand() % mounts.size()]; // use something better for randomness??? nah...
         }
         else
         {
-            return CachedMountKey{ path };
+            return nullptr;
         }
-    }();
+    };
 
-    std::lock_guard lock{ m_MountCacheMutex };
-    const CachedMount* cached_mount = algo::find(m_MountCache, &CachedMount::Key, cache_key);
-    if (cached_mount == nullptr)
+    if (const BoundPathes* bound_pathes = GetBoundPathes(path_view))
     {
-        const VfsMount* selected_mount{ [&]() -> const VfsMount*
-                                        {
-                                            std::vector<const VfsMount*> mounts = GetAllLoadingMounts(path, path_view, allowed_extensions, type);
-                                            if (!mounts.empty())
-                                            {
-                                                return mounts[rand() % mounts.size()]; // use something better for randomness??? nah...
-                                            }
-                                            else
-                                            {
-                                                return nullptr;
-                                            }
-                                        }() };
-        m_MountCache.push_back(CachedMount{ cache_key, selected_mount });
-        cached_mount = &m_MountCache.back();
+        return m_MountCache->FindOrInsert(VfsMountCache::Key{ .Group{ bound_pathes } }, select_mount);
+    }
+    else
+    {
+        return m_MountCache->FindOrInsert(VfsMountCache::Key{ .Path{ path_view } }, select_mount);
     }
-
-    return cached_mount->Mount;
 }
 
 std::vector<const VirtualFilesystem::VfsMount*> VirtualFilesystem::GetAllLoadingMounts(
@@ -696,84 +1021,84 @@ bool VirtualFilesystem::FilterPath(const std::filesystem::path& path, std::strin
     return allowed_extensions.empty() || algo::contains(allowed_extensions, path.extension());
 }
 
-template<class PathListSourceT>
-auto* GetBoundPathesImpl(std::string_view path, PathListSourceT& source)
+void VirtualFilesystem::AddToPathGroupIndex(PathGroupIndex& index, std::string_view path, std::size_t group_id)
+{
+    // A path may be part of multiple groups, in that case the index only holds the first of them
+    if (auto it = index.find(NormalizedPathView{ path }); it != index.end())
+    {
+        it->second = std::min(it->second, group_id);
+    }
+    else
+    {
+        index.emplace(std::string{ path }, group_id);
+    }
+}
+
+template<class PathListSourceT, class PathIndexT>
+auto* GetPathGroupImpl(std::string_view path, const PathIndexT& index, PathListSourceT& source)
 {
     path = path.substr(0, path.rfind('.'));
-    return algo::find_if(source,
-                         [path](const std::vector<std::string_view>& bound_pathes)
-                         {
-                             return algo::contains(bound_pathes, path);
-                         });
-}
-template<class PathListSourceT>
-auto* GetBoundPathesImpl(const std::vector<std::string_view>& pathes, PathListSourceT& source)
-{
-    return algo::find_if(source,
-                         [&pathes](const std::vector<std::string_view>& bound_pathes)
-                         {
-                             return algo::contains_if(bound_pathes,
-                                                      [&pathes](std::string_view bound_path)
-                                                      {
-                                                          return algo::contains(pathes, bound_path);
-                                                      });
-                         });
+    auto it = index.find(NormalizedPathView{ path });
+    return it != index.end() ? &source[it->second] : nullptr;
+}
+template<class PathListSourceT, class PathIndexT, class PathesT, class ToStringFunT>
+auto* GetPathGroupImpl(const PathesT& pathes, const PathIndexT& index, PathListSourceT& source, ToStringFunT&& to_string)
+{
+    std::size_t group_id{ source.size() };
+    for (const auto& path : pathes)
+    {
+        decltype(auto) path_string{ to_string(path) };
+        if (auto it = index.find(NormalizedPathView{ path_string }); it != index.end())
+        {
+            group_id = std::min(group_id, it->second);
+        }
+    }
+    return group_id < source.size() ? &source[group_id] : nullptr;
 }
 
 VirtualFilesystem::BoundPathes* VirtualFilesystem::GetBoundPathes(std::string_view path)
 {
-    return GetBoundPathesImpl(path, m_BoundPathes);
+    return GetPathGroupImpl(path, m_BoundPathesIndex, m_BoundPathes);
 }
 VirtualFilesystem::BoundPathes* VirtualFilesystem::GetBoundPathes(const BoundPathes& pathes)
 {
-    return GetBoundPathesImpl(pathes, m_BoundPathes);
+    return GetPathGroupImpl(pathes, m_BoundPathesIndex, m_BoundPathes, std::identity{});
 }
 const VirtualFilesystem::BoundPathes* VirtualFilesystem::GetBoundPathes(std::string_view path) const
 {
-    return GetBoundPathesImpl(path, m_BoundPathes);
+    return GetPathGroupImpl(path, m_BoundPathesIndex, m_BoundPathes);
 }
 const VirtualFilesystem::BoundPathes* VirtualFilesystem::GetBoundPathes(const BoundPathes& pathes) const
 {
-    return GetBoundPathesImpl(pathes, m_BoundPathes);
+    return GetPathGroupImpl(pathes, m_BoundPathesIndex, m_BoundPathes, std::identity{});
 }
 
-template<class PathListSourceT>
-auto* GetLinkedPathesImpl(std::string_view path, PathListSourceT& source)
+static auto LinkedPathString(const VirtualFilesystem::LinkedPathesElement& linked_path)
 {
-    path = path.substr(0, path.rfind('.'));
-    return algo::find_if(source,
-                         [path](const std::vector<VirtualFilesystem::LinkedPathesElement>& linked_pathes)
-                         {
-                             return algo::contains(linked_pathes, &VirtualFilesystem::LinkedPathesElement::Path, path);
-                         });
-}
-template<class PathListSourceT>
-auto* GetLinkedPathesImpl(const std::vector<VirtualFilesystem::LinkedPathesElement>& pathes, PathListSourceT& source)
-{
-    return algo::find_if(source,
-                         [&pathes](const std::vector<VirtualFilesystem::LinkedPathesElement>& linked_pathes)
-                         {
-                             return algo::contains_if(linked_pathes,
-                                                      [&pathes](const VirtualFilesystem::LinkedPathesElement& linked_path)
-                                                      {
-                                                          return algo::contains(pathes, &VirtualFilesystem::LinkedPathesElement::Path, linked_path.Path);
-                                                      });
-                         });
+    // Only wide pathes have to be converted
+    if constexpr (std::is_same_v<std::filesystem::path::value_type, char>)
+    {
+        return std::string_view{ linked_path.Path.native() };
+    }
+    else
+    {
+        return linked_path.Path.string();
+    }
 }
 
 VirtualFilesystem::LinkedPathes* VirtualFilesystem::GetLinkedPathes(std::string_view path)
 {
-    return GetLinkedPathesImpl(path, m_LinkedPathes);
+    return GetPathGroupImpl(path, m_LinkedPathesIndex, m_LinkedPathes);
 }
 VirtualFilesystem::LinkedPathes* VirtualFilesystem::GetLinkedPathes(const LinkedPathes& pathes)
 {
-    return GetLinkedPathesImpl(pathes, m_LinkedPathes);
+    return GetPathGroupImpl(pathes, m_LinkedPathesIndex, m_LinkedPathes, LinkedPathString);
 }
 const VirtualFilesystem::LinkedPathes* VirtualFilesystem::GetLinkedPathes(std::string_view path) const
 {
-    return GetLinkedPathesImpl(path, m_LinkedPathes);
+    return GetPathGroupImpl(path, m_LinkedPathesIndex, m_LinkedPathes);
 }
 const VirtualFilesystem::LinkedPathes* VirtualFilesystem::GetLinkedPathes(const LinkedPathes& pathes) const
 {
-    return GetLinkedPathesImpl(pathes, m_LinkedPathes);
+    return GetPathGroupImpl(pathes, m_LinkedPathesIndex, m_LinkedPathes, LinkedPathString);
 }
@@ -1,16 +1,25 @@
 #pragma once
 
+#include "util/normalized_path.h"
+
+#include <atomic>
 #include <filesystem>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <span>
+#include <string>
 #include <string_view>
-#include <variant>
+#include <unordered_map>
 #include <vector>
 
 struct SpelunkyFileInfo;
+class VfsMemoryMount;
+class VfsMountCache;
+class VfsPrefetcher;
+class VfsSnapshot;
+class VfsTracer;
 
 enum class VfsType
 {
@@ -32,8 +41,42 @@ class VirtualFilesystem
 
     struct VfsMount;
     VfsMount* MountFolder(std::string_view path, std::int64_t priority, VfsType vfs_type);
+    // Serves files straight from a zip archive, files requested by path during preprocessing are extracted to extract_path
+    VfsMount* MountArchive(std::string_view path, std::string_view extract_path, std::int64_t priority, VfsType vfs_type);
+    // Serves files published with PublishFile from memory, only LoadFile sees them until they were written to backing_path
+    VfsMount* MountMemory(std::string_view backing_path, std::int64_t priority, VfsType vfs_type, std::size_t memory_budget);
     void LinkMounts(struct VfsMount* lhs, struct VfsMount* rhs);
 
+    // Makes a generated file loadable right away, with write_behind set it is written to disk in the background
+    // Files outside of the memory mounts backing folder are written to disk immediately
+    bool PublishFile(const std::filesystem::path& file_path, std::vector<std::uint8_t> data, bool write_behind = true);
+    // Blocks until all published files are on disk
+    void FlushPublishedFiles();
+
+    // Folders mounted after loading a snapshot restore their index from it instead of walking the folder again
+    // Discard pathes that changed since the snapshot was saved before mounting the folders containing them
+    void LoadSnapshot(const std::filesystem::path& snapshot_path);
+    void DiscardSnapshot(const std::filesystem::path& changed_path);
+    // Saves the indices of all mounted folders, the file is deleted again as soon as any index is invalidated
+    void SaveSnapshot(const std::filesystem::path& snapshot_path);
+
+    // The file is still being generated in the background, looking it up calls wait first, pathes are matched without extension
+    // Several waits may be registered for the same path, they are dropped once all of them returned true, i.e. the file is ready
+    using DeferredFileWaitFun = std::function<bool()>;
+    void DeferFile(std::string_view relative_path, DeferredFileWaitFun wait);
+    void ClearDeferredFiles();
+
+    // Mounts index their files on creation, call this after writing to or deleting from a mounted folder
+    void InvalidateIndex(const std::filesystem::path& changed_path);
+
+    // Logs per-mount counters of how many loads were skipped or served
+    void LogStatistics() const;
+
+    // Records every LoadFile and GetFilePath call, only call this before mounting anything
+    void EnableTracing();
+    // Writes per-path and per-mount counters plus latency histograms to json_path and the raw call sequence to trace_path
+    bool WriteTrace(const std::filesystem::path& json_path, const std::filesystem::path& trace_path) const;
+
     // Allow loading only files specified in this list
     void RestrictFiles(std::span<const std::string_view> files);
     bool HasRestrictedFiles() const
@@ -60,6 +103,13 @@ class VirtualFilesystem
     // Interface for runtime loading
     using FileInfo = SpelunkyFileInfo;
     FileInfo* LoadFile(const char* path, void* (*allocator)(std::size_t) = nullptr) const;
+    // Allocates a FileInfo with room for file_size bytes of data right behind it, a null allocator means malloc
+    static FileInfo* AllocateFileInfo(void* (*allocator)(std::size_t), std::size_t file_size);
+
+    // Loads files on background threads into a cache of at most cache_budget bytes, LoadFile then only copies them
+    // With predict_loads set the order in which files are loaded is remembered and used to prefetch the files following each load
+    void EnablePrefetching(std::size_t num_threads, std::size_t cache_budget, bool predict_loads);
+    void Prefetch(std::span<const char* const> paths);
 
     // Interface for loading during preprocessing
     std::optional<std::filesystem::path> GetFilePath(const std::filesystem::path& path, VfsType type = VfsType::Any) const;
@@ -69,13 +119,34 @@ class VirtualFilesystem
     std::optional<std::filesystem::path> GetRandomFilePathFilterExt(const std::filesystem::path& path, std::span<const std::filesystem::path> allowed_extensions, VfsType type = VfsType::Any) const;
     std::vector<std::filesystem::path> GetAllFilePaths(const std::filesystem::path& path, VfsType type = VfsType::Any) const;
 
+    // Resolves a whole batch of pathes like GetFilePathFilterExt would, walking the mounts only once for all of them
+    struct ResolveRequest
+    {
+        std::filesystem::path Path;
+        std::span<const std::filesystem::path> AllowedExtensions;
+    };
+    std::vector<std::optional<std::filesystem::path>> ResolveMany(std::span<const ResolveRequest> requests, VfsType type = VfsType::Any) const;
+
   private:
     using BoundPathes = std::vector<std::string_view>;
     using LinkedPathes = std::vector<LinkedPathesElement>;
 
     bool IsAllowedFile(const std::filesystem::path& path) const;
 
+    FileInfo* LoadFileUntraced(const char* path, void* (*allocator)(std::size_t)) const;
+    FileInfo* LoadFileFromMounts(const char* path, void* (*allocator)(std::size_t)) const;
+    FileInfo* LoadFileFromMounts(const char* path, const NormalizedPathView& normalized_path, void* (*allocator)(std::size_t)) const;
+
+    // Lets all other mounts see published files that have been written to disk since the last call
+    void SyncPublishedFiles() const;
+    void WaitForPublishedFile(const std::filesystem::path& path) const;
+    // Returns true if the file was deferred, it may have been loaded before it was generated so caches of it are stale
+    bool WaitForDeferredFile(std::string_view path) const;
+
+    void DeleteSavedSnapshot() const;
+
     std::optional<std::filesystem::path> GetFilePath(const VfsMount* mount, const std::filesystem::path& path, std::string_view path_view, std::span<const std::filesystem::path> allowed_extensions, VfsType type) const;
+    std::optional<std::filesystem::path> GetLinkedMountsFilePath(const VfsMount* mount, const std::filesystem::path& path, std::string_view path_view, std::span<const std::filesystem::path> allowed_extensions, VfsType type) const;
 
     const VfsMount* GetLinkedMount(const std::filesystem::path& path, std::string_view path_view, std::span<const std::filesystem::path> allowed_extensions, VfsType type) const;
     const VfsMount* GetLoadingMount(const std::filesystem::path& path, std::string_view path_view, std::span<const std::filesystem::path> allowed_extensions, VfsType type) const;
@@ -87,6 +158,11 @@ class VirtualFilesystem
 
     bool FilterPath(const std::filesystem::path& path, std::string_view relative_path, std::span<const std::filesystem::path> allowed_extensions) const;
 
+    // Maps each bound or linked path, without extension, to the index of its group
+    // Keys are hashed and compared normalized, so pathes match no matter their separators or case
+    using PathGroupIndex = std::unordered_map<std::string, std::size_t, NormalizedPathHash, NormalizedPathEqual>;
+    static void AddToPathGroupIndex(PathGroupIndex& index, std::string_view path, std::size_t group_id);
+
     BoundPathes* GetBoundPathes(std::string_view path);
     BoundPathes* GetBoundPathes(const BoundPathes& pathes);
     const BoundPathes* GetBoundPathes(std::string_view path) const;
@@ -99,18 +175,29 @@ class VirtualFilesystem
 
     std::vector<std::unique_ptr<VfsMount>> mMounts;
 
-    using CachedMountKey = std::variant<const BoundPathes*, const LinkedPathes*, std::filesystem::path>;
-    struct CachedMount
-    {
-        CachedMountKey Key;
-        const VfsMount* Mount;
-    };
-    mutable std::mutex m_MountCacheMutex;
-    mutable std::vector<CachedMount> m_MountCache;
+    std::unique_ptr<VfsMountCache> m_MountCache;
+
+    VfsMemoryMount* m_MemoryMount{ nullptr };
+
+    // Published files discard their folder from the snapshot, which may happen from background threads
+    std::mutex m_SnapshotMutex;
+    std::unique_ptr<VfsSnapshot> m_Snapshot;
+    std::filesystem::path m_SnapshotPath;
+    mutable std::atomic_bool m_SnapshotSaved{ false };
+
+    std::unique_ptr<VfsTracer> m_Tracer;
+
+    std::unique_ptr<VfsPrefetcher> m_Prefetcher;
 
     std::span<const std::string_view> m_RestrictedFiles;
     std::vector<CustomFilterFun> m_CustomFilters;
 
     std::vector<BoundPathes> m_BoundPathes;
     std::vector<LinkedPathes> m_LinkedPathes;
+    PathGroupIndex m_BoundPathesIndex;
+    PathGroupIndex m_LinkedPathesIndex;
+
+    mutable std::mutex m_DeferredFilesMutex;
+    mutable std::unordered_map<std::string, std::vector<DeferredFileWaitFun>, NormalizedPathHash, NormalizedPathEqual> m_DeferredFiles;
+    mutable std::atomic_size_t m_NumDeferredFiles{ 0 };
 };
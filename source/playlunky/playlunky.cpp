@@ -7,6 +7,7 @@
 #include "mod/save_game.h"
 #include "mod/virtual_filesystem.h"
 #include "playlunky_settings.h"
+#include "util/profiler.h"
 #include "version.h"
 
 #include <spel2.h>
@@ -69,6 +70,8 @@ bool Playlunky::IsDestroy()
 
 void Playlunky::Init()
 {
+    const ProfileZone profile_zone{ "Playlunky::Init" };
+
     LogInfo("Initializing Playlunky...");
     LogInfo("Playlunky Version: {}", playlunky_version());
 
@@ -82,9 +85,18 @@ void Playlunky::Init()
 
 void Playlunky::PostGameInit()
 {
-    LogInfo("Finalizing Playlunky setup...");
+    {
+        const ProfileZone profile_zone{ "Playlunky::PostGameInit" };
 
-    mImpl->Manager->PostGameInit(mImpl->Settings);
+        LogInfo("Finalizing Playlunky setup...");
+
+        mImpl->Manager->PostGameInit(mImpl->Settings);
+    }
+
+    if (mImpl->Settings.GetBool("general_settings", "write_startup_profile", true))
+    {
+        mImpl->Manager->WriteStartupProfile();
+    }
 }
 
 const PlaylunkySettings& Playlunky::GetSettings() const
@@ -79,6 +79,13 @@ void PlaylunkySettings::WriteToFile(std::string settings_file) const
                                                    KnownSetting{ .Name{ "enable_loose_file_warning" }, .AltCategory{ "settings" }, .DefaultValue{ "true" } },
                                                    KnownSetting{ .Name{ "enable_raw_string_loading" }, .DefaultValue{ "false" } },
                                                    KnownSetting{ .Name{ "disable_asset_caching" }, .DefaultValue{ "false" } },
+                                                   KnownSetting{ .Name{ "enable_load_prefetching" }, .DefaultValue{ "false" }, .Comment{ "Remembers the order in which the game loads files and reads the next ones ahead of time, uses up to 64 MB of memory" } },
+                                                   KnownSetting{ .Name{ "enable_content_deduplication" }, .DefaultValue{ "false" }, .Comment{ "Converts files that are identical across mods only once and shares the result on disk" } },
+                                                   KnownSetting{ .Name{ "use_consolidated_mod_database" }, .DefaultValue{ "false" }, .Comment{ "Keeps the state of all mods in a single file instead of one file per mod, speeds up startup with many mods" } },
+                                                   KnownSetting{ .Name{ "enable_content_hashing" }, .DefaultValue{ "false" }, .Comment{ "Hashes mod files whose timestamp changed and skips regenerating them if their content is the same" } },
+                                                   KnownSetting{ .Name{ "enable_deferred_asset_generation" }, .DefaultValue{ "false" }, .Comment{ "Generates journal sheets, arena previews and cached audio in the background while the game starts, the game only waits for them if it needs them earlier" } },
+                                                   KnownSetting{ .Name{ "write_startup_profile" }, .DefaultValue{ "true" }, .Comment{ "Writes where startup time went to Mods/Packs/.db/startup_profile.json, which opens in Perfetto or chrome://tracing, and a summary to startup_profile.txt" } },
+                                                   KnownSetting{ .Name{ "enable_vfs_tracing" }, .DefaultValue{ "false" }, .Comment{ "Records every file the game and Playlunky look up, written to Mods/Packs/.db/vfs_trace.json and vfs_trace.txt on exit" } },
                                                    KnownSetting{ .Name{ "block_save_game" }, .DefaultValue{ "false" } },
                                                    KnownSetting{ .Name{ "allow_save_game_mods" }, .DefaultValue{ "true" } },
                                                    KnownSetting{ .Name{ "use_playlunky_save" }, .DefaultValue{ "false" } },
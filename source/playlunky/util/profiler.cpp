@@ -0,0 +1,217 @@
+#include "profiler.h"
+
+#include "log.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Enough for every zone of a startup with plenty of mods, the oldest zones are overwritten after that
+static constexpr std::size_t c_NumProfileEvents{ 64 * 1024 };
+
+struct ProfileEvent
+{
+    const char* Name;
+    std::int64_t StartNanoseconds;
+    std::int64_t DurationNanoseconds;
+    std::uint32_t ThreadId;
+};
+struct ProfileSlot
+{
+    // Odd while the event is being written, readers only take events whose sequence is even and did not change while copying
+    std::atomic_uint64_t Sequence{ 0 };
+    ProfileEvent Event{};
+};
+
+static const std::chrono::steady_clock::time_point s_ProfileStart{ std::chrono::steady_clock::now() };
+static std::array<ProfileSlot, c_NumProfileEvents> s_ProfileSlots;
+static std::atomic_uint64_t s_NumProfileEvents{ 0 };
+static std::atomic_uint32_t s_NumProfiledThreads{ 0 };
+
+static std::int64_t GetProfileNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_ProfileStart).count();
+}
+static std::uint32_t GetProfileThreadId()
+{
+    // Small sequential ids read better in a trace viewer than native thread ids
+    static thread_local const std::uint32_t s_ThreadId{ s_NumProfiledThreads++ };
+    return s_ThreadId;
+}
+
+ProfileZone::ProfileZone(const char* name)
+    : mName{ name }
+    , mStartNanoseconds{ GetProfileNanoseconds() }
+{
+}
+ProfileZone::~ProfileZone()
+{
+    const std::int64_t end_nanoseconds{ GetProfileNanoseconds() };
+    const std::uint64_t event_index{ s_NumProfileEvents++ };
+
+    ProfileSlot& slot = s_ProfileSlots[event_index % c_NumProfileEvents];
+    slot.Sequence.store(event_index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.Event = ProfileEvent{
+        .Name = mName,
+        .StartNanoseconds = mStartNanoseconds,
+        .DurationNanoseconds = end_nanoseconds - mStartNanoseconds,
+        .ThreadId = GetProfileThreadId(),
+    };
+    slot.Sequence.store(event_index * 2 + 2, std::memory_order_release);
+}
+
+static std::vector<ProfileEvent> GetProfileEvents()
+{
+    const std::uint64_t num_events{ s_NumProfileEvents.load() };
+    const std::uint64_t first_event{ num_events > c_NumProfileEvents ? num_events - c_NumProfileEvents : 0 };
+
+    std::vector<ProfileEvent> events;
+    events.reserve(num_events - first_event);
+    for (std::uint64_t i = first_event; i < num_events; i++)
+    {
+        const ProfileSlot& slot = s_ProfileSlots[i % c_NumProfileEvents];
+        const std::uint64_t sequence{ slot.Sequence.load(std::memory_order_acquire) };
+        if (sequence != i * 2 + 2)
+        {
+            // Still being written or already overwritten by a newer zone
+            continue;
+        }
+
+        const ProfileEvent event{ slot.Event };
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.Sequence.load(std::memory_order_relaxed) == sequence)
+        {
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+bool WriteProfile(const std::filesystem::path& json_path, const std::filesystem::path& summary_path)
+{
+    using nlohmann::json;
+
+    std::vector<ProfileEvent> events{ GetProfileEvents() };
+
+    {
+        json trace_events = json::array();
+        for (const ProfileEvent& event : events)
+        {
+            trace_events.push_back({
+                { "name", event.Name },
+                { "cat", "playlunky" },
+                { "ph", "X" },
+                { "ts", static_cast<double>(event.StartNanoseconds) / 1000.0 },
+                { "dur", static_cast<double>(event.DurationNanoseconds) / 1000.0 },
+                { "pid", 0 },
+                { "tid", event.ThreadId },
+            });
+        }
+
+        const json root{
+            { "traceEvents", std::move(trace_events) },
+            { "displayTimeUnit", "ms" },
+        };
+        if (auto json_file = std::ofstream{ json_path, std::ios::trunc })
+        {
+            json_file << root.dump();
+        }
+        else
+        {
+            LogError("Could not write profile trace to {}...", json_path.string());
+            return false;
+        }
+    }
+
+    struct ZoneStats
+    {
+        std::string_view Name;
+        std::uint64_t Calls{ 0 };
+        std::int64_t TotalNanoseconds{ 0 };
+        std::int64_t SelfNanoseconds{ 0 };
+        std::int64_t MaxNanoseconds{ 0 };
+    };
+    std::unordered_map<std::string_view, ZoneStats> zone_stats;
+
+    // Zones of one thread either nest or follow each other, so going through them by start time with a stack finds each zone's parent
+    std::sort(events.begin(), events.end(), [](const ProfileEvent& lhs, const ProfileEvent& rhs)
+              {
+                  if (lhs.ThreadId != rhs.ThreadId)
+                      return lhs.ThreadId < rhs.ThreadId;
+                  if (lhs.StartNanoseconds != rhs.StartNanoseconds)
+                      return lhs.StartNanoseconds < rhs.StartNanoseconds;
+                  return lhs.DurationNanoseconds > rhs.DurationNanoseconds; });
+    std::vector<std::pair<const ProfileEvent*, ZoneStats*>> open_zones;
+    for (const ProfileEvent& event : events)
+    {
+        while (!open_zones.empty())
+        {
+            const ProfileEvent& open_event = *open_zones.back().first;
+            if (open_event.ThreadId == event.ThreadId && open_event.StartNanoseconds + open_event.DurationNanoseconds > event.StartNanoseconds)
+            {
+                break;
+            }
+            open_zones.pop_back();
+        }
+
+        ZoneStats& stats = zone_stats[event.Name];
+        stats.Name = event.Name;
+        stats.Calls++;
+        stats.TotalNanoseconds += event.DurationNanoseconds;
+        stats.SelfNanoseconds += event.DurationNanoseconds;
+        stats.MaxNanoseconds = std::max(stats.MaxNanoseconds, event.DurationNanoseconds);
+
+        if (!open_zones.empty())
+        {
+            open_zones.back().second->SelfNanoseconds -= event.DurationNanoseconds;
+        }
+        open_zones.push_back({ &event, &stats });
+    }
+
+    // Most expensive zones first, those are the ones worth looking at
+    std::vector<ZoneStats> sorted_stats;
+    sorted_stats.reserve(zone_stats.size());
+    for (const auto& [name, stats] : zone_stats)
+    {
+        sorted_stats.push_back(stats);
+    }
+    std::sort(sorted_stats.begin(), sorted_stats.end(), [](const ZoneStats& lhs, const ZoneStats& rhs)
+              { return lhs.TotalNanoseconds > rhs.TotalNanoseconds; });
+
+    if (auto summary_file = std::ofstream{ summary_path, std::ios::trunc })
+    {
+        const std::uint64_t num_recorded_events{ s_NumProfileEvents.load() };
+        summary_file << fmt::format("{} zones on {} threads", events.size(), s_NumProfiledThreads.load());
+        if (num_recorded_events > events.size())
+        {
+            summary_file << fmt::format(", {} older or unfinished zones are missing", num_recorded_events - events.size());
+        }
+        summary_file << "\n\n";
+
+        static constexpr auto to_milliseconds = [](std::int64_t nanoseconds)
+        {
+            return static_cast<double>(nanoseconds) / 1'000'000.0;
+        };
+        summary_file << fmt::format("{:<48} {:>8} {:>12} {:>12} {:>12}\n", "zone", "calls", "total ms", "self ms", "max ms");
+        for (const ZoneStats& stats : sorted_stats)
+        {
+            summary_file << fmt::format("{:<48} {:>8} {:>12.3f} {:>12.3f} {:>12.3f}\n",
+                                        stats.Name,
+                                        stats.Calls,
+                                        to_milliseconds(stats.TotalNanoseconds),
+                                        to_milliseconds(stats.SelfNanoseconds),
+                                        to_milliseconds(stats.MaxNanoseconds));
+        }
+        return static_cast<bool>(summary_file);
+    }
+
+    LogError("Could not write profile summary to {}...", summary_path.string());
+    return false;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+// Times the scope it lives in, zones may nest and be used on any thread
+// Only the pointer to the name is kept, so it has to live as long as the program, e.g. a string literal
+// Each zone costs two clock reads and one store into a fixed ring buffer, so they are always recorded
+class ProfileZone
+{
+  public:
+    explicit ProfileZone(const char* name);
+    ~ProfileZone();
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone(ProfileZone&&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+    ProfileZone& operator=(ProfileZone&&) = delete;
+
+  private:
+    const char* const mName;
+    const std::int64_t mStartNanoseconds;
+};
+
+// Zones that ended so far as a Chrome trace, which Perfetto opens too, and the total and self time per zone name as plain text
+bool WriteProfile(const std::filesystem::path& json_path, const std::filesystem::path& summary_path);
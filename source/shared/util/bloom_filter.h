@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// Compact probabilistic set, never reports false negatives
+// Sized for roughly 1% false positives at the expected number of elements
+// Elements are passed as their hash, so a key can be hashed once and probed against many filters
+// Inserting while others probe is safe, a probe racing an insert may miss that element but nothing else
+class BloomFilter
+{
+  public:
+    BloomFilter() = default;
+    explicit BloomFilter(std::size_t expected_elements)
+        : m_Bits(std::bit_ceil(std::max<std::size_t>(expected_elements * c_BitsPerElement / 64, 1)), 0)
+    {
+    }
+
+    void Insert(std::size_t element_hash)
+    {
+        const auto [first_hash, second_hash] = Hash(element_hash);
+        const std::size_t mask{ m_Bits.size() * 64 - 1 };
+        for (std::size_t i = 0; i < c_NumHashes; i++)
+        {
+            const std::size_t bit{ (first_hash + i * second_hash) & mask };
+            std::atomic_ref{ m_Bits[bit / 64] }.fetch_or(std::uint64_t{ 1 } << (bit % 64), std::memory_order_relaxed);
+        }
+    }
+
+    bool MayContain(std::size_t element_hash) const
+    {
+        if (m_Bits.empty())
+        {
+            return false;
+        }
+
+        const auto [first_hash, second_hash] = Hash(element_hash);
+        const std::size_t mask{ m_Bits.size() * 64 - 1 };
+        for (std::size_t i = 0; i < c_NumHashes; i++)
+        {
+            const std::size_t bit{ (first_hash + i * second_hash) & mask };
+            const std::uint64_t word{ std::atomic_ref{ m_Bits[bit / 64] }.load(std::memory_order_relaxed) };
+            if ((word & (std::uint64_t{ 1 } << (bit % 64))) == 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+  private:
+    static constexpr std::size_t c_BitsPerElement{ 10 };
+    static constexpr std::size_t c_NumHashes{ 7 };
+
+    struct HashPair
+    {
+        std::size_t First;
+        std::size_t Second;
+    };
+    static HashPair Hash(std::uint64_t hash)
+    {
+        // Double hashing, derive the second hash by remixing the first one, it has to be odd to visit all bits
+        std::uint64_t remixed{ hash ^ (hash >> 33) };
+        remixed *= 0xff51afd7ed558ccdull;
+        remixed ^= remixed >> 33;
+        return { static_cast<std::size_t>(hash), static_cast<std::size_t>(remixed | 1) };
+    }
+
+    // Only accessed through atomic_ref, so the filter stays movable
+    mutable std::vector<std::uint64_t> m_Bits;
+};
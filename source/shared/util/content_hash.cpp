@@ -0,0 +1,116 @@
+#include "content_hash.h"
+
+#include "mapped_file.h"
+
+#include <bit>
+#include <cstring>
+
+static constexpr std::uint64_t c_Prime1{ 0x9E3779B185EBCA87 };
+static constexpr std::uint64_t c_Prime2{ 0xC2B2AE3D27D4EB4F };
+static constexpr std::uint64_t c_Prime3{ 0x165667B19E3779F9 };
+static constexpr std::uint64_t c_Prime4{ 0x85EBCA77C2B2AE63 };
+static constexpr std::uint64_t c_Prime5{ 0x27D4EB2F165667C5 };
+
+static std::uint64_t Read64(const char* data)
+{
+    std::uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+static std::uint32_t Read32(const char* data)
+{
+    std::uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static std::uint64_t Round(std::uint64_t lane, std::uint64_t input)
+{
+    lane += input * c_Prime2;
+    lane = std::rotl(lane, 31);
+    return lane * c_Prime1;
+}
+static std::uint64_t MergeRound(std::uint64_t hash, std::uint64_t lane)
+{
+    hash ^= Round(0, lane);
+    return hash * c_Prime1 + c_Prime4;
+}
+
+std::uint64_t HashContent(std::string_view data, std::uint64_t seed)
+{
+    const char* input = data.data();
+    const char* const end = input + data.size();
+
+    std::uint64_t hash;
+    if (data.size() >= 32)
+    {
+        std::uint64_t lanes[4]{
+            seed + c_Prime1 + c_Prime2,
+            seed + c_Prime2,
+            seed,
+            seed - c_Prime1,
+        };
+
+        const char* const last_stripe = end - 32;
+        do
+        {
+            for (std::size_t i = 0; i < 4; i++)
+            {
+                lanes[i] = Round(lanes[i], Read64(input + i * 8));
+            }
+            input += 32;
+        } while (input <= last_stripe);
+
+        hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+        for (std::uint64_t lane : lanes)
+        {
+            hash = MergeRound(hash, lane);
+        }
+    }
+    else
+    {
+        hash = seed + c_Prime5;
+    }
+
+    hash += static_cast<std::uint64_t>(data.size());
+
+    for (; input + 8 <= end; input += 8)
+    {
+        hash ^= Round(0, Read64(input));
+        hash = std::rotl(hash, 27) * c_Prime1 + c_Prime4;
+    }
+    if (input + 4 <= end)
+    {
+        hash ^= static_cast<std::uint64_t>(Read32(input)) * c_Prime1;
+        hash = std::rotl(hash, 23) * c_Prime2 + c_Prime3;
+        input += 4;
+    }
+    for (; input < end; input++)
+    {
+        hash ^= static_cast<std::uint64_t>(static_cast<std::uint8_t>(*input)) * c_Prime5;
+        hash = std::rotl(hash, 11) * c_Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= c_Prime2;
+    hash ^= hash >> 29;
+    hash *= c_Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::optional<std::uint64_t> HashFileContent(const std::filesystem::path& file_path)
+{
+    if (auto mapped_file = MappedFile::Open(file_path))
+    {
+        return HashContent(mapped_file->GetData());
+    }
+
+    // Empty files can't be mapped
+    std::error_code error_code;
+    if (std::filesystem::is_regular_file(file_path, error_code) && std::filesystem::file_size(file_path, error_code) == 0 && !error_code)
+    {
+        return HashContent({});
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+// Fast non-cryptographic 64-bit hash of file contents, the XXH64 algorithm
+// Stripes of 32 bytes are mixed into four independent lanes, so the loop is bound by memory bandwidth rather than by multiply latency
+std::uint64_t HashContent(std::string_view data, std::uint64_t seed = 0);
+
+// Hashes the file from a mapping without copying it, returns nullopt if the file can't be read
+std::optional<std::uint64_t> HashFileContent(const std::filesystem::path& file_path);
@@ -0,0 +1,164 @@
+#include "deferred_work.h"
+
+#include <algorithm>
+
+class DeferredWorkScheduler::Job
+{
+  public:
+    enum class State
+    {
+        Queued,
+        Running,
+        Done,
+    };
+
+    std::function<bool()> Fun;
+    DeferredWorkScheduler::QueueKey Key;
+    State CurrentState{ State::Queued };
+    bool Result{ false };
+
+    // Set while running, the job that was running on the same thread when this one was taken over by a waiting thread
+    const Job* OuterJob{ nullptr };
+};
+
+// Innermost job running on this thread
+static thread_local const DeferredWorkScheduler::Job* s_CurrentJob{ nullptr };
+
+DeferredWorkScheduler::DeferredWorkScheduler(std::size_t num_threads)
+    // Leaves cores to the game, which is starting up at the same time
+    : mNumThreads{ num_threads != 0 ? num_threads : std::max(std::thread::hardware_concurrency() / 2, 1u) }
+{
+}
+DeferredWorkScheduler::~DeferredWorkScheduler()
+{
+    Start();
+
+    {
+        std::lock_guard lock{ mMutex };
+        mStopping = true;
+    }
+    mWorkAvailable.notify_all();
+
+    for (std::thread& worker : mWorkers)
+    {
+        worker.join();
+    }
+}
+
+DeferredWorkScheduler::JobHandle DeferredWorkScheduler::Submit(std::int32_t priority, std::function<bool()> job)
+{
+    auto handle = std::make_shared<Job>();
+    handle->Fun = std::move(job);
+
+    {
+        std::lock_guard lock{ mMutex };
+        handle->Key = QueueKey{ -std::int64_t{ priority }, mNumSubmitted++ };
+        mQueue.emplace(handle->Key, handle);
+    }
+    mWorkAvailable.notify_one();
+
+    return handle;
+}
+void DeferredWorkScheduler::Start()
+{
+    std::lock_guard lock{ mMutex };
+    if (mStarted)
+    {
+        return;
+    }
+    mStarted = true;
+
+    mWorkers.reserve(mNumThreads);
+    for (std::size_t i = 0; i < mNumThreads; i++)
+    {
+        mWorkers.emplace_back(&DeferredWorkScheduler::WorkerMain, this);
+    }
+}
+
+bool DeferredWorkScheduler::Wait(const JobHandle& job)
+{
+    for (const Job* running_job = s_CurrentJob; running_job != nullptr; running_job = running_job->OuterJob)
+    {
+        if (running_job == job.get())
+        {
+            return false;
+        }
+    }
+
+    std::unique_lock lock{ mMutex };
+    if (job->CurrentState == Job::State::Queued)
+    {
+        mQueue.erase(job->Key);
+        job->CurrentState = Job::State::Running;
+        mNumRunning++;
+
+        lock.unlock();
+        Run(job);
+        lock.lock();
+
+        mNumRunning--;
+        job->CurrentState = Job::State::Done;
+        mJobDone.notify_all();
+        return job->Result;
+    }
+
+    mJobDone.wait(lock, [&job]()
+                  { return job->CurrentState == Job::State::Done; });
+    return job->Result;
+}
+bool DeferredWorkScheduler::IsDone(const JobHandle& job) const
+{
+    std::lock_guard lock{ mMutex };
+    return job->CurrentState == Job::State::Done;
+}
+
+bool DeferredWorkScheduler::IsIdle() const
+{
+    std::lock_guard lock{ mMutex };
+    return mQueue.empty() && mNumRunning == 0;
+}
+void DeferredWorkScheduler::WaitIdle()
+{
+    Start();
+
+    std::unique_lock lock{ mMutex };
+    mJobDone.wait(lock, [this]()
+                  { return mQueue.empty() && mNumRunning == 0; });
+}
+
+void DeferredWorkScheduler::Run(const JobHandle& job)
+{
+    job->OuterJob = s_CurrentJob;
+    s_CurrentJob = job.get();
+    job->Result = job->Fun();
+    job->Fun = nullptr;
+    s_CurrentJob = job->OuterJob;
+}
+
+void DeferredWorkScheduler::WorkerMain()
+{
+    std::unique_lock lock{ mMutex };
+    while (true)
+    {
+        // Jobs still queued when stopping are run anyways, somebody may still wait for them
+        mWorkAvailable.wait(lock, [this]()
+                            { return mStopping || !mQueue.empty(); });
+        if (mQueue.empty())
+        {
+            return;
+        }
+
+        JobHandle job{ std::move(mQueue.begin()->second) };
+        mQueue.erase(mQueue.begin());
+        job->CurrentState = Job::State::Running;
+        mNumRunning++;
+
+        lock.unlock();
+        Run(job);
+        lock.lock();
+
+        mNumRunning--;
+        job->CurrentState = Job::State::Done;
+        mJobDone.notify_all();
+    }
+}
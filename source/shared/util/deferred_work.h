@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Background threads for work that is not needed right away, jobs with a higher priority are taken first
+// Nothing runs before Start, so state the jobs read can still be set up after submitting them
+// Waiting for a job that was not taken yet runs it on the waiting thread, so whoever needs a result first never queues behind others
+class DeferredWorkScheduler
+{
+  public:
+    class Job;
+    using JobHandle = std::shared_ptr<Job>;
+
+    explicit DeferredWorkScheduler(std::size_t num_threads = 0);
+    // Finishes all submitted jobs first, starting them if that did not happen yet
+    ~DeferredWorkScheduler();
+
+    DeferredWorkScheduler(const DeferredWorkScheduler&) = delete;
+    DeferredWorkScheduler(DeferredWorkScheduler&&) = delete;
+    DeferredWorkScheduler& operator=(const DeferredWorkScheduler&) = delete;
+    DeferredWorkScheduler& operator=(DeferredWorkScheduler&&) = delete;
+
+    // Jobs of the same priority are taken in the order they were submitted, the result is whatever the job returns
+    JobHandle Submit(std::int32_t priority, std::function<bool()> job);
+    void Start();
+
+    // Blocks until the job finished and returns its result
+    // Called from inside the job itself, e.g. when it looks up its own output, this returns false right away instead of deadlocking
+    bool Wait(const JobHandle& job);
+    bool IsDone(const JobHandle& job) const;
+
+    // True once every submitted job has finished
+    bool IsIdle() const;
+    // Blocks until every submitted job has finished, starting them if that did not happen yet
+    void WaitIdle();
+
+  private:
+    void Run(const JobHandle& job);
+    void WorkerMain();
+
+    mutable std::mutex mMutex;
+    std::condition_variable mWorkAvailable;
+    std::condition_variable mJobDone;
+
+    // Ordered by descending priority, then by submission
+    // The priority is negated in 64 bits, negating the lowest 32-bit priority would overflow
+    using QueueKey = std::pair<std::int64_t, std::uint64_t>;
+    std::map<QueueKey, JobHandle> mQueue;
+    std::uint64_t mNumSubmitted{ 0 };
+    std::size_t mNumRunning{ 0 };
+    bool mStarted{ false };
+    bool mStopping{ false };
+
+    const std::size_t mNumThreads;
+    std::vector<std::thread> mWorkers;
+};
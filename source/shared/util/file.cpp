@@ -2,6 +2,7 @@
 
 #include "util/on_scope_exit.h"
 
+#include <fstream>
 #include <functional>
 
 std::string ReadWholeFile(const char* file_path)
@@ -29,3 +30,32 @@ std::string ReadWholeFile(const char* file_path)
     }
     return {};
 }
+
+bool WriteFileAtomically(const std::filesystem::path& file_path, std::string_view data)
+{
+    namespace fs = std::filesystem;
+
+    fs::path temp_path{ file_path };
+    temp_path += ".tmp";
+    {
+        auto file = std::ofstream{ temp_path, std::ios::trunc | std::ios::binary };
+        if (!file)
+        {
+            return false;
+        }
+        file.write(data.data(), data.size());
+        if (!file)
+        {
+            return false;
+        }
+    }
+
+    std::error_code error_code;
+    fs::rename(temp_path, file_path, error_code);
+    if (error_code)
+    {
+        fs::remove(temp_path, error_code);
+        return false;
+    }
+    return true;
+}
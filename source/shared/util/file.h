@@ -1,6 +1,11 @@
 #pragma once
 
+#include <filesystem>
 #include <string>
 #include <string_view>
 
 std::string ReadWholeFile(const char* file_path);
+
+// Writes data to a temporary file with a single write and renames it over file_path afterwards
+// Readers see either the old or the new file, never a partially written one
+bool WriteFileAtomically(const std::filesystem::path& file_path, std::string_view data);
@@ -0,0 +1,52 @@
+#include "mapped_file.h"
+
+#include <Windows.h>
+
+std::unique_ptr<MappedFile> MappedFile::Open(const std::filesystem::path& file_path)
+{
+    HANDLE file_handle = CreateFileW(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<MappedFile> mapped_file{ new MappedFile{} };
+    mapped_file->mFileHandle = file_handle;
+
+    LARGE_INTEGER file_size{};
+    if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+    {
+        return nullptr;
+    }
+    mapped_file->mSize = static_cast<std::size_t>(file_size.QuadPart);
+
+    mapped_file->mMappingHandle = CreateFileMappingW(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapped_file->mMappingHandle == NULL)
+    {
+        return nullptr;
+    }
+
+    mapped_file->mMappedData = MapViewOfFile(mapped_file->mMappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (mapped_file->mMappedData == nullptr)
+    {
+        return nullptr;
+    }
+
+    return mapped_file;
+}
+
+MappedFile::~MappedFile()
+{
+    if (mMappedData != nullptr)
+    {
+        UnmapViewOfFile(mMappedData);
+    }
+    if (mMappingHandle != nullptr)
+    {
+        CloseHandle(mMappingHandle);
+    }
+    if (mFileHandle != nullptr)
+    {
+        CloseHandle(mFileHandle);
+    }
+}
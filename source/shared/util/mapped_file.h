@@ -0,0 +1,33 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string_view>
+
+// Read-only view of a whole file mapped into memory, the file can't be replaced while it is open
+class MappedFile
+{
+  public:
+    // Returns nullptr if the file does not exist, is empty or can't be mapped
+    static std::unique_ptr<MappedFile> Open(const std::filesystem::path& file_path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    std::string_view GetData() const
+    {
+        return std::string_view{ static_cast<const char*>(mMappedData), mSize };
+    }
+
+  private:
+    MappedFile() = default;
+
+    void* mFileHandle{ nullptr };
+    void* mMappingHandle{ nullptr };
+    const void* mMappedData{ nullptr };
+    std::size_t mSize{ 0 };
+};
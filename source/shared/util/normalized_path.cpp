@@ -0,0 +1,152 @@
+#include "normalized_path.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+#include <unordered_map>
+
+template<class CharT>
+static char NormalizeChar(CharT c)
+{
+    if (c == '\\')
+    {
+        return '/';
+    }
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : static_cast<char>(c);
+}
+template<class CharT>
+static void NormalizeInto(std::basic_string_view<CharT> path, std::string& normalized)
+{
+    normalized.resize(path.size());
+    std::transform(path.begin(), path.end(), normalized.begin(), NormalizeChar<CharT>);
+    while (normalized.ends_with('/'))
+    {
+        normalized.pop_back();
+    }
+}
+static std::string_view TrimTrailingSeparators(std::string_view path)
+{
+    while (path.ends_with('/') || path.ends_with('\\'))
+    {
+        path.remove_suffix(1);
+    }
+    return path;
+}
+
+NormalizedPath::NormalizedPath(std::string_view path)
+{
+    // Reusing the buffer means known pathes can be looked up without allocating
+    thread_local std::string normalized;
+    NormalizeInto(path, normalized);
+    m_Entry = Intern(normalized);
+}
+NormalizedPath::NormalizedPath(const std::filesystem::path& path)
+{
+    using value_type = std::filesystem::path::value_type;
+    if constexpr (std::is_same_v<value_type, char>)
+    {
+        *this = NormalizedPath{ std::string_view{ path.native() } };
+    }
+    else
+    {
+        // Pure ascii pathes don't need a code page conversion, which is pretty much all of them
+        const std::basic_string_view<value_type> native{ path.native() };
+        if (std::all_of(native.begin(), native.end(), [](value_type c)
+                        { return static_cast<std::uint32_t>(c) < 0x80; }))
+        {
+            thread_local std::string normalized;
+            NormalizeInto(native, normalized);
+            m_Entry = Intern(normalized);
+        }
+        else
+        {
+            *this = NormalizedPath{ std::string_view{ path.string() } };
+        }
+    }
+}
+
+NormalizedPath NormalizedPath::FromNormalized(std::string_view normalized_path)
+{
+    return NormalizedPath{ Intern(normalized_path) };
+}
+
+std::string NormalizedPath::Normalize(std::string_view path)
+{
+    std::string normalized;
+    NormalizeInto(path, normalized);
+    return normalized;
+}
+
+std::size_t NormalizedPath::Hash(std::string_view path)
+{
+    // Same as an empty NormalizedPath
+    path = TrimTrailingSeparators(path);
+    if (path.empty())
+    {
+        return 0;
+    }
+
+    // FNV-1a over the normalized characters, so the path never has to be copied to be normalized
+    std::uint64_t hash{ 0xcbf29ce484222325ull };
+    for (char c : path)
+    {
+        hash ^= static_cast<std::uint8_t>(NormalizeChar(c));
+        hash *= 0x100000001b3ull;
+    }
+    return static_cast<std::size_t>(hash);
+}
+bool NormalizedPath::IsSame(std::string_view lhs, std::string_view rhs)
+{
+    lhs = TrimTrailingSeparators(lhs);
+    rhs = TrimTrailingSeparators(rhs);
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](char lhs_char, char rhs_char)
+                      { return NormalizeChar(lhs_char) == NormalizeChar(rhs_char); });
+}
+
+NormalizedPathView::NormalizedPathView(std::string_view path)
+    : m_Path{ TrimTrailingSeparators(path) }
+    , m_Hash{ NormalizedPath::Hash(m_Path) }
+{
+}
+
+const NormalizedPath::Entry* NormalizedPath::Intern(std::string_view normalized_path)
+{
+    if (normalized_path.empty())
+    {
+        return nullptr;
+    }
+
+    struct Pool
+    {
+        std::shared_mutex Mutex;
+        std::deque<Entry> Entries;
+        std::unordered_map<std::string_view, const Entry*> Index;
+    };
+    // Intentionally leaked, pathes may still be used while other statics are destroyed
+    static Pool& pool = *new Pool{};
+
+    {
+        std::shared_lock lock{ pool.Mutex };
+        if (auto it = pool.Index.find(normalized_path); it != pool.Index.end())
+        {
+            return it->second;
+        }
+    }
+
+    std::unique_lock lock{ pool.Mutex };
+    if (auto it = pool.Index.find(normalized_path); it != pool.Index.end())
+    {
+        return it->second;
+    }
+
+    // Deque never moves its elements, so views into the entries stay valid
+    const Entry& entry = pool.Entries.emplace_back(Entry{
+        .String = std::string{ normalized_path },
+        .Hash = Hash(normalized_path),
+    });
+    pool.Index.emplace(entry.String, &entry);
+    return &entry;
+}
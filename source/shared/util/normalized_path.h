@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Lower-case, '/'-separated path without trailing separators, interned in a global pool
+// Equal pathes share the same pool entry, so comparing and hashing never touches the string
+// Pool entries are never freed, only use this for pathes that are part of the mod pipeline
+class NormalizedPath
+{
+  public:
+    NormalizedPath() = default;
+    explicit NormalizedPath(std::string_view path);
+    explicit NormalizedPath(const char* path)
+        : NormalizedPath{ std::string_view{ path } }
+    {
+    }
+    explicit NormalizedPath(const std::string& path)
+        : NormalizedPath{ std::string_view{ path } }
+    {
+    }
+    explicit NormalizedPath(const std::filesystem::path& path);
+
+    // Skips normalization, path must already be in normalized form
+    static NormalizedPath FromNormalized(std::string_view normalized_path);
+
+    // Only normalizes without interning, for pathes that are only needed temporarily
+    static std::string Normalize(std::string_view path);
+
+    // Hash and comparison of the normalized forms, computed on the fly without allocating or interning anything
+    // Hash matches GetHash of a NormalizedPath created from the same path
+    static std::size_t Hash(std::string_view path);
+    static bool IsSame(std::string_view lhs, std::string_view rhs);
+
+    std::string_view GetString() const
+    {
+        return m_Entry != nullptr ? std::string_view{ m_Entry->String } : std::string_view{};
+    }
+    std::size_t GetHash() const
+    {
+        return m_Entry != nullptr ? m_Entry->Hash : 0;
+    }
+    bool IsEmpty() const
+    {
+        return m_Entry == nullptr;
+    }
+
+    bool operator==(const NormalizedPath& rhs) const
+    {
+        return m_Entry == rhs.m_Entry;
+    }
+
+  private:
+    struct Entry
+    {
+        std::string String;
+        std::size_t Hash;
+    };
+
+    explicit NormalizedPath(const Entry* entry)
+        : m_Entry{ entry }
+    {
+    }
+
+    static const Entry* Intern(std::string_view normalized_path);
+
+    const Entry* m_Entry{ nullptr };
+};
+
+// A path as it was passed in together with the hash of its normalized form
+// Used to look up pathes the game asks for, those should neither allocate nor grow the pool
+class NormalizedPathView
+{
+  public:
+    explicit NormalizedPathView(std::string_view path);
+
+    // Trailing separators are stripped, otherwise the path is not normalized
+    std::string_view GetPath() const
+    {
+        return m_Path;
+    }
+    std::size_t GetHash() const
+    {
+        return m_Hash;
+    }
+
+  private:
+    std::string_view m_Path;
+    std::size_t m_Hash;
+};
+
+// Hash and equality for containers keyed by NormalizedPath or by plain strings, which are normalized on the fly
+// Both can be looked up with a NormalizedPathView without allocating
+struct NormalizedPathHash
+{
+    using is_transparent = void;
+    std::size_t operator()(const NormalizedPath& path) const
+    {
+        return path.GetHash();
+    }
+    std::size_t operator()(const NormalizedPathView& path) const
+    {
+        return path.GetHash();
+    }
+    std::size_t operator()(std::string_view path) const
+    {
+        return NormalizedPath::Hash(path);
+    }
+};
+struct NormalizedPathEqual
+{
+    using is_transparent = void;
+    bool operator()(const NormalizedPath& lhs, const NormalizedPath& rhs) const
+    {
+        return lhs == rhs;
+    }
+    bool operator()(const NormalizedPath& lhs, const NormalizedPathView& rhs) const
+    {
+        return lhs.GetHash() == rhs.GetHash() && NormalizedPath::IsSame(lhs.GetString(), rhs.GetPath());
+    }
+    bool operator()(const NormalizedPathView& lhs, const NormalizedPath& rhs) const
+    {
+        return operator()(rhs, lhs);
+    }
+    bool operator()(std::string_view lhs, std::string_view rhs) const
+    {
+        return NormalizedPath::IsSame(lhs, rhs);
+    }
+    bool operator()(std::string_view lhs, const NormalizedPathView& rhs) const
+    {
+        return NormalizedPath::IsSame(lhs, rhs.GetPath());
+    }
+    bool operator()(const NormalizedPathView& lhs, std::string_view rhs) const
+    {
+        return NormalizedPath::IsSame(lhs.GetPath(), rhs);
+    }
+};
+
+template<>
+struct std::hash<NormalizedPath>
+{
+    std::size_t operator()(const NormalizedPath& path) const
+    {
+        return path.GetHash();
+    }
+};
@@ -0,0 +1,161 @@
+#include "parallel_directory_walker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+ParallelDirectoryWalker::ParallelDirectoryWalker(std::size_t num_threads)
+    : mNumThreads{ num_threads != 0 ? num_threads : std::max(std::thread::hardware_concurrency(), 1u) }
+{
+}
+
+std::vector<std::vector<std::filesystem::directory_entry>> ParallelDirectoryWalker::Walk(std::span<const std::filesystem::path> roots, const FilterFun& filter, bool recurse) const
+{
+    namespace fs = std::filesystem;
+
+    struct Folder
+    {
+        std::size_t Root;
+        fs::path Path;
+    };
+    struct FoundEntry
+    {
+        std::size_t Root;
+        fs::directory_entry Entry;
+    };
+    struct Worker
+    {
+        std::mutex Mutex;
+        std::deque<Folder> Folders;
+        std::vector<FoundEntry> Found;
+    };
+
+    std::vector<std::vector<fs::directory_entry>> results(roots.size());
+    if (roots.empty())
+    {
+        return results;
+    }
+
+    // Without recursion there is nothing to steal beyond the roots themselves
+    const std::size_t num_workers{ recurse ? mNumThreads : std::min(mNumThreads, roots.size()) };
+    std::vector<Worker> workers(num_workers);
+    for (std::size_t i = 0; i < roots.size(); i++)
+    {
+        workers[i % num_workers].Folders.push_back(Folder{ i, roots[i] });
+    }
+
+    // Counts folders that are queued or being listed, only when it drops to zero all work is done
+    std::atomic_size_t pending_folders{ roots.size() };
+    // Bumped whenever a folder is queued or all work is done, idle workers block on it instead of spinning
+    std::atomic_size_t work_signal{ 0 };
+
+    auto take_folder = [&workers, num_workers](std::size_t self) -> std::optional<Folder>
+    {
+        {
+            // Own work is taken from the back, which keeps walking depth-first and close to what was just listed
+            Worker& worker = workers[self];
+            std::lock_guard lock{ worker.Mutex };
+            if (!worker.Folders.empty())
+            {
+                Folder folder{ std::move(worker.Folders.back()) };
+                worker.Folders.pop_back();
+                return folder;
+            }
+        }
+
+        // Others are stolen from at the front, those are the folders closest to the root and likely hold the most work
+        for (std::size_t i = 1; i < num_workers; i++)
+        {
+            Worker& victim = workers[(self + i) % num_workers];
+            std::lock_guard lock{ victim.Mutex };
+            if (!victim.Folders.empty())
+            {
+                Folder folder{ std::move(victim.Folders.front()) };
+                victim.Folders.pop_front();
+                return folder;
+            }
+        }
+
+        return std::nullopt;
+    };
+
+    auto run_worker = [&](std::size_t self)
+    {
+        Worker& worker = workers[self];
+        while (true)
+        {
+            // Read before looking for work, anything queued after this changes the signal and the wait returns right away
+            const std::size_t observed_signal{ work_signal.load() };
+            if (pending_folders.load() == 0)
+            {
+                break;
+            }
+
+            std::optional<Folder> folder{ take_folder(self) };
+            if (!folder.has_value())
+            {
+                work_signal.wait(observed_signal);
+                continue;
+            }
+
+            std::error_code error_code;
+            for (auto it = fs::directory_iterator{ folder->Path, error_code }; !error_code && it != fs::directory_iterator{}; it.increment(error_code))
+            {
+                const fs::directory_entry& entry = *it;
+                if (filter && !filter(entry))
+                {
+                    continue;
+                }
+
+                worker.Found.push_back(FoundEntry{ folder->Root, entry });
+
+                std::error_code type_error_code;
+                if (recurse && entry.is_directory(type_error_code))
+                {
+                    pending_folders++;
+                    {
+                        std::lock_guard lock{ worker.Mutex };
+                        worker.Folders.push_back(Folder{ folder->Root, entry.path() });
+                    }
+                    work_signal++;
+                    work_signal.notify_one();
+                }
+            }
+
+            // Children were counted before, so this never reaches zero while there is still work queued
+            if (--pending_folders == 0)
+            {
+                work_signal++;
+                work_signal.notify_all();
+            }
+        }
+    };
+
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(num_workers - 1);
+        for (std::size_t i = 1; i < num_workers; i++)
+        {
+            threads.emplace_back(run_worker, i);
+        }
+        run_worker(0);
+    }
+
+    for (Worker& worker : workers)
+    {
+        for (FoundEntry& found : worker.Found)
+        {
+            results[found.Root].push_back(std::move(found.Entry));
+        }
+    }
+    for (std::vector<fs::directory_entry>& entries : results)
+    {
+        std::sort(entries.begin(), entries.end(), [](const fs::directory_entry& lhs, const fs::directory_entry& rhs)
+                  { return lhs.path() < rhs.path(); });
+    }
+
+    return results;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <span>
+#include <vector>
+
+// Walks directory trees on several threads, each thread works through its own queue of folders and steals from the others once it runs dry
+// Results are sorted by path, so they never depend on how the work was scheduled
+class ParallelDirectoryWalker
+{
+  public:
+    explicit ParallelDirectoryWalker(std::size_t num_threads = 0);
+
+    // Return false to skip an entry, skipped folders are not descended into
+    // Called concurrently from all threads
+    using FilterFun = std::function<bool(const std::filesystem::directory_entry&)>;
+
+    // Returns all entries found below each of the roots, in the same order as the roots
+    std::vector<std::vector<std::filesystem::directory_entry>> Walk(std::span<const std::filesystem::path> roots, const FilterFun& filter, bool recurse = true) const;
+
+  private:
+    std::size_t mNumThreads;
+};
@@ -0,0 +1,71 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(std::size_t num_threads)
+{
+    const std::size_t num_workers{ num_threads != 0 ? num_threads : std::max(std::thread::hardware_concurrency(), 1u) };
+    mWorkers.reserve(num_workers);
+    for (std::size_t i = 0; i < num_workers; i++)
+    {
+        mWorkers.emplace_back(&WorkerPool::WorkerMain, this);
+    }
+}
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard lock{ mMutex };
+        mStopping = true;
+    }
+    mWorkAvailable.notify_all();
+
+    for (std::thread& worker : mWorkers)
+    {
+        worker.join();
+    }
+}
+
+void WorkerPool::WaitIdle()
+{
+    std::unique_lock lock{ mMutex };
+    mIdle.wait(lock, [this]()
+               { return mJobs.empty() && mNumRunning == 0; });
+}
+
+void WorkerPool::Enqueue(std::function<void()> job)
+{
+    {
+        std::lock_guard lock{ mMutex };
+        mJobs.push_back(std::move(job));
+    }
+    mWorkAvailable.notify_one();
+}
+
+void WorkerPool::WorkerMain()
+{
+    std::unique_lock lock{ mMutex };
+    while (true)
+    {
+        // Jobs still queued when stopping are run anyways, nobody else would complete their futures
+        mWorkAvailable.wait(lock, [this]()
+                            { return mStopping || !mJobs.empty(); });
+        if (mJobs.empty())
+        {
+            return;
+        }
+
+        std::function<void()> job{ std::move(mJobs.front()) };
+        mJobs.pop_front();
+        mNumRunning++;
+
+        lock.unlock();
+        job();
+        lock.lock();
+
+        mNumRunning--;
+        if (mJobs.empty() && mNumRunning == 0)
+        {
+            mIdle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of threads that take jobs in the order they were submitted
+// A job may wait for one submitted before it, that one has already been picked up by another thread
+class WorkerPool
+{
+  public:
+    explicit WorkerPool(std::size_t num_threads = 0);
+    // Finishes all submitted jobs first
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool(WorkerPool&&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    WorkerPool& operator=(WorkerPool&&) = delete;
+
+    template<class FunT>
+    requires std::is_invocable_v<FunT>
+    std::future<std::invoke_result_t<FunT>> Submit(FunT&& fun)
+    {
+        using ResultT = std::invoke_result_t<FunT>;
+        auto task = std::make_shared<std::packaged_task<ResultT()>>(std::forward<FunT>(fun));
+        std::future<ResultT> result = task->get_future();
+        Enqueue([task = std::move(task)]()
+                { (*task)(); });
+        return result;
+    }
+
+    // Blocks until every job submitted so far has finished
+    void WaitIdle();
+
+    std::size_t GetNumThreads() const
+    {
+        return mWorkers.size();
+    }
+
+  private:
+    void Enqueue(std::function<void()> job);
+    void WorkerMain();
+
+    std::mutex mMutex;
+    std::condition_variable mWorkAvailable;
+    std::condition_variable mIdle;
+    std::deque<std::function<void()>> mJobs;
+    std::size_t mNumRunning{ 0 };
+    bool mStopping{ false };
+
+    std::vector<std::thread> mWorkers;
+};
@@ -0,0 +1,48 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic_uint64_t s_Allocations{ 0 };
+static std::atomic_uint64_t s_AllocatedBytes{ 0 };
+
+AllocationCount GetAllocationCount()
+{
+    return AllocationCount{
+        s_Allocations.load(std::memory_order_relaxed),
+        s_AllocatedBytes.load(std::memory_order_relaxed),
+    };
+}
+
+// Aligned and nothrow overloads forward to these by default, so replacing the plain ones is enough to see all of them
+void* operator new(std::size_t size)
+{
+    s_Allocations.fetch_add(1, std::memory_order_relaxed);
+    s_AllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc{};
+}
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
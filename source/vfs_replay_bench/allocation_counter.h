@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts every call to the global operator new of the whole process, including allocations made on other threads
+struct AllocationCount
+{
+    std::uint64_t Allocations;
+    std::uint64_t Bytes;
+
+    AllocationCount operator-(const AllocationCount& rhs) const
+    {
+        return AllocationCount{ Allocations - rhs.Allocations, Bytes - rhs.Bytes };
+    }
+};
+AllocationCount GetAllocationCount();
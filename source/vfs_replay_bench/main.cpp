@@ -0,0 +1,1036 @@
+#include "allocation_counter.h"
+#include "find_path.h"
+#include "mod_database.h"
+#include "util/algorithms.h"
+#include "util/normalized_path.h"
+#include "util/on_scope_exit.h"
+#include "vfs_folder_mount.h"
+#include "vfs_mount_cache.h"
+#include "vfs_mount_impl.h"
+#include "vfs_prefetcher.h"
+
+#include <spel2.h>
+
+#include <Windows.h>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fmt/format.h>
+
+// Replays a vfs_trace.txt, as written to Mods/Packs/.db with enable_vfs_tracing, against a synthetic mods tree
+// Every file the trace found is generated into one of the mods and everything else is left missing, so lookups hit and miss as in the recorded session
+// Each mod is mounted as a VfsFolderMount, calls are replayed through those mounts the way VirtualFilesystem dispatches them
+// For comparison calls are also replayed by probing each mod folder on disk, which is what a folder mount without an index has to do
+// Loads are also replayed through a VfsPrefetcher, once prefetching the upcoming loads of the trace and once predicting them from a previous replay
+// Afterwards every generated file is read through its mount and with stdio, which gives the bytes and time spent reading per mount
+// Allocations made while mounting and replaying are counted, and looking up each traced path among all traced pathes compares algo::is_same_path against NormalizedPath
+// Last a synthetic mod of up to scan-files loose files is scanned with ModDatabase at several sizes, the time per file stays flat if scanning is linear
+// Outside of Windows the mounts run on a shim of the Win32 file api that matches pathes case-insensitively like Windows does
+
+enum ReturnReason
+{
+    SUCCESS,
+    FAILED_PARSING_COMMAND_LINE,
+    FAILED_READING_TRACE,
+    FAILED_GENERATING_MODS,
+    FAILED_GENERATING_SCAN_MOD,
+};
+
+struct CommandLineOptions
+{
+    std::string Trace;
+    std::optional<std::string> WorkDir;
+    std::size_t NumMods{ 16 };
+    std::size_t FileSize{ 4096 };
+    std::size_t Iterations{ 5 };
+    std::size_t PrefetchThreads{ 4 };
+    std::size_t PrefetchWindow{ 64 };
+    std::size_t ScanFiles{ 50000 };
+    bool ReplayGaps{ false };
+};
+static constexpr std::string_view c_Usage{
+    "usage: vfs_replay_bench <trace> [--work-dir <path>] [--num-mods <count>] [--file-size <bytes>] [--iterations <count>]"
+    " [--prefetch-threads <count>] [--prefetch-window <count>] [--replay-gaps] [--scan-files <count>]"
+};
+
+// The few options are parsed by hand, so the benchmark builds without any of playlunky's dependencies
+std::optional<CommandLineOptions> ParseCommandLine(std::span<char* const> args)
+{
+    CommandLineOptions options;
+    bool has_trace{ false };
+    for (std::size_t i = 1; i < args.size(); i++)
+    {
+        const std::string_view arg{ args[i] };
+        if (!arg.starts_with("--"))
+        {
+            if (has_trace)
+            {
+                return std::nullopt;
+            }
+            options.Trace = arg;
+            has_trace = true;
+            continue;
+        }
+
+        if (arg == "--replay-gaps")
+        {
+            options.ReplayGaps = true;
+            continue;
+        }
+
+        if (i + 1 == args.size())
+        {
+            return std::nullopt;
+        }
+        const std::string_view value{ args[++i] };
+
+        if (arg == "--work-dir")
+        {
+            options.WorkDir = std::string{ value };
+            continue;
+        }
+
+        std::size_t* number{ nullptr };
+        if (arg == "--num-mods")
+        {
+            number = &options.NumMods;
+        }
+        else if (arg == "--file-size")
+        {
+            number = &options.FileSize;
+        }
+        else if (arg == "--iterations")
+        {
+            number = &options.Iterations;
+        }
+        else if (arg == "--prefetch-threads")
+        {
+            number = &options.PrefetchThreads;
+        }
+        else if (arg == "--prefetch-window")
+        {
+            number = &options.PrefetchWindow;
+        }
+        else if (arg == "--scan-files")
+        {
+            number = &options.ScanFiles;
+        }
+        if (number == nullptr)
+        {
+            return std::nullopt;
+        }
+
+        const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), *number);
+        if (error != std::errc{} || end != value.data() + value.size())
+        {
+            return std::nullopt;
+        }
+    }
+
+    if (!has_trace)
+    {
+        return std::nullopt;
+    }
+    return options;
+}
+
+enum class Call
+{
+    LoadFile,
+    GetFilePath,
+};
+static constexpr std::string_view c_CallNames[]{ "load_file", "get_file_path" };
+
+struct TraceEvent
+{
+    Call TracedCall;
+    bool Found;
+    std::uint64_t StartNanoseconds;
+    std::uint64_t LatencyNanoseconds;
+    std::string Path;
+};
+
+// Same format as VfsTracer::WriteTrace: call, offset from the first call and latency in ns, found, path
+std::optional<std::vector<TraceEvent>> ReadTrace(const std::filesystem::path& trace_path)
+{
+    std::ifstream trace_file{ trace_path };
+    if (!trace_file)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<TraceEvent> events;
+    std::string line;
+    while (std::getline(trace_file, line))
+    {
+        std::istringstream line_stream{ line };
+        std::string call_name;
+        TraceEvent event{};
+        int found;
+        if (!(line_stream >> call_name >> event.StartNanoseconds >> event.LatencyNanoseconds >> found))
+        {
+            continue;
+        }
+        // Pathes may contain spaces, so they take up the rest of the line
+        std::getline(line_stream >> std::ws, event.Path);
+
+        if (call_name == c_CallNames[0])
+        {
+            event.TracedCall = Call::LoadFile;
+        }
+        else if (call_name == c_CallNames[1])
+        {
+            event.TracedCall = Call::GetFilePath;
+        }
+        else
+        {
+            continue;
+        }
+        event.Found = found != 0;
+        events.push_back(std::move(event));
+    }
+    return events;
+}
+
+std::filesystem::path GetModFolder(const std::filesystem::path& mods_folder, std::size_t mod_index)
+{
+    return mods_folder / fmt::format("Mod{:03}", mod_index);
+}
+
+struct GeneratedFile
+{
+    std::size_t ModIndex;
+    std::string RelativePath;
+};
+
+// Which mod a file goes into only depends on its path, so repeated runs generate the same tree
+// Only pathes the mounts can index are generated, in a real session the rest is answered by the game folder
+std::optional<std::vector<GeneratedFile>> GenerateModsTree(const std::filesystem::path& mods_folder, std::span<const TraceEvent> events, std::size_t num_mods, std::size_t file_size)
+{
+    namespace fs = std::filesystem;
+
+    std::error_code error_code;
+    fs::remove_all(mods_folder, error_code);
+    for (std::size_t i = 0; i < num_mods; i++)
+    {
+        fs::create_directories(GetModFolder(mods_folder, i), error_code);
+        if (error_code)
+        {
+            return std::nullopt;
+        }
+    }
+
+    const std::string contents(file_size, 'x');
+    std::vector<GeneratedFile> generated_files;
+    std::unordered_set<NormalizedPath> generated_pathes;
+    std::unordered_map<NormalizedPath, fs::path> folders;
+    for (const TraceEvent& event : events)
+    {
+        if (!event.Found || !VfsPathIndex::CanIndex(std::string_view{ event.Path }))
+        {
+            continue;
+        }
+
+        const NormalizedPath normalized_path{ std::string_view{ event.Path } };
+        if (!generated_pathes.insert(normalized_path).second)
+        {
+            continue;
+        }
+
+        // Windows puts pathes that only differ in case into the same folder, so folders are reused the same way on every platform
+        const fs::path relative_path{ event.Path };
+        const std::size_t mod_index{ normalized_path.GetHash() % num_mods };
+        const fs::path mod_folder{ GetModFolder(mods_folder, mod_index) };
+        fs::path folder{ mod_folder };
+        for (const fs::path& element : relative_path.parent_path())
+        {
+            folder /= element;
+            folder = folders.try_emplace(NormalizedPath{ folder }, folder).first->second;
+        }
+
+        // Lookups without extension match any file with the same stem
+        fs::path file_path{ folder / relative_path.filename() };
+        if (!file_path.has_extension())
+        {
+            file_path += ".bin";
+        }
+
+        fs::create_directories(file_path.parent_path(), error_code);
+        if (auto file = std::ofstream{ file_path, std::ios::binary | std::ios::trunc })
+        {
+            file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        }
+        else
+        {
+            return std::nullopt;
+        }
+        generated_files.push_back(GeneratedFile{ mod_index, file_path.lexically_relative(mod_folder).generic_string() });
+    }
+
+    return generated_files;
+}
+
+using VfsMount = VirtualFilesystem::VfsMount;
+
+VirtualFilesystem::FileInfo* LoadFromMounts(std::span<const std::unique_ptr<VfsMount>> mounts, const NormalizedPathView& path)
+{
+    for (const auto& mount : mounts)
+    {
+        if (VirtualFilesystem::FileInfo* file_info = mount->MountImpl->LoadFile(path, nullptr))
+        {
+            return file_info;
+        }
+    }
+    return nullptr;
+}
+
+// Same dispatch as VirtualFilesystem without filters, bound or linked pathes, none of those are part of the trace
+// Every replay starts with an empty mount cache, the indices of the mounts are built once up front
+class MountsReplayer
+{
+  public:
+    explicit MountsReplayer(std::span<const std::unique_ptr<VfsMount>> mounts)
+        : mMounts{ mounts }
+    {
+    }
+
+    bool LoadFile(std::string_view path) const
+    {
+        VirtualFilesystem::FileInfo* file_info{ LoadFromMounts(mMounts, NormalizedPathView{ path }) };
+        free(file_info);
+        return file_info != nullptr;
+    }
+
+    bool GetFilePath(std::string_view path)
+    {
+        const std::filesystem::path file_path{ path };
+        const VfsMount* resolving_mount = mMountCache.FindOrInsert(
+            VfsMountCache::Key{ .Path{ path } },
+            [&]() -> const VfsMount*
+            {
+                for (const auto& mount : mMounts)
+                {
+                    if (mount->MountImpl->GetFilePath(file_path))
+                    {
+                        return mount.get();
+                    }
+                }
+                return nullptr;
+            });
+        if (resolving_mount == nullptr)
+        {
+            return false;
+        }
+
+        if (auto found_path = resolving_mount->MountImpl->GetFilePath(file_path))
+        {
+            return resolving_mount->MountImpl->GetDiskPath(std::move(found_path).value()).has_value();
+        }
+        return false;
+    }
+
+    std::span<const std::unique_ptr<VfsMount>> GetMounts() const
+    {
+        return mMounts;
+    }
+
+  private:
+    std::span<const std::unique_ptr<VfsMount>> mMounts;
+    VfsMountCache mMountCache;
+};
+
+// Loads go through a VfsPrefetcher first, the same as in VirtualFilesystem::LoadFile once prefetching is enabled
+// Without prediction the loads of the trace are prefetched one window ahead, the way the game would prefetch the files of the next level
+// With prediction the loads are replayed once up front, so the prefetcher already learned which file follows which
+class PrefetchingReplayer
+{
+  public:
+    static constexpr std::size_t c_CacheBudget{ 64 * 1024 * 1024 };
+
+    PrefetchingReplayer(std::span<const std::unique_ptr<VfsMount>> mounts, std::span<const TraceEvent> events, std::size_t num_threads, std::size_t window, bool predict_loads)
+        : mMountsReplayer{ mounts }
+        , mPrefetcher{ [mounts](const char* path)
+                       { return LoadFromMounts(mounts, NormalizedPathView{ path }); },
+                       num_threads,
+                       c_CacheBudget,
+                       predict_loads }
+        , mWindow{ predict_loads ? 0 : std::max<std::size_t>(window, 1) }
+    {
+        for (const TraceEvent& event : events)
+        {
+            if (event.TracedCall == Call::LoadFile && VfsPathIndex::CanIndex(std::string_view{ event.Path }))
+            {
+                mLoadPathes.push_back(event.Path.c_str());
+            }
+        }
+
+        if (predict_loads)
+        {
+            for (const char* path : mLoadPathes)
+            {
+                free(TakeOrLoad(path));
+            }
+            mPrefetcher.Clear();
+        }
+        else
+        {
+            PrefetchWindow(0);
+        }
+    }
+
+    bool LoadFile(std::string_view path)
+    {
+        if (mWindow != 0 && mNumLoads % mWindow == 0)
+        {
+            PrefetchWindow(mNumLoads + mWindow);
+        }
+        mNumLoads++;
+
+        VirtualFilesystem::FileInfo* file_info{ TakeOrLoad(path) };
+        free(file_info);
+        return file_info != nullptr;
+    }
+
+    bool GetFilePath(std::string_view path)
+    {
+        return mMountsReplayer.GetFilePath(path);
+    }
+
+  private:
+    VirtualFilesystem::FileInfo* TakeOrLoad(std::string_view path)
+    {
+        const NormalizedPathView normalized_path{ path };
+        if (VirtualFilesystem::FileInfo* file_info = mPrefetcher.Take(normalized_path, nullptr, false))
+        {
+            return file_info;
+        }
+        return LoadFromMounts(mMountsReplayer.GetMounts(), normalized_path);
+    }
+
+    void PrefetchWindow(std::size_t first_load)
+    {
+        if (first_load < mLoadPathes.size())
+        {
+            const std::span<const char* const> load_pathes{ mLoadPathes };
+            mPrefetcher.Prefetch(load_pathes.subspan(first_load, std::min(mWindow, mLoadPathes.size() - first_load)));
+        }
+    }
+
+    MountsReplayer mMountsReplayer;
+    VfsPrefetcher mPrefetcher;
+    const std::size_t mWindow;
+    std::vector<const char*> mLoadPathes;
+    std::size_t mNumLoads{ 0 };
+};
+
+// Probes each mod folder on disk in order, pathes with extension are opened directly and all others are matched against each file in their folder
+// Just like the mounts all pathes are matched case-insensitively
+class DiskReplayer
+{
+  public:
+    explicit DiskReplayer(std::span<const std::filesystem::path> mod_folders)
+        : mModFolders{ mod_folders }
+    {
+    }
+
+    bool LoadFile(std::string_view path)
+    {
+        for (const std::filesystem::path& mod_folder : mModFolders)
+        {
+            const std::filesystem::path file_path{ mod_folder / path };
+            HANDLE file = CreateFileW(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                continue;
+            }
+            auto close_file = OnScopeExit{ [file]()
+                                           { CloseHandle(file); } };
+
+            LARGE_INTEGER file_size{};
+            if (!GetFileSizeEx(file, &file_size))
+            {
+                return false;
+            }
+            mBuffer.resize(static_cast<std::size_t>(file_size.QuadPart));
+
+            std::size_t total_size_read{ 0 };
+            while (total_size_read < mBuffer.size())
+            {
+                DWORD size_read{ 0 };
+                if (!ReadFile(file, mBuffer.data() + total_size_read, static_cast<DWORD>(mBuffer.size() - total_size_read), &size_read, NULL) || size_read == 0)
+                {
+                    return false;
+                }
+                total_size_read += size_read;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    bool GetFilePath(std::string_view path) const
+    {
+        namespace fs = std::filesystem;
+
+        const fs::path relative_path{ path };
+        std::error_code error_code;
+        for (const fs::path& mod_folder : mModFolders)
+        {
+            const fs::path file_path{ mod_folder / relative_path };
+            if (relative_path.has_extension())
+            {
+                HANDLE file = CreateFileW(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+                if (file != INVALID_HANDLE_VALUE)
+                {
+                    CloseHandle(file);
+                    return true;
+                }
+                continue;
+            }
+
+            const std::optional<fs::path> folder{ FindPathIgnoringCase(file_path.parent_path()) };
+            if (!folder.has_value())
+            {
+                continue;
+            }
+
+            const std::string file_name{ relative_path.filename().string() };
+            for (fs::directory_iterator it{ folder.value(), error_code }, end{}; !error_code && it != end; it.increment(error_code))
+            {
+                if (NormalizedPath::IsSame(it->path().stem().string(), file_name))
+                {
+                    return true;
+                }
+            }
+            error_code.clear();
+        }
+        return false;
+    }
+
+  private:
+    std::span<const std::filesystem::path> mModFolders;
+    std::vector<char> mBuffer;
+};
+
+struct ReplayResult
+{
+    std::vector<std::uint64_t> LatencyNanoseconds[2];
+    std::uint64_t TotalNanoseconds{ 0 };
+    std::size_t Mismatches{ 0 };
+    // Includes allocations of prefetch workers, which run while the calls are replayed
+    std::optional<AllocationCount> Allocated;
+};
+
+// With replay_gaps set each call waits for its recorded offset from the first call, which gives prefetching the time it had in the session
+template<class ReplayerT>
+ReplayResult Replay(std::span<const TraceEvent> events, bool replay_gaps, ReplayerT& replayer)
+{
+    ReplayResult result;
+
+    // Calls from different threads may be recorded slightly out of order
+    const std::uint64_t first_start{ events.empty() ? 0 : events.front().StartNanoseconds };
+
+    // Recording latencies must not show up as allocations of the replayed calls
+    for (std::vector<std::uint64_t>& latencies : result.LatencyNanoseconds)
+    {
+        latencies.reserve(events.size());
+    }
+
+    const AllocationCount allocations_before{ GetAllocationCount() };
+    const auto replay_start = std::chrono::steady_clock::now();
+    for (const TraceEvent& event : events)
+    {
+        if (replay_gaps)
+        {
+            const std::uint64_t offset{ std::max(event.StartNanoseconds, first_start) - first_start };
+            std::this_thread::sleep_until(replay_start + std::chrono::nanoseconds{ offset });
+        }
+
+        // Pathes that can't be indexed are answered by the game folder in a real session, they are never generated here
+        const bool is_mod_path{ VfsPathIndex::CanIndex(std::string_view{ event.Path }) };
+
+        const auto call_start = std::chrono::steady_clock::now();
+        bool found{ false };
+        if (is_mod_path)
+        {
+            found = event.TracedCall == Call::LoadFile
+                        ? replayer.LoadFile(event.Path)
+                        : replayer.GetFilePath(event.Path);
+        }
+        const auto call_end = std::chrono::steady_clock::now();
+
+        if (is_mod_path && found != event.Found)
+        {
+            result.Mismatches++;
+        }
+        result.LatencyNanoseconds[static_cast<std::size_t>(event.TracedCall)].push_back(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(call_end - call_start).count()));
+    }
+    result.TotalNanoseconds = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - replay_start).count());
+    result.Allocated = GetAllocationCount() - allocations_before;
+
+    return result;
+}
+
+// The fastest iteration is reported, it is the least disturbed by everything else running on the machine
+template<class ReplayerT, class... ArgsT>
+ReplayResult ReplayBest(std::span<const TraceEvent> events, std::size_t iterations, bool replay_gaps, const ArgsT&... args)
+{
+    std::optional<ReplayResult> best;
+    for (std::size_t i = 0; i < iterations; i++)
+    {
+        ReplayerT replayer{ args... };
+        ReplayResult result{ Replay(events, replay_gaps, replayer) };
+        if (!best.has_value() || result.TotalNanoseconds < best->TotalNanoseconds)
+        {
+            best = std::move(result);
+        }
+    }
+    return std::move(best).value();
+}
+
+struct SearchResult
+{
+    std::size_t Found{ 0 };
+    std::uint64_t TotalNanoseconds{ 0 };
+    AllocationCount Allocated{};
+};
+
+// Searches each path linearly in distinct_pathes, like the mergers looked up registered files before they used NormalizedPath
+template<class PathT, class IsSameFunT>
+SearchResult SearchEachPath(std::span<const PathT> pathes, std::span<const PathT> distinct_pathes, IsSameFunT&& is_same)
+{
+    SearchResult result;
+
+    const AllocationCount allocations_before{ GetAllocationCount() };
+    const auto search_start = std::chrono::steady_clock::now();
+    for (const PathT& path : pathes)
+    {
+        if (std::any_of(distinct_pathes.begin(), distinct_pathes.end(), [&](const PathT& distinct_path)
+                        { return is_same(path, distinct_path); }))
+        {
+            result.Found++;
+        }
+    }
+    result.TotalNanoseconds = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - search_start).count());
+    result.Allocated = GetAllocationCount() - allocations_before;
+
+    return result;
+}
+
+void PrintSearchResult(std::string_view name, const SearchResult& result)
+{
+    fmt::print("  {:<16} {:>9} found in {:>10.3f}ms {:>12} allocations {:>14} bytes\n",
+               name,
+               result.Found,
+               static_cast<double>(result.TotalNanoseconds) / 1e6,
+               result.Allocated.Allocations,
+               result.Allocated.Bytes);
+}
+
+struct LoadResult
+{
+    std::uint64_t LoadedFiles{ 0 };
+    std::uint64_t LoadedBytes{ 0 };
+    std::uint64_t TotalNanoseconds{ 0 };
+};
+
+// What folder mounts did before reading files with a single ReadFile or copying them from a mapping
+VirtualFilesystem::FileInfo* LoadFileWithStdio(const std::filesystem::path& file_path)
+{
+#ifdef _WIN32
+    FILE* file{ nullptr };
+    if (_wfopen_s(&file, file_path.c_str(), L"rb") != 0)
+    {
+        file = nullptr;
+    }
+#else
+    FILE* file{ std::fopen(file_path.c_str(), "rb") };
+#endif
+    if (file == nullptr)
+    {
+        return nullptr;
+    }
+    auto close_file = OnScopeExit{ [file]()
+                                   { std::fclose(file); } };
+
+    std::fseek(file, 0, SEEK_END);
+    const long file_size{ std::ftell(file) };
+    std::fseek(file, 0, SEEK_SET);
+    if (file_size < 0)
+    {
+        return nullptr;
+    }
+
+    VirtualFilesystem::FileInfo* file_info{ VirtualFilesystem::AllocateFileInfo(nullptr, static_cast<std::size_t>(file_size)) };
+    if (file_info != nullptr && std::fread(file_info->Data, 1, static_cast<std::size_t>(file_size), file) != static_cast<std::size_t>(file_size))
+    {
+        free(file_info);
+        return nullptr;
+    }
+    return file_info;
+}
+
+// Reads every generated file once per iteration and reports the fastest iteration
+// The mounts read files of at least 1 MiB from a mapping, so pass a --file-size that large to measure that path
+template<class LoadFunT>
+LoadResult LoadBest(std::span<const GeneratedFile> files, std::size_t iterations, LoadFunT&& load_file)
+{
+    std::optional<LoadResult> best;
+    for (std::size_t i = 0; i < iterations; i++)
+    {
+        LoadResult result;
+        const auto load_start = std::chrono::steady_clock::now();
+        for (const GeneratedFile& file : files)
+        {
+            if (VirtualFilesystem::FileInfo* file_info = load_file(file))
+            {
+                result.LoadedFiles++;
+                result.LoadedBytes += static_cast<std::uint64_t>(file_info->DataSize);
+                free(file_info);
+            }
+        }
+        result.TotalNanoseconds = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - load_start).count());
+
+        if (!best.has_value() || result.TotalNanoseconds < best->TotalNanoseconds)
+        {
+            best = result;
+        }
+    }
+    return best.value();
+}
+
+void PrintLoadResult(std::string_view name, const LoadResult& result)
+{
+    const double seconds{ static_cast<double>(result.TotalNanoseconds) / 1e9 };
+    fmt::print("  {:<10} {:>9} files {:>12} bytes in {:>9.3f}ms  {:>9.1f} MiB/s  {:>9.2f}us per file\n",
+               name,
+               result.LoadedFiles,
+               result.LoadedBytes,
+               seconds * 1000.0,
+               seconds > 0.0 ? static_cast<double>(result.LoadedBytes) / (1024.0 * 1024.0) / seconds : 0.0,
+               result.LoadedFiles > 0 ? seconds * 1e6 / static_cast<double>(result.LoadedFiles) : 0.0);
+}
+
+// Loose files spread over folders of a hundred files each, like a mod that replaces lots of sprites and sounds
+// Files are empty, ModDatabase only looks at their stamps unless it is asked to hash them
+bool GenerateScanMod(const std::filesystem::path& mod_folder, std::size_t num_files)
+{
+    namespace fs = std::filesystem;
+
+    std::error_code error_code;
+    fs::remove_all(mod_folder, error_code);
+    if (error_code)
+    {
+        return false;
+    }
+
+    static constexpr std::size_t c_FilesPerFolder{ 100 };
+    for (std::size_t i = 0; i < num_files; i++)
+    {
+        const fs::path folder{ mod_folder / "Data" / "Textures" / fmt::format("Folder{:04}", i / c_FilesPerFolder) };
+        if (i % c_FilesPerFolder == 0)
+        {
+            fs::create_directories(folder, error_code);
+        }
+        if (!std::ofstream{ folder / fmt::format("File{:06}.png", i), std::ios::binary })
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct ScanResult
+{
+    std::uint64_t WalkNanoseconds{ 0 };
+    std::uint64_t NewNanoseconds{ 0 };
+    std::uint64_t KnownNanoseconds{ 0 };
+};
+
+// Times UpdateDatabase separately from walking the folder, once with every file new and once with every file read back from the database
+ScanResult ScanBest(const std::filesystem::path& mod_folder, const std::filesystem::path& database_folder, std::size_t iterations)
+{
+    namespace fs = std::filesystem;
+
+    const auto elapsed_nanoseconds = [](auto start)
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    };
+
+    static constexpr ModDatabaseFlags c_Flags{ static_cast<ModDatabaseFlags>(ModDatabaseFlags_Files | ModDatabaseFlags_Folders | ModDatabaseFlags_Recurse) };
+
+    std::optional<ScanResult> best;
+    for (std::size_t i = 0; i < iterations; i++)
+    {
+        std::error_code error_code;
+        fs::remove_all(database_folder, error_code);
+
+        ScanResult result;
+
+        const auto walk_start = std::chrono::steady_clock::now();
+        const std::vector<ModDatabase::ScannedEntries> scanned_entries = ModDatabase::ScanModFolders(std::span{ &mod_folder, 1 }, c_Flags);
+        result.WalkNanoseconds = elapsed_nanoseconds(walk_start);
+
+        {
+            ModDatabase mod_db{ database_folder, mod_folder, c_Flags };
+            const auto new_start = std::chrono::steady_clock::now();
+            mod_db.UpdateDatabase(scanned_entries.front());
+            result.NewNanoseconds = elapsed_nanoseconds(new_start);
+            mod_db.WriteDatabase();
+        }
+
+        {
+            ModDatabase mod_db{ database_folder, mod_folder, c_Flags };
+            const auto known_start = std::chrono::steady_clock::now();
+            mod_db.UpdateDatabase(scanned_entries.front());
+            result.KnownNanoseconds = elapsed_nanoseconds(known_start);
+        }
+
+        if (!best.has_value() || result.NewNanoseconds + result.KnownNanoseconds < best->NewNanoseconds + best->KnownNanoseconds)
+        {
+            best = result;
+        }
+    }
+    return best.value_or(ScanResult{});
+}
+
+void PrintScanResult(std::size_t num_files, const ScanResult& result)
+{
+    const auto per_file = [num_files](std::uint64_t nanoseconds)
+    {
+        return static_cast<double>(nanoseconds) / static_cast<double>(num_files);
+    };
+    fmt::print("  {:>9} files  walk {:>10.3f}ms  new {:>10.3f}ms {:>8.0f}ns per file  known {:>10.3f}ms {:>8.0f}ns per file\n",
+               num_files,
+               static_cast<double>(result.WalkNanoseconds) / 1e6,
+               static_cast<double>(result.NewNanoseconds) / 1e6,
+               per_file(result.NewNanoseconds),
+               static_cast<double>(result.KnownNanoseconds) / 1e6,
+               per_file(result.KnownNanoseconds));
+}
+
+void PrintLatencies(std::string_view name, Call call, std::vector<std::uint64_t> latencies)
+{
+    if (latencies.empty())
+    {
+        return;
+    }
+
+    std::ranges::sort(latencies);
+    std::uint64_t total{ 0 };
+    for (std::uint64_t latency : latencies)
+    {
+        total += latency;
+    }
+    const auto percentile = [&latencies](std::size_t percent)
+    {
+        return static_cast<double>(latencies[(latencies.size() - 1) * percent / 100]) / 1000.0;
+    };
+    fmt::print("  {:<10} {:<14} {:>9} calls  mean {:>9.2f}us  p50 {:>9.2f}us  p99 {:>9.2f}us  max {:>10.2f}us\n",
+               name,
+               c_CallNames[static_cast<std::size_t>(call)],
+               latencies.size(),
+               static_cast<double>(total) / static_cast<double>(latencies.size()) / 1000.0,
+               percentile(50),
+               percentile(99),
+               static_cast<double>(latencies.back()) / 1000.0);
+}
+
+int main(int argc, char** argv)
+{
+    namespace fs = std::filesystem;
+
+    const std::optional<CommandLineOptions> options = ParseCommandLine(std::span{ argv, static_cast<std::size_t>(argc) });
+    if (!options.has_value())
+    {
+        fmt::print(stderr, "{}\n", c_Usage);
+        return FAILED_PARSING_COMMAND_LINE;
+    }
+    const std::size_t num_mods{ std::max<std::size_t>(options->NumMods, 1) };
+    const std::size_t iterations{ std::max<std::size_t>(options->Iterations, 1) };
+
+    const std::optional<std::vector<TraceEvent>> events = ReadTrace(options->Trace);
+    if (!events.has_value())
+    {
+        fmt::print(stderr, "Could not read trace '{}'\n", options->Trace);
+        return FAILED_READING_TRACE;
+    }
+
+    const fs::path work_dir{ options->WorkDir.has_value() ? fs::path{ options->WorkDir.value() } : fs::temp_directory_path() / "vfs_replay_bench" };
+    const fs::path mods_folder{ work_dir / "Mods" / "Packs" };
+    const std::optional<std::vector<GeneratedFile>> generated_files = GenerateModsTree(mods_folder, events.value(), num_mods, options->FileSize);
+    if (!generated_files.has_value())
+    {
+        fmt::print(stderr, "Could not generate mods in '{}'\n", mods_folder.string());
+        return FAILED_GENERATING_MODS;
+    }
+
+    std::vector<fs::path> mod_folders;
+    for (std::size_t i = 0; i < num_mods; i++)
+    {
+        mod_folders.push_back(GetModFolder(mods_folder, i));
+    }
+
+    fmt::print("Replaying {} calls against {} mods in '{}', {} iterations{}\n", events->size(), num_mods, mods_folder.string(), iterations, options->ReplayGaps ? ", waiting out recorded gaps between calls" : "");
+
+    ReplayResult recorded;
+    for (const TraceEvent& event : events.value())
+    {
+        recorded.LatencyNanoseconds[static_cast<std::size_t>(event.TracedCall)].push_back(event.LatencyNanoseconds);
+        recorded.TotalNanoseconds += event.LatencyNanoseconds;
+    }
+
+    // Mounted in the same order VirtualFilesystem keeps them, the first mod wins
+    const AllocationCount mount_allocations_before{ GetAllocationCount() };
+    const auto mount_start = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<VfsMount>> mounts;
+    for (std::size_t i = 0; i < num_mods; i++)
+    {
+        mounts.push_back(std::unique_ptr<VfsMount>{ new VfsMount{
+            .Priority = static_cast<std::int64_t>(i),
+            .Name = mod_folders[i].string(),
+            .LinkedMounts{},
+            .MountImpl = std::make_unique<VfsFolderMount>(mod_folders[i], VfsType::User, std::nullopt),
+        } });
+    }
+    const auto mount_duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mount_start);
+    const AllocationCount mount_allocations{ GetAllocationCount() - mount_allocations_before };
+    fmt::print("Mounted and indexed mods in {}us, {} allocations of {} bytes in total\n", mount_duration.count(), mount_allocations.Allocations, mount_allocations.Bytes);
+
+    const std::span<const std::unique_ptr<VfsMount>> mounts_view{ mounts };
+    const std::span<const fs::path> mod_folders_view{ mod_folders };
+    const std::span<const TraceEvent> events_view{ events.value() };
+    const bool replay_gaps{ options->ReplayGaps };
+    const ReplayResult mounted = ReplayBest<MountsReplayer>(events_view, iterations, replay_gaps, mounts_view);
+    const ReplayResult on_disk = ReplayBest<DiskReplayer>(events_view, iterations, replay_gaps, mod_folders_view);
+    const ReplayResult prefetched = ReplayBest<PrefetchingReplayer>(events_view, iterations, replay_gaps, mounts_view, events_view, options->PrefetchThreads, options->PrefetchWindow, false);
+    const ReplayResult predicted = ReplayBest<PrefetchingReplayer>(events_view, iterations, replay_gaps, mounts_view, events_view, options->PrefetchThreads, options->PrefetchWindow, true);
+
+    const std::pair<std::string_view, const ReplayResult&> results[]{
+        { "recorded", recorded },
+        { "mounts", mounted },
+        { "disk", on_disk },
+        { "prefetch", prefetched },
+        { "predicted", predicted },
+    };
+    for (const auto& [name, result] : results)
+    {
+        fmt::print("{}: {:.3f}ms total, {} mismatched calls", name, static_cast<double>(result.TotalNanoseconds) / 1000000.0, result.Mismatches);
+        if (result.Allocated.has_value() && !events->empty())
+        {
+            const double num_calls{ static_cast<double>(events->size()) };
+            fmt::print(", {:.2f} allocations of {:.0f} bytes per call", static_cast<double>(result.Allocated->Allocations) / num_calls, static_cast<double>(result.Allocated->Bytes) / num_calls);
+        }
+        fmt::print("\n");
+        for (Call call : { Call::LoadFile, Call::GetFilePath })
+        {
+            PrintLatencies(name, call, result.LatencyNanoseconds[static_cast<std::size_t>(call)]);
+        }
+    }
+
+    {
+        std::vector<std::string_view> traced_views;
+        std::vector<std::string_view> distinct_traced_views;
+        std::unordered_set<std::string_view> seen_pathes;
+        for (const TraceEvent& event : events.value())
+        {
+            traced_views.push_back(event.Path);
+            if (seen_pathes.insert(event.Path).second)
+            {
+                distinct_traced_views.push_back(event.Path);
+            }
+        }
+
+        // The old code compared std::filesystem::path objects it already had, building them is not part of the comparison
+        const std::vector<fs::path> traced_pathes{ traced_views.begin(), traced_views.end() };
+        const std::vector<fs::path> distinct_traced_pathes{ distinct_traced_views.begin(), distinct_traced_views.end() };
+
+        // Interning only allocates for pathes the pool has not seen yet, most traced pathes were interned by the mounts already
+        const AllocationCount intern_allocations_before{ GetAllocationCount() };
+        std::vector<NormalizedPath> traced_normalized;
+        std::vector<NormalizedPath> distinct_traced_normalized;
+        traced_normalized.reserve(traced_pathes.size());
+        distinct_traced_normalized.reserve(distinct_traced_pathes.size());
+        for (const fs::path& traced_path : traced_pathes)
+        {
+            traced_normalized.emplace_back(traced_path);
+        }
+        for (const fs::path& distinct_path : distinct_traced_pathes)
+        {
+            distinct_traced_normalized.emplace_back(distinct_path);
+        }
+        const AllocationCount intern_allocations{ GetAllocationCount() - intern_allocations_before };
+
+        fmt::print("search: each of {} traced pathes among {} distinct ones, one pass\n", traced_pathes.size(), distinct_traced_pathes.size());
+        PrintSearchResult("is_same_path", SearchEachPath<fs::path>(traced_pathes, distinct_traced_pathes, [](const fs::path& lhs, const fs::path& rhs)
+                                                                  { return algo::is_same_path(lhs, rhs); }));
+        PrintSearchResult("IsSame", SearchEachPath<std::string_view>(traced_views, distinct_traced_views, [](std::string_view lhs, std::string_view rhs)
+                                                                     { return NormalizedPath::IsSame(lhs, rhs); }));
+        PrintSearchResult("NormalizedPath", SearchEachPath<NormalizedPath>(traced_normalized, distinct_traced_normalized, std::equal_to<NormalizedPath>{}));
+        fmt::print("  interning all pathes took {} allocations of {} bytes\n", intern_allocations.Allocations, intern_allocations.Bytes);
+    }
+
+    // Reads each file straight from the mount holding it, the counters of the mounts tell how long the reads themselves took
+    std::vector<VfsFolderMount::LoadStatistics> statistics_before;
+    for (const auto& mount : mounts)
+    {
+        statistics_before.push_back(static_cast<const VfsFolderMount&>(*mount->MountImpl).GetLoadStatistics());
+    }
+    const LoadResult mount_loads = LoadBest(generated_files.value(), iterations, [&mounts](const GeneratedFile& file)
+                                            { return mounts[file.ModIndex]->MountImpl->LoadFile(NormalizedPathView{ file.RelativePath }, nullptr); });
+    const LoadResult stdio_loads = LoadBest(generated_files.value(), iterations, [&mod_folders](const GeneratedFile& file)
+                                            { return LoadFileWithStdio(mod_folders[file.ModIndex] / file.RelativePath); });
+
+    fmt::print("load: {} files of {} bytes, fastest of {} iterations\n", generated_files->size(), options->FileSize, iterations);
+    PrintLoadResult("mounts", mount_loads);
+    PrintLoadResult("stdio", stdio_loads);
+    for (std::size_t i = 0; i < mounts.size(); i++)
+    {
+        const VfsFolderMount::LoadStatistics statistics{ static_cast<const VfsFolderMount&>(*mounts[i]->MountImpl).GetLoadStatistics() };
+        const std::uint64_t loaded_files{ statistics.LoadedFiles - statistics_before[i].LoadedFiles };
+        if (loaded_files > 0)
+        {
+            const std::uint64_t loaded_bytes{ statistics.LoadedBytes - statistics_before[i].LoadedBytes };
+            const double load_milliseconds{ static_cast<double>(statistics.LoadNanoseconds - statistics_before[i].LoadNanoseconds) / 1e6 };
+            fmt::print("  {:<10} {:>9} files {:>12} bytes in {:>9.3f}ms over all iterations\n", mod_folders[i].filename().string(), loaded_files, loaded_bytes, load_milliseconds);
+        }
+    }
+
+    if (options->ScanFiles > 0)
+    {
+        fmt::print("scan: ModDatabase::UpdateDatabase on a synthetic mod, fastest of {} iterations\n", iterations);
+        for (std::size_t num_files : { options->ScanFiles / 4, options->ScanFiles / 2, options->ScanFiles })
+        {
+            if (num_files == 0)
+            {
+                continue;
+            }
+
+            const fs::path scan_mod_folder{ work_dir / "ScanMods" / fmt::format("Scan{}", num_files) };
+            if (!GenerateScanMod(scan_mod_folder, num_files))
+            {
+                fmt::print(stderr, "Could not generate mod in '{}'\n", scan_mod_folder.string());
+                return FAILED_GENERATING_SCAN_MOD;
+            }
+            PrintScanResult(num_files, ScanBest(scan_mod_folder, work_dir / "ScanMods" / ".db" / scan_mod_folder.filename(), iterations));
+        }
+    }
+
+    return SUCCESS;
+}
@@ -0,0 +1,35 @@
+#include "find_path.h"
+
+#include "util/normalized_path.h"
+
+std::optional<std::filesystem::path> FindPathIgnoringCase(const std::filesystem::path& path)
+{
+    namespace fs = std::filesystem;
+
+    std::error_code error_code;
+    if (fs::exists(path, error_code))
+    {
+        return path;
+    }
+    if (!path.has_filename())
+    {
+        return std::nullopt;
+    }
+
+    const std::optional<fs::path> parent_path{ path.has_parent_path() ? FindPathIgnoringCase(path.parent_path()) : fs::path{} };
+    if (!parent_path.has_value())
+    {
+        return std::nullopt;
+    }
+
+    const std::string file_name{ path.filename().string() };
+    const fs::path search_path{ parent_path->empty() ? fs::path{ "." } : parent_path.value() };
+    for (fs::directory_iterator it{ search_path, error_code }, end{}; !error_code && it != end; it.increment(error_code))
+    {
+        if (NormalizedPath::IsSame(it->path().filename().string(), file_name))
+        {
+            return parent_path.value() / it->path().filename();
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+
+// Finds a file or folder the way Windows does, each element of the path that does not exist is looked up case-insensitively in its parent
+// On case-insensitive filesystems the path is returned as is if it exists
+std::optional<std::filesystem::path> FindPathIgnoringCase(const std::filesystem::path& path);
@@ -0,0 +1,9 @@
+#include "log.h"
+
+#include <cstdio>
+
+void Log(std::string message, LogLevel log_level)
+{
+    std::FILE* stream{ log_level == LogLevel::Error || log_level == LogLevel::Fatal ? stderr : stdout };
+    fmt::print(stream, "{}\n", message);
+}
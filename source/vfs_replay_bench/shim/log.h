@@ -0,0 +1,29 @@
+#pragma once
+
+#include <fmt/format.h>
+
+#include <string>
+#include <utility>
+
+// Same interface as playlunky's log, messages go straight to the console instead of the game
+enum class LogLevel
+{
+    Info = 0,
+    InfoScreen = 3,
+    Fatal = 1,
+    Error = 2
+};
+void Log(std::string message, LogLevel log_level);
+
+template<class... Args>
+void LogInfo(const char* format, Args&&... args)
+{
+    std::string message = fmt::format(fmt::runtime(format), std::forward<Args>(args)...);
+    Log(std::move(message), LogLevel::Info);
+}
+template<class... Args>
+void LogError(const char* format, Args&&... args)
+{
+    std::string message = fmt::format(fmt::runtime(format), std::forward<Args>(args)...);
+    Log(std::move(message), LogLevel::Error);
+}
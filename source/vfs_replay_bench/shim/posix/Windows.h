@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Just enough of the Win32 file api for the vfs mounts to run on other platforms
+// Like on Windows pathes are matched case-insensitively, files that only exist in a different case are found as well
+
+using BOOL = int;
+using DWORD = std::uint32_t;
+using HANDLE = void*;
+using LPCWSTR = const std::filesystem::path::value_type*;
+
+struct LARGE_INTEGER
+{
+    std::int64_t QuadPart;
+};
+
+inline const HANDLE INVALID_HANDLE_VALUE{ reinterpret_cast<HANDLE>(static_cast<std::intptr_t>(-1)) };
+
+inline constexpr DWORD GENERIC_READ{ 0x80000000 };
+inline constexpr DWORD FILE_SHARE_READ{ 0x00000001 };
+inline constexpr DWORD OPEN_EXISTING{ 3 };
+inline constexpr DWORD FILE_ATTRIBUTE_NORMAL{ 0x00000080 };
+inline constexpr DWORD FILE_FLAG_SEQUENTIAL_SCAN{ 0x08000000 };
+inline constexpr DWORD PAGE_READONLY{ 0x02 };
+inline constexpr DWORD FILE_MAP_READ{ 0x0004 };
+
+// Only opening existing files for reading is supported
+HANDLE CreateFileW(LPCWSTR file_name, DWORD desired_access, DWORD share_mode, void* security_attributes, DWORD creation_disposition, DWORD flags_and_attributes, HANDLE template_file);
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* file_size);
+BOOL ReadFile(HANDLE file, void* buffer, DWORD number_of_bytes_to_read, DWORD* number_of_bytes_read, void* overlapped);
+
+// Only read-only mappings of whole files are supported
+HANDLE CreateFileMappingW(HANDLE file, void* file_mapping_attributes, DWORD protect, DWORD maximum_size_high, DWORD maximum_size_low, LPCWSTR name);
+void* MapViewOfFile(HANDLE file_mapping, DWORD desired_access, DWORD file_offset_high, DWORD file_offset_low, std::size_t number_of_bytes_to_map);
+BOOL UnmapViewOfFile(const void* base_address);
+
+BOOL CloseHandle(HANDLE object);
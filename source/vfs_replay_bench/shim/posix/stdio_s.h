@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+
+// Force-included into sources that use the bounds-checked stdio functions of the Microsoft CRT
+inline int fopen_s(FILE** file, const char* file_name, const char* mode)
+{
+    *file = std::fopen(file_name, mode);
+    return *file != nullptr ? 0 : errno;
+}
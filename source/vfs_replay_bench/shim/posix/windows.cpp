@@ -0,0 +1,149 @@
+#include "Windows.h"
+
+#include "find_path.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <mutex>
+#include <optional>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+// Files and mappings share one handle type, so CloseHandle knows what it closes
+struct ShimHandle
+{
+    int FileDescriptor;
+    bool IsMapping;
+    std::size_t MappingSize;
+};
+
+// munmap needs the size of the view, UnmapViewOfFile only gets its address
+static std::mutex s_ViewsMutex;
+static std::unordered_map<const void*, std::size_t> s_ViewSizes;
+
+static ShimHandle* ToShimHandle(HANDLE handle)
+{
+    return handle == nullptr || handle == INVALID_HANDLE_VALUE ? nullptr : static_cast<ShimHandle*>(handle);
+}
+
+HANDLE CreateFileW(LPCWSTR file_name, DWORD /*desired_access*/, DWORD /*share_mode*/, void* /*security_attributes*/, DWORD creation_disposition, DWORD /*flags_and_attributes*/, HANDLE /*template_file*/)
+{
+    if (creation_disposition != OPEN_EXISTING)
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    int file_descriptor{ open(file_name, O_RDONLY | O_CLOEXEC) };
+    if (file_descriptor < 0 && errno == ENOENT)
+    {
+        if (const std::optional<std::filesystem::path> found_path = FindPathIgnoringCase(file_name))
+        {
+            file_descriptor = open(found_path->c_str(), O_RDONLY | O_CLOEXEC);
+        }
+    }
+    if (file_descriptor < 0)
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    struct stat file_status{};
+    if (fstat(file_descriptor, &file_status) != 0 || !S_ISREG(file_status.st_mode))
+    {
+        close(file_descriptor);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    return new ShimHandle{ .FileDescriptor = file_descriptor, .IsMapping = false, .MappingSize = 0 };
+}
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER* file_size)
+{
+    ShimHandle* shim_handle{ ToShimHandle(file) };
+    struct stat file_status{};
+    if (shim_handle == nullptr || fstat(shim_handle->FileDescriptor, &file_status) != 0)
+    {
+        return 0;
+    }
+    file_size->QuadPart = static_cast<std::int64_t>(file_status.st_size);
+    return 1;
+}
+BOOL ReadFile(HANDLE file, void* buffer, DWORD number_of_bytes_to_read, DWORD* number_of_bytes_read, void* /*overlapped*/)
+{
+    ShimHandle* shim_handle{ ToShimHandle(file) };
+    if (shim_handle == nullptr)
+    {
+        return 0;
+    }
+
+    const ssize_t size_read{ read(shim_handle->FileDescriptor, buffer, number_of_bytes_to_read) };
+    if (size_read < 0)
+    {
+        return 0;
+    }
+    *number_of_bytes_read = static_cast<DWORD>(size_read);
+    return 1;
+}
+
+HANDLE CreateFileMappingW(HANDLE file, void* /*file_mapping_attributes*/, DWORD protect, DWORD /*maximum_size_high*/, DWORD /*maximum_size_low*/, LPCWSTR /*name*/)
+{
+    LARGE_INTEGER file_size{};
+    if (protect != PAGE_READONLY || !GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        return nullptr;
+    }
+
+    // Windows keeps the file alive for as long as the mapping is open, regardless of the file handle
+    const int file_descriptor{ dup(ToShimHandle(file)->FileDescriptor) };
+    if (file_descriptor < 0)
+    {
+        return nullptr;
+    }
+    return new ShimHandle{ .FileDescriptor = file_descriptor, .IsMapping = true, .MappingSize = static_cast<std::size_t>(file_size.QuadPart) };
+}
+void* MapViewOfFile(HANDLE file_mapping, DWORD desired_access, DWORD file_offset_high, DWORD file_offset_low, std::size_t number_of_bytes_to_map)
+{
+    ShimHandle* shim_handle{ ToShimHandle(file_mapping) };
+    if (shim_handle == nullptr || !shim_handle->IsMapping || desired_access != FILE_MAP_READ || file_offset_high != 0 || file_offset_low != 0)
+    {
+        return nullptr;
+    }
+
+    const std::size_t view_size{ number_of_bytes_to_map == 0 ? shim_handle->MappingSize : number_of_bytes_to_map };
+    void* view{ mmap(nullptr, view_size, PROT_READ, MAP_PRIVATE, shim_handle->FileDescriptor, 0) };
+    if (view == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    std::lock_guard lock{ s_ViewsMutex };
+    s_ViewSizes.emplace(view, view_size);
+    return view;
+}
+BOOL UnmapViewOfFile(const void* base_address)
+{
+    std::size_t view_size{ 0 };
+    {
+        std::lock_guard lock{ s_ViewsMutex };
+        auto it = s_ViewSizes.find(base_address);
+        if (it == s_ViewSizes.end())
+        {
+            return 0;
+        }
+        view_size = it->second;
+        s_ViewSizes.erase(it);
+    }
+    return munmap(const_cast<void*>(base_address), view_size) == 0;
+}
+
+BOOL CloseHandle(HANDLE object)
+{
+    ShimHandle* shim_handle{ ToShimHandle(object) };
+    if (shim_handle == nullptr)
+    {
+        return 0;
+    }
+    const bool closed{ close(shim_handle->FileDescriptor) == 0 };
+    delete shim_handle;
+    return closed;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+// Same layout as the game's file info, the benchmark only ever hands it back to free
+struct SpelunkyFileInfo
+{
+    void* Data{ nullptr };
+    int _member_1{ 0 };
+    int DataSize{ 0 };
+    int AllocationSize{ 0 };
+    int _member_4{ 0 };
+};
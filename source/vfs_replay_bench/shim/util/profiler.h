@@ -0,0 +1,16 @@
+#pragma once
+
+// Same interface as playlunky's profiler, zones are not recorded since the bench times everything itself
+class ProfileZone
+{
+  public:
+    explicit ProfileZone(const char*)
+    {
+    }
+    ~ProfileZone() = default;
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone(ProfileZone&&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+    ProfileZone& operator=(ProfileZone&&) = delete;
+};